@@ -242,6 +242,31 @@
 #define LWS_SERVER_OPTION_DISABLE_TLS_SESSION_CACHE		 (1ll << 39)
 	/**< (VHOST) Disallow use of client tls caching (on by default) */
 
+#define LWS_SERVER_OPTION_EPOLL					 (1ll << 40)
+	/**< (CTX) Use native Linux epoll event loop */
+
+#define LWS_SERVER_OPTION_IO_URING				 (1ll << 41)
+	/**< (CTX) Use native Linux io_uring event loop */
+
+#define LWS_SERVER_OPTION_TLS_KTLS				 (1ll << 42)
+	/**< (VHOST) With OpenSSL 3+ on Linux, after the tls handshake hand the
+	 * record layer to the kernel (kTLS) if it supports the negotiated
+	 * cipher, so static files can be served with sendfile() on tls
+	 * connections.  If it can't, tls stays in userspace as usual. */
+
+#define LWS_SERVER_OPTION_H2_PRIORITIES				 (1ll << 43)
+	/**< (VHOST) On h2 connections, choose which stream gets to write next
+	 * using RFC9218 extensible priorities (the priority: header and
+	 * PRIORITY_UPDATE frames) rather than plain round-robin.  More urgent
+	 * streams go first, and at the same urgency, non-incremental streams
+	 * are served one after the other in stream order before incremental
+	 * ones, which share the connection round-robin. */
+
+#define LWS_SERVER_OPTION_H2_HPACK_LITERAL_ONLY			 (1ll << 44)
+	/**< (VHOST) On h2 connections, send header blocks as plain literals
+	 * the way lws used to, instead of compressing them using the hpack
+	 * static and dynamic tables and huffman coding. */
+
 
 	/****** add new things just above ---^ ******/
 
@@ -256,6 +281,11 @@ struct lws_sss_ops;
 
 typedef int (*lws_context_ready_cb_t)(struct lws_context *context);
 
+enum lws_access_log_format {
+	LWS_ACCESS_LOG_FMT_COMBINED,	/**< Apache-compatible combined format */
+	LWS_ACCESS_LOG_FMT_JSON,	/**< one JSON object per line */
+};
+
 #if defined(LWS_WITH_NETWORK)
 typedef int (*lws_peer_limits_notify_t)(struct lws_context *ctx,
 					lws_sockfd_type sockfd,
@@ -924,6 +954,76 @@ struct lws_context_creation_info {
 	 * handle */
 #endif
 
+#if defined(LWS_WITH_SYS_ASYNC_DNS)
+	unsigned int				async_dns_cache_max_items;
+	/**< CONTEXT: 0 for the default of 10, else the number of resolved
+	 * names the async dns cache may hold before it starts evicting the
+	 * least recently used unreferenced ones */
+#endif
+	unsigned int				conn_freelist_max;
+	/**< CONTEXT: 0 for the default of freeing them, else each service
+	 * thread keeps up to this many freed struct lws, and the same number
+	 * of each kind of per-connection role struct, for reuse by new
+	 * connections on the same thread */
+#if defined(LWS_WITH_CLIENT)
+	unsigned int				client_idle_max_per_origin;
+	/**< VHOST: 0 for the default, where only client connections with
+	 * LCCSCF_PIPELINE share connections.  Otherwise, http client
+	 * connections made on this vhost transparently reuse an idle h1
+	 * connection, or join a live h2 connection, to the same host, port,
+	 * tls and compatible alpn, and up to this many h1 connections per
+	 * origin are kept idle after their transaction completes */
+	unsigned int				client_idle_timeout_secs;
+	/**< VHOST: 0 for the defaults, which are the client connect info
+	 * keep_warm_secs for h1 and keepalive_timeout for h2.  Else the
+	 * number of seconds an idle client connection on this vhost is kept
+	 * for reuse before it is closed */
+#endif
+#if defined(LWS_WITH_ACCESS_LOG)
+	uint8_t					access_log_format;
+	/**< VHOST: LWS_ACCESS_LOG_FMT_COMBINED (0, default) for
+	 * Apache-compatible combined log lines in log_filepath, or
+	 * LWS_ACCESS_LOG_FMT_JSON for one JSON object per line */
+	unsigned int				access_log_queue_size;
+	/**< CONTEXT: 0 for the default of writing each access log record
+	 * from the service thread as the transaction completes.  Else, if
+	 * built with LWS_WITH_ACCESS_LOG_ASYNC, the bytes of records each
+	 * service thread can queue, which a background thread writes to the
+	 * log files in batches.  Records that would overflow the queue are
+	 * dropped and counted, see lws_access_log_dropped() */
+#endif
+#if defined(LWS_WITH_TLS_HANDSHAKE_OFFLOAD)
+	unsigned int				tls_handshake_threads;
+	/**< CONTEXT: 0 for the default of performing server tls handshakes
+	 * on the service thread.  Else the number of threads in a pool the
+	 * handshake steps are passed to, so a burst of new tls connections
+	 * doesn't stall service of the established ones */
+	unsigned int				tls_handshake_queue_max;
+	/**< CONTEXT: 0 for the default of 64 per handshake thread.  Else the
+	 * max number of handshake steps waiting for a free thread, beyond that
+	 * they are performed on the service thread as usual */
+#endif
+#if defined(LWS_WITH_TLS_SESSIONS)
+	const char				*tls_session_cache_filepath;
+	/**< VHOST: NULL, or a file the vhost's client tls session cache is
+	 * restored from when lws creates the vhost's client tls context, and
+	 * saved to when the vhost is destroyed, so session resumption survives
+	 * restarts.  Nothing is restored for a vhost using
+	 * .provided_client_ssl_ctx, or without
+	 * LWS_SERVER_OPTION_DO_SSL_GLOBAL_INIT.  See
+	 * lws_tls_session_cache_save() */
+#endif
+#if defined(LWS_ROLE_H2)
+	unsigned int				h2_tx_coalesce_size;
+	/**< CONTEXT: 0 for the default of writing each h2 frame on the
+	 * connection as the stream produces it.  Else the size of a buffer per
+	 * service thread where frames from all the streams serviced in one
+	 * POLLOUT on an h2 connection are gathered, so they go out in one
+	 * write instead of one each.  It's capped at the connection's tx
+	 * packet size, ie, the protocol tx_packet_size, rx_buffer_size or
+	 * pt_serv_buf_size */
+#endif
+
 	/* Add new things just above here ---^
 	 * This is part of the ABI, don't needlessly break compatibility
 	 *
@@ -1226,6 +1326,22 @@ lws_vhost_user(struct lws_vhost *vhost);
 LWS_VISIBLE LWS_EXTERN void *
 lws_context_user(struct lws_context *context);
 
+#if defined(LWS_WITH_ACCESS_LOG)
+/**
+ * lws_access_log_dropped() - count of access log records that were dropped
+ * \param context: Websocket context
+ *
+ * With LWS_WITH_ACCESS_LOG_ASYNC and a nonzero access_log_queue_size, access
+ * log records are queued and written by a background thread.  If a service
+ * thread's queue is full, because the log files can't be written as fast as
+ * the records are coming, new records are dropped rather than blocking the
+ * service thread.  This returns how many have been dropped for the whole
+ * context, it's always 0 if the records are written directly.
+ */
+LWS_VISIBLE LWS_EXTERN uint64_t
+lws_access_log_dropped(struct lws_context *context);
+#endif
+
 LWS_VISIBLE LWS_EXTERN const char *
 lws_vh_tag(struct lws_vhost *vh);
 
@@ -1352,5 +1468,24 @@ struct lws_http_mount {
 	 */
 };
 
+#if defined(LWS_WITH_SERVER)
+/**
+ * lws_vhost_find_mount() - find the mount that serves a url path on a vhost
+ *
+ * \param vh: the vhost
+ * \param uri: the url path, eg, "/a/b/c.html"
+ * \param uri_len: the length of uri
+ *
+ * Returns the mount on vh that a GET for uri would be served by, that is the
+ * one with the longest mountpoint matching the start of uri and ending at the
+ * end of uri or at a '/' in it, or NULL if none.
+ *
+ * Vhosts with many mounts compile them into a tree when they are created, so
+ * this costs about the same however many mounts there are.
+ */
+LWS_VISIBLE LWS_EXTERN const struct lws_http_mount *
+lws_vhost_find_mount(struct lws_vhost *vh, const char *uri, int uri_len);
+#endif
+
 ///@}
 ///@}
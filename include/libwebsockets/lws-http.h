@@ -70,6 +70,10 @@ lws_get_mimetype(const char *file, const struct lws_http_mount *m);
  *	lws_http_transaction_completed() called on the wsi (and close if != 0)
  *	==0 indicates the file transfer is started and needs more service later,
  *	the wsi should be left alone.
+ *
+ *	On Linux, when the file comes from the platform fops and goes out
+ *	unmodified on a non-tls http/1.x connection, the content is sent using
+ *	sendfile() without being copied through userspace.
  */
 LWS_VISIBLE LWS_EXTERN int
 lws_serve_http_file(struct lws *wsi, const char *file, const char *content_type,
@@ -337,6 +341,9 @@ enum lws_token_indexes {
 #endif
 	WSI_TOKEN_X_AUTH_TOKEN,
 	WSI_TOKEN_DSS_SIGNATURE,
+#if defined(LWS_ROLE_H2) || defined(LWS_HTTP_HEADERS_ALL)
+	WSI_TOKEN_HTTP_PRIORITY,	/* RFC9218 */
+#endif
 
 	/****** add new things just above ---^ ******/
 
@@ -78,4 +78,35 @@ LWS_VISIBLE LWS_EXTERN int
 lws_tls_session_dump_load(struct lws_vhost *vh, const char *host, uint16_t port,
 			  lws_tls_sess_cb_t cb_load, void *opq);
 
+/**
+ * lws_tls_session_cache_save() - save a vhost's whole tls session cache
+ *
+ * \param vh: the vhost whose client session cache should be saved
+ * \param filepath: the file to save it in
+ *
+ * Serializes every session in the vhost's client session cache into
+ * \p filepath, replacing it, so they can be restored after a restart with
+ * lws_tls_session_cache_load().  The file contains session secrets, it is
+ * created with mode 0600.
+ *
+ * Returns 0 if the file was written, else nonzero.  Only supported on OpenSSL.
+ */
+LWS_VISIBLE LWS_EXTERN int
+lws_tls_session_cache_save(struct lws_vhost *vh, const char *filepath);
+
+/**
+ * lws_tls_session_cache_load() - restore a vhost's tls session cache
+ *
+ * \param vh: the vhost whose client session cache should be restored
+ * \param filepath: the file created by lws_tls_session_cache_save()
+ *
+ * Adds the sessions from \p filepath that haven't expired since to the vhost's
+ * client session cache, unless it already has a session for the same host.
+ *
+ * Returns the number of sessions restored, or -1 if the file couldn't be read.
+ * Only supported on OpenSSL.
+ */
+LWS_VISIBLE LWS_EXTERN int
+lws_tls_session_cache_load(struct lws_vhost *vh, const char *filepath);
+
 ///@}
@@ -0,0 +1,117 @@
+/*
+ * libwebsockets - small server side websockets and web server implementation
+ *
+ * Copyright (C) 2010 - 2019 Andy Green <andy@warmcat.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+/** \defgroup wsbcast Websocket broadcast
+ * ##Websocket broadcast APIs
+ *
+ * These let you send the same ws message to many connections while only
+ * framing it once.  The message is copied once into a refcounted object that
+ * holds it already framed, and a reference to that is queued on each
+ * connection.  When the connection becomes writeable, lws writes the framed
+ * message straight from the shared object, before calling the user
+ * WRITEABLE callback, without copying it again unless the socket could only
+ * take part of it.
+ *
+ * Connections that can't use the shared frame as it is, clients (who must
+ * mask what they send), ws-over-h2 streams and connections with an active
+ * extension like permessage-deflate, still take the queued message, but it
+ * is sent using a normal lws_write() on a copy, one message per writeable.
+ *
+ * Each connection holds at most max_pending queued messages, if it isn't
+ * keeping up with the rate they are being queued then new messages are not
+ * queued for it, and optionally it can be closed as lagging.
+ *
+ * Like lws_callback_on_writable_all_protocol_vhost(), these must be called
+ * from a service thread context, eg, a protocol callback.
+ */
+///@{
+
+struct lws_ws_bcast;
+
+#define LWSBCF_CLOSE_SLOW		(1 << 0)
+/**< close connections that already have max_pending messages queued */
+
+/**
+ * lws_ws_bcast_create() - create a shared, preframed ws message
+ *
+ * \param payload: the message payload
+ * \param len: the length of the message payload
+ * \param binary: 0 for a TEXT message, 1 for a BINARY one
+ *
+ * Returns a new broadcast object holding a copy of the payload framed as a
+ * single, complete ws message, with one reference held by the caller, or
+ * NULL on OOM.  The caller should queue it to the connections it wants and
+ * then release its reference with lws_ws_bcast_unref().
+ */
+LWS_VISIBLE LWS_EXTERN struct lws_ws_bcast *
+lws_ws_bcast_create(const void *payload, size_t len, int binary);
+
+/**
+ * lws_ws_bcast_unref() - release a reference on a broadcast object
+ *
+ * \param bc: the broadcast object
+ *
+ * The object is destroyed when the last connection it was queued on has
+ * sent it, or dropped it by closing, and the creator has released its
+ * reference.
+ */
+LWS_VISIBLE LWS_EXTERN void
+lws_ws_bcast_unref(struct lws_ws_bcast *bc);
+
+/**
+ * lws_ws_bcast_queue() - queue a broadcast object on one connection
+ *
+ * \param wsi: the established ws connection
+ * \param bc: the broadcast object
+ * \param max_pending: most messages this connection may have queued
+ * \param flags: 0 or LWSBCF_ flags
+ *
+ * Returns 0 if queued, 1 if the connection already had max_pending
+ * messages waiting, so this one was not queued, or -1 if the connection is
+ * not an established ws connection or OOM.
+ */
+LWS_VISIBLE LWS_EXTERN int
+lws_ws_bcast_queue(struct lws *wsi, struct lws_ws_bcast *bc,
+		   unsigned int max_pending, int flags);
+
+/**
+ * lws_ws_bcast_queue_vhost_protocol() - queue on all connections of protocol
+ *
+ * \param vh: the vhost
+ * \param protocol: the protocol on vh whose connections should get it
+ * \param bc: the broadcast object
+ * \param max_pending: most messages each connection may have queued
+ * \param flags: 0 or LWSBCF_ flags
+ *
+ * Queues bc on every established ws connection bound to protocol on vh,
+ * returns the number of connections it was queued on, or -1 if protocol is
+ * not from vh.
+ */
+LWS_VISIBLE LWS_EXTERN int
+lws_ws_bcast_queue_vhost_protocol(struct lws_vhost *vh,
+				  const struct lws_protocols *protocol,
+				  struct lws_ws_bcast *bc,
+				  unsigned int max_pending, int flags);
+///@}
@@ -90,4 +90,35 @@ lws_partial_buffered(struct lws *wsi);
  */
 LWS_VISIBLE LWS_EXTERN int LWS_WARN_UNUSED_RESULT
 lws_frame_is_binary(struct lws *wsi);
+
+#if defined(LWS_WITH_WS_RX_POOL)
+struct lws_ws_rx_pool_stats {
+	size_t		bytes_in_use;	/**< rx buffer bytes lent out now */
+	size_t		bytes_idle;	/**< rx buffer bytes kept for reuse */
+	uint64_t	lent;		/**< times a buffer was lent */
+	uint64_t	allocated;	/**< ...of which needed a new buffer */
+	uint32_t	in_use;		/**< buffers lent out now */
+	uint32_t	idle;		/**< buffers kept for reuse */
+	uint32_t	peak_in_use;	/**< most buffers lent out at once */
+};
+
+/**
+ * lws_ws_rx_pool_stats() - get the ws rx buffer pool occupancy for a pt
+ *
+ * \param cx: the lws context
+ * \param tsi: the service thread index, 0 if not using SMP
+ * \param s: the struct to fill with the pool stats
+ *
+ * With LWS_WITH_WS_RX_POOL, ws connections only hold an rx buffer while they
+ * are collecting payload for the user callback, borrowing it from a pool
+ * kept by their service thread.  This reports how much of that pool is lent
+ * out, and kept idle, at the moment.
+ *
+ * Returns 0 if s was filled, or nonzero if tsi is not a valid service
+ * thread index.
+ */
+LWS_VISIBLE LWS_EXTERN int
+lws_ws_rx_pool_stats(struct lws_context *cx, int tsi,
+		     struct lws_ws_rx_pool_stats *s);
+#endif
 ///@}
@@ -215,7 +215,7 @@ bail:
 	lws_pt_unlock(pt);
 	__lws_vhost_unbind_wsi(new_wsi); /* req cx, acq vh lock */
 
-	lws_free(new_wsi);
+	lws_wsi_free_mem(new_wsi);
 
 	return NULL;
 }
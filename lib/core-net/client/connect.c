@@ -539,7 +539,7 @@ bail:
 
 	lws_free_set_NULL(wsi->stash);
 	lws_fi_destroy(&wsi->fic);
-	lws_free(wsi);
+	lws_wsi_free_mem(wsi);
 #if defined(LWS_ROLE_H1) || defined(LWS_ROLE_H2)
 bail2:
 #endif
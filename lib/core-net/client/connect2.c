@@ -179,9 +179,12 @@ lws_client_connect_2_dnsreq(struct lws *wsi)
 	adsin = lws_wsi_client_stash_item(wsi, CIS_ADDRESS,
 					  _WSI_TOKEN_CLIENT_PEER_ADDRESS);
 
-	/* we only pipeline connections that said it was okay */
+	/*
+	 * we only pipeline connections that said it was okay, or reuse idle
+	 * ones if the vhost was configured to
+	 */
 
-	if (!wsi->client_pipeline) {
+	if (!wsi->client_pipeline && !wsi->a.vhost->cli_idle_max) {
 		lwsl_wsi_debug(wsi, "new conn on no pipeline flag");
 
 		goto solo;
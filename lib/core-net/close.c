@@ -264,7 +264,7 @@ __lws_free_wsi(struct lws *wsi)
 	lws_sul_debug_zombies(wsi->a.context, wsi, sizeof(*wsi), __func__);
 
 	__lws_lc_untag(wsi->a.context, &wsi->lc);
-	lws_free(wsi);
+	lws_wsi_free_mem(wsi);
 }
 
 
@@ -560,6 +560,10 @@ just_kill_connection:
 	lwsl_wsi_debug(wsi, "real just_kill_connection A: (sockfd %d)",
 			wsi->desc.sockfd);
 
+#if defined(LWS_WITH_TLS_HANDSHAKE_OFFLOAD)
+	/* any handshake worker must be done with our SSL before it goes */
+	lws_tls_hs_offload_cancel(wsi);
+#endif
 #if defined(LWS_WITH_THREADPOOL)
 	lws_threadpool_wsi_closing(wsi);
 #endif
@@ -915,6 +919,9 @@ __lws_close_free_wsi_final(struct lws *wsi)
 #endif
 #if defined(LWS_ROLE_H2) || defined(LWS_ROLE_MQTT)
 		if (wsi->mux.parent_wsi) {
+#if defined(LWS_ROLE_H2)
+			lws_dll2_remove(&wsi->h2.sched_list);
+#endif
 			lws_wsi_mux_sibling_disconnect(wsi);
 			wsi->mux.parent_wsi = NULL;
 		}
@@ -0,0 +1,129 @@
+/*
+ * libwebsockets - small server side websockets and web server implementation
+ *
+ * Copyright (C) 2010 - 2021 Andy Green <andy@warmcat.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "private-lib-core.h"
+
+/*
+ * Each pt keeps free lists of the fixed-size objects that are created and
+ * destroyed with every connection, so with heavy connection churn we can
+ * mostly reuse memory that was last touched by the same service thread
+ * rather than going to the allocator each time.
+ *
+ * Freed objects are linked through their first pointer-sized member, since
+ * nothing else is using them by then.  With a limit of 0, which is the
+ * default, the list is never used and we just act like the allocator.
+ *
+ * The lists have their own lock, since objects may be freed when we hold
+ * all kinds of other locks, and this way it's always the innermost one.
+ */
+
+void
+lws_freelist_init(lws_freelist_t *fl, size_t size, uint32_t limit)
+{
+	memset(fl, 0, sizeof(*fl));
+#if LWS_MAX_SMP > 1
+	pthread_mutex_init(&fl->lock, NULL);
+#endif
+	assert(size >= sizeof(void *));
+	fl->size = size;
+	fl->limit = limit;
+}
+
+void *
+lws_freelist_zalloc(lws_freelist_t *fl, const char *reason)
+{
+	void *p = NULL;
+
+	if (fl->limit) {
+#if LWS_MAX_SMP > 1
+		pthread_mutex_lock(&fl->lock);
+#endif
+		p = fl->head;
+		if (p) {
+			fl->head = *(void **)p;
+			fl->count--;
+		}
+#if LWS_MAX_SMP > 1
+		pthread_mutex_unlock(&fl->lock);
+#endif
+	}
+
+	if (!p)
+		return lws_zalloc(fl->size, reason);
+
+	memset(p, 0, fl->size);
+
+	return p;
+}
+
+void
+lws_freelist_free(lws_freelist_t *fl, void *p)
+{
+	if (!p)
+		return;
+
+	if (fl->limit) {
+#if LWS_MAX_SMP > 1
+		pthread_mutex_lock(&fl->lock);
+#endif
+		if (fl->count < fl->limit) {
+			*(void **)p = fl->head;
+			fl->head = p;
+			fl->count++;
+			p = NULL;
+		}
+#if LWS_MAX_SMP > 1
+		pthread_mutex_unlock(&fl->lock);
+#endif
+	}
+
+	if (p)
+		lws_free(p);
+}
+
+/*
+ * Anything freed onto the list after this goes straight back to the
+ * allocator
+ */
+
+void
+lws_freelist_destroy(lws_freelist_t *fl)
+{
+	void *p;
+
+#if LWS_MAX_SMP > 1
+	pthread_mutex_lock(&fl->lock);
+#endif
+	while (fl->head) {
+		p = fl->head;
+		fl->head = *(void **)p;
+		lws_free(p);
+	}
+	fl->count = 0;
+	fl->limit = 0;
+#if LWS_MAX_SMP > 1
+	pthread_mutex_unlock(&fl->lock);
+	pthread_mutex_destroy(&fl->lock);
+#endif
+}
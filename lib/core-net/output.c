@@ -53,6 +53,17 @@ lws_issue_raw(struct lws *wsi, unsigned char *buf, size_t len)
 	    )
 		return (int)len;
 
+#if defined(LWS_ROLE_H2)
+	if (wsi->h2_tx_coalescing && buf && len && !lws_has_buffered_out(wsi)) {
+		int r = lws_h2_tx_coalesce(wsi, buf, len);
+
+		if (r)
+			return r;
+
+		/* else it has to go out the normal way */
+	}
+#endif
+
 	if (buf && lws_has_buffered_out(wsi)) {
 		lwsl_wsi_info(wsi, "** prot: %s, incr buflist_out by %lu",
 				   wsi->a.protocol->name, (unsigned long)len);
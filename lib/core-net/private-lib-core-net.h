@@ -52,9 +52,9 @@ struct lws_muxable {
 extern "C" {
 #endif
 
-#define __lws_sul_insert_us(owner, sul, _us) \
+#define __lws_sul_insert_us(pt, idx, sul, _us) \
 		(sul)->us = lws_now_usecs() + (lws_usec_t)(_us); \
-		__lws_sul_insert(owner, sul)
+		__lws_sul_insert_pt(pt, idx, sul)
 
 
 /*
@@ -165,7 +165,7 @@ enum pmd_return {
 #if defined(LWS_WITH_PEER_LIMITS)
 struct lws_peer {
 	struct lws_peer *next;
-	struct lws_peer *peer_wait_list;
+	lws_dll2_t list_wait; /* on our stripe's wait_owner while unused */
 
 	lws_sockaddr46	sa46;
 
@@ -241,6 +241,34 @@ struct client_info_stash {
 lws_usec_t
 __lws_sul_service_ripe(lws_dll2_owner_t *own, int num_own, lws_usec_t usnow);
 
+struct lws_context_per_thread;
+
+int
+__lws_sul_insert_pt(struct lws_context_per_thread *pt, int idx,
+		    lws_sorted_usec_list_t *sul);
+
+#if defined(LWS_WITH_SUL_WHEEL)
+
+/*
+ * Hierarchical timer wheel that holds a pt's suls that are not due yet, so
+ * scheduling one is O(1) instead of a walk of a sorted list.  Level 0 slots
+ * are one tick (~1ms) wide, each level up is LWS_SUL_WHEEL_SLOTS times
+ * coarser.  Suls due in the current tick live on the sorted pt_sul_owner list.
+ */
+
+#define LWS_SUL_WHEEL_TICK_SHIFT	10 /* tick is 1024us */
+#define LWS_SUL_WHEEL_SLOT_BITS		6
+#define LWS_SUL_WHEEL_SLOTS		(1 << LWS_SUL_WHEEL_SLOT_BITS)
+#define LWS_SUL_WHEEL_LEVELS		5  /* ~12 days, later is parked */
+
+typedef struct lws_sul_wheel {
+	lws_dll2_owner_t	slot[LWS_SUL_WHEEL_LEVELS][LWS_SUL_WHEEL_SLOTS];
+	uint64_t		occupied[LWS_SUL_WHEEL_LEVELS]; /* may be stale */
+	lws_usec_t		tick; /* ticks up to here were moved out */
+} lws_sul_wheel_t;
+
+#endif
+
 /*
  * lws_async_dns
  */
@@ -249,8 +277,11 @@ typedef struct lws_async_dns {
 	lws_sockaddr46 		sa46; /* nameserver */
 	lws_dll2_owner_t	waiting;
 	lws_dll2_owner_t	cached;
+	lws_dll2_owner_t	*hash; /* cached, waiting by name, waiting by tid */
 	struct lws		*wsi;
 	time_t			time_set_server;
+	unsigned int		hash_buckets;
+	unsigned int		cache_max_items;
 	uint8_t			dns_server_set:1;
 	uint8_t			dns_server_connected:1;
 } lws_async_dns_t;
@@ -272,6 +303,30 @@ lws_async_dns_cancel(struct lws *wsi);
 void
 lws_async_dns_drop_server(struct lws_context *context);
 
+/*
+ * Fixed-size objects the pt keeps for reuse after they are freed, see
+ * info->conn_freelist_max
+ */
+
+typedef struct lws_freelist {
+#if LWS_MAX_SMP > 1
+	pthread_mutex_t		lock;
+#endif
+	void			*head;
+	size_t			size;
+	uint32_t		count;
+	uint32_t		limit;
+} lws_freelist_t;
+
+void
+lws_freelist_init(lws_freelist_t *fl, size_t size, uint32_t limit);
+void *
+lws_freelist_zalloc(lws_freelist_t *fl, const char *reason);
+void
+lws_freelist_free(lws_freelist_t *fl, void *p);
+void
+lws_freelist_destroy(lws_freelist_t *fl);
+
 /*
  * so we can have n connections being serviced simultaneously,
  * these things need to be isolated per-thread.
@@ -296,6 +351,9 @@ struct lws_context_per_thread {
 #endif
 
 	struct lws_dll2_owner pt_sul_owner[LWS_COUNT_PT_SUL_OWNERS];
+#if defined(LWS_WITH_SUL_WHEEL)
+	lws_sul_wheel_t pt_sul_wheel[LWS_COUNT_PT_SUL_OWNERS];
+#endif
 
 #if (defined(LWS_ROLE_H1) || defined(LWS_ROLE_H2)) && defined(LWS_WITH_SERVER)
 	lws_sorted_usec_list_t sul_ah_lifecheck;
@@ -311,6 +369,7 @@ struct lws_context_per_thread {
 #endif
 #if defined(LWS_WITH_PEER_LIMITS)
 	lws_sorted_usec_list_t sul_peer_limits;
+	time_t next_peer_cull;
 #endif
 
 #if !defined(LWS_PLAT_FREERTOS)
@@ -339,11 +398,25 @@ struct lws_context_per_thread {
 	lws_sockfd_type dummy_pipe_fds[2];
 	struct lws *pipe_wsi;
 
+	lws_freelist_t fl_wsi; /* struct lws + evlib part */
+#if defined(LWS_ROLE_WS)
+	lws_freelist_t fl_ws; /* struct _lws_websocket_related */
+#endif
+#if defined(LWS_ROLE_H2)
+	lws_freelist_t fl_h2n; /* struct lws_h2_netconn */
+	uint8_t *h2_tx_coalesce; /* frames gathered during h2 POLLOUT */
+	size_t h2_tx_coalesce_len;
+	size_t h2_tx_coalesce_max;
+#endif
+
 	/* --- role based members --- */
 
 #if defined(LWS_ROLE_WS) && !defined(LWS_WITHOUT_EXTENSIONS)
 	struct lws_pt_role_ws ws;
 #endif
+#if defined(LWS_ROLE_WS) && defined(LWS_WITH_WS_RX_POOL)
+	struct lws_ws_rx_pool ws_rx_pool;
+#endif
 #if defined(LWS_ROLE_H1) || defined(LWS_ROLE_H2)
 	struct lws_pt_role_http http;
 #endif
@@ -424,6 +497,8 @@ struct lws_vhost {
 
 	lws_lifecycle_t		lc;
 	lws_dll2_t		vh_being_destroyed_list;
+	lws_dll2_t		vh_name_hash_list; /* cx->vhost_name_hash */
+	uint32_t		name_hash;
 
 #if defined(LWS_WITH_SOCKS5)
 	char socks_proxy_address[128];
@@ -433,6 +508,8 @@ struct lws_vhost {
 
 #if defined(LWS_WITH_TLS_SESSIONS)
 	lws_dll2_owner_t	tls_sessions; /* vh lock */
+	lws_dll2_owner_t	*tls_sessions_hash; /* buckets of tls_sessions */
+	const char		*tls_session_cache_filepath;
 #endif
 
 #if defined(LWS_WITH_EVENT_LIBS)
@@ -484,6 +561,8 @@ struct lws_vhost {
 
 #if defined(LWS_WITH_CLIENT)
 	struct lws_dll2_owner dll_cli_active_conns_owner;
+	unsigned int cli_idle_max; /* 0 = only LCCSCF_PIPELINE conns share */
+	unsigned int cli_idle_secs; /* 0 = keep_warm_secs / keepalive_timeout */
 #endif
 	struct lws_dll2_owner vh_awaiting_socket_owner;
 
@@ -514,10 +593,12 @@ struct lws_vhost {
 
 #ifdef LWS_WITH_ACCESS_LOG
 	int log_fd;
+	uint8_t log_format; /* enum lws_access_log_format */
 #endif
 
 #if defined(LWS_WITH_TLS_SESSIONS)
 	uint32_t		tls_session_cache_max;
+	uint32_t		tls_sessions_hash_buckets;
 #endif
 
 #if defined(LWS_WITH_SECURE_STREAMS_STATIC_POLICY_ONLY) || defined(LWS_WITH_SECURE_STREAMS_CPP)
@@ -542,6 +623,14 @@ struct lws_vhost {
 void
 __lws_vhost_destroy2(struct lws_vhost *vh);
 
+int
+lws_vhost_name_hash_add(struct lws_vhost *vh);
+void
+lws_vhost_name_hash_remove(struct lws_vhost *vh);
+struct lws_vhost *
+lws_vhost_by_name_len(struct lws_context *cx, const char *name, size_t len,
+		      int wildcard, int port);
+
 #define mux_to_wsi(_m) lws_container_of(_m, struct lws, mux)
 
 void
@@ -756,6 +845,7 @@ struct lws {
 	unsigned int			h2_stream_carries_ws:1; /* immortal set as well */
 	unsigned int			h2_stream_carries_sse:1; /* immortal set as well */
 	unsigned int			h2_acked_settings:1;
+	unsigned int			h2_tx_coalescing:1;
 	unsigned int			seen_nonpseudoheader:1;
 	unsigned int			listener:1;
 	unsigned int			pf_packet:1;
@@ -1231,6 +1321,8 @@ struct lws *
 __lws_wsi_create_with_role(struct lws_context *context, int tsi,
 			 const struct lws_role_ops *ops,
 			 lws_log_cx_t *log_cx_template);
+void
+lws_wsi_free_mem(struct lws *wsi);
 int
 lws_wsi_inject_to_loop(struct lws_context_per_thread *pt, struct lws *wsi);
 
@@ -1272,6 +1364,14 @@ int
 lws_access_log(struct lws *wsi);
 void
 lws_prepare_access_log_info(struct lws *wsi, char *uri_ptr, int len, int meth);
+#if defined(LWS_WITH_ACCESS_LOG_ASYNC)
+int
+lws_access_log_async_init(struct lws_context *cx, unsigned int size);
+void
+lws_access_log_async_flush(struct lws_context *cx);
+void
+lws_access_log_async_destroy(struct lws_context *cx);
+#endif
 #else
 #define lws_access_log(_a)
 #endif
@@ -1311,6 +1411,12 @@ int
 lws_plat_change_pollfd(struct lws_context *context, struct lws *wsi,
 		       struct lws_pollfd *pfd);
 
+#if defined(LWS_HAVE_SENDFILE) && defined(LWS_WITH_FILE_OPS)
+int
+lws_plat_file_sendfile(struct lws *wsi, lws_fop_fd_t fop_fd,
+		       lws_filepos_t len, lws_filepos_t *amount);
+#endif
+
 #if defined(LWS_WITH_SERVER) && defined(LWS_WITH_SECURE_STREAMS)
 int
 lws_adopt_ss_server_accept(struct lws *new_wsi);
@@ -1410,9 +1516,15 @@ int
 lws_peer_confirm_ah_attach_ok(struct lws_context *context,
 			      struct lws_peer *peer);
 void
+lws_peer_track_ah_attach(struct lws_context *context, struct lws_peer *peer);
+void
 lws_peer_track_ah_detach(struct lws_context *context, struct lws_peer *peer);
 void
-lws_peer_cull_peer_wait_list(struct lws_context *context);
+lws_peer_limits_init(struct lws_context *context);
+void
+lws_peer_limits_destroy(struct lws_context *context);
+void
+lws_peer_cull_peer_wait_list(struct lws_context_per_thread *pt);
 struct lws_peer *
 lws_get_or_create_peer(struct lws_vhost *vhost, lws_sockfd_type sockfd);
 void
@@ -1507,6 +1619,8 @@ delete_from_fdwsi(const struct lws_context *context, struct lws *wsi);
 
 int
 lws_vhost_active_conns(struct lws *wsi, struct lws **nwsi, const char *adsin);
+int
+lws_vhost_cli_idle_count(struct lws *wsi, char take_vh_lock);
 
 const char *
 lws_wsi_client_stash_item(struct lws *wsi, int stash_idx, int hdr_idx);
@@ -64,6 +64,218 @@ __lws_sul_insert(lws_dll2_owner_t *own, lws_sorted_usec_list_t *sul)
 	return 0;
 }
 
+#if defined(LWS_WITH_SUL_WHEEL)
+
+/*
+ * The wheel only needs to be exact about what is due in the current tick, and
+ * that lives on the sorted list.  Anything later goes in a wheel slot for its
+ * tick at the finest level that can hold it without wrapping, and gets moved
+ * down a level (or onto the sorted list) when the wheel reaches its slot.  So
+ * each sul is touched at most once per level, and cancel is just a dll2
+ * remove from whatever slot list it is on.
+ */
+
+#define lws_sul_wheel_shift(_l) ((_l) * LWS_SUL_WHEEL_SLOT_BITS)
+
+static void
+lws_sul_wheel_add(lws_dll2_owner_t *own, lws_sul_wheel_t *w,
+		  lws_sorted_usec_list_t *sul)
+{
+	lws_usec_t t = sul->us >> LWS_SUL_WHEEL_TICK_SHIFT, cur = 0;
+	int l, s;
+
+	if (!w->tick)
+		w->tick = lws_now_usecs() >> LWS_SUL_WHEEL_TICK_SHIFT;
+
+	if (t <= w->tick) {
+		/* due in the current tick, it must be exactly sorted */
+		lws_dll2_add_sorted(&sul->list, own, sul_compare);
+
+		return;
+	}
+
+	for (l = 0; l < LWS_SUL_WHEEL_LEVELS; l++) {
+		cur = w->tick >> lws_sul_wheel_shift(l);
+		if ((t >> lws_sul_wheel_shift(l)) - cur < LWS_SUL_WHEEL_SLOTS)
+			break;
+	}
+
+	if (l == LWS_SUL_WHEEL_LEVELS) {
+		/* beyond the horizon... park in the last slot, try again then */
+		l--;
+		t = cur + LWS_SUL_WHEEL_SLOTS - 1;
+	} else
+		t >>= lws_sul_wheel_shift(l);
+
+	s = (int)(t & (LWS_SUL_WHEEL_SLOTS - 1));
+	lws_dll2_add_tail(&sul->list, &w->slot[l][s]);
+	w->occupied[l] |= 1ull << s;
+}
+
+/*
+ * Move the wheel on to the tick containing usnow, distributing the contents of
+ * any slots it reached on any level to lower levels or the sorted list
+ */
+
+static void
+lws_sul_wheel_advance(lws_dll2_owner_t *own, lws_sul_wheel_t *w,
+		      lws_usec_t usnow)
+{
+	lws_usec_t now = usnow >> LWS_SUL_WHEEL_TICK_SHIFT, old = w->tick;
+	int l;
+
+	if (now <= old)
+		return;
+
+	w->tick = now;
+
+	for (l = 0; l < LWS_SUL_WHEEL_LEVELS; l++) {
+		lws_usec_t from = (old >> lws_sul_wheel_shift(l)) + 1,
+			   to = now >> lws_sul_wheel_shift(l);
+		uint64_t mask, todo;
+		int st;
+
+		if (from > to)
+			/* no coarser level can have moved either */
+			break;
+
+		if (to - from >= LWS_SUL_WHEEL_SLOTS - 1)
+			mask = ~0ull;
+		else {
+			mask = (1ull << (to - from + 1)) - 1;
+			st = (int)(from & (LWS_SUL_WHEEL_SLOTS - 1));
+			if (st)
+				mask = (mask << st) | (mask >> (64 - st));
+		}
+
+		todo = w->occupied[l] & mask;
+		w->occupied[l] &= ~mask;
+
+		while (todo) {
+			int s = 0;
+			uint32_t c;
+
+			while (!(todo & (1ull << s)))
+				s++;
+			todo &= ~(1ull << s);
+
+			/*
+			 * It may put some back on this same slot, only do the
+			 * ones that were there when we started
+			 */
+
+			c = (uint32_t)w->slot[l][s].count;
+			while (c--) {
+				lws_sorted_usec_list_t *sul =
+					(lws_sorted_usec_list_t *)
+					lws_dll2_get_head(&w->slot[l][s]);
+
+				lws_dll2_remove(&sul->list);
+				lws_sul_wheel_add(own, w, sul);
+			}
+		}
+	}
+}
+
+/*
+ * Returns a time no later than the earliest sul in the wheel, or 0 if it's
+ * empty.  Level 0 is exact, coarser levels give the start of the slot, where
+ * the advance will move things down to where they can be seen exactly.
+ */
+
+static lws_usec_t
+lws_sul_wheel_earliest(lws_sul_wheel_t *w)
+{
+	lws_usec_t best = 0;
+	int l;
+
+	for (l = 0; l < LWS_SUL_WHEEL_LEVELS; l++) {
+		lws_usec_t cur = w->tick >> lws_sul_wheel_shift(l), e = 0;
+		int d;
+
+		if (!w->occupied[l])
+			continue;
+
+		/* slots ahead of cur in time order, clearing stale bits */
+
+		for (d = 1; d < LWS_SUL_WHEEL_SLOTS; d++) {
+			int s = (int)((cur + d) & (LWS_SUL_WHEEL_SLOTS - 1));
+
+			if (!(w->occupied[l] & (1ull << s)))
+				continue;
+
+			if (!w->slot[l][s].count) {
+				w->occupied[l] &= ~(1ull << s);
+				continue;
+			}
+
+			if (l)
+				e = (cur + d) << (lws_sul_wheel_shift(l) +
+						  LWS_SUL_WHEEL_TICK_SHIFT);
+			else
+				lws_start_foreach_dll(struct lws_dll2 *, p,
+					lws_dll2_get_head(&w->slot[l][s])) {
+					lws_sorted_usec_list_t *sul =
+						(lws_sorted_usec_list_t *)p;
+
+					if (!e || sul->us < e)
+						e = sul->us;
+				} lws_end_foreach_dll(p);
+			break;
+		}
+
+		if (e && (!best || e < best))
+			best = e;
+	}
+
+	return best;
+}
+
+/* move everything on the wheel onto the sorted list */
+
+static void
+lws_sul_wheel_drain(lws_dll2_owner_t *own, lws_sul_wheel_t *w)
+{
+	int l, s;
+
+	for (l = 0; l < LWS_SUL_WHEEL_LEVELS; l++) {
+		for (s = 0; s < LWS_SUL_WHEEL_SLOTS; s++)
+			while (w->slot[l][s].count) {
+				lws_sorted_usec_list_t *sul =
+					(lws_sorted_usec_list_t *)
+					lws_dll2_get_head(&w->slot[l][s]);
+
+				lws_dll2_remove(&sul->list);
+				lws_dll2_add_sorted(&sul->list, own,
+						    sul_compare);
+			}
+		w->occupied[l] = 0;
+	}
+}
+
+#endif
+
+/*
+ * Schedule on one of the pt's own sul owners
+ */
+
+int
+__lws_sul_insert_pt(struct lws_context_per_thread *pt, int idx,
+		    lws_sorted_usec_list_t *sul)
+{
+#if defined(LWS_WITH_SUL_WHEEL)
+	lws_dll2_remove(&sul->list);
+
+	assert(sul->cb);
+
+	lws_sul_wheel_add(&pt->pt_sul_owner[idx], &pt->pt_sul_wheel[idx], sul);
+
+	return 0;
+#else
+	return __lws_sul_insert(&pt->pt_sul_owner[idx], sul);
+#endif
+}
+
 void
 lws_sul_cancel(lws_sorted_usec_list_t *sul)
 {
@@ -83,8 +295,7 @@ lws_sul2_schedule(struct lws_context *context, int tsi, int flags,
 
 	assert(sul->cb);
 
-	__lws_sul_insert(
-		&pt->pt_sul_owner[!!(flags & LWSSULLI_WAKE_IF_SUSPENDED)], sul);
+	__lws_sul_insert_pt(pt, !!(flags & LWSSULLI_WAKE_IF_SUSPENDED), sul);
 }
 
 /*
@@ -111,6 +322,18 @@ __lws_sul_service_ripe(lws_dll2_owner_t *own, int own_len, lws_usec_t usnow)
 	/* must be at least 1 */
 	assert(own_len > 0);
 
+#if defined(LWS_WITH_SUL_WHEEL)
+	{
+		int n;
+
+		/* anything on the wheel due by now goes on the sorted lists */
+
+		for (n = 0; n < own_len; n++)
+			lws_sul_wheel_advance(&own[n], &pt->pt_sul_wheel[n],
+					      usnow);
+	}
+#endif
+
 	/*
 	 * Of the own_len sul owning lists, the earliest next sul could be on
 	 * any of them.  We have to find it and handle each in turn until no
@@ -138,11 +361,33 @@ __lws_sul_service_ripe(lws_dll2_owner_t *own, int own_len, lws_usec_t usnow)
 			}
 		}
 
+#if defined(LWS_WITH_SUL_WHEEL)
+		/*
+		 * Nothing on the wheel is due by usnow, but it may be due
+		 * before the earliest on the sorted lists
+		 */
+
+		if (!hit || lowest > usnow)
+			for (n = 0; n < own_len; n++) {
+				lws_usec_t e = lws_sul_wheel_earliest(
+							&pt->pt_sul_wheel[n]);
+
+				if (e && (!lowest || e < lowest))
+					lowest = e;
+			}
+
+		if (!lowest)
+			return 0;
+
+		if (!hit || lowest > usnow)
+			return lowest - usnow;
+#else
 		if (!hit)
 			return 0;
 
 		if (lowest > usnow)
 			return lowest - usnow;
+#endif
 
 		/* his moment has come... remove him from his owning list */
 
@@ -198,6 +443,18 @@ lws_sul_nonmonotonic_adjust(struct lws_context *ctx, int64_t step_us)
 
 		for (n = 0; n < LWS_COUNT_PT_SUL_OWNERS; n++) {
 
+#if defined(LWS_WITH_SUL_WHEEL)
+			/*
+			 * The wheel slots are keyed by time, so they'd all be
+			 * wrong after the step.  It's a rare event, just put
+			 * everything on the sorted list and let the wheel
+			 * start again from the new time.
+			 */
+			lws_sul_wheel_drain(&pt->pt_sul_owner[n],
+					    &pt->pt_sul_wheel[n]);
+			pt->pt_sul_wheel[n].tick = 0;
+#endif
+
 			if (!pt->pt_sul_owner[n].count)
 				continue;
 
@@ -255,6 +512,18 @@ lws_sul_earliest_wakeable_event(struct lws_context *ctx, lws_usec_t *pearliest)
 			}
 		}
 
+#if defined(LWS_WITH_SUL_WHEEL)
+		{
+			lws_usec_t e = lws_sul_wheel_earliest(
+				&pt->pt_sul_wheel[LWSSULLI_WAKE_IF_SUSPENDED]);
+
+			if (e && (hit == -1 || e < lowest)) {
+				hit = n;
+				lowest = e;
+			}
+		}
+#endif
+
 		lws_pt_unlock(pt);
 	}
 
@@ -320,12 +589,63 @@ lws_sul_schedule_wakesuspend(struct lws_context *ctx, int tsi,
  * being destroyed, there is no live sul scheduled from inside the object.
  */
 
+static void
+lws_sul_debug_zombies_list(struct lws_context *ctx, lws_dll2_owner_t *own,
+			   int m, void *po, size_t len,
+			   const char *destroy_description)
+{
+	lws_start_foreach_dll(struct lws_dll2 *, p, lws_dll2_get_head(own)) {
+		lws_sorted_usec_list_t *sul =
+			lws_container_of(p, lws_sorted_usec_list_t, list);
+
+		if (!po) {
+			lwsl_cx_err(ctx, "%s", destroy_description);
+			/* just sanity check the list */
+			assert(sul->cb);
+		}
+
+		/*
+		 * Is the sul resident inside the object that is
+		 * indicated as being deleted?
+		 */
+
+		if (po &&
+		    (void *)sul >= po &&
+		    (size_t)lws_ptr_diff(sul, po) < len) {
+			lwsl_cx_err(ctx, "ERROR: Zombie Sul "
+				 "(on list %d) %s, cb %p\n", m,
+				 destroy_description, sul->cb);
+			/*
+			 * This assert fires if you have left
+			 * a sul scheduled to fire later, but
+			 * are about to destroy the object the
+			 * sul lives in.  You must take care to
+			 * do lws_sul_cancel(&sul) on any suls
+			 * that may be scheduled before
+			 * destroying the object the sul lives
+			 * inside.
+			 *
+			 * You can look up the cb pointer in
+			 * your mapfile to find out which
+			 * callback function the sul was using
+			 * which usually tells you which sul
+			 * it is.
+			 */
+			assert(0);
+		}
+
+	} lws_end_foreach_dll(p);
+}
+
 void
 lws_sul_debug_zombies(struct lws_context *ctx, void *po, size_t len,
 		      const char *destroy_description)
 {
 	struct lws_context_per_thread *pt;
 	int n, m;
+#if defined(LWS_WITH_SUL_WHEEL)
+	int l, s;
+#endif
 
 	for (n = 0; n < ctx->count_threads; n++) {
 		pt = &ctx->pt[n];
@@ -333,51 +653,17 @@ lws_sul_debug_zombies(struct lws_context *ctx, void *po, size_t len,
 		lws_pt_lock(pt, __func__);
 
 		for (m = 0; m < LWS_COUNT_PT_SUL_OWNERS; m++) {
-
-			lws_start_foreach_dll(struct lws_dll2 *, p,
-				      lws_dll2_get_head(&pt->pt_sul_owner[m])) {
-				lws_sorted_usec_list_t *sul =
-					lws_container_of(p,
-						lws_sorted_usec_list_t, list);
-
-				if (!po) {
-					lwsl_cx_err(ctx, "%s",
-							 destroy_description);
-					/* just sanity check the list */
-					assert(sul->cb);
-				}
-
-				/*
-				 * Is the sul resident inside the object that is
-				 * indicated as being deleted?
-				 */
-
-				if (po &&
-				    (void *)sul >= po &&
-				    (size_t)lws_ptr_diff(sul, po) < len) {
-					lwsl_cx_err(ctx, "ERROR: Zombie Sul "
-						 "(on list %d) %s, cb %p\n", m,
-						 destroy_description, sul->cb);
-					/*
-					 * This assert fires if you have left
-					 * a sul scheduled to fire later, but
-					 * are about to destroy the object the
-					 * sul lives in.  You must take care to
-					 * do lws_sul_cancel(&sul) on any suls
-					 * that may be scheduled before
-					 * destroying the object the sul lives
-					 * inside.
-					 *
-					 * You can look up the cb pointer in
-					 * your mapfile to find out which
-					 * callback function the sul was using
-					 * which usually tells you which sul
-					 * it is.
-					 */
-					assert(0);
-				}
-
-			} lws_end_foreach_dll(p);
+			lws_sul_debug_zombies_list(ctx, &pt->pt_sul_owner[m],
+						   m, po, len,
+						   destroy_description);
+#if defined(LWS_WITH_SUL_WHEEL)
+			for (l = 0; l < LWS_SUL_WHEEL_LEVELS; l++)
+				for (s = 0; s < LWS_SUL_WHEEL_SLOTS; s++)
+					lws_sul_debug_zombies_list(ctx,
+						&pt->pt_sul_wheel[m].slot[l][s],
+						m, po, len,
+						destroy_description);
+#endif
 		}
 
 		lws_pt_unlock(pt);
@@ -723,6 +723,11 @@ lws_create_vhost(struct lws_context *context,
 	else
 		vh->keepalive_timeout = 5;
 
+#if defined(LWS_WITH_CLIENT)
+	vh->cli_idle_max = info->client_idle_max_per_origin;
+	vh->cli_idle_secs = info->client_idle_timeout_secs;
+#endif
+
 	if (info->timeout_secs_ah_idle)
 		vh->timeout_secs_ah_idle = (int)info->timeout_secs_ah_idle;
 	else
@@ -879,6 +884,10 @@ lws_create_vhost(struct lws_context *context,
 				   (unsigned int)vh->count_protocols, "same vh list");
 #if defined(LWS_ROLE_H1) || defined(LWS_ROLE_H2)
 	vh->http.mount_list = info->mounts;
+#if defined(LWS_WITH_SERVER)
+	/* failure just leaves us scanning the list */
+	lws_vhost_mount_tree_build(vh);
+#endif
 #endif
 
 #if defined(LWS_WITH_SYS_METRICS) && defined(LWS_WITH_SERVER)
@@ -977,6 +986,7 @@ lws_create_vhost(struct lws_context *context,
 		lwsl_vhost_notice(vh, "   STS enabled");
 
 #ifdef LWS_WITH_ACCESS_LOG
+	vh->log_format = info->access_log_format;
 	if (info->log_filepath) {
 		if (lws_fi(&vh->fic, "vh_create_access_log_open_fail"))
 			vh->log_fd = (int)LWS_INVALID_FILE;
@@ -1033,6 +1043,11 @@ lws_create_vhost(struct lws_context *context,
 		vh1 = &(*vh1)->vhost_next;
 	};
 
+	if (lws_vhost_name_hash_add(vh)) {
+		lwsl_vhost_err(vh, "OOM");
+		goto bail1;
+	}
+
 #if defined(LWS_WITH_SYS_ASYNC_DNS)
 	if (!n)
 		lws_async_dns_init(context);
@@ -1170,7 +1185,7 @@ lws_destroy_event_pipe(struct lws *wsi)
 	n = lws_wsi_extract_from_loop(wsi);
 	lws_plat_pipe_close(wsi);
 	if (!n)
-		lws_free(wsi);
+		lws_wsi_free_mem(wsi);
 }
 
 /*
@@ -1292,6 +1307,9 @@ void
 lws_vhost_destroy1(struct lws_vhost *vh)
 {
 	struct lws_context *context = vh->context;
+#if defined(LWS_WITH_TLS_SESSIONS) && defined(LWS_WITH_TLS)
+	struct lws_buflist *sess_bl = NULL;
+#endif
 	int n;
 
 	lwsl_vhost_info(vh, "\n");
@@ -1312,6 +1330,9 @@ lws_vhost_destroy1(struct lws_vhost *vh)
 	lws_vhost_lock(vh); /* -------------- vh { */
 
 #if defined(LWS_WITH_TLS_SESSIONS) && defined(LWS_WITH_TLS)
+	/* just copy it out while we hold the locks, the file i/o is later */
+	if (vh->tls_session_cache_filepath)
+		lws_tls_session_cache_serialize(vh, &sess_bl);
 	lws_tls_session_vh_destroy(vh);
 #endif
 
@@ -1410,6 +1431,12 @@ lws_vhost_destroy1(struct lws_vhost *vh)
 
 out:
 	lws_context_unlock(context); /* --------------------------- context { */
+
+#if defined(LWS_WITH_TLS_SESSIONS) && defined(LWS_WITH_TLS)
+	if (sess_bl)
+		lws_tls_session_cache_write(vh, vh->tls_session_cache_filepath,
+					    &sess_bl);
+#endif
 }
 
 #if defined(LWS_WITH_ABSTRACT)
@@ -1477,6 +1504,8 @@ __lws_vhost_destroy2(struct lws_vhost *vh)
 		}
 	} lws_end_foreach_llp(pv, vhost_next);
 
+	lws_vhost_name_hash_remove(vh);
+
 	/* add ourselves to the pending destruction list */
 
 	if (vh->context->vhost_pending_destruction_list != vh) {
@@ -1515,6 +1544,10 @@ __lws_vhost_destroy2(struct lws_vhost *vh)
 	}
 	if (vh->protocol_vh_privs)
 		lws_free(vh->protocol_vh_privs);
+#if defined(LWS_WITH_TLS_SESSIONS) && defined(LWS_WITH_TLS)
+	/* destroy1 is skipped if the context never started service */
+	lws_tls_session_vh_destroy(vh);
+#endif
 	lws_ssl_SSL_CTX_destroy(vh);
 	lws_free(vh->same_vh_protocol_owner);
 
@@ -1534,13 +1567,22 @@ __lws_vhost_destroy2(struct lws_vhost *vh)
 #endif
 
 #ifdef LWS_WITH_ACCESS_LOG
-	if (vh->log_fd != (int)LWS_INVALID_FILE)
+	if (vh->log_fd != (int)LWS_INVALID_FILE) {
+#if defined(LWS_WITH_ACCESS_LOG_ASYNC)
+		/* records for this log may still be queued */
+		if (context->alog.size)
+			lws_access_log_async_flush(context);
+#endif
 		close(vh->log_fd);
+	}
 #endif
 
 #if defined (LWS_WITH_TLS)
 	lws_free_set_NULL(vh->tls.alloc_cert_path);
 #endif
+#if (defined(LWS_ROLE_H1) || defined(LWS_ROLE_H2)) && defined(LWS_WITH_SERVER)
+	lws_vhost_mount_tree_destroy(vh);
+#endif
 
 #if LWS_MAX_SMP > 1
 	lws_mutex_refcount_destroy(&vh->mr);
@@ -1710,21 +1752,182 @@ lws_context_deprecate(struct lws_context *cx, lws_reload_func cb)
 
 #if defined(LWS_WITH_NETWORK)
 
+/*
+ * The context's vhosts are also listed in buckets by the hash of their name,
+ * so finding one by name, or by SNI / Host header servername, doesn't have to
+ * strcmp() its way down every vhost in the context.  Within a bucket, vhosts
+ * are in the order they were created, same as in the vhost list, so if there
+ * are several with the same name the first one still wins.
+ *
+ * The table starts small and is rebuilt four times bigger whenever there
+ * come to be twice as many vhosts as buckets.
+ */
+
+#define LWS_VH_NAME_HASH_SEED		0x811c9dc5 /* FNV-1a */
+#define LWS_VH_NAME_HASH_MIN_BUCKETS	16
+
+static uint32_t
+lws_vhost_name_hash(uint32_t h, const char *name, size_t len)
+{
+	while (len--) {
+		h ^= (uint8_t)*name++;
+		h *= 0x01000193;
+	}
+
+	return h;
+}
+
+int
+lws_vhost_name_hash_add(struct lws_vhost *vh)
+{
+	struct lws_context *cx = vh->context;
+	lws_dll2_owner_t *t;
+	unsigned int n;
+
+	vh->name_hash = lws_vhost_name_hash(LWS_VH_NAME_HASH_SEED, vh->name,
+					    strlen(vh->name));
+
+	if (!cx->vhost_name_hash ||
+	    cx->count_vhost_names >= cx->vhost_name_hash_buckets * 2) {
+		n = cx->vhost_name_hash_buckets ?
+			cx->vhost_name_hash_buckets * 4 :
+			LWS_VH_NAME_HASH_MIN_BUCKETS;
+
+		t = lws_zalloc(n * sizeof(*t), "vh-name-hash");
+		if (!t) {
+			if (!cx->vhost_name_hash)
+				return 1;
+
+			/* we can carry on with the table we have */
+			lwsl_cx_warn(cx, "OOM growing vhost name hash");
+			goto add;
+		}
+
+		/* move the hashed vhosts across, in vhost list order */
+
+		lws_start_foreach_ll(struct lws_vhost *, v, cx->vhost_list) {
+			if (!lws_dll2_is_detached(&v->vh_name_hash_list)) {
+				lws_dll2_remove(&v->vh_name_hash_list);
+				lws_dll2_add_tail(&v->vh_name_hash_list,
+						  &t[v->name_hash & (n - 1)]);
+			}
+		} lws_end_foreach_ll(v, vhost_next);
+
+		lws_free(cx->vhost_name_hash);
+		cx->vhost_name_hash = t;
+		cx->vhost_name_hash_buckets = n;
+	}
+
+add:
+	lws_dll2_add_tail(&vh->vh_name_hash_list,
+			  &cx->vhost_name_hash[vh->name_hash &
+					(cx->vhost_name_hash_buckets - 1)]);
+	cx->count_vhost_names++;
+
+	return 0;
+}
+
+void
+lws_vhost_name_hash_remove(struct lws_vhost *vh)
+{
+	struct lws_context *cx = vh->context;
+
+	if (lws_dll2_is_detached(&vh->vh_name_hash_list))
+		return;
+
+	lws_dll2_remove(&vh->vh_name_hash_list);
+
+	if (!--cx->count_vhost_names) {
+		lws_free_set_NULL(cx->vhost_name_hash);
+		cx->vhost_name_hash_buckets = 0;
+	}
+}
+
+/*
+ * Find the first vhost called name[0..len), or if wildcard, the first one
+ * called "*" + name[0..len), eg, "*.example.com" for ".example.com".  If port
+ * is not -1, the vhost must also be listening on that port.
+ */
+
 struct lws_vhost *
-lws_get_vhost_by_name(struct lws_context *context, const char *name)
+lws_vhost_by_name_len(struct lws_context *cx, const char *name, size_t len,
+		      int wildcard, int port)
 {
-	lws_start_foreach_ll(struct lws_vhost *, v,
-			     context->vhost_list) {
-		if (!v->being_destroyed && !strcmp(v->name, name))
+	uint32_t h = LWS_VH_NAME_HASH_SEED;
+	size_t o = !!wildcard;
+
+	if (!cx->vhost_name_hash)
+		return NULL;
+
+	if (wildcard)
+		h = lws_vhost_name_hash(h, "*", 1);
+	h = lws_vhost_name_hash(h, name, len);
+
+	lws_start_foreach_dll(struct lws_dll2 *, d,
+		lws_dll2_get_head(&cx->vhost_name_hash[h &
+					(cx->vhost_name_hash_buckets - 1)])) {
+		struct lws_vhost *v = lws_container_of(d, struct lws_vhost,
+						       vh_name_hash_list);
+
+		if (v->name_hash == h && !v->being_destroyed &&
+		    (port == -1 || port == v->listen_port) &&
+		    (!wildcard || v->name[0] == '*') &&
+		    !strncmp(v->name + o, name, len) && !v->name[o + len])
 			return v;
 
-	} lws_end_foreach_ll(v, vhost_next);
+	} lws_end_foreach_dll(d);
 
 	return NULL;
 }
 
+struct lws_vhost *
+lws_get_vhost_by_name(struct lws_context *context, const char *name)
+{
+	return lws_vhost_by_name_len(context, name, strlen(name), 0, -1);
+}
+
 
 #if defined(LWS_WITH_CLIENT)
+/*
+ * How many client connections on the vhost are idle with the same role,
+ * endpoint and tls use as wsi, including wsi itself if it is idle
+ */
+
+int
+lws_vhost_cli_idle_count(struct lws *wsi, char take_vh_lock)
+{
+	int n = 0;
+
+	if (!wsi->cli_hostname_copy)
+		return 0;
+
+	if (take_vh_lock)
+		lws_vhost_lock(wsi->a.vhost); /* ---------------------------- { */
+
+	lws_start_foreach_dll(struct lws_dll2 *, d,
+			      wsi->a.vhost->dll_cli_active_conns_owner.head) {
+		struct lws *w = lws_container_of(d, struct lws,
+						 dll_cli_active_conns);
+
+		if (lwsi_state(w) == LRS_IDLING &&
+		    w->role_ops == wsi->role_ops &&
+		    w->c_port == wsi->c_port &&
+#if defined(LWS_WITH_TLS)
+		    (w->tls.use_ssl & LCCSCF_USE_SSL) ==
+				(wsi->tls.use_ssl & LCCSCF_USE_SSL) &&
+#endif
+		    w->cli_hostname_copy &&
+		    !strcmp(w->cli_hostname_copy, wsi->cli_hostname_copy))
+			n++;
+
+	} lws_end_foreach_dll(d);
+
+	if (take_vh_lock)
+		lws_vhost_unlock(wsi->a.vhost); /* } ------------------------- */
+
+	return n;
+}
+
 /*
  * This is the logic checking to see if the new connection wsi should have a
  * pipelining or muxing relationship with an existing "active connection" to
@@ -1812,8 +2015,15 @@ lws_vhost_active_conns(struct lws *wsi, struct lws **nwsi, const char *adsin)
 		     (w->tls.use_ssl & LCCSCF_USE_SSL) &&
 		     /* must both agree on tls use or not */
 #endif
-		    wsi->c_port == w->c_port) {
-			/* same endpoint port */
+		    wsi->c_port == w->c_port &&
+		    /* same endpoint port */
+		    (wsi->client_pipeline || (lwsi_role_http(wsi) &&
+		     (lwsi_state(w) == LRS_IDLING || w->client_mux_migrated)))) {
+			/*
+			 * ...and if the new guy didn't ask for pipelining,
+			 * we're only here because the vhost reuses idle http
+			 * connections, so the old guy must be idle or h2
+			 */
 
 			/*
 			 * There's already an active connection.
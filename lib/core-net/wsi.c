@@ -290,18 +290,14 @@ __lws_wsi_create_with_role(struct lws_context *context, int tsi,
 			   const struct lws_role_ops *ops,
 			   lws_log_cx_t *log_cx_template)
 {
-	size_t s = sizeof(struct lws);
 	struct lws *wsi;
 
 	assert(tsi >= 0 && tsi < LWS_MAX_SMP);
 
 	lws_context_assert_lock_held(context);
 
-#if defined(LWS_WITH_EVENT_LIBS)
-	s += context->event_loop_ops->evlib_size_wsi;
-#endif
-
-	wsi = lws_zalloc(s, __func__);
+	/* sized for the evlib part as well, see lws_create_context() */
+	wsi = lws_freelist_zalloc(&context->pt[tsi].fl_wsi, __func__);
 
 	if (!wsi) {
 		lwsl_cx_err(context, "OOM");
@@ -333,13 +329,24 @@ __lws_wsi_create_with_role(struct lws_context *context, int tsi,
 
 	if (lws_fi(&wsi->fic, "createfail")) {
 		lws_fi_destroy(&wsi->fic);
-		lws_free(wsi);
+		lws_wsi_free_mem(wsi);
 		return NULL;
 	}
 
 	return wsi;
 }
 
+/*
+ * Only for wsi that came from __lws_wsi_create_with_role(), the memory
+ * may go back on the pt free list for reuse
+ */
+
+void
+lws_wsi_free_mem(struct lws *wsi)
+{
+	lws_freelist_free(&wsi->a.context->pt[(int)wsi->tsi].fl_wsi, wsi);
+}
+
 int
 lws_wsi_inject_to_loop(struct lws_context_per_thread *pt, struct lws *wsi)
 {
@@ -1056,6 +1063,9 @@ _lws_generic_transaction_completed_active_conn(struct lws **_wsi, char take_vh_l
 	 */
 
 	if (!wsi->dll2_cli_txn_queue_owner.head) {
+		struct lws_vhost *vh = wsi->a.vhost;
+		int secs = wsi->keep_warm_secs;
+
 		/*
 		 * Nothing pipelined... we should hang around a bit
 		 * in case something turns up... otherwise we'll close
@@ -1063,8 +1073,20 @@ _lws_generic_transaction_completed_active_conn(struct lws **_wsi, char take_vh_l
 		lwsl_wsi_info(wsi, "nothing pipelined waiting");
 		lwsi_set_state(wsi, LRS_IDLING);
 
-		lws_set_timeout(wsi, PENDING_TIMEOUT_CLIENT_CONN_IDLE,
-				wsi->keep_warm_secs);
+		if (vh->cli_idle_secs)
+			secs = (int)vh->cli_idle_secs;
+
+		/* ... unless the vhost already has enough idle to there */
+
+		if (vh->cli_idle_max &&
+		    (unsigned int)lws_vhost_cli_idle_count(wsi, take_vh_lock) >
+							vh->cli_idle_max) {
+			lwsl_wsi_info(wsi, "origin has %u idle already",
+					   vh->cli_idle_max);
+			secs = LWS_TO_KILL_ASYNC;
+		}
+
+		lws_set_timeout(wsi, PENDING_TIMEOUT_CLIENT_CONN_IDLE, secs);
 
 		return 0; /* no new transaction right now */
 	}
@@ -361,6 +361,8 @@ static const struct lws_evlib_map {
 	{ LWS_SERVER_OPTION_LIBEV,    "evlib_ev" },
 	{ LWS_SERVER_OPTION_SDEVENT,  "evlib_sd" },
 	{ LWS_SERVER_OPTION_ULOOP,    "evlib_uloop" },
+	{ LWS_SERVER_OPTION_EPOLL,    "evlib_epoll" },
+	{ LWS_SERVER_OPTION_IO_URING, "evlib_io_uring" },
 };
 static const char * const dlist[] = {
 	".",				/* Priority 1: plugins in cwd */
@@ -589,6 +591,22 @@ lws_create_context(const struct lws_context_creation_info *info)
     }
 #endif
 
+#if defined(LWS_WITH_EPOLL)
+	if (lws_check_opt(info->options, LWS_SERVER_OPTION_EPOLL)) {
+		extern const lws_plugin_evlib_t evlib_epoll;
+		plev = &evlib_epoll;
+		us_wait_resolution = 0;
+	}
+#endif
+
+#if defined(LWS_WITH_IO_URING)
+	if (lws_check_opt(info->options, LWS_SERVER_OPTION_IO_URING)) {
+		extern const lws_plugin_evlib_t evlib_io_uring;
+		plev = &evlib_io_uring;
+		us_wait_resolution = 0;
+	}
+#endif
+
 #endif /* with event libs */
 
 #endif /* not with ev plugins */
@@ -625,6 +643,9 @@ lws_create_context(const struct lws_context_creation_info *info)
 		context->trust_cache = lws_cache_create(&ci);
 	}
 #endif
+#if defined(LWS_WITH_SYS_ASYNC_DNS)
+	context->async_dns.cache_max_items = info->async_dns_cache_max_items;
+#endif
 #endif
 #if defined(LWS_WITH_EVENT_LIBS)
 	/* at the very end */
@@ -650,6 +671,9 @@ lws_create_context(const struct lws_context_creation_info *info)
 
 	context->system_ops = info->system_ops;
 	context->pt_serv_buf_size = (unsigned int)s1;
+#if defined(LWS_ROLE_H2)
+	context->h2_tx_coalesce_size = info->h2_tx_coalesce_size;
+#endif
 	context->protocols_copy = info->protocols;
 #if defined(LWS_WITH_TLS_JIT_TRUST)
 	context->vh_idle_grace_ms = info->vh_idle_grace_ms ?
@@ -779,6 +803,26 @@ lws_create_context(const struct lws_context_creation_info *info)
 					     LWSMTFL_REPORT_HIST, "n.srv");
 #endif /* network + metrics + server */
 
+#if defined(LWS_ROLE_WS) && defined(LWS_WITH_WS_RX_POOL)
+	context->mt_ws_rx_pool = lws_metric_create(context,
+						   LWSMTFL_REPORT_MEAN,
+						   "n.ws.rxpool");
+#endif
+#if defined(LWS_WITH_TLS_HANDSHAKE_OFFLOAD)
+	context->mt_tls_hs_queue = lws_metric_create(context,
+						     LWSMTFL_REPORT_MEAN,
+						     "n.srv.tls.hsq");
+	context->mt_tls_hs_lat = lws_metric_create(context,
+						   LWSMTFL_REPORT_MEAN |
+						   LWSMTFL_REPORT_DUTY_WALLCLOCK_US,
+						   "n.srv.tls.hs");
+#endif
+#if defined(LWS_WITH_TLS_SESSIONS) && defined(LWS_WITH_CLIENT)
+	context->mt_tls_sess = lws_metric_create(context, 0, "n.cli.tls.sess");
+	context->mt_tls_resume = lws_metric_create(context, 0,
+						   "n.cli.tls.resume");
+#endif
+
 #endif /* network + metrics */
 
 #endif /* network */
@@ -1108,6 +1152,8 @@ lws_create_context(const struct lws_context_creation_info *info)
 				info->retry_and_idle_policy->secs_since_valid_hangup;
 	}
 
+	context->conn_freelist_max = info->conn_freelist_max;
+
 	/*
 	 * Allocate the per-thread storage for scratchpad buffers,
 	 * and header data pool
@@ -1143,6 +1189,22 @@ lws_create_context(const struct lws_context_creation_info *info)
 #endif
 		lws_pt_mutex_init(&context->pt[n]);
 
+		lws_freelist_init(&context->pt[n].fl_wsi, sizeof(struct lws)
+#if defined(LWS_WITH_EVENT_LIBS)
+				  + plev->ops->evlib_size_wsi
+#endif
+				  , context->conn_freelist_max);
+#if defined(LWS_ROLE_WS)
+		lws_freelist_init(&context->pt[n].fl_ws,
+				  sizeof(struct _lws_websocket_related),
+				  context->conn_freelist_max);
+#endif
+#if defined(LWS_ROLE_H2)
+		lws_freelist_init(&context->pt[n].fl_h2n,
+				  sizeof(struct lws_h2_netconn),
+				  context->conn_freelist_max);
+#endif
+
 #if defined(LWS_WITH_CGI)
 		if (lws_rops_fidx(&role_ops_cgi, LWS_ROPS_pt_init_destroy))
 			(lws_rops_func_fidx(&role_ops_cgi, LWS_ROPS_pt_init_destroy)).
@@ -1157,15 +1219,7 @@ lws_create_context(const struct lws_context_creation_info *info)
 	}
 
 #if defined(LWS_WITH_PEER_LIMITS)
-	/* scale the peer hash table according to the max fds for the process,
-	 * so that the max list depth averages 16.  Eg, 1024 fd -> 64,
-	 * 102400 fd -> 6400
-	 */
-
-	context->pl_hash_elements =
-		(context->count_threads * context->fd_limit_per_thread) / 16;
-	context->pl_hash_table = lws_zalloc(sizeof(struct lws_peer *) *
-			context->pl_hash_elements, "peer limits hash table");
+	lws_peer_limits_init(context);
 
 	context->ip_limit_ah = info->ip_limit_ah;
 	context->ip_limit_wsi = info->ip_limit_wsi;
@@ -1220,6 +1274,13 @@ lws_create_context(const struct lws_context_creation_info *info)
 				     context->fd_limit_per_thread;
 #endif
 
+#if defined(LWS_WITH_ACCESS_LOG_ASYNC)
+	if (lws_access_log_async_init(context, info->access_log_queue_size)) {
+		lwsl_cx_err(context, "OOM starting access log writer");
+		goto free_context_fail;
+	}
+#endif
+
 
 	/*
 	 * Past here, we may have added handles to the event lib
@@ -1271,6 +1332,11 @@ lws_create_context(const struct lws_context_creation_info *info)
 
 	lws_context_init_ssl_library(context, info);
 
+#if defined(LWS_WITH_TLS_HANDSHAKE_OFFLOAD)
+	if (lws_tls_hs_offload_init(context, info))
+		goto bail_libuv_aware;
+#endif
+
 	context->user_space = info->user;
 
 #if defined(LWS_WITH_SERVER)
@@ -1389,7 +1455,7 @@ lws_create_context(const struct lws_context_creation_info *info)
 			lwsl_cx_err(context, "Failed to create default vhost");
 
 #if defined(LWS_WITH_PEER_LIMITS)
-			lws_free_set_NULL(context->pl_hash_table);
+			lws_peer_limits_destroy(context);
 #endif
 			goto bail;
 		}
@@ -1717,6 +1783,10 @@ lws_pt_destroy(struct lws_context_per_thread *pt)
 			_lws_destroy_ah(pt, pt->http.ah_list);
 #endif
 
+#endif
+
+#if defined(LWS_ROLE_WS) && defined(LWS_WITH_WS_RX_POOL)
+	lws_ws_rx_pool_destroy(pt);
 #endif
 
 	lws_pt_unlock(pt);
@@ -1769,9 +1839,6 @@ lws_context_destroy(struct lws_context *context)
 	struct lws_context_per_thread *pt;
 	struct lws_vhost *vh = NULL, *vh1;
 	int alive = 0, deferred_pt = 0;
-#endif
-#if defined(LWS_WITH_PEER_LIMITS)
-	uint32_t nu;
 #endif
 	int n;
 
@@ -2017,24 +2084,22 @@ next:
 		while (context->vhost_pending_destruction_list)
 			/* removes itself from list */
 			__lws_vhost_destroy2(context->vhost_pending_destruction_list);
+
+		lws_free_set_NULL(context->vhost_name_hash);
 #endif
 
+#if defined(LWS_WITH_TLS_HANDSHAKE_OFFLOAD)
+		/* every wsi has gone, so nothing can have a handshake step
+		 * with the workers any more */
+		lws_tls_hs_offload_destroy(context);
+#endif
 #if defined(LWS_WITH_NETWORK)
 		lws_ssl_context_destroy(context);
 #endif
 		lws_plat_context_late_destroy(context);
 
 #if defined(LWS_WITH_PEER_LIMITS)
-		for (nu = 0; nu < context->pl_hash_elements; nu++)	{
-			lws_start_foreach_llp(struct lws_peer **, peer,
-					      context->pl_hash_table[nu]) {
-				struct lws_peer *df = *peer;
-				*peer = df->next;
-				lws_free(df);
-				continue;
-			} lws_end_foreach_llp(peer, next);
-		}
-		lws_free(context->pl_hash_table);
+		lws_peer_limits_destroy(context);
 #endif
 
 #if defined(LWS_WITH_NETWORK)
@@ -2060,6 +2125,7 @@ next:
 #if defined(LWS_ROLE_H1) || defined(LWS_ROLE_H2)
 			while (pt->http.ah_list)
 				_lws_destroy_ah(pt, pt->http.ah_list);
+			_lws_ah_free_list_destroy(pt);
 #endif
 			lwsl_cx_info(context, "pt destroy %d", n);
 			lws_pt_destroy(pt);
@@ -2102,6 +2168,10 @@ next:
 #if defined(LWS_WITH_SYS_STATE)
 		lws_state_transition_steps(&context->mgr_system,
 					   LWS_SYSTATE_CONTEXT_DESTROYING);
+#endif
+#if defined(LWS_WITH_ACCESS_LOG_ASYNC)
+		/* the vhosts have gone, write anything still queued */
+		lws_access_log_async_destroy(context);
 #endif
 		/*
 		 * finalize destroy of pt and things hanging off it
@@ -2125,6 +2195,15 @@ next:
 						pt_init_destroy(context, NULL, pt, 1);
 		#endif
 
+			lws_freelist_destroy(&pt->fl_wsi);
+#if defined(LWS_ROLE_WS)
+			lws_freelist_destroy(&pt->fl_ws);
+#endif
+#if defined(LWS_ROLE_H2)
+			lws_freelist_destroy(&pt->fl_h2n);
+			lws_free_set_NULL(pt->h2_tx_coalesce);
+#endif
+
 			lws_pt_mutex_destroy(pt);
 			assert(!pt->is_destroyed);
 			pt->destroy_self = 0;
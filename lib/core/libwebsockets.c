@@ -61,7 +61,8 @@ lws_ser_ru16be(const uint8_t *b)
 uint32_t
 lws_ser_ru32be(const uint8_t *b)
 {
-	return (unsigned int)((b[0] << 24) | (b[1] << 16) | (b[2] << 8) | b[3]);
+	return ((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16) |
+	       ((uint32_t)b[2] << 8) | (uint32_t)b[3];
 }
 
 uint64_t
@@ -65,7 +65,8 @@
  #include <sys/stat.h>
 #endif
 
-#if LWS_MAX_SMP > 1 || defined(LWS_WITH_SYS_SMD)
+#if LWS_MAX_SMP > 1 || defined(LWS_WITH_SYS_SMD) || \
+    defined(LWS_WITH_ACCESS_LOG_ASYNC)
  /* https://stackoverflow.com/questions/33557506/timespec-redefinition-error */
  #define HAVE_STRUCT_TIMESPEC
  #include <pthread.h>
@@ -435,6 +436,23 @@ typedef struct lws_ss_sinks {
  *  - contextwide headers pool
  */
 
+#if defined(LWS_WITH_PEER_LIMITS)
+/*
+ * The peer hash table buckets are shared out between a fixed number of
+ * stripes, each with its own lock and wait list, so service threads accepting
+ * connections from different peers don't serialize on one lock
+ */
+#define LWS_PEER_STRIPES 16 /* must be a power of 2 */
+
+struct lws_peer_stripe {
+#if LWS_MAX_SMP > 1
+	pthread_mutex_t			lock;
+#endif
+	lws_dll2_owner_t		wait_owner;	/* protected by lock */
+	uint32_t			count_peers;	/* protected by lock */
+};
+#endif
+
 struct lws_context {
  #if defined(LWS_WITH_SERVER)
 	char canonical_hostname[96];
@@ -528,6 +546,21 @@ struct lws_context {
 #if defined(LWS_WITH_SERVER)
 	lws_metric_t			*mth_srv;
 #endif
+#if defined(LWS_ROLE_WS) && defined(LWS_WITH_WS_RX_POOL)
+	lws_metric_t			*mt_ws_rx_pool; /* ws rx buffers lent */
+#endif
+#if defined(LWS_WITH_TLS_HANDSHAKE_OFFLOAD)
+	lws_metric_t			*mt_tls_hs_queue; /* hs steps offloaded */
+	lws_metric_t			*mt_tls_hs_lat; /* offloaded hs step latency */
+#endif
+#if defined(LWS_WITH_TLS_SESSIONS) && defined(LWS_WITH_CLIENT)
+	lws_metric_t			*mt_tls_sess; /* session cache hit / miss */
+	lws_metric_t			*mt_tls_resume; /* server resumed session */
+#endif
+
+#if defined(LWS_WITH_ACCESS_LOG_ASYNC)
+	struct lws_alog_writer		alog;
+#endif
 
 #if defined(LWS_WITH_EVENT_LIBS)
 	struct lws_plugin		*evlib_plugin_list;
@@ -591,6 +624,10 @@ struct lws_context {
 	struct lws_vhost		*no_listener_vhost_list;
 	struct lws_vhost		*vhost_pending_destruction_list;
 	struct lws_vhost		*vhost_system;
+	lws_dll2_owner_t		*vhost_name_hash;
+					/**< buckets of vhosts by name */
+	unsigned int			vhost_name_hash_buckets;
+	unsigned int			count_vhost_names;
 
 #if defined(LWS_WITH_SERVER)
 	const char			*server_string;
@@ -653,10 +690,9 @@ struct lws_context {
 #endif
 
 #if defined(LWS_WITH_PEER_LIMITS)
+	struct lws_peer_stripe		pl_stripe[LWS_PEER_STRIPES];
 	struct lws_peer			**pl_hash_table;
-	struct lws_peer			*peer_wait_list;
 	lws_peer_limits_notify_t	pl_notify_cb;
-	time_t				next_cull;
 #endif
 
 	const lws_system_ops_t		*system_ops;
@@ -724,8 +760,12 @@ struct lws_context {
 	unsigned int fd_limit_per_thread;
 	unsigned int timeout_secs;
 	unsigned int pt_serv_buf_size;
+#if defined(LWS_ROLE_H2)
+	unsigned int h2_tx_coalesce_size;
+#endif
 	unsigned int max_http_header_data;
 	unsigned int max_http_header_pool;
+	unsigned int conn_freelist_max;
 	int simultaneous_ssl_restriction;
 	int simultaneous_ssl;
 	int simultaneous_ssl_handshake_restriction;
@@ -734,8 +774,7 @@ struct lws_context {
 	int		vh_idle_grace_ms;
 #endif
 #if defined(LWS_WITH_PEER_LIMITS)
-	uint32_t pl_hash_elements;	/* protected by context->lock */
-	uint32_t count_peers;		/* protected by context->lock */
+	uint32_t pl_hash_elements;	/* set at context creation */
 	unsigned short ip_limit_ah;
 	unsigned short ip_limit_wsi;
 #endif
@@ -0,0 +1,439 @@
+/*
+ * libwebsockets - small server side websockets and web server implementation
+ *
+ * Copyright (C) 2010 - 2026 Andy Green <andy@warmcat.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "private-lib-core.h"
+#include "private-lib-event-libs-epoll.h"
+
+#include <sys/timerfd.h>
+
+#define pt_to_priv_epoll(_pt) ((struct lws_pt_eventlibs_epoll *)(_pt)->evlib_pt)
+#define wsi_to_priv_epoll(_w) ((struct lws_wsi_eventlibs_epoll *)(_w)->evlib_wsi)
+
+/*
+ * Bring the kernel's idea of what we are waiting for on this wsi's fd into
+ * line with what lws wants, adding, modifying or removing it from the pt
+ * epoll set as needed.  We are level-triggered, so we get the same
+ * semantics lws has from poll(), just without the per-wait walk of every fd.
+ */
+
+static void
+lws_epoll_sync(struct lws_pt_eventlibs_epoll *ptpr, struct lws *wsi)
+{
+	struct lws_wsi_eventlibs_epoll *w = wsi_to_priv_epoll(wsi);
+	struct epoll_event ev;
+	int op;
+
+	if (!w->events) {
+		if (!w->registered)
+			return;
+
+		/* fd may already be closed, ENOENT / EBADF are fine */
+		epoll_ctl(ptpr->epfd, EPOLL_CTL_DEL, wsi->desc.sockfd, NULL);
+		w->registered = 0;
+
+		return;
+	}
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = w->events;
+	ev.data.fd = wsi->desc.sockfd;
+
+	op = w->registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+
+	if (epoll_ctl(ptpr->epfd, op, wsi->desc.sockfd, &ev)) {
+		/*
+		 * EPERM means something like a regular file, that epoll
+		 * cannot wait on
+		 */
+		lwsl_wsi_warn(wsi, "epoll_ctl %d fd %d failed: errno %d",
+				   op, wsi->desc.sockfd, LWS_ERRNO);
+		return;
+	}
+
+	w->registered = 1;
+}
+
+/*
+ * Only used with a foreign loop: arrange that our nested epoll fd becomes
+ * readable when the next sul is due, or asap if somebody needs forced
+ * service, so the foreign loop calls back into us in time.
+ */
+
+static void
+lws_epoll_arm_timer(struct lws_context_per_thread *pt)
+{
+	struct lws_pt_eventlibs_epoll *ptpr = pt_to_priv_epoll(pt);
+	struct itimerspec its;
+	lws_usec_t us;
+
+	lws_pt_lock(pt, __func__);
+	us = __lws_sul_service_ripe(pt->pt_sul_owner, LWS_COUNT_PT_SUL_OWNERS,
+				    lws_now_usecs());
+	lws_pt_unlock(pt);
+
+	if (!lws_service_adjust_timeout(pt->context, 1, pt->tid))
+		us = LWS_US_PER_MS;
+
+	memset(&its, 0, sizeof(its));
+	if (us) {
+		its.it_value.tv_sec = (time_t)(us / LWS_US_PER_SEC);
+		its.it_value.tv_nsec = (long)((us % LWS_US_PER_SEC) * 1000);
+	}
+
+	/* all-zero it_value disarms it, which is what we want if no sul */
+	timerfd_settime(ptpr->timerfd, 0, &its, NULL);
+}
+
+static int
+elops_init_pt_epoll(struct lws_context *context, void *_loop, int tsi)
+{
+	struct lws_context_per_thread *pt = &context->pt[tsi];
+	struct lws_pt_eventlibs_epoll *ptpr = pt_to_priv_epoll(pt);
+	struct epoll_event ev;
+	unsigned int n;
+
+	ptpr->pt = pt;
+	ptpr->timerfd = -1;
+
+	ptpr->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if (ptpr->epfd < 0) {
+		lwsl_cx_err(context, "epoll_create1 failed: errno %d",
+			    LWS_ERRNO);
+
+		return -1;
+	}
+
+	if (_loop) {
+		/*
+		 * The foreign loop is represented by a pointer to its epoll
+		 * fd.  We keep our own epoll set per pt and nest it inside
+		 * the foreign one, the foreign loop must call
+		 * lws_service_tsi() when it sees an event whose data.ptr is
+		 * the same pointer it gave us in foreign_loops[tsi].
+		 *
+		 * Since the foreign loop owns the wait, our sul have to be
+		 * signalled by a timerfd inside our set.
+		 */
+		ptpr->timerfd = timerfd_create(CLOCK_MONOTONIC,
+					       TFD_NONBLOCK | TFD_CLOEXEC);
+		if (ptpr->timerfd < 0)
+			goto bail;
+
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN;
+		ev.data.fd = ptpr->timerfd;
+		if (epoll_ctl(ptpr->epfd, EPOLL_CTL_ADD, ptpr->timerfd, &ev))
+			goto bail;
+
+		ptpr->foreign_epfd = (int *)_loop;
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN;
+		ev.data.ptr = _loop;
+		if (epoll_ctl(*ptpr->foreign_epfd, EPOLL_CTL_ADD, ptpr->epfd,
+			      &ev)) {
+			lwsl_cx_err(context, "unable to nest in foreign epoll");
+			ptpr->foreign_epfd = NULL;
+			goto bail;
+		}
+
+		pt->event_loop_foreign = 1;
+	}
+
+	ptpr->init_done = 1;
+
+	/*
+	 * Anything that was already inserted into the pt fds before we had
+	 * an epoll set, eg, vhost listen sockets, must be registered now
+	 */
+
+	for (n = 0; n < pt->fds_count; n++) {
+		struct lws *wsi = wsi_from_fd(context, pt->fds[n].fd);
+
+		if (wsi)
+			lws_epoll_sync(ptpr, wsi);
+	}
+
+	lwsl_cx_info(context, "tsi %d: epoll fd %d%s", tsi, ptpr->epfd,
+		     _loop ? " (foreign)" : "");
+
+	return 0;
+
+bail:
+	if (ptpr->timerfd >= 0)
+		close(ptpr->timerfd);
+	ptpr->timerfd = -1;
+	close(ptpr->epfd);
+	ptpr->epfd = -1;
+
+	return -1;
+}
+
+static void
+elops_io_epoll(struct lws *wsi, unsigned int flags)
+{
+	struct lws_context_per_thread *pt = &wsi->a.context->pt[(int)wsi->tsi];
+	struct lws_pt_eventlibs_epoll *ptpr = pt_to_priv_epoll(pt);
+	struct lws_wsi_eventlibs_epoll *w = wsi_to_priv_epoll(wsi);
+	uint32_t m = (uint32_t)(((flags & LWS_EV_WRITE) ? EPOLLOUT : 0) |
+				((flags & LWS_EV_READ) ? EPOLLIN : 0));
+
+	assert((flags & (LWS_EV_START | LWS_EV_STOP)) &&
+	       (flags & (LWS_EV_READ | LWS_EV_WRITE)));
+
+	if (flags & LWS_EV_START)
+		w->events |= m;
+	else
+		w->events &= ~m;
+
+	/* if the pt isn't up yet, init_pt will register what we wanted */
+
+	if (!ptpr->init_done || pt->is_destroyed)
+		return;
+
+	lws_epoll_sync(ptpr, wsi);
+}
+
+/*
+ * One wait and service pass.  Returns 0 if the caller may continue looping,
+ * nonzero if it must return (interrupted by a signal, or the pt is going
+ * away and must not be touched any more).
+ */
+
+static int
+lws_epoll_service_once(struct lws_context *context, int tsi)
+{
+	struct lws_context_per_thread *pt = &context->pt[tsi];
+	struct lws_pt_eventlibs_epoll *ptpr = pt_to_priv_epoll(pt);
+	volatile struct lws_context_per_thread *vpt =
+				(volatile struct lws_context_per_thread *)pt;
+	int n, m, timeout_ms = -1;
+	lws_usec_t us;
+
+	if (!ptpr->init_done || pt->is_destroyed || context->interrupted)
+		return 1;
+
+	lws_pt_lock(pt, __func__);
+	us = __lws_sul_service_ripe(pt->pt_sul_owner, LWS_COUNT_PT_SUL_OWNERS,
+				    lws_now_usecs());
+	lws_pt_unlock(pt);
+
+	if (us)
+		/* round up, so we don't wake just before it is due */
+		timeout_ms = us >= (lws_usec_t)2000000000 * LWS_US_PER_MS ?
+				2000000000 :
+				(int)((us + LWS_US_PER_MS - 1) / LWS_US_PER_MS);
+
+	/*
+	 * If a foreign loop is calling us, it only does so because our set is
+	 * already readable, we must never block it
+	 */
+
+	if (ptpr->foreign_epfd ||
+	    !lws_service_adjust_timeout(context, 1, tsi))
+		timeout_ms = 0;
+
+	vpt->inside_poll = 1;
+	lws_memory_barrier();
+	n = epoll_wait(ptpr->epfd, ptpr->ev, LWS_EPOLL_BATCH, timeout_ms);
+	vpt->inside_poll = 0;
+	lws_memory_barrier();
+
+	if (n < 0)
+		/* EINTR: let the user code see its signal handler effects */
+		return 1;
+
+	/*
+	 * We only visit the fds that actually have something to say.
+	 *
+	 * Servicing one may close it, and the fd number may even be reused by
+	 * a new connection accepted later in the same batch.  That's OK, we
+	 * always look the wsi up again by fd, and at worst the new guy gets a
+	 * spurious POLLIN or POLLOUT, which lws already copes with.
+	 */
+
+	for (m = 0; m < n; m++) {
+		struct epoll_event *e = &ptpr->ev[m];
+		struct lws_pollfd pfd;
+		struct lws *wsi;
+
+		if (ptpr->foreign_epfd && e->data.fd == ptpr->timerfd) {
+			uint64_t ticks;
+
+			if (read(ptpr->timerfd, &ticks, sizeof(ticks)) < 0)
+				lwsl_cx_debug(context, "timerfd read failed");
+			continue;
+		}
+
+		wsi = wsi_from_fd(context, e->data.fd);
+		if (!wsi || wsi->position_in_fds_table == LWS_NO_FDS_POS)
+			continue;
+
+		pfd.fd = e->data.fd;
+		pfd.events = pt->fds[wsi->position_in_fds_table].events;
+		pfd.revents = (short)(e->events & (EPOLLIN | EPOLLOUT));
+		if (e->events & (EPOLLHUP | EPOLLERR))
+			pfd.revents = (short)(pfd.revents | LWS_POLLHUP);
+
+		if (lws_service_fd_tsi(context, &pfd, tsi) < 0) {
+			lwsl_cx_err(context, "lws_service_fd_tsi failed");
+			break;
+		}
+	}
+
+	/*
+	 * Is anybody holding buffered rx, tls or ext data that needs service
+	 * without waiting for the network?
+	 */
+
+	if (!lws_service_adjust_timeout(context, 1, tsi))
+		_lws_plat_service_forced_tsi(context, tsi);
+	else
+		lws_service_do_ripe_rxflow(pt);
+
+	if (pt->destroy_self) {
+		lws_context_destroy(pt->context);
+		return 1;
+	}
+
+	if (ptpr->foreign_epfd && !pt->is_destroyed)
+		lws_epoll_arm_timer(pt);
+
+	return 0;
+}
+
+static void
+elops_run_pt_epoll(struct lws_context *context, int tsi)
+{
+	/*
+	 * With a foreign loop, we are only called when our nested set became
+	 * readable, so do exactly one nonblocking pass.  Otherwise, like the
+	 * other event libs, run_pt means run the loop until it's stopped.
+	 */
+
+	if (pt_to_priv_epoll(&context->pt[tsi])->foreign_epfd) {
+		lws_epoll_service_once(context, tsi);
+		return;
+	}
+
+	while (!lws_epoll_service_once(context, tsi))
+		;
+}
+
+static void
+elops_destroy_pt_epoll(struct lws_context *context, int tsi)
+{
+	struct lws_context_per_thread *pt = &context->pt[tsi];
+	struct lws_pt_eventlibs_epoll *ptpr = pt_to_priv_epoll(pt);
+
+	if (!ptpr->init_done)
+		return;
+
+	ptpr->init_done = 0;
+
+	if (ptpr->foreign_epfd) {
+		/* leave the foreign loop exactly as we found it */
+		epoll_ctl(*ptpr->foreign_epfd, EPOLL_CTL_DEL, ptpr->epfd, NULL);
+		ptpr->foreign_epfd = NULL;
+	}
+
+	if (ptpr->timerfd >= 0)
+		close(ptpr->timerfd);
+	ptpr->timerfd = -1;
+
+	close(ptpr->epfd);
+	ptpr->epfd = -1;
+}
+
+static void
+elops_destroy_wsi_epoll(struct lws *wsi)
+{
+	struct lws_context_per_thread *pt;
+	struct lws_wsi_eventlibs_epoll *w;
+
+	if (!wsi)
+		return;
+
+	pt = &wsi->a.context->pt[(int)wsi->tsi];
+	w = wsi_to_priv_epoll(wsi);
+	w->events = 0;
+
+	if (pt_to_priv_epoll(pt)->init_done)
+		lws_epoll_sync(pt_to_priv_epoll(pt), wsi);
+
+	w->registered = 0;
+}
+
+static int
+elops_foreign_thread_epoll(struct lws_context *cx, int tsi)
+{
+	volatile struct lws_context_per_thread *vpt =
+			(volatile struct lws_context_per_thread *)&cx->pt[tsi];
+
+	/* same logic as the default poll() loop */
+
+	return vpt->inside_poll;
+}
+
+static const struct lws_event_loop_ops event_loop_ops_epoll = {
+	/* name */			"epoll",
+	/* init_context */		NULL,
+	/* destroy_context1 */		NULL,
+	/* destroy_context2 */		NULL,
+	/* init_vhost_listen_wsi */	NULL,
+	/* init_pt */			elops_init_pt_epoll,
+	/* wsi_logical_close */		NULL,
+	/* check_client_connect_ok */	NULL,
+	/* close_handle_manually */	NULL,
+	/* accept */			NULL,
+	/* io */			elops_io_epoll,
+	/* run_pt */			elops_run_pt_epoll,
+	/* destroy_pt */		elops_destroy_pt_epoll,
+	/* destroy wsi */		elops_destroy_wsi_epoll,
+	/* foreign_thread */		elops_foreign_thread_epoll,
+
+	/*
+	 * we are a synchronous, level-triggered fd wait just like poll(), so
+	 * we can also take part in the graceful shutdown flush
+	 */
+	/* flags */			LELOF_ISPOLL,
+
+	/* evlib_size_ctx */	0,
+	/* evlib_size_pt */	sizeof(struct lws_pt_eventlibs_epoll),
+	/* evlib_size_vh */	0,
+	/* evlib_size_wsi */	sizeof(struct lws_wsi_eventlibs_epoll),
+};
+
+#if defined(LWS_WITH_EVLIB_PLUGINS)
+LWS_VISIBLE
+#endif
+const lws_plugin_evlib_t evlib_epoll = {
+	.hdr = {
+		"epoll event loop",
+		"lws_evlib_plugin",
+		LWS_BUILD_HASH,
+		LWS_PLUGIN_API_MAGIC
+	},
+
+	.ops	= &event_loop_ops_epoll
+};
@@ -0,0 +1,45 @@
+/*
+ * libwebsockets - small server side websockets and web server implementation
+ *
+ * Copyright (C) 2010 - 2026 Andy Green <andy@warmcat.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <sys/epoll.h>
+
+/*
+ * How many ready fds we collect from one epoll_wait().  If more are ready,
+ * they stay ready (we are level-triggered) and are collected next time.
+ */
+#define LWS_EPOLL_BATCH 128
+
+struct lws_pt_eventlibs_epoll {
+	struct lws_context_per_thread		*pt;
+	int					*foreign_epfd;
+	struct epoll_event			ev[LWS_EPOLL_BATCH];
+	int					epfd;
+	int					timerfd; /* foreign loop only */
+	uint8_t					init_done;
+};
+
+struct lws_wsi_eventlibs_epoll {
+	uint32_t				events;
+	uint8_t					registered;
+};
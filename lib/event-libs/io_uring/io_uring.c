@@ -0,0 +1,698 @@
+/*
+ * libwebsockets - small server side websockets and web server implementation
+ *
+ * Copyright (C) 2010 - 2026 Andy Green <andy@warmcat.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "private-lib-core.h"
+#include "private-lib-event-libs-io_uring.h"
+
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/epoll.h>
+
+#define pt_to_priv_uring(_pt) ((struct lws_pt_eventlibs_io_uring *)(_pt)->evlib_pt)
+#define wsi_to_priv_uring(_w) ((struct lws_wsi_eventlibs_io_uring *)(_w)->evlib_wsi)
+
+/*
+ * This talks to the kernel directly, the amount of io_uring we need is
+ * small enough that it isn't worth bringing in liburing as a dependency.
+ *
+ * Readiness is done with oneshot IORING_OP_POLL_ADD that we rearm after each
+ * service.  Multishot poll is edge-triggered, but lws relies on level-
+ * triggered semantics: it doesn't always drain everything on POLLIN, eg,
+ * because of rx flow control or limited rx buffer size, and would stall.  The
+ * win comes from batching: all the rearms and any poll changes made while
+ * servicing go to the kernel together with the next wait in a single
+ * io_uring_enter(), and all ready completions come back in one go.
+ */
+
+static int
+lws_uring_sys_enter(int fd, unsigned int to_submit, unsigned int min_complete,
+		    unsigned int flags, void *arg, size_t argsz)
+{
+	return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+			    flags, arg, argsz);
+}
+
+/*
+ * Publish any sqes we prepared, and optionally wait for at least one
+ * completion or the timeout.  timeout_us < 0 means wait forever.
+ */
+
+static int
+lws_uring_enter(struct lws_pt_eventlibs_io_uring *ptpr, int wait,
+		lws_usec_t timeout_us)
+{
+	struct io_uring_getevents_arg arg;
+	unsigned int to_submit, flags = 0;
+	void *parg = NULL;
+	size_t argsz = 0;
+
+	__atomic_store_n(ptpr->sq.ktail, ptpr->sq.tail, __ATOMIC_RELEASE);
+	to_submit = ptpr->sq.tail -
+			__atomic_load_n(ptpr->sq.khead, __ATOMIC_ACQUIRE);
+
+	if (!to_submit && !wait)
+		return 0;
+
+	if (wait) {
+		flags |= IORING_ENTER_GETEVENTS;
+		if (timeout_us >= 0) {
+			memset(&arg, 0, sizeof(arg));
+			ptpr->ts.tv_sec = (long long)(timeout_us /
+							LWS_US_PER_SEC);
+			ptpr->ts.tv_nsec = (long long)((timeout_us %
+							LWS_US_PER_SEC) * 1000);
+			arg.ts = (uint64_t)(uintptr_t)&ptpr->ts;
+			flags |= IORING_ENTER_EXT_ARG;
+			parg = &arg;
+			argsz = sizeof(arg);
+		}
+	}
+
+	return lws_uring_sys_enter(ptpr->ring_fd, to_submit,
+				   wait ? 1 : 0, flags, parg, argsz);
+}
+
+/* requires pt lock, since io() may be called by foreign threads */
+
+static struct io_uring_sqe *
+lws_uring_get_sqe(struct lws_pt_eventlibs_io_uring *ptpr)
+{
+	struct io_uring_sqe *sqe;
+
+	if (ptpr->sq.tail - __atomic_load_n(ptpr->sq.khead, __ATOMIC_ACQUIRE) >=
+						*ptpr->sq.kring_entries) {
+		/* sq is full, push what we have to the kernel */
+		lws_uring_enter(ptpr, 0, 0);
+		if (ptpr->sq.tail -
+		    __atomic_load_n(ptpr->sq.khead, __ATOMIC_ACQUIRE) >=
+						*ptpr->sq.kring_entries)
+			return NULL;
+	}
+
+	sqe = &ptpr->sq.sqes[ptpr->sq.tail & *ptpr->sq.kring_mask];
+	ptpr->sq.tail++;
+	memset(sqe, 0, sizeof(*sqe));
+
+	return sqe;
+}
+
+/*
+ * Make the poll the kernel has in flight for this wsi match what lws wants.
+ * It's idempotent, so it's safe to call after service on whatever wsi now
+ * holds the fd.
+ *
+ * If the kernel won't take any more sqes even after we submitted what we
+ * have, eg, because the cq is backed up, the wsi goes on the pt's unarmed
+ * list and we try it again after the next wait has reaped completions.
+ */
+
+static void
+lws_uring_arm(struct lws_pt_eventlibs_io_uring *ptpr, struct lws *wsi)
+{
+	struct lws_wsi_eventlibs_io_uring *w = wsi_to_priv_uring(wsi);
+	struct io_uring_sqe *sqe;
+	uint32_t ev;
+
+	if (w->gen) {
+		if (w->armed_events == w->events)
+			return;
+
+		sqe = lws_uring_get_sqe(ptpr);
+		if (!sqe)
+			goto oom;
+		sqe->opcode = IORING_OP_POLL_REMOVE;
+		sqe->fd = -1;
+		sqe->addr = lws_uring_ud(w->gen, wsi->desc.sockfd);
+		sqe->user_data = lws_uring_ud(0, 0);
+		w->gen = 0;
+
+		if (!w->events) {
+			/*
+			 * The in-flight poll holds a reference on the file,
+			 * so the socket won't really close until the kernel
+			 * has seen the remove... don't wait for the next loop
+			 */
+			lws_uring_enter(ptpr, 0, 0);
+
+			return;
+		}
+	}
+
+	if (!w->events)
+		return;
+
+	sqe = lws_uring_get_sqe(ptpr);
+	if (!sqe)
+		goto oom;
+
+	if (!++ptpr->gen)
+		ptpr->gen = 1;
+
+	ev = w->events;
+#if __BYTE_ORDER == __BIG_ENDIAN
+	ev = (ev << 16) | (ev >> 16);
+#endif
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = wsi->desc.sockfd;
+	sqe->poll32_events = ev;
+	sqe->user_data = lws_uring_ud(ptpr->gen, wsi->desc.sockfd);
+
+	w->gen = ptpr->gen;
+	w->armed_events = w->events;
+	lws_dll2_remove(&w->list_unarmed);
+
+	return;
+
+oom:
+	lwsl_wsi_info(wsi, "no sqe, deferring");
+	w->wsi = wsi;
+	if (lws_dll2_is_detached(&w->list_unarmed))
+		lws_dll2_add_tail(&w->list_unarmed, &ptpr->unarmed);
+}
+
+/* requires pt lock */
+
+static void
+lws_uring_arm_deferred(struct lws_pt_eventlibs_io_uring *ptpr)
+{
+	lws_start_foreach_dll_safe(struct lws_dll2 *, d, d1,
+				   lws_dll2_get_head(&ptpr->unarmed)) {
+		struct lws_wsi_eventlibs_io_uring *w = lws_container_of(d,
+				struct lws_wsi_eventlibs_io_uring, list_unarmed);
+
+		lws_dll2_remove(d);
+		lws_uring_arm(ptpr, w->wsi);
+		if (!lws_dll2_is_detached(d))
+			/* still no sqe, leave the rest for next time */
+			break;
+	} lws_end_foreach_dll_safe(d, d1);
+}
+
+/*
+ * Only used with a foreign loop: have a timeout complete in our ring when
+ * the next sul is due, so our ring fd becomes readable in the foreign loop
+ */
+
+static void
+lws_uring_arm_timer(struct lws_context_per_thread *pt)
+{
+	struct lws_pt_eventlibs_io_uring *ptpr = pt_to_priv_uring(pt);
+	struct io_uring_sqe *sqe;
+	lws_usec_t us;
+
+	lws_pt_lock(pt, __func__);
+	us = __lws_sul_service_ripe(pt->pt_sul_owner, LWS_COUNT_PT_SUL_OWNERS,
+				    lws_now_usecs());
+	lws_pt_unlock(pt);
+
+	if (!lws_service_adjust_timeout(pt->context, 1, pt->tid))
+		us = LWS_US_PER_MS;
+
+	lws_pt_lock(pt, __func__);
+
+	if (ptpr->timeout_armed) {
+		sqe = lws_uring_get_sqe(ptpr);
+		if (!sqe)
+			goto bail;
+		sqe->opcode = IORING_OP_TIMEOUT_REMOVE;
+		sqe->fd = -1;
+		sqe->addr = lws_uring_ud(0, ptpr->tgen);
+		sqe->user_data = lws_uring_ud(0, 0);
+		ptpr->timeout_armed = 0;
+	}
+
+	if (us) {
+		sqe = lws_uring_get_sqe(ptpr);
+		if (!sqe)
+			goto bail;
+
+		if (!++ptpr->tgen)
+			ptpr->tgen = 1;
+
+		/* the kernel takes a copy of ts during the submit below */
+		ptpr->ts.tv_sec = (long long)(us / LWS_US_PER_SEC);
+		ptpr->ts.tv_nsec = (long long)((us % LWS_US_PER_SEC) * 1000);
+
+		sqe->opcode = IORING_OP_TIMEOUT;
+		sqe->fd = -1;
+		sqe->addr = (uint64_t)(uintptr_t)&ptpr->ts;
+		sqe->len = 1;
+		sqe->user_data = lws_uring_ud(0, ptpr->tgen);
+		ptpr->timeout_armed = 1;
+	}
+
+bail:
+	lws_uring_enter(ptpr, 0, 0);
+	lws_pt_unlock(pt);
+}
+
+static void
+lws_uring_unmap(struct lws_pt_eventlibs_io_uring *ptpr)
+{
+	if (ptpr->sq.sqes && ptpr->sq.sqes != MAP_FAILED)
+		munmap(ptpr->sq.sqes, ptpr->sq.sqes_sz);
+	if (ptpr->cq.ring && ptpr->cq.ring != MAP_FAILED &&
+	    ptpr->cq.ring != ptpr->sq.ring)
+		munmap(ptpr->cq.ring, ptpr->cq.ring_sz);
+	if (ptpr->sq.ring && ptpr->sq.ring != MAP_FAILED)
+		munmap(ptpr->sq.ring, ptpr->sq.ring_sz);
+
+	ptpr->sq.sqes = NULL;
+	ptpr->sq.ring = NULL;
+	ptpr->cq.ring = NULL;
+
+	if (ptpr->ring_fd >= 0)
+		close(ptpr->ring_fd);
+	ptpr->ring_fd = -1;
+}
+
+static int
+elops_init_pt_io_uring(struct lws_context *context, void *_loop, int tsi)
+{
+	struct lws_context_per_thread *pt = &context->pt[tsi];
+	struct lws_pt_eventlibs_io_uring *ptpr = pt_to_priv_uring(pt);
+	struct io_uring_params p;
+	struct epoll_event ev;
+	unsigned int n, *arr;
+	uint8_t *sq;
+
+	ptpr->pt = pt;
+
+	memset(&p, 0, sizeof(p));
+	ptpr->ring_fd = (int)syscall(__NR_io_uring_setup, LWS_URING_ENTRIES,
+				     &p);
+	if (ptpr->ring_fd < 0) {
+		lwsl_cx_err(context, "io_uring_setup failed: errno %d",
+			    LWS_ERRNO);
+
+		return -1;
+	}
+
+	if (!(p.features & IORING_FEAT_EXT_ARG) ||
+	    !(p.features & IORING_FEAT_NODROP)) {
+		lwsl_cx_err(context, "kernel io_uring too old (need 5.11+)");
+		goto bail;
+	}
+
+	ptpr->sq.ring_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+	ptpr->cq.ring_sz = p.cq_off.cqes +
+				p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		if (ptpr->cq.ring_sz > ptpr->sq.ring_sz)
+			ptpr->sq.ring_sz = ptpr->cq.ring_sz;
+		ptpr->cq.ring_sz = ptpr->sq.ring_sz;
+	}
+
+	ptpr->sq.ring = mmap(NULL, ptpr->sq.ring_sz, PROT_READ | PROT_WRITE,
+			     MAP_SHARED | MAP_POPULATE, ptpr->ring_fd,
+			     IORING_OFF_SQ_RING);
+	if (ptpr->sq.ring == MAP_FAILED)
+		goto bail;
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		ptpr->cq.ring = ptpr->sq.ring;
+	else {
+		ptpr->cq.ring = mmap(NULL, ptpr->cq.ring_sz,
+				     PROT_READ | PROT_WRITE,
+				     MAP_SHARED | MAP_POPULATE, ptpr->ring_fd,
+				     IORING_OFF_CQ_RING);
+		if (ptpr->cq.ring == MAP_FAILED)
+			goto bail;
+	}
+
+	ptpr->sq.sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+	ptpr->sq.sqes = mmap(NULL, ptpr->sq.sqes_sz, PROT_READ | PROT_WRITE,
+			     MAP_SHARED | MAP_POPULATE, ptpr->ring_fd,
+			     IORING_OFF_SQES);
+	if (ptpr->sq.sqes == MAP_FAILED)
+		goto bail;
+
+	sq = (uint8_t *)ptpr->sq.ring;
+	ptpr->sq.khead = (unsigned int *)(sq + p.sq_off.head);
+	ptpr->sq.ktail = (unsigned int *)(sq + p.sq_off.tail);
+	ptpr->sq.kring_mask = (unsigned int *)(sq + p.sq_off.ring_mask);
+	ptpr->sq.kring_entries = (unsigned int *)(sq + p.sq_off.ring_entries);
+	ptpr->sq.tail = *ptpr->sq.ktail;
+
+	/* we always use the sqes in ring order */
+	arr = (unsigned int *)(sq + p.sq_off.array);
+	for (n = 0; n < p.sq_entries; n++)
+		arr[n] = n;
+
+	sq = (uint8_t *)ptpr->cq.ring;
+	ptpr->cq.khead = (unsigned int *)(sq + p.cq_off.head);
+	ptpr->cq.ktail = (unsigned int *)(sq + p.cq_off.tail);
+	ptpr->cq.kring_mask = (unsigned int *)(sq + p.cq_off.ring_mask);
+	ptpr->cq.cqes = (struct io_uring_cqe *)(sq + p.cq_off.cqes);
+
+	if (_loop) {
+		/*
+		 * Same arrangement as the epoll event lib: the foreign loop is
+		 * a pointer to an epoll fd, we add our ring fd to it (it
+		 * becomes readable when there are completions) with data.ptr
+		 * set to the pointer we were given.  The foreign loop must
+		 * call lws_service_tsi() when it sees that.
+		 */
+		ptpr->foreign_epfd = (int *)_loop;
+		memset(&ev, 0, sizeof(ev));
+		ev.events = EPOLLIN;
+		ev.data.ptr = _loop;
+		if (epoll_ctl(*ptpr->foreign_epfd, EPOLL_CTL_ADD,
+			      ptpr->ring_fd, &ev)) {
+			lwsl_cx_err(context, "unable to join foreign epoll");
+			ptpr->foreign_epfd = NULL;
+			goto bail;
+		}
+
+		pt->event_loop_foreign = 1;
+	}
+
+	ptpr->init_done = 1;
+
+	/* register anything inserted into the pt fds before we existed */
+
+	lws_pt_lock(pt, __func__);
+	for (n = 0; n < pt->fds_count; n++) {
+		struct lws *wsi = wsi_from_fd(context, pt->fds[n].fd);
+
+		if (wsi)
+			lws_uring_arm(ptpr, wsi);
+	}
+	lws_pt_unlock(pt);
+
+	lwsl_cx_info(context, "tsi %d: io_uring fd %d, %u entries%s", tsi,
+		     ptpr->ring_fd, p.sq_entries, _loop ? " (foreign)" : "");
+
+	return 0;
+
+bail:
+	lws_uring_unmap(ptpr);
+
+	return -1;
+}
+
+static void
+elops_io_io_uring(struct lws *wsi, unsigned int flags)
+{
+	struct lws_context_per_thread *pt = &wsi->a.context->pt[(int)wsi->tsi];
+	struct lws_pt_eventlibs_io_uring *ptpr = pt_to_priv_uring(pt);
+	struct lws_wsi_eventlibs_io_uring *w = wsi_to_priv_uring(wsi);
+	uint32_t m = (uint32_t)(((flags & LWS_EV_WRITE) ? POLLOUT : 0) |
+				((flags & LWS_EV_READ) ? POLLIN : 0));
+
+	assert((flags & (LWS_EV_START | LWS_EV_STOP)) &&
+	       (flags & (LWS_EV_READ | LWS_EV_WRITE)));
+
+	if (flags & LWS_EV_START)
+		w->events |= m;
+	else
+		w->events &= ~m;
+
+	if (!ptpr->init_done || pt->is_destroyed)
+		return;
+
+	/*
+	 * This just prepares the sqe(s), they go to the kernel with the next
+	 * wait... if we're on a foreign thread while the service thread is
+	 * already waiting, we have to push them now
+	 */
+
+	lws_uring_arm(ptpr, wsi);
+
+	if (((volatile struct lws_context_per_thread *)pt)->inside_poll)
+		lws_uring_enter(ptpr, 0, 0);
+}
+
+/*
+ * One wait and service pass.  Returns 0 if the caller may continue looping,
+ * nonzero if it must return.
+ */
+
+static int
+lws_uring_service_once(struct lws_context *context, int tsi)
+{
+	struct lws_context_per_thread *pt = &context->pt[tsi];
+	struct lws_pt_eventlibs_io_uring *ptpr = pt_to_priv_uring(pt);
+	volatile struct lws_context_per_thread *vpt =
+				(volatile struct lws_context_per_thread *)pt;
+	lws_usec_t us, timeout_us = -1;
+	unsigned int head, tail;
+	int n;
+
+	if (!ptpr->init_done || pt->is_destroyed || context->interrupted)
+		return 1;
+
+	lws_pt_lock(pt, __func__);
+	us = __lws_sul_service_ripe(pt->pt_sul_owner, LWS_COUNT_PT_SUL_OWNERS,
+				    lws_now_usecs());
+	lws_pt_unlock(pt);
+
+	if (us)
+		timeout_us = us;
+
+	if (!lws_service_adjust_timeout(context, 1, tsi))
+		timeout_us = 0;
+
+	/*
+	 * Submit everything prepared since last time, and wait... unless a
+	 * foreign loop is calling us, we must never block it
+	 */
+
+	lws_pt_lock(pt, __func__);
+	lws_uring_arm_deferred(ptpr);
+	vpt->inside_poll = 1;
+	lws_memory_barrier();
+	lws_pt_unlock(pt);
+
+	n = lws_uring_enter(ptpr, !ptpr->foreign_epfd && timeout_us,
+			    timeout_us);
+
+	lws_pt_lock(pt, __func__);
+	vpt->inside_poll = 0;
+	lws_memory_barrier();
+	lws_pt_unlock(pt);
+
+	if (n < 0 && LWS_ERRNO == EINTR)
+		/* let the user code see its signal handler effects */
+		return 1;
+
+	head = *ptpr->cq.khead;
+	tail = __atomic_load_n(ptpr->cq.ktail, __ATOMIC_ACQUIRE);
+
+	while (head != tail) {
+		struct io_uring_cqe *c = &ptpr->cq.cqes[head &
+							*ptpr->cq.kring_mask];
+		struct lws_wsi_eventlibs_io_uring *w;
+		uint64_t ud = c->user_data;
+		int res = c->res, fd;
+		struct lws_pollfd pfd;
+		struct lws *wsi;
+
+		/* release the cqe slot before doing anything else */
+		__atomic_store_n(ptpr->cq.khead, ++head, __ATOMIC_RELEASE);
+
+		if (!lws_uring_ud_gen(ud)) {
+			if (lws_uring_ud_low(ud) &&
+			    lws_uring_ud_low(ud) == ptpr->tgen && res == -ETIME)
+				/* our foreign loop timer, sul handled below */
+				ptpr->timeout_armed = 0;
+			goto next;
+		}
+
+		fd = (int)lws_uring_ud_low(ud);
+		wsi = wsi_from_fd(context, fd);
+		if (!wsi || wsi->position_in_fds_table == LWS_NO_FDS_POS)
+			goto next;
+
+		w = wsi_to_priv_uring(wsi);
+		if (w->gen != lws_uring_ud_gen(ud))
+			/* stale, for a poll we already replaced */
+			goto next;
+
+		/* the oneshot poll is used up */
+		w->gen = 0;
+
+		if (res == -ECANCELED)
+			goto rearm;
+
+		pfd.fd = fd;
+		pfd.events = pt->fds[wsi->position_in_fds_table].events;
+		if (res < 0)
+			pfd.revents = LWS_POLLHUP;
+		else {
+			pfd.revents = (short)(res & (POLLIN | POLLOUT));
+			if (res & (POLLHUP | POLLERR))
+				pfd.revents = (short)(pfd.revents |
+						      LWS_POLLHUP);
+		}
+
+		if (lws_service_fd_tsi(context, &pfd, tsi) < 0)
+			lwsl_cx_err(context, "lws_service_fd_tsi failed");
+
+		/*
+		 * he may have been closed, or even replaced on the fd... if
+		 * he's still there, even after a failed service, he must get
+		 * his poll back or he will never hear from us again
+		 */
+
+		wsi = wsi_from_fd(context, fd);
+		if (!wsi)
+			goto next;
+rearm:
+		lws_pt_lock(pt, __func__);
+		lws_uring_arm(ptpr, wsi);
+		lws_pt_unlock(pt);
+next:
+		tail = __atomic_load_n(ptpr->cq.ktail, __ATOMIC_ACQUIRE);
+	}
+
+	if (!lws_service_adjust_timeout(context, 1, tsi))
+		_lws_plat_service_forced_tsi(context, tsi);
+	else
+		lws_service_do_ripe_rxflow(pt);
+
+	if (pt->destroy_self) {
+		lws_context_destroy(pt->context);
+		return 1;
+	}
+
+	if (ptpr->foreign_epfd && !pt->is_destroyed)
+		/* also submits our rearms */
+		lws_uring_arm_timer(pt);
+
+	return 0;
+}
+
+static void
+elops_run_pt_io_uring(struct lws_context *context, int tsi)
+{
+	/*
+	 * With a foreign loop, do one nonblocking pass.  Otherwise run the loop
+	 * until it's stopped, like the other event libs.
+	 */
+
+	if (pt_to_priv_uring(&context->pt[tsi])->foreign_epfd) {
+		lws_uring_service_once(context, tsi);
+		return;
+	}
+
+	while (!lws_uring_service_once(context, tsi))
+		;
+}
+
+static void
+elops_destroy_pt_io_uring(struct lws_context *context, int tsi)
+{
+	struct lws_context_per_thread *pt = &context->pt[tsi];
+	struct lws_pt_eventlibs_io_uring *ptpr = pt_to_priv_uring(pt);
+
+	if (!ptpr->init_done)
+		return;
+
+	ptpr->init_done = 0;
+
+	if (ptpr->foreign_epfd) {
+		/* leave the foreign loop exactly as we found it */
+		epoll_ctl(*ptpr->foreign_epfd, EPOLL_CTL_DEL, ptpr->ring_fd,
+			  NULL);
+		ptpr->foreign_epfd = NULL;
+	}
+
+	/* closing the ring cancels anything still in flight */
+
+	lws_uring_unmap(ptpr);
+}
+
+static void
+elops_destroy_wsi_io_uring(struct lws *wsi)
+{
+	struct lws_context_per_thread *pt;
+	struct lws_wsi_eventlibs_io_uring *w;
+
+	if (!wsi)
+		return;
+
+	pt = &wsi->a.context->pt[(int)wsi->tsi];
+	w = wsi_to_priv_uring(wsi);
+	w->events = 0;
+
+	lws_pt_lock(pt, __func__);
+	if (pt_to_priv_uring(pt)->init_done && w->gen) {
+		lws_uring_arm(pt_to_priv_uring(pt), wsi);
+		if (!lws_dll2_is_detached(&w->list_unarmed))
+			lwsl_wsi_warn(wsi, "unable to cancel poll");
+	}
+	/* the wsi is going away, we can't retry it later */
+	lws_dll2_remove(&w->list_unarmed);
+	lws_pt_unlock(pt);
+}
+
+static int
+elops_foreign_thread_io_uring(struct lws_context *cx, int tsi)
+{
+	volatile struct lws_context_per_thread *vpt =
+			(volatile struct lws_context_per_thread *)&cx->pt[tsi];
+
+	return vpt->inside_poll;
+}
+
+static const struct lws_event_loop_ops event_loop_ops_io_uring = {
+	/* name */			"io_uring",
+	/* init_context */		NULL,
+	/* destroy_context1 */		NULL,
+	/* destroy_context2 */		NULL,
+	/* init_vhost_listen_wsi */	NULL,
+	/* init_pt */			elops_init_pt_io_uring,
+	/* wsi_logical_close */		NULL,
+	/* check_client_connect_ok */	NULL,
+	/* close_handle_manually */	NULL,
+	/* accept */			NULL,
+	/* io */			elops_io_io_uring,
+	/* run_pt */			elops_run_pt_io_uring,
+	/* destroy_pt */		elops_destroy_pt_io_uring,
+	/* destroy wsi */		elops_destroy_wsi_io_uring,
+	/* foreign_thread */		elops_foreign_thread_io_uring,
+
+	/* level-triggered readiness like poll(), see top of file */
+	/* flags */			LELOF_ISPOLL,
+
+	/* evlib_size_ctx */	0,
+	/* evlib_size_pt */	sizeof(struct lws_pt_eventlibs_io_uring),
+	/* evlib_size_vh */	0,
+	/* evlib_size_wsi */	sizeof(struct lws_wsi_eventlibs_io_uring),
+};
+
+#if defined(LWS_WITH_EVLIB_PLUGINS)
+LWS_VISIBLE
+#endif
+const lws_plugin_evlib_t evlib_io_uring = {
+	.hdr = {
+		"io_uring event loop",
+		"lws_evlib_plugin",
+		LWS_BUILD_HASH,
+		LWS_PLUGIN_API_MAGIC
+	},
+
+	.ops	= &event_loop_ops_io_uring
+};
@@ -0,0 +1,82 @@
+/*
+ * libwebsockets - small server side websockets and web server implementation
+ *
+ * Copyright (C) 2010 - 2026 Andy Green <andy@warmcat.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <linux/io_uring.h>
+
+#define LWS_URING_ENTRIES 256
+
+/*
+ * user_data on our sqes is (generation << 32) | fd for wsi polls, so a
+ * completion can be checked against the wsi currently using the fd.
+ * Generation 0 is reserved for our own housekeeping ops, there the low 32
+ * bits are 0 for "ignore the completion" or the timeout generation.
+ */
+
+#define lws_uring_ud(_gen, _low) ((((uint64_t)(_gen)) << 32) | \
+				  (uint32_t)(_low))
+#define lws_uring_ud_gen(_ud) ((uint32_t)((_ud) >> 32))
+#define lws_uring_ud_low(_ud) ((uint32_t)(_ud))
+
+struct lws_uring_sq {
+	unsigned int				*khead;
+	unsigned int				*ktail;
+	unsigned int				*kring_mask;
+	unsigned int				*kring_entries;
+	struct io_uring_sqe			*sqes;
+	void					*ring;
+	size_t					ring_sz;
+	size_t					sqes_sz;
+	unsigned int				tail; /* ours, unpublished */
+};
+
+struct lws_uring_cq {
+	unsigned int				*khead;
+	unsigned int				*ktail;
+	unsigned int				*kring_mask;
+	struct io_uring_cqe			*cqes;
+	void					*ring;
+	size_t					ring_sz;
+};
+
+struct lws_pt_eventlibs_io_uring {
+	struct lws_context_per_thread		*pt;
+	int					*foreign_epfd;
+	struct lws_uring_sq			sq;
+	struct lws_uring_cq			cq;
+	struct __kernel_timespec		ts;
+	lws_dll2_owner_t			unarmed; /* wsi we owe an sqe */
+	uint32_t				gen;
+	uint32_t				tgen;
+	int					ring_fd;
+	uint8_t					timeout_armed;
+	uint8_t					init_done;
+};
+
+struct lws_wsi_eventlibs_io_uring {
+	lws_dll2_t				list_unarmed;
+	struct lws				*wsi; /* while unarmed */
+	uint32_t				events; /* wanted */
+	uint32_t				armed_events;
+	uint32_t				gen; /* of poll in flight, or 0 */
+};
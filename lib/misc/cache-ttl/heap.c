@@ -35,17 +35,132 @@ update_sul(lws_cache_ttl_lru_t_heap_t *cache);
 static int
 lws_cache_heap_invalidate(struct lws_cache_ttl_lru *_c, const char *key);
 
+/*
+ * Items with an expiry live on a binary min-heap in cache->expiry, so the
+ * earliest is always at [0].  Each item knows its own 1-based index on it
+ * so it can be taken out from anywhere.
+ */
+
+static void
+expiry_heap_set(lws_cache_ttl_lru_t_heap_t *cache, size_t n,
+		lws_cache_ttl_item_heap_t *item)
+{
+	cache->expiry[n] = item;
+	item->expiry_idx = n + 1;
+}
+
+static void
+expiry_heap_fix(lws_cache_ttl_lru_t_heap_t *cache, size_t n)
+{
+	lws_cache_ttl_item_heap_t *item = cache->expiry[n];
+	size_t c;
+
+	/* bubble up while earlier than the parent */
+
+	while (n && item->expiry < cache->expiry[(n - 1) / 2]->expiry) {
+		expiry_heap_set(cache, n, cache->expiry[(n - 1) / 2]);
+		n = (n - 1) / 2;
+	}
+
+	/* sift down while later than the earliest child */
+
+	while ((c = (2 * n) + 1) < cache->expiry_count) {
+		if (c + 1 < cache->expiry_count &&
+		    cache->expiry[c + 1]->expiry < cache->expiry[c]->expiry)
+			c++;
+		if (item->expiry <= cache->expiry[c]->expiry)
+			break;
+		expiry_heap_set(cache, n, cache->expiry[c]);
+		n = c;
+	}
+
+	expiry_heap_set(cache, n, item);
+}
+
 static int
-sort_expiry(const lws_dll2_t *a, const lws_dll2_t *b)
+expiry_heap_add(lws_cache_ttl_lru_t_heap_t *cache,
+		lws_cache_ttl_item_heap_t *item)
 {
-	const lws_cache_ttl_item_heap_t
-		*c = lws_container_of(a, lws_cache_ttl_item_heap_t, list_expiry),
-		*d = lws_container_of(b, lws_cache_ttl_item_heap_t, list_expiry);
+	if (cache->expiry_count == cache->expiry_alloc) {
+		size_t na = cache->expiry_alloc ? cache->expiry_alloc * 2 : 16;
+		void *p = lws_realloc(cache->expiry, na * sizeof(*cache->expiry),
+				      __func__);
 
-	if (c->expiry > d->expiry)
-		return 1;
-	if (c->expiry < d->expiry)
-		return -1;
+		if (!p)
+			return 1;
+
+		cache->expiry = p;
+		cache->expiry_alloc = na;
+	}
+
+	expiry_heap_set(cache, cache->expiry_count++, item);
+	expiry_heap_fix(cache, cache->expiry_count - 1);
+
+	return 0;
+}
+
+static void
+expiry_heap_remove(lws_cache_ttl_lru_t_heap_t *cache,
+		   lws_cache_ttl_item_heap_t *item)
+{
+	size_t n = item->expiry_idx;
+
+	if (!n)
+		return;
+
+	item->expiry_idx = 0;
+	if (n-- == cache->expiry_count--)
+		/* it was the last one */
+		return;
+
+	expiry_heap_set(cache, n, cache->expiry[cache->expiry_count]);
+	expiry_heap_fix(cache, n);
+}
+
+/*
+ * Specific keys are indexed in a hashtable of dll2 buckets, which we double
+ * when the items outnumber the buckets by more than two to one.
+ */
+
+static uint32_t
+key_hash(const char *key)
+{
+	uint32_t h = 0x811c9dc5; /* FNV-1a */
+
+	while (*key) {
+		h ^= (uint8_t)*key++;
+		h *= 0x01000193;
+	}
+
+	return h;
+}
+
+#define hash_bucket(_cache, _h) \
+		(&(_cache)->hash[(_h) & ((_cache)->hash_buckets - 1)])
+
+static int
+hash_grow(lws_cache_ttl_lru_t_heap_t *cache)
+{
+	size_t nb = cache->hash_buckets ? cache->hash_buckets * 2 : 64;
+	lws_dll2_owner_t *h = lws_zalloc(nb * sizeof(*h), __func__);
+
+	if (!h)
+		/* fine if we already have a table, it just gets slower */
+		return !cache->hash;
+
+	lws_free(cache->hash);
+	cache->hash = h;
+	cache->hash_buckets = nb;
+
+	lws_start_foreach_dll(struct lws_dll2 *, d, cache->items_lru.head) {
+		lws_cache_ttl_item_heap_t *item = lws_container_of(d,
+						lws_cache_ttl_item_heap_t,
+						list_lru);
+
+		memset(&item->list_hash, 0, sizeof(item->list_hash));
+		lws_dll2_add_head(&item->list_hash,
+				  hash_bucket(cache, item->hash));
+	} lws_end_foreach_dll(d);
 
 	return 0;
 }
@@ -57,8 +172,10 @@ _lws_cache_heap_item_destroy(lws_cache_ttl_lru_t_heap_t *cache,
 	lwsl_cache("%s: %s (%s)\n", __func__, cache->cache.info.name,
 			(const char *)&item[1] + item->size);
 
-	lws_dll2_remove(&item->list_expiry);
+	expiry_heap_remove(cache, item);
 	lws_dll2_remove(&item->list_lru);
+	lws_dll2_remove(&item->list_hash);
+	lws_dll2_remove(&item->list_meta);
 
 	cache->cache.current_footprint -= item->size;
 
@@ -95,52 +212,38 @@ lws_cache_heap_item_destroy(lws_cache_ttl_lru_t_heap_t *cache,
 	 */
 
 	lws_start_foreach_dll_safe(struct lws_dll2 *, d, d1,
-				   cache->items_lru.head) {
+				   cache->items_meta.head) {
 		lws_cache_ttl_item_heap_t *i = lws_container_of(d,
 						lws_cache_ttl_item_heap_t,
-						list_lru);
-		const char *iname = ((const char *)&item[1]) + item->size;
-		uint8_t *pay = (uint8_t *)&item[1], *end = pay + item->size;
-
-		if (*iname == META_ITEM_LEADING) {
-			size_t taglen = strlen(iname);
-
-			/*
-			 * If the item about to be destroyed makes an
-			 * appearance on the meta results list, we must kill
-			 * the meta result item to force recalc next time
-			 */
+						list_meta);
+		uint8_t *pay = (uint8_t *)&i[1], *end = pay + i->size;
+		size_t taglen = strlen(tag);
 
-			while (pay < end) {
-				uint32_t tlen = lws_ser_ru32be(pay + 4);
+		/*
+		 * If the item about to be destroyed makes an appearance on the
+		 * meta results list, we must kill the meta result item to
+		 * force recalc next time
+		 */
 
-				if (tlen == taglen &&
-				    !strcmp((const char *)pay + 8, iname)) {
-#if defined(_DEBUG)
-					/*
-					 * Sanity check that the item tag is
-					 * really a match for that meta results
-					 * item
-					 */
-
-					assert (!backing->info.ops->tag_match(
-						 backing, iname + 1, tag, 1));
-#endif
-					_lws_cache_heap_item_destroy(cache, i);
-					break;
-				}
-				pay += 8 + tlen + 1;
-			}
+		while (pay < end) {
+			uint32_t tlen = lws_ser_ru32be(pay + 4);
 
+			if (tlen == taglen &&
+			    !strcmp((const char *)pay + 8, tag)) {
 #if defined(_DEBUG)
-			/*
-			 * Sanity check that the item tag really isn't a match
-			 * for that meta results item
-			 */
+				/*
+				 * Sanity check that the item tag is really a
+				 * match for that meta results item
+				 */
 
-			assert (backing->info.ops->tag_match(backing, iname + 1,
-							  tag, 1));
+				assert (!backing->info.ops->tag_match(backing,
+					(const char *)&i[1] + i->size + 1,
+					tag, 1));
 #endif
+				_lws_cache_heap_item_destroy(cache, i);
+				break;
+			}
+			pay += 8 + tlen + 1;
 		}
 
 	} lws_end_foreach_dll_safe(d, d1);
@@ -176,11 +279,8 @@ expiry_cb(lws_sorted_usec_list_t *sul)
 
 	lwsl_cache("%s: %s\n", __func__, cache->cache.info.name);
 
-	while (cache->items_expiry.head) {
-		lws_cache_ttl_item_heap_t *item;
-
-		item = lws_container_of(cache->items_expiry.head,
-					lws_cache_ttl_item_heap_t, list_expiry);
+	while (cache->expiry_count) {
+		lws_cache_ttl_item_heap_t *item = cache->expiry[0];
 
 		if (item->expiry > now)
 			return;
@@ -196,15 +296,10 @@ expiry_cb(lws_sorted_usec_list_t *sul)
 static int
 earliest_expiry(lws_cache_ttl_lru_t_heap_t *cache, lws_usec_t *pearliest)
 {
-	lws_cache_ttl_item_heap_t *item;
-
-	if (!cache->items_expiry.head)
+	if (!cache->expiry_count)
 		return 1;
 
-	item = lws_container_of(cache->items_expiry.head,
-				lws_cache_ttl_item_heap_t, list_expiry);
-
-	*pearliest = item->expiry;
+	*pearliest = cache->expiry[0]->expiry;
 
 	return 0;
 }
@@ -234,13 +329,23 @@ static lws_cache_ttl_item_heap_t *
 lws_cache_heap_specific(lws_cache_ttl_lru_t_heap_t *cache,
 			const char *specific_key)
 {
-	lws_start_foreach_dll(struct lws_dll2 *, d, cache->items_lru.head) {
+	size_t kl = strlen(specific_key);
+	uint32_t h;
+
+	if (!cache->hash)
+		return NULL;
+
+	h = key_hash(specific_key);
+
+	lws_start_foreach_dll(struct lws_dll2 *, d,
+			      hash_bucket(cache, h)->head) {
 		lws_cache_ttl_item_heap_t *item = lws_container_of(d,
 						lws_cache_ttl_item_heap_t,
-						list_lru);
+						list_hash);
 		const char *iname = ((const char *)&item[1]) + item->size;
 
-		if (!strcmp(specific_key, iname))
+		if (item->hash == h && item->key_len == kl &&
+		    !strcmp(specific_key, iname))
 			return item;
 
 	} lws_end_foreach_dll(d);
@@ -325,7 +430,7 @@ lws_cache_heap_write(struct lws_cache_ttl_lru *_c, const char *specific_key,
 {
 	lws_cache_ttl_lru_t_heap_t *cache = (lws_cache_ttl_lru_t_heap_t *)_c;
 	struct lws_cache_ttl_lru *backing = _c;
-	lws_cache_ttl_item_heap_t *item, *ei;
+	lws_cache_ttl_item_heap_t *item;
 	size_t kl = strlen(specific_key);
 	char *p;
 
@@ -341,24 +446,21 @@ lws_cache_heap_write(struct lws_cache_ttl_lru *_c, const char *specific_key,
 		backing = backing->info.parent;
 
 	lws_start_foreach_dll_safe(struct lws_dll2 *, d, d1,
-				   cache->items_lru.head) {
+				   cache->items_meta.head) {
 		lws_cache_ttl_item_heap_t *i = lws_container_of(d,
 						lws_cache_ttl_item_heap_t,
-						list_lru);
+						list_meta);
 		const char *iname = ((const char *)&i[1]) + i->size;
 
-		if (*iname == META_ITEM_LEADING) {
+		/*
+		 * If the item about to be added would match any cached
+		 * results from before it was added, we have to
+		 * invalidate them.  To check this, we have to use the
+		 * matching rules at the backing store level
+		 */
 
-			/*
-			 * If the item about to be added would match any cached
-			 * results from before it was added, we have to
-			 * invalidate them.  To check this, we have to use the
-			 * matching rules at the backing store level
-			 */
-
-			if (!strcmp(iname + 1, specific_key))
-				_lws_cache_heap_item_destroy(cache, i);
-		}
+		if (!strcmp(iname + 1, specific_key))
+			_lws_cache_heap_item_destroy(cache, i);
 
 	} lws_end_foreach_dll_safe(d, d1);
 
@@ -379,13 +481,16 @@ lws_cache_heap_write(struct lws_cache_ttl_lru *_c, const char *specific_key,
 
 	lws_cache_heap_invalidate(&cache->cache, specific_key);
 
+	if ((!cache->hash || cache->items_lru.count + 1 >
+					2 * cache->hash_buckets) &&
+	    hash_grow(cache))
+		return 1;
+
 	item = lws_fi(&_c->info.cx->fic, "cache_write_oom") ? NULL :
 			lws_malloc(sizeof(*item) + kl + 1u + size, __func__);
 	if (!item)
 		return 1;
 
-	cache->cache.current_footprint += item->size;
-
 	/* only need to zero down our item object */
 	memset(item, 0, sizeof(*item));
 
@@ -403,20 +508,27 @@ lws_cache_heap_write(struct lws_cache_ttl_lru *_c, const char *specific_key,
 	item->expiry = expiry;
 	item->key_len = kl;
 	item->size = size;
+	item->hash = key_hash(specific_key);
 
 	if (expiry) {
 		/* adding to expiry is optional, on nonzero expiry */
-		lws_dll2_add_sorted(&item->list_expiry, &cache->items_expiry,
-				    sort_expiry);
-		ei = lws_container_of(cache->items_expiry.head,
-				      lws_cache_ttl_item_heap_t, list_expiry);
+		if (expiry_heap_add(cache, item)) {
+			lws_free(item);
+			return 1;
+		}
 		lwsl_debug("%s: setting exp %llu\n", __func__,
-						(unsigned long long)ei->expiry);
-		lws_cache_schedule(&cache->cache, expiry_cb, ei->expiry);
+				(unsigned long long)cache->expiry[0]->expiry);
+		lws_cache_schedule(&cache->cache, expiry_cb,
+				   cache->expiry[0]->expiry);
 	}
 
+	cache->cache.current_footprint += item->size;
+
 	/* always add outselves to head of lru list */
 	lws_dll2_add_head(&item->list_lru, &cache->items_lru);
+	lws_dll2_add_head(&item->list_hash, hash_bucket(cache, item->hash));
+	if (*specific_key == META_ITEM_LEADING)
+		lws_dll2_add_tail(&item->list_meta, &cache->items_meta);
 
 	return 0;
 }
@@ -466,25 +578,22 @@ lws_cache_heap_invalidate(struct lws_cache_ttl_lru *_c, const char *specific_key
 	 */
 
 	lws_start_foreach_dll_safe(struct lws_dll2 *, d, d1,
-				   cache->items_lru.head) {
+				   cache->items_meta.head) {
 		lws_cache_ttl_item_heap_t *i = lws_container_of(d,
 						lws_cache_ttl_item_heap_t,
-						list_lru);
+						list_meta);
 		const char *iname = ((const char *)&i[1]) + i->size;
 
-		if (*iname == META_ITEM_LEADING) {
+		/*
+		 * If the item about to be added would match any cached
+		 * results from before it was added, we have to
+		 * invalidate them.  To check this, we have to use the
+		 * matching rules at the backing store level
+		 */
 
-			/*
-			 * If the item about to be added would match any cached
-			 * results from before it was added, we have to
-			 * invalidate them.  To check this, we have to use the
-			 * matching rules at the backing store level
-			 */
-
-			if (!backing->info.ops->tag_match(backing, iname + 1,
-							  specific_key, 1))
-				_lws_cache_heap_item_destroy(cache, i);
-		}
+		if (!backing->info.ops->tag_match(backing, iname + 1,
+						  specific_key, 1))
+			_lws_cache_heap_item_destroy(cache, i);
 
 	} lws_end_foreach_dll_safe(d, d1);
 
@@ -551,6 +660,9 @@ lws_cache_heap_destroy(struct lws_cache_ttl_lru **_cache)
 
 	lws_dll2_foreach_safe(&cache->items_lru, cache, destroy_dll);
 
+	lws_free(cache->hash);
+	lws_free(cache->expiry);
+
 	lws_free_set_NULL(*_cache);
 }
 
@@ -575,13 +687,8 @@ lws_cache_heap_debug_dump(struct lws_cache_ttl_lru *_c)
 {
 	lws_cache_ttl_lru_t_heap_t *cache = (lws_cache_ttl_lru_t_heap_t *)_c;
 #if !defined(LWS_WITH_NO_LOGS)
-	lws_cache_ttl_item_heap_t *item = NULL;
-
-	lws_dll2_t *d = cache->items_expiry.head;
-
-	if (d)
-		item = lws_container_of(d, lws_cache_ttl_item_heap_t,
-						list_expiry);
+	lws_cache_ttl_item_heap_t *item = cache->expiry_count ?
+						cache->expiry[0] : NULL;
 
 	lwsl_cache("%s: %s: items %d, earliest %llu\n", __func__,
 			cache->cache.info.name, (int)cache->items_lru.count,
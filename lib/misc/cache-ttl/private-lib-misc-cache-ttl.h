@@ -39,12 +39,15 @@
 #define META_ITEM_LEADING '!'
 
 typedef struct lws_cache_ttl_item_heap {
-	lws_dll2_t			list_expiry;
 	lws_dll2_t			list_lru;
+	lws_dll2_t			list_hash; /* specific key index bucket */
+	lws_dll2_t			list_meta; /* only if a meta item */
 
 	lws_usec_t			expiry;
 	size_t				key_len;
 	size_t				size;
+	size_t				expiry_idx; /* 1-based in expiry heap */
+	uint32_t			hash;
 
 	/*
 	 * len + key_len + 1 bytes of data overcommitted, user object first
@@ -63,14 +66,23 @@ typedef struct lws_cache_ttl_lru {
 
 /*
  * The heap-backed cache uses lws_dll2 linked-lists to track items that are
- * in it.
+ * in it, in lru order and separately the meta items.  Items are also indexed
+ * by specific key in a hashtable that grows with the item count, and those
+ * with an expiry are kept on a binary min-heap by expiry time.
  */
 
 typedef struct lws_cache_ttl_lru_heap {
 	lws_cache_ttl_lru_t		cache;
 
-	lws_dll2_owner_t		items_expiry;
 	lws_dll2_owner_t		items_lru;
+	lws_dll2_owner_t		items_meta;
+
+	lws_dll2_owner_t		*hash;
+	size_t				hash_buckets;
+
+	lws_cache_ttl_item_heap_t	**expiry;
+	size_t				expiry_count;
+	size_t				expiry_alloc;
 } lws_cache_ttl_lru_t_heap_t;
 
 /*
@@ -25,26 +25,82 @@
 #include <libwebsockets.h>
 #include "private-lib-core.h"
 
-/* requires context->lock */
-static void
-__lws_peer_remove_from_peer_wait_list(struct lws_context *context,
-				      struct lws_peer *peer)
+/*
+ * The peer hash table is shared out between LWS_PEER_STRIPES stripes, by
+ * bucket.  Everything about a peer, its bucket chain, its wait list
+ * membership and its counts, is protected by its stripe's lock, so
+ * different service threads only contend when their peers hash to the same
+ * stripe.  Nothing here takes the context lock any more.
+ */
+
+#if LWS_MAX_SMP > 1
+#define lws_peer_stripe_lock(_s) pthread_mutex_lock(&(_s)->lock)
+#define lws_peer_stripe_unlock(_s) pthread_mutex_unlock(&(_s)->lock)
+#else
+#define lws_peer_stripe_lock(_s) (void)(_s)
+#define lws_peer_stripe_unlock(_s) (void)(_s)
+#endif
+
+static struct lws_peer_stripe *
+lws_peer_stripe(struct lws_context *context, uint32_t hash)
 {
-	struct lws_peer *df;
+	return &context->pl_stripe[hash & (LWS_PEER_STRIPES - 1)];
+}
 
-	lws_start_foreach_llp(struct lws_peer **, p, context->peer_wait_list) {
-		if (*p == peer) {
-			df = *p;
+void
+lws_peer_limits_init(struct lws_context *context)
+{
+#if LWS_MAX_SMP > 1
+	int n;
+#endif
 
-			*p = df->peer_wait_list;
-			df->peer_wait_list = NULL;
+	/* scale the peer hash table according to the max fds for the process,
+	 * so that the max list depth averages 16.  Eg, 1024 fd -> 64,
+	 * 102400 fd -> 6400
+	 */
 
-			if (!context->peer_wait_list)
-				lws_sul_cancel(&context->pt[0].sul_peer_limits);
+	context->pl_hash_elements =
+		(context->count_threads * context->fd_limit_per_thread) / 16;
+	if (!context->pl_hash_elements)
+		return;
 
-			return;
-		}
-	} lws_end_foreach_llp(p, peer_wait_list);
+	context->pl_hash_table = lws_zalloc(sizeof(struct lws_peer *) *
+			context->pl_hash_elements, "peer limits hash table");
+	if (!context->pl_hash_table) {
+		context->pl_hash_elements = 0; /* peer limits are disabled */
+		return;
+	}
+
+#if LWS_MAX_SMP > 1
+	for (n = 0; n < LWS_PEER_STRIPES; n++)
+		pthread_mutex_init(&context->pl_stripe[n].lock, NULL);
+#endif
+}
+
+void
+lws_peer_limits_destroy(struct lws_context *context)
+{
+	uint32_t nu;
+
+	if (!context->pl_hash_elements)
+		return;
+
+	for (nu = 0; nu < context->pl_hash_elements; nu++) {
+		lws_start_foreach_llp(struct lws_peer **, peer,
+				      context->pl_hash_table[nu]) {
+			struct lws_peer *df = *peer;
+			*peer = df->next;
+			lws_free(df);
+			continue;
+		} lws_end_foreach_llp(peer, next);
+	}
+	lws_free_set_NULL(context->pl_hash_table);
+	context->pl_hash_elements = 0;
+
+#if LWS_MAX_SMP > 1
+	for (nu = 0; nu < LWS_PEER_STRIPES; nu++)
+		pthread_mutex_destroy(&context->pl_stripe[nu].lock);
+#endif
 }
 
 void
@@ -52,33 +108,69 @@ lws_sul_peer_limits_cb(lws_sorted_usec_list_t *sul)
 {
 	struct lws_context_per_thread *pt = lws_container_of(sul,
 			struct lws_context_per_thread, sul_peer_limits);
+	struct lws_context *context = pt->context;
+	uint32_t waiting = 0;
+	int n;
 
-	lws_peer_cull_peer_wait_list(pt->context);
+	lws_peer_cull_peer_wait_list(pt);
 
-	lws_sul_schedule(pt->context, 0, &pt->context->pt[0].sul_peer_limits,
+	/* only come back while there's something that may need culling */
+
+	for (n = 0; n < LWS_PEER_STRIPES && !waiting; n++) {
+		lws_peer_stripe_lock(&context->pl_stripe[n]);
+		waiting = context->pl_stripe[n].wait_owner.count;
+		lws_peer_stripe_unlock(&context->pl_stripe[n]);
+	}
+
+	if (!waiting)
+		return;
+
+	lws_sul_schedule(context, (int)(pt - context->pt), &pt->sul_peer_limits,
 			 lws_sul_peer_limits_cb, 10 * LWS_US_PER_SEC);
 }
 
-/* requires context->lock */
+/*
+ * Each pt has its own cull timer, and we schedule the one on the calling
+ * service thread's pt.  That thread may already hold its own pt lock, which
+ * is recursive, but taking another pt's lock here could deadlock against a
+ * thread doing the same the other way round.  A thread that isn't a service
+ * thread holds no pt lock, so it can use pt[0]'s.
+ *
+ * The pt services its timer under its pt lock, so we must not try to schedule
+ * it while holding a stripe lock.
+ */
+
 static void
-__lws_peer_add_to_peer_wait_list(struct lws_context *context,
-				 struct lws_peer *peer)
+lws_peer_schedule_cull(struct lws_context *context)
 {
-	__lws_peer_remove_from_peer_wait_list(context, peer);
+	int tsi = lws_pthread_self_to_tsi(context);
+	struct lws_context_per_thread *pt = &context->pt[tsi < 0 ? 0 : tsi];
+
+	lws_pt_lock(pt, __func__); /* <=================================== */
 
-	peer->peer_wait_list = context->peer_wait_list;
-	context->peer_wait_list = peer;
+	if (!pt->sul_peer_limits.list.owner)
+		lws_sul_schedule(context, (int)(pt - context->pt),
+				 &pt->sul_peer_limits,
+				 lws_sul_peer_limits_cb, 10 * LWS_US_PER_SEC);
 
-	if (!context->pt[0].sul_peer_limits.list.owner)
-		lws_sul_schedule(context, 0, &context->pt[0].sul_peer_limits,
-				lws_sul_peer_limits_cb, 10 * LWS_US_PER_SEC);
+	lws_pt_unlock(pt); /* ==============================================> */
 }
 
+/* requires stripe lock */
+static void
+__lws_peer_add_to_peer_wait_list(struct lws_peer_stripe *ps,
+				 struct lws_peer *peer)
+{
+	time(&peer->time_closed_all);
+	lws_dll2_remove(&peer->list_wait);
+	lws_dll2_add_tail(&peer->list_wait, &ps->wait_owner);
+}
 
 struct lws_peer *
 lws_get_or_create_peer(struct lws_vhost *vhost, lws_sockfd_type sockfd)
 {
 	struct lws_context *context = vhost->context;
+	struct lws_peer_stripe *ps;
 	struct lws_peer *peer;
 	lws_sockaddr46 sa46;
 	socklen_t rlen = 0;
@@ -114,8 +206,9 @@ lws_get_or_create_peer(struct lws_vhost *vhost, lws_sockfd_type sockfd)
 		return NULL;
 
 	hash = hash % context->pl_hash_elements;
+	ps = lws_peer_stripe(context, hash);
 
-	lws_context_lock(context, "peer search"); /* <======================= */
+	lws_peer_stripe_lock(ps); /* <====================================== */
 
 	lws_start_foreach_ll(struct lws_peer *, peerx,
 			     context->pl_hash_table[hash]) {
@@ -130,7 +223,14 @@ lws_get_or_create_peer(struct lws_vhost *vhost, lws_sockfd_type sockfd)
 #if defined(LWS_WITH_IPV6)
 hit:
 #endif
-				lws_context_unlock(context); /* === */
+				/*
+				 * If it's idle, refresh it so it can't be
+				 * culled before the caller attaches a wsi
+				 */
+				if (peerx->list_wait.owner)
+					__lws_peer_add_to_peer_wait_list(ps,
+									 peerx);
+				lws_peer_stripe_unlock(ps); /* ============ */
 
 				return peerx;
 			}
@@ -141,12 +241,12 @@ hit:
 
 	peer = lws_zalloc(sizeof(*peer), "peer");
 	if (!peer) {
-		lws_context_unlock(context); /* === */
+		lws_peer_stripe_unlock(ps); /* ============================ */
 		lwsl_err("%s: OOM for new peer\n", __func__);
 		return NULL;
 	}
 
-	context->count_peers++;
+	ps->count_peers++;
 	peer->next = context->pl_hash_table[hash];
 	peer->hash = hash;
 	peer->sa46 = sa46;
@@ -156,17 +256,19 @@ hit:
 	 * On creation, the peer has no wsi attached, so is created on the
 	 * wait list.  When a wsi is added it is removed from the wait list.
 	 */
-	time(&peer->time_closed_all);
-	__lws_peer_add_to_peer_wait_list(context, peer);
+	__lws_peer_add_to_peer_wait_list(ps, peer);
 
-	lws_context_unlock(context); /* ====================================> */
+	lws_peer_stripe_unlock(ps); /* =====================================> */
+
+	lws_peer_schedule_cull(context);
 
 	return peer;
 }
 
-/* requires context->lock */
+/* requires stripe lock */
 static int
-__lws_peer_destroy(struct lws_context *context, struct lws_peer *peer)
+__lws_peer_destroy(struct lws_context *context, struct lws_peer_stripe *ps,
+		   struct lws_peer *peer)
 {
 	lws_start_foreach_llp(struct lws_peer **, p,
 			      context->pl_hash_table[peer->hash]) {
@@ -174,7 +276,7 @@ __lws_peer_destroy(struct lws_context *context, struct lws_peer *peer)
 			struct lws_peer *df = *p;
 			*p = df->next;
 			lws_free(df);
-			context->count_peers--;
+			ps->count_peers--;
 
 			return 0;
 		}
@@ -184,50 +286,63 @@ __lws_peer_destroy(struct lws_context *context, struct lws_peer *peer)
 }
 
 void
-lws_peer_cull_peer_wait_list(struct lws_context *context)
+lws_peer_cull_peer_wait_list(struct lws_context_per_thread *pt)
 {
-	struct lws_peer *df;
+	struct lws_context *context = pt->context;
+	struct lws_peer_stripe *ps;
 	time_t t;
+	int n;
 
 	time(&t);
 
-	if (context->next_cull && t < context->next_cull)
+	/* several pts may cull, each stripe is only walked under its lock */
+
+	if (pt->next_peer_cull && t < pt->next_peer_cull)
 		return;
 
-	lws_context_lock(context, "peer cull"); /* <========================= */
+	pt->next_peer_cull = t + 5;
 
-	context->next_cull = t + 5;
+	for (n = 0; n < LWS_PEER_STRIPES; n++) {
+		ps = &context->pl_stripe[n];
 
-	lws_start_foreach_llp(struct lws_peer **, p, context->peer_wait_list) {
-		if (t - (*p)->time_closed_all > 10) {
-			df = *p;
+		lws_peer_stripe_lock(ps); /* <============================= */
 
-			/* remove us from the peer wait list */
-			*p = df->peer_wait_list;
-			df->peer_wait_list = NULL;
+		/* the wait list is in order of time_closed_all */
 
-			__lws_peer_destroy(context, df);
-			continue; /* we already point to next, if any */
-		}
-	} lws_end_foreach_llp(p, peer_wait_list);
+		lws_start_foreach_dll_safe(struct lws_dll2 *, d, d1,
+					   lws_dll2_get_head(&ps->wait_owner)) {
+			struct lws_peer *df = lws_container_of(d,
+						struct lws_peer, list_wait);
+
+			if (t - df->time_closed_all <= 10)
+				break;
+
+			lws_dll2_remove(&df->list_wait);
+			__lws_peer_destroy(context, ps, df);
+		} lws_end_foreach_dll_safe(d, d1);
 
-	lws_context_unlock(context); /* ====================================> */
+		lws_peer_stripe_unlock(ps); /* ============================> */
+	}
 }
 
 void
 lws_peer_add_wsi(struct lws_context *context, struct lws_peer *peer,
 		 struct lws *wsi)
 {
+	struct lws_peer_stripe *ps;
+
 	if (!peer)
 		return;
 
-	lws_context_lock(context, "peer add"); /* <========================== */
+	ps = lws_peer_stripe(context, peer->hash);
+
+	lws_peer_stripe_lock(ps); /* <====================================== */
 
 	peer->count_wsi++;
 	wsi->peer = peer;
-	__lws_peer_remove_from_peer_wait_list(context, peer);
+	lws_dll2_remove(&peer->list_wait);
 
-	lws_context_unlock(context); /* ====================================> */
+	lws_peer_stripe_unlock(ps); /* =====================================> */
 }
 
 void
@@ -257,19 +372,25 @@ lws_peer_dump_from_wsi(struct lws *wsi)
 void
 lws_peer_track_wsi_close(struct lws_context *context, struct lws_peer *peer)
 {
+	struct lws_peer_stripe *ps;
+	char idle;
+
 	if (!peer)
 		return;
 
-	lws_context_lock(context, "peer wsi close"); /* <==================== */
+	ps = lws_peer_stripe(context, peer->hash);
+
+	lws_peer_stripe_lock(ps); /* <====================================== */
 
 	assert(peer->count_wsi);
 	peer->count_wsi--;
 
-	if (!peer->count_wsi
+	idle = !peer->count_wsi
 #if defined(LWS_ROLE_H1) || defined(LWS_ROLE_H2)
 			&& !peer->http.count_ah
 #endif
-	) {
+	;
+	if (idle)
 		/*
 		 * in order that we can accumulate peer activity correctly
 		 * allowing for periods when the peer has no connections,
@@ -278,11 +399,12 @@ lws_peer_track_wsi_close(struct lws_context *context, struct lws_peer *peer)
 		 * closed and add him to a peer_wait_list to be reaped
 		 * later if no further activity is coming.
 		 */
-		time(&peer->time_closed_all);
-		__lws_peer_add_to_peer_wait_list(context, peer);
-	}
+		__lws_peer_add_to_peer_wait_list(ps, peer);
+
+	lws_peer_stripe_unlock(ps); /* =====================================> */
 
-	lws_context_unlock(context); /* ====================================> */
+	if (idle)
+		lws_peer_schedule_cull(context);
 }
 
 #if defined(LWS_ROLE_H1) || defined(LWS_ROLE_H2)
@@ -304,15 +426,34 @@ lws_peer_confirm_ah_attach_ok(struct lws_context *context,
 	return 0;
 }
 
+void
+lws_peer_track_ah_attach(struct lws_context *context, struct lws_peer *peer)
+{
+	struct lws_peer_stripe *ps;
+
+	if (!peer)
+		return;
+
+	ps = lws_peer_stripe(context, peer->hash);
+
+	lws_peer_stripe_lock(ps); /* <====================================== */
+	peer->http.count_ah++;
+	lws_peer_stripe_unlock(ps); /* =====================================> */
+}
+
 void
 lws_peer_track_ah_detach(struct lws_context *context, struct lws_peer *peer)
 {
+	struct lws_peer_stripe *ps;
+
 	if (!peer)
 		return;
 
-	lws_context_lock(context, "peer ah detach"); /* <==================== */
+	ps = lws_peer_stripe(context, peer->hash);
+
+	lws_peer_stripe_lock(ps); /* <====================================== */
 	assert(peer->http.count_ah);
 	peer->http.count_ah--;
-	lws_context_unlock(context); /* ====================================> */
+	lws_peer_stripe_unlock(ps); /* =====================================> */
 }
 #endif
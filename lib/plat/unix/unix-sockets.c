@@ -48,6 +48,10 @@
 
 #include <netinet/ip.h>
 
+#if defined(LWS_HAVE_SENDFILE)
+#include <sys/sendfile.h>
+#endif
+
 int
 lws_send_pipe_choked(struct lws *wsi)
 {
@@ -635,3 +639,52 @@ lws_plat_mbedtls_net_recv(void *ctx, unsigned char *buf, size_t len)
 	return MBEDTLS_ERR_NET_RECV_FAILED;
 }
 #endif
+
+#if defined(LWS_HAVE_SENDFILE) && defined(LWS_WITH_FILE_OPS)
+/*
+ * Have the kernel copy up to len bytes from the current position in a
+ * platform fops file directly to the wsi socket.
+ *
+ * Returns 0 with *amount set to what was sent (0 if the socket buffer is
+ * full), 1 if sendfile() can't be used with this fd pair and the caller should
+ * fall back to read + write, or -1 on a fatal error.
+ */
+
+int
+lws_plat_file_sendfile(struct lws *wsi, lws_fop_fd_t fop_fd,
+		       lws_filepos_t len, lws_filepos_t *amount)
+{
+	ssize_t n;
+
+	*amount = 0;
+
+	/* NULL offset, so the fd offset moves on just like read() */
+	n = sendfile(wsi->desc.sockfd, fop_fd->fd, NULL, (size_t)len);
+	if (!n && len) {
+		lwsl_wsi_info(wsi, "file shorter than expected");
+
+		return -1;
+	}
+	if (n > 0) {
+		fop_fd->pos = (lws_filepos_t)(fop_fd->pos + (lws_filepos_t)n);
+		*amount = (lws_filepos_t)n;
+
+		return 0;
+	}
+
+	if (LWS_ERRNO == LWS_EAGAIN || LWS_ERRNO == LWS_EWOULDBLOCK ||
+	    LWS_ERRNO == LWS_EINTR)
+		return 0;
+
+	if (LWS_ERRNO == EINVAL || LWS_ERRNO == ENOSYS ||
+	    LWS_ERRNO == EOPNOTSUPP) {
+		lwsl_wsi_info(wsi, "sendfile unusable, errno %d", LWS_ERRNO);
+
+		return 1;
+	}
+
+	lwsl_wsi_info(wsi, "sendfile failed, errno %d", LWS_ERRNO);
+
+	return -1;
+}
+#endif
@@ -329,6 +329,7 @@ lws_spawn_piped(const struct lws_spawn_piped_info *i)
 {
 	const struct lws_protocols *pcol = i->vh->context->vhost_list->protocols;
 	struct lws_context *context = i->vh->context;
+	struct lws_context_per_thread *pt = &context->pt[i->tsi];
 	struct lws_spawn_piped *lsp;
 	const char *wd;
 	int n, m;
@@ -421,8 +422,12 @@ lws_spawn_piped(const struct lws_spawn_piped_info *i)
 			if (context->event_loop_ops->sock_accept(lsp->stdwsi[n]))
 				goto bail3;
 
-		if (__insert_wsi_socket_into_fds(context, lsp->stdwsi[n]))
+		lws_pt_lock(pt, __func__);
+		if (__insert_wsi_socket_into_fds(context, lsp->stdwsi[n])) {
+			lws_pt_unlock(pt);
 			goto bail3;
+		}
+		lws_pt_unlock(pt);
 		if (i->opt_parent) {
 			lsp->stdwsi[n]->parent = i->opt_parent;
 			lsp->stdwsi[n]->sibling_list = i->opt_parent->child_list;
@@ -567,8 +572,10 @@ lws_spawn_piped(const struct lws_spawn_piped_info *i)
 
 bail3:
 
+	lws_pt_lock(pt, __func__);
 	while (--n >= 0)
 		__remove_wsi_socket_from_fds(lsp->stdwsi[n]);
+	lws_pt_unlock(pt);
 bail2:
 	for (n = 0; n < 3; n++)
 		if (lsp->stdwsi[n])
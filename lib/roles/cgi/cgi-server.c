@@ -462,7 +462,7 @@ lws_cgi_write_split_stdout_headers(struct lws *wsi)
 	int n, m, cmd;
 	unsigned char buf[LWS_PRE + 4096], *start = &buf[LWS_PRE], *p = start,
 			*end = &buf[sizeof(buf) - 1 - LWS_PRE], *name,
-			*value = NULL;
+			*value = NULL, *hs = start, *he = end;
 	char c, hrs;
 
 	if (!wsi->http.cgi)
@@ -477,24 +477,34 @@ lws_cgi_write_split_stdout_headers(struct lws *wsi)
 		case LHCS_RESPONSE:
 			lwsl_wsi_debug(wsi, "LHCS_RESPONSE: iss response %d",
 					    wsi->http.cgi->response_code);
+			if (wsi->mux_substream) {
+				/*
+				 * On h2, the status goes in front of the
+				 * recoded cgi headers and they're all sent in
+				 * one HEADERS frame, since no other stream may
+				 * send anything between a HEADERS and its
+				 * CONTINUATIONs
+				 */
+				hs = wsi->http.cgi->headers_pos;
+				he = wsi->http.cgi->headers_end;
+				p = hs;
+			}
 			if (lws_add_http_header_status(wsi,
 						   (unsigned int)wsi->http.cgi->response_code,
-						       &p, end))
+						       &p, he))
 				return 1;
 			if (!wsi->http.cgi->explicitly_chunked &&
 			    !wsi->http.cgi->content_length &&
 				lws_add_http_header_by_token(wsi,
 					WSI_TOKEN_HTTP_TRANSFER_ENCODING,
-					(unsigned char *)"chunked", 7, &p, end))
+					(unsigned char *)"chunked", 7, &p, he))
 				return 1;
 			if (!(wsi->mux_substream))
 				if (lws_add_http_header_by_token(wsi,
 						WSI_TOKEN_CONNECTION,
 						(unsigned char *)"close", 5,
-						&p, end))
+						&p, he))
 					return 1;
-			n = lws_write(wsi, start, lws_ptr_diff_size_t(p, start),
-				      LWS_WRITE_HTTP_HEADERS | LWS_WRITE_NO_FIN);
 
 			/*
 			 * so we have a bunch of http/1 style ascii headers
@@ -502,17 +512,20 @@ lws_cgi_write_split_stdout_headers(struct lws *wsi)
 			 * wsi->http.cgi->headers_pos.  These are OK for http/1
 			 * connections, but they're no good for http/2 conns.
 			 *
-			 * Let's redo them at headers_pos forward using the
-			 * correct coding for http/1 or http/2
+			 * Let's redo them after the status using the
+			 * correct coding for http/2
 			 */
-			if (!wsi->mux_substream)
+			if (!wsi->mux_substream) {
+				n = lws_write(wsi, hs, lws_ptr_diff_size_t(p, hs),
+					      LWS_WRITE_HTTP_HEADERS |
+					      LWS_WRITE_NO_FIN);
 				goto post_hpack_recode;
+			}
 
+			wsi->http.cgi->headers_dumped = hs;
+			wsi->http.cgi->headers_pos = p;
 			p = wsi->http.cgi->headers_start;
-			wsi->http.cgi->headers_start =
-					wsi->http.cgi->headers_pos;
-			wsi->http.cgi->headers_dumped =
-					wsi->http.cgi->headers_start;
+			wsi->http.cgi->headers_start = hs;
 			hrs = HR_NAME;
 			name = buf;
 
@@ -600,12 +613,16 @@ post_hpack_recode:
 
 			n = (int)(wsi->http.cgi->headers_pos -
 			    wsi->http.cgi->headers_dumped);
-			if (n > 512)
-				n = 512;
+			cmd = LWS_WRITE_HTTP_HEADERS_CONTINUATION;
+			if (wsi->mux_substream)
+				/* the whole block in one frame, see above */
+				cmd = LWS_WRITE_HTTP_HEADERS;
+			else
+				if (n > 512)
+					n = 512;
 
 			lwsl_wsi_debug(wsi, "LHCS_DUMP_HEADERS: %d", n);
 
-			cmd = LWS_WRITE_HTTP_HEADERS_CONTINUATION;
 			if (wsi->http.cgi->headers_dumped + n !=
 						wsi->http.cgi->headers_pos) {
 				lwsl_notice("adding no fin flag\n");
@@ -623,8 +640,22 @@ post_hpack_recode:
 			if (wsi->http.cgi->headers_dumped ==
 			    wsi->http.cgi->headers_pos) {
 				wsi->hdr_state = LHCS_PAYLOAD;
-				lws_free_set_NULL(wsi->http.cgi->headers_buf);
-				lwsl_wsi_debug(wsi, "freed cgi headers");
+				if (wsi->http.cgi->hdr_rx_pos ==
+						wsi->http.cgi->hdr_rx_len) {
+					lws_free_set_NULL(wsi->http.cgi->headers_buf);
+					lwsl_wsi_debug(wsi, "freed cgi headers");
+				} else {
+					/*
+					 * we already read the start of the
+					 * body, stdout may never signal again
+					 * for it.  The HEADERS bit is the one
+					 * cleared when we return.
+					 */
+					wsi->reason_bf |=
+						LWS_CB_REASON_AUX_BF__CGI |
+						LWS_CB_REASON_AUX_BF__CGI_HEADERS;
+					lws_callback_on_writable(wsi);
+				}
 
 				if (wsi->http.cgi->post_in_expected) {
 					lwsl_wsi_info(wsi, "post data still "
@@ -651,8 +682,9 @@ post_hpack_recode:
 			n = 2048;
 			if (wsi->mux_substream)
 				n = 4096;
-			wsi->http.cgi->headers_buf = lws_malloc((unsigned int)n + LWS_PRE,
-							   "cgi hdr buf");
+			wsi->http.cgi->headers_buf = lws_malloc((unsigned int)n +
+						LWS_PRE + LWS_CGI_HDR_RX_SIZE,
+						"cgi hdr buf");
 			if (!wsi->http.cgi->headers_buf) {
 				lwsl_wsi_err(wsi, "OOM");
 				return -1;
@@ -665,6 +697,10 @@ post_hpack_recode:
 			wsi->http.cgi->headers_dumped = wsi->http.cgi->headers_pos;
 			wsi->http.cgi->headers_end =
 					wsi->http.cgi->headers_buf + n - 1;
+			wsi->http.cgi->hdr_rx =
+					wsi->http.cgi->headers_buf + n + LWS_PRE;
+			wsi->http.cgi->hdr_rx_pos = 0;
+			wsi->http.cgi->hdr_rx_len = 0;
 
 			for (n = 0; n < SIGNIFICANT_HDR_COUNT; n++) {
 				wsi->http.cgi->match[n] = 0;
@@ -672,27 +708,41 @@ post_hpack_recode:
 			}
 		}
 
-		n = lws_get_socket_fd(wsi->http.cgi->lsp->stdwsi[LWS_STDOUT]);
-		if (n < 0)
-			return -1;
-		n = (int)read(n, &c, 1);
-		if (n < 0) {
-			if (errno != EAGAIN) {
-				lwsl_wsi_debug(wsi, "read says %d", n);
+		if (wsi->http.cgi->hdr_rx_pos == wsi->http.cgi->hdr_rx_len) {
+			/*
+			 * Read what's waiting in one go, rather than a syscall
+			 * per header byte.  Whatever is left over when the
+			 * headers end is the start of the body.
+			 */
+			n = lws_get_socket_fd(wsi->http.cgi->lsp->stdwsi[LWS_STDOUT]);
+			if (n < 0)
 				return -1;
+			n = (int)read(n, wsi->http.cgi->hdr_rx,
+				      LWS_CGI_HDR_RX_SIZE);
+			if (n < 0) {
+				if (errno != EAGAIN) {
+					lwsl_wsi_debug(wsi, "read says %d", n);
+					return -1;
+				}
+				else
+					n = 0;
 			}
-			else
-				n = 0;
+			if (!n)
+				goto agin;
 
-			if (wsi->http.cgi->headers_pos >=
-					wsi->http.cgi->headers_end - 4) {
-				lwsl_wsi_notice(wsi, "CGI hdrs > buf size");
+			wsi->http.cgi->hdr_rx_pos = 0;
+			wsi->http.cgi->hdr_rx_len = (uint16_t)n;
+		}
 
-				return -1;
-			}
+		if (wsi->http.cgi->headers_pos >=
+				wsi->http.cgi->headers_end - 4) {
+			lwsl_wsi_notice(wsi, "CGI hdrs > buf size");
+
+			return -1;
 		}
-		if (!n)
-			goto agin;
+
+		c = (char)wsi->http.cgi->hdr_rx[wsi->http.cgi->hdr_rx_pos++];
+		n = 1;
 
 		lwsl_wsi_debug(wsi, "-- 0x%02X %c %d %d", (unsigned char)c, c,
 				    wsi->http.cgi->match[1], wsi->hdr_state);
@@ -823,10 +873,19 @@ agin:
 	m = !wsi->http.cgi->implied_chunked && !wsi->mux_substream &&
 	//    !wsi->http.cgi->explicitly_chunked &&
 	    !wsi->http.cgi->content_length;
-	n = lws_get_socket_fd(wsi->http.cgi->lsp->stdwsi[LWS_STDOUT]);
-	if (n < 0)
-		return -1;
-	n = (int)read(n, start, sizeof(buf) - LWS_PRE);
+	if (wsi->http.cgi->headers_buf) {
+		/* body we read along with the end of the headers goes first */
+		n = wsi->http.cgi->hdr_rx_len - wsi->http.cgi->hdr_rx_pos;
+		memcpy(start, wsi->http.cgi->hdr_rx + wsi->http.cgi->hdr_rx_pos,
+		       (unsigned int)n);
+		lws_free_set_NULL(wsi->http.cgi->headers_buf);
+		wsi->http.cgi->hdr_rx_pos = wsi->http.cgi->hdr_rx_len = 0;
+	} else {
+		n = lws_get_socket_fd(wsi->http.cgi->lsp->stdwsi[LWS_STDOUT]);
+		if (n < 0)
+			return -1;
+		n = (int)read(n, start, sizeof(buf) - LWS_PRE);
+	}
 
 	if (n < 0 && errno != EAGAIN) {
 		lwsl_wsi_debug(wsi, "stdout read says %d", n);
@@ -934,72 +993,25 @@ lws_cgi_kill(struct lws *wsi)
 int
 lws_cgi_kill_terminated(struct lws_context_per_thread *pt)
 {
-	struct lws_cgi **pcgi, *cgi = NULL;
+	struct lws_cgi **pcgi, *cgi;
 	int status, n = 1;
 
 	while (n > 0) {
-		/* find finished guys but don't reap yet */
+		/*
+		 * Reap anything that finished.  If it was one of our cgis, he
+		 * may still have headers or stdout for us to send, so just
+		 * note it, we can't waitpid() for him again later.
+		 */
 		n = waitpid(-1, &status, WNOHANG);
 		if (n <= 0)
 			continue;
 		lwsl_cx_debug(pt->context, "observed PID %d terminated", n);
 
-		pcgi = &pt->http.cgi_list;
-
-		/* check all the subprocesses on the cgi list */
-		while (*pcgi) {
-			/* get the next one first as list may change */
-			cgi = *pcgi;
-			pcgi = &(*pcgi)->cgi_list;
-
-			if (cgi->lsp->child_pid <= 0)
-				continue;
-
-			/* finish sending cached headers */
-			if (cgi->headers_buf)
-				continue;
-
-			/* wait for stdout to be drained */
-			if (cgi->content_length > cgi->content_length_seen)
-				continue;
-
-			if (cgi->content_length) {
-				lwsl_cx_debug(pt->context, "expected content "
-							   "length seen: %lld",
-				(unsigned long long)cgi->content_length_seen);
-			}
-
-			/* reap it */
-			waitpid(n, &status, WNOHANG);
-			/*
-			 * he's already terminated so no need for kill()
-			 * but we should do the terminated cgi callback
-			 * and close him if he's not already closing
-			 */
-			if (n == cgi->lsp->child_pid) {
-
-				if (!cgi->content_length) {
-					/*
-					 * well, if he sends chunked...
-					 * give him 2s after the
-					 * cgi terminated to send buffered
-					 */
-					cgi->chunked_grace++;
-					continue;
-				}
-
-				/* defeat kill() */
-				cgi->lsp->child_pid = 0;
-				lws_cgi_kill(cgi->wsi);
-
+		for (cgi = pt->http.cgi_list; cgi; cgi = cgi->cgi_list)
+			if (cgi->lsp && cgi->lsp->child_pid == n) {
+				cgi->exited = 1;
 				break;
 			}
-			cgi = NULL;
-		}
-		/* if not found on the cgi list, as he's one of ours, reap */
-		if (!cgi)
-			waitpid(n, &status, WNOHANG);
-
 	}
 
 	pcgi = &pt->http.cgi_list;
@@ -1010,15 +1022,13 @@ lws_cgi_kill_terminated(struct lws_context_per_thread *pt)
 		cgi = *pcgi;
 		pcgi = &(*pcgi)->cgi_list;
 
-		if (!cgi || !cgi->lsp || cgi->lsp->child_pid <= 0)
+		if (!cgi->lsp || cgi->lsp->child_pid <= 0)
 			continue;
 
-		/* we deferred killing him after reaping his PID */
-		if (cgi->chunked_grace) {
-			cgi->chunked_grace++;
-			if (cgi->chunked_grace < 2)
+		if (!cgi->exited) {
+			if (waitpid(cgi->lsp->child_pid, &status, WNOHANG) <= 0)
 				continue;
-			goto finish_him;
+			cgi->exited = 1;
 		}
 
 		/* finish sending cached headers */
@@ -1032,29 +1042,29 @@ lws_cgi_kill_terminated(struct lws_context_per_thread *pt)
 		if (cgi->content_length)
 			lwsl_wsi_debug(cgi->wsi, "expected cont len seen: %lld",
 				  (unsigned long long)cgi->content_length_seen);
-
-		/* reap it */
-		if (waitpid(cgi->lsp->child_pid, &status, WNOHANG) > 0) {
-
-			if (!cgi->content_length) {
-				/*
-				 * well, if he sends chunked...
-				 * give him 2s after the
-				 * cgi terminated to send buffered
-				 */
-				cgi->chunked_grace++;
+		else
+			/*
+			 * well, if he sends chunked... if we're still waiting
+			 * to pass on stdout we already read, give him until
+			 * our next look to send buffered
+			 */
+			if ((cgi->wsi->reason_bf & LWS_CB_REASON_AUX_BF__CGI) &&
+			    !cgi->wsi->cgi_stdout_zero_length &&
+			    !cgi->chunked_grace++)
 				continue;
-			}
-finish_him:
-			lwsl_cx_debug(pt->context, "found PID %d on cgi list",
-						   cgi->lsp->child_pid);
 
-			/* defeat kill() */
-			cgi->lsp->child_pid = 0;
-			lws_cgi_kill(cgi->wsi);
+		lwsl_cx_debug(pt->context, "found PID %d on cgi list",
+					   cgi->lsp->child_pid);
 
-			break;
-		}
+		/* defeat kill() */
+		cgi->lsp->child_pid = 0;
+		lws_cgi_kill(cgi->wsi);
+
+		/*
+		 * That may have closed his wsi and taken him off the list,
+		 * start again from the top to finish any others
+		 */
+		pcgi = &pt->http.cgi_list;
 	}
 
 	return 0;
@@ -37,6 +37,8 @@ extern const struct lws_role_ops role_ops_cgi;
 #define lwsi_role_cgi(wsi) (wsi->role_ops == &role_ops_cgi)
 
 #define LWS_HTTP_CHUNK_HDR_SIZE 16
+/* stdout is read this much at a time while parsing the cgi headers */
+#define LWS_CGI_HDR_RX_SIZE 1024
 
 enum {
 	SIGNIFICANT_HDR_CONTENT_LENGTH,		/* numeric */
@@ -64,6 +66,7 @@ struct lws_cgi {
 	unsigned char *headers_pos;
 	unsigned char *headers_dumped;
 	unsigned char *headers_end;
+	unsigned char *hdr_rx; /* in headers_buf allocation */
 
 	char summary[128];
 #if defined(LWS_WITH_ZLIB)
@@ -79,6 +82,8 @@ struct lws_cgi {
 	char l[12];
 	int response_code;
 	int lp;
+	uint16_t hdr_rx_pos;
+	uint16_t hdr_rx_len;
 
 	unsigned char being_closed:1;
 	unsigned char explicitly_chunked:1;
@@ -86,6 +91,7 @@ struct lws_cgi {
 	unsigned char implied_chunked:1;
 	unsigned char gzip_inflate:1;
 	unsigned char gzip_init:1;
+	unsigned char exited:1; /* child already reaped */
 
 	unsigned char chunked_grace;
 };
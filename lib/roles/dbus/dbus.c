@@ -95,7 +95,7 @@ __lws_shadow_wsi(struct lws_dbus_ctx *ctx, DBusWatch *w, int fd, int create_ok)
 	if (__insert_wsi_socket_into_fds(ctx->vh->context, wsi)) {
 		lwsl_err("inserting wsi socket into fds failed\n");
 		__lws_vhost_unbind_wsi(wsi); /* cx + vh lock */
-		lws_free(wsi);
+		lws_wsi_free_mem(wsi);
 		return NULL;
 	}
 
@@ -123,7 +123,7 @@ __lws_shadow_wsi_destroy(struct lws_dbus_ctx *ctx, struct lws *wsi)
 
 	__lws_vhost_unbind_wsi(wsi);
 
-	lws_free(wsi);
+	lws_wsi_free_mem(wsi);
 
 	return 0;
 }
@@ -894,7 +894,8 @@ rops_destroy_role_h1(struct lws *wsi)
 #endif
 
 #ifdef LWS_ROLE_WS
-	lws_free_set_NULL(wsi->ws);
+	lws_freelist_free(&wsi->a.context->pt[(int)wsi->tsi].fl_ws, wsi->ws);
+	wsi->ws = NULL;
 #endif
 	return 0;
 }
@@ -1095,7 +1096,7 @@ rops_pt_init_destroy_h1(struct lws_context *context,
 
 		pt->sul_ah_lifecheck.cb = lws_sul_http_ah_lifecheck;
 
-		__lws_sul_insert_us(&pt->pt_sul_owner[LWSSULLI_MISS_IF_SUSPENDED],
+		__lws_sul_insert_us(pt, LWSSULLI_MISS_IF_SUSPENDED,
 				 &pt->sul_ah_lifecheck, 30 * LWS_US_PER_SEC);
 	} else
 		lws_dll2_remove(&pt->sul_ah_lifecheck.list);
@@ -193,6 +193,7 @@ static const char * const http2_canned[] = {
 
 #include "huftable.h"
 
+#if !defined(LWS_WITH_HTTP2_HUFFMAN_FSM)
 static int huftable_decode(int pos, char c)
 {
 	int q = pos + !!c;
@@ -202,6 +203,7 @@ static int huftable_decode(int pos, char c)
 
 	return pos + (lextable[q] << 1);
 }
+#endif
 
 static int lws_frag_start(struct lws *wsi, int hdr_token_idx)
 {
@@ -598,8 +600,20 @@ lws_hpack_dynamic_size(struct lws *wsi, int size)
 		  (unsigned int)nwsi->a.vhost->h2.set.s[H2SET_HEADER_TABLE_SIZE]);
 
 	if (!size) {
+		/*
+		 * The peer emptied its table (rfc7541 4.2), so evict everything,
+		 * keeping the entries for when it grows it again.  This used to
+		 * "destroy" it via the stream wsi, which has no h2n, so nothing
+		 * was evicted and our accounting went out of step with his.
+		 */
+		while (dyn->used_entries) {
+			n = lws_safe_modulo(dyn->pos - dyn->used_entries,
+					    dyn->num_entries);
+			if (n < 0)
+				n += dyn->num_entries;
+			lws_dynamic_free(dyn, n);
+		}
 		size = dyn->num_entries * 8;
-		lws_hpack_destroy_dynamic_header(wsi);
 	}
 
 	if (size > (int)nwsi->a.vhost->h2.set.s[H2SET_HEADER_TABLE_SIZE]) {
@@ -821,12 +835,183 @@ lws_hpack_handle_pseudo_rules(struct lws *nwsi, struct lws *wsi, int m)
 	return 0;
 }
 
+/*
+ * Decode one byte of a huffman-coded string into zero, one or two chars in
+ * out[], returns how many, or -1 if it's not valid.
+ *
+ * Afterwards, h2n->huff_pad and h2n->zero_huff_padding are set so the check
+ * at the end of the string can tell if it would have legal padding if it
+ * ended here.
+ */
+
+static int
+lws_hpack_huff_byte(struct lws *nwsi, struct lws_h2_netconn *h2n,
+		    unsigned char c, unsigned char *out)
+{
+#if defined(LWS_WITH_HTTP2_HUFFMAN_FSM)
+	const unsigned char *t = NULL;
+	int m = 0, n;
+
+	/* 4 bits at a time, with the state machine from minihuf.c */
+
+	for (n = 0; n < 2; n++) {
+		t = huftable_fsm[h2n->hpack_pos][n ? c & 0xf : c >> 4];
+		if (t[1] & HUFTABLE_FSM_FAIL) {
+			lws_h2_goaway(nwsi, H2_ERR_COMPRESSION_ERROR,
+				      "Huffman EOT seen");
+			return -1;
+		}
+		if (t[1] & HUFTABLE_FSM_SYM)
+			out[m++] = t[2];
+		h2n->hpack_pos = t[0];
+	}
+
+	/* the state machine already knows if the padding is OK to end on */
+
+	h2n->huff_pad = !(t[1] & HUFTABLE_FSM_ACCEPT);
+	h2n->zero_huff_padding = !(t[1] & HUFTABLE_FSM_ACCEPT);
+
+	return m;
+#else
+	unsigned int prev;
+	int m = 0, n;
+
+	for (n = 0; n < 8; n++) {
+		char b = (c >> 7) & 1;
+
+		prev = h2n->hpack_pos;
+		h2n->hpack_pos = (uint16_t)huftable_decode(
+				(int)h2n->hpack_pos, b);
+		c = (unsigned char)(c << 1);
+		if (h2n->hpack_pos == 0xffff) {
+			lwsl_notice("Huffman err\n");
+			return -1;
+		}
+		if (!(h2n->hpack_pos & 0x8000)) {
+			if (!b)
+				h2n->zero_huff_padding = 1;
+			h2n->huff_pad++;
+			continue;
+		}
+		out[m] = (uint8_t)(h2n->hpack_pos & 0x7fff);
+		h2n->hpack_pos = 0;
+		h2n->huff_pad = 0;
+		h2n->zero_huff_padding = 0;
+
+		/* EOS |11111111|11111111|11111111|111111 */
+		if (!out[m] && prev == HUFTABLE_0x100_PREV) {
+			lws_h2_goaway(nwsi, H2_ERR_COMPRESSION_ERROR,
+				      "Huffman EOT seen");
+			return -1;
+		}
+		m++;
+	}
+
+	return m;
+#endif
+}
+
+/*
+ * Deal with one decoded char of a header name or value, returns 0 if OK
+ */
+
+static int
+lws_hpack_data_char(struct lws *wsi, struct lws *nwsi,
+		    struct lws_h2_netconn *h2n, unsigned char c1)
+{
+	struct allocated_headers *ah = wsi->http.ah;
+	int plen;
+
+	if (h2n->value) { /* value */
+
+		if (!h2n->hdr_idx || h2n->hdr_idx == LWS_HPACK_IGNORE_ENTRY)
+			return 0;
+
+		if (ah->hdr_token_idx == WSI_TOKEN_HTTP_COLON_PATH) {
+
+			switch (lws_parse_urldecode(wsi, &c1)) {
+			case LPUR_CONTINUE:
+				break;
+			case LPUR_SWALLOW:
+				return 0;
+			case LPUR_EXCESSIVE:
+			case LPUR_FORBID:
+				lws_h2_goaway(nwsi, H2_ERR_PROTOCOL_ERROR,
+					      "Evil URI");
+				return 1;
+
+			default:
+				return -1;
+			}
+		}
+		if (lws_frag_append(wsi, c1)) {
+			lwsl_notice("%s: frag app fail\n", __func__);
+			return 1;
+		}
+
+		return 0;
+	}
+
+	/*
+	 * Convert name using existing parser,
+	 * If h2n->unknown_header == 0, result is
+	 * in wsi->parser_state
+	 * using WSI_TOKEN_GET_URI.
+	 *
+	 * If unknown header h2n->unknown_header
+	 * will be set.
+	 */
+	h2n->hpack_hdr_len++;
+	if (h2n->is_first_header_char) {
+		h2n->is_first_header_char = 0;
+		h2n->first_hdr_char = (char)c1;
+	}
+	lwsl_header("parser: %c\n", c1);
+	/* uppercase header names illegal */
+	if (c1 >= 'A' && c1 <= 'Z') {
+		lws_h2_goaway(nwsi, H2_ERR_COMPRESSION_ERROR,
+			      "Uppercase literal hpack hdr");
+		return 1;
+	}
+	plen = 1;
+	if (!h2n->unknown_header && lws_parse(wsi, &c1, &plen))
+		h2n->unknown_header = 1;
+
+	return 0;
+}
+
+/*
+ * One byte of a header name or value string, huffman-coded or not
+ */
+
+static int
+lws_hpack_data_byte(struct lws *wsi, struct lws *nwsi,
+		    struct lws_h2_netconn *h2n, unsigned char c)
+{
+	unsigned char out[2];
+	int n, m, r;
+
+	if (!h2n->huff)
+		return lws_hpack_data_char(wsi, nwsi, h2n, c);
+
+	n = lws_hpack_huff_byte(nwsi, h2n, c, out);
+	if (n < 0)
+		return 1;
+
+	for (m = 0; m < n; m++) {
+		r = lws_hpack_data_char(wsi, nwsi, h2n, out[m]);
+		if (r)
+			return r;
+	}
+
+	return 0;
+}
+
 int lws_hpack_interpret(struct lws *wsi, unsigned char c)
 {
 	struct lws *nwsi = lws_get_network_wsi(wsi);
 	struct lws_h2_netconn *h2n = nwsi->h2.h2n;
 	struct allocated_headers *ah = wsi->http.ah;
-	unsigned int prev;
 	unsigned char c1;
 	int n, m, plen;
 
@@ -1105,105 +1290,9 @@ pre_data:
 		goto pre_data;
 
 	case HPKS_DATA:
-		//lwsl_header(" 0x%02X huff %d\n", c, h2n->huff);
-			c1 = c;
-
-		for (n = 0; n < 8; n++) {
-			if (h2n->huff) {
-				char b = (c >> 7) & 1;
-				prev = h2n->hpack_pos;
-				h2n->hpack_pos = (uint16_t)huftable_decode(
-						(int)h2n->hpack_pos, b);
-				c = (unsigned char)(c << 1);
-				if (h2n->hpack_pos == 0xffff) {
-					lwsl_notice("Huffman err\n");
-					return 1;
-				}
-				if (!(h2n->hpack_pos & 0x8000)) {
-					if (!b)
-						h2n->zero_huff_padding = 1;
-					h2n->huff_pad++;
-					continue;
-				}
-				c1 = (uint8_t)(h2n->hpack_pos & 0x7fff);
-				h2n->hpack_pos = 0;
-				h2n->huff_pad = 0;
-				h2n->zero_huff_padding = 0;
-
-				/* EOS |11111111|11111111|11111111|111111 */
-				if (!c1 && prev == HUFTABLE_0x100_PREV) {
-					lws_h2_goaway(nwsi,
-						H2_ERR_COMPRESSION_ERROR,
-						"Huffman EOT seen");
-					return 1;
-				}
-			} else
-				n = 8;
-
-			if (h2n->value) { /* value */
-
-				if (h2n->hdr_idx &&
-				    h2n->hdr_idx != LWS_HPACK_IGNORE_ENTRY) {
-
-					if (ah->hdr_token_idx ==
-					    WSI_TOKEN_HTTP_COLON_PATH) {
-
-						switch (lws_parse_urldecode(
-								    wsi, &c1)) {
-						case LPUR_CONTINUE:
-							break;
-						case LPUR_SWALLOW:
-							goto swallow;
-						case LPUR_EXCESSIVE:
-						case LPUR_FORBID:
-							lws_h2_goaway(nwsi,
-							  H2_ERR_PROTOCOL_ERROR,
-							  "Evil URI");
-							return 1;
-
-						default:
-							return -1;
-						}
-					}
-					if (lws_frag_append(wsi, c1)) {
-						lwsl_notice(
-							"%s: frag app fail\n",
-							    __func__);
-						return 1;
-					}
-				} //else
-					//lwsl_header("ignoring %c\n", c1);
-			} else {
-				/*
-				 * Convert name using existing parser,
-			 	 * If h2n->unknown_header == 0, result is
-				 * in wsi->parser_state
-			 	 * using WSI_TOKEN_GET_URI.
-			 	 *
-			 	 * If unknown header h2n->unknown_header
-			 	 * will be set.
-			 	 */
-				h2n->hpack_hdr_len++;
-				if (h2n->is_first_header_char) {
-					h2n->is_first_header_char = 0;
-					h2n->first_hdr_char = (char)c1;
-				}
-				lwsl_header("parser: %c\n", c1);
-				/* uppercase header names illegal */
-				if (c1 >= 'A' && c1 <= 'Z') {
-					lws_h2_goaway(nwsi,
-						H2_ERR_COMPRESSION_ERROR,
-						"Uppercase literal hpack hdr");
-					return 1;
-				}
-				plen = 1;
-				if (!h2n->unknown_header &&
-				    lws_parse(wsi, &c1, &plen))
-					h2n->unknown_header = 1;
-			}
-swallow:
-			(void)n;
-		} // for n
+		n = lws_hpack_data_byte(wsi, nwsi, h2n, c);
+		if (n)
+			return n;
 
 		if (--h2n->hpack_len)
 			break;
@@ -1353,6 +1442,49 @@ add_it:
 	return 0;
 }
 
+/*
+ * The same as passing the buffer to lws_hpack_interpret() a byte at a time,
+ * but the middle of header name and value strings, which is most of the
+ * bytes in a header block, is done in a tight loop here.  The last byte of
+ * each string goes through lws_hpack_interpret() to finish the string.
+ */
+
+int
+lws_hpack_interpret_buf(struct lws *wsi, const unsigned char *buf, size_t len)
+{
+	struct lws *nwsi = lws_get_network_wsi(wsi);
+	struct lws_h2_netconn *h2n = nwsi->h2.h2n;
+	size_t run;
+	int n;
+
+	if (!h2n)
+		return -1;
+
+	while (len) {
+		if (h2n->hpack != HPKS_DATA || h2n->hpack_len < 2) {
+			n = lws_hpack_interpret(wsi, *buf++);
+			if (n)
+				return n;
+			len--;
+			continue;
+		}
+
+		run = h2n->hpack_len - 1;
+		if (run > len)
+			run = len;
+		len -= run;
+		h2n->hpack_len -= (uint32_t)run;
+
+		while (run--) {
+			n = lws_hpack_data_byte(wsi, nwsi, h2n, *buf++);
+			if (n)
+				return n;
+		}
+	}
+
+	return 0;
+}
+
 
 
 static unsigned int
@@ -1476,3 +1608,437 @@ int lws_add_http2_header_status(struct lws *wsi, unsigned int code,
 
 	return 0;
 }
+
+/*
+ * hpack encoder
+ *
+ * Header blocks are built up by lws_add_http2_header_by_name() as literals
+ * that don't touch the peer's dynamic table.  Just before a block goes out in
+ * a HEADERS frame, we re-encode it using the static table, our copy of the
+ * peer decoder's dynamic table, and huffman coding where that is shorter.
+ * Doing it at write time means blocks reach the table in the same order they
+ * reach the wire, whatever order the streams prepared them in.
+ *
+ * The output is never larger than the literal input, apart from a couple of
+ * table size updates at the start.
+ */
+
+#define LWS_HPACK_ENC_MASK (LWS_H2_HPACK_ENC_ENTRIES - 1)
+
+/* values that are private or different every time aren't worth indexing */
+
+static const char * const hpack_enc_never[] = {
+	"authorization", "proxy-authorization", "cookie", "set-cookie",
+};
+
+static const char * const hpack_enc_unindexed[] = {
+	":path", "content-length", "content-range", "date", "etag",
+	"last-modified", "expires", "age", "location", "if-modified-since",
+	"if-none-match",
+};
+
+static int
+lws_hpack_enc_name_in(const char * const *list, int count,
+		      const uint8_t *name, uint32_t nl)
+{
+	while (count--)
+		if (strlen(list[count]) == nl && !memcmp(list[count], name, nl))
+			return 1;
+
+	return 0;
+}
+
+/*
+ * While a block is encoded, we work on a copy of the table bookkeeping.  New
+ * entries go in free slots after the table's head, and evicted ones are only
+ * freed once the whole block is known to fit, so a failed block leaves the
+ * table as the peer still has it.
+ */
+
+struct hpack_enc_stage {
+	uint32_t size;
+	uint32_t max;
+	uint16_t head;
+	uint16_t count;
+	uint16_t added; /* new entries, from the table's head onwards */
+};
+
+static void
+lws_hpack_enc_release(struct hpack_enc_table *t, int from, int count)
+{
+	while (count-- > 0) {
+		lws_free_set_NULL(t->entries[from & LWS_HPACK_ENC_MASK].nv);
+		from++;
+	}
+}
+
+static void
+lws_hpack_enc_evict(struct hpack_enc_table *t, struct hpack_enc_stage *st,
+		    uint32_t limit)
+{
+	struct hpack_enc_entry *e;
+
+	while (st->count && st->size > limit) {
+		e = &t->entries[(st->head - st->count) & LWS_HPACK_ENC_MASK];
+		st->size -= (uint32_t)e->name_len + e->value_len + 32u;
+		st->count--;
+	}
+}
+
+/*
+ * Returns the index of an entry matching both name and value, setting *full,
+ * or else the index of one matching only the name, or 0 if nothing does
+ */
+
+static int
+lws_hpack_enc_find(const struct hpack_enc_table *t,
+		   const struct hpack_enc_stage *st, const uint8_t *name,
+		   uint32_t nl, const uint8_t *value, uint32_t vl, int *full)
+{
+	const struct hpack_enc_entry *e;
+	const char *s;
+	int n, idx = 0;
+
+	*full = 0;
+
+	if (!nl)
+		return 0;
+
+	for (n = 1; n < (int)LWS_ARRAY_SIZE(static_token); n++) {
+		if (static_hdr_len[n] != nl)
+			continue;
+		s = (const char *)lws_token_to_string(static_token[n]);
+		if (!s || memcmp(s, name, nl))
+			continue;
+		if (!idx)
+			idx = n;
+		s = n < (int)LWS_ARRAY_SIZE(http2_canned) ? http2_canned[n] : "";
+		if (strlen(s) == vl && !memcmp(s, value, vl)) {
+			*full = 1;
+			return n;
+		}
+	}
+
+	for (n = 0; n < st->count; n++) {
+		e = &t->entries[(st->head - 1 - n) & LWS_HPACK_ENC_MASK];
+		if (e->name_len != nl || memcmp(e->nv, name, nl))
+			continue;
+		if (e->value_len == vl && !memcmp(e->nv + nl, value, vl)) {
+			*full = 1;
+			return (int)LWS_ARRAY_SIZE(static_token) + n;
+		}
+		if (!idx)
+			idx = (int)LWS_ARRAY_SIZE(static_token) + n;
+	}
+
+	return idx;
+}
+
+static int
+lws_hpack_enc_int(uint8_t **p, uint8_t *end, uint8_t first, int bits,
+		  unsigned long num)
+{
+	if (*p >= end)
+		return 1;
+
+	*((*p)++) = (uint8_t)(first | lws_h2_num_start(bits, num));
+
+	return lws_h2_num(bits, num, p, end);
+}
+
+static int
+lws_hpack_enc_str(uint8_t **p, uint8_t *end, const uint8_t *s, uint32_t len)
+{
+	unsigned int bits = 0;
+	uint64_t acc = 0;
+	uint32_t n;
+
+	for (n = 0; n < len; n++)
+		bits += huftable_enc_len[s[n]];
+	bits = (bits + 7) >> 3;
+
+	if (bits >= len) {
+		if (lws_hpack_enc_int(p, end, 0, 7, len) ||
+		    lws_ptr_diff_size_t(end, *p) < len)
+			return 1;
+		memcpy(*p, s, len);
+		*p += len;
+
+		return 0;
+	}
+
+	if (lws_hpack_enc_int(p, end, 0x80, 7, bits) ||
+	    lws_ptr_diff_size_t(end, *p) < bits)
+		return 1;
+
+	bits = 0;
+	while (len--) {
+		acc = (acc << huftable_enc_len[*s]) | huftable_enc_code[*s];
+		bits += huftable_enc_len[*s++];
+		while (bits >= 8) {
+			bits -= 8;
+			*((*p)++) = (uint8_t)(acc >> bits);
+		}
+	}
+	if (bits) /* pad with the msbs of EOS */
+		*((*p)++) = (uint8_t)((acc << (8 - bits)) | (0xff >> bits));
+
+	return 0;
+}
+
+/* one non-huffman string from a literal, as lws_add_http2_header_by_name() */
+
+static int
+lws_hpack_lit_str(const uint8_t **p, const uint8_t *end, const uint8_t **s,
+		  uint32_t *len)
+{
+	unsigned int m = 0;
+	uint32_t v;
+	uint8_t c;
+
+	if (*p >= end || (**p & 0x80))
+		return 1;
+
+	v = *((*p)++) & 0x7f;
+	if (v == 0x7f)
+		do {
+			if (*p >= end || m > 21)
+				return 1;
+			c = *((*p)++);
+			v += (uint32_t)(c & 0x7f) << m;
+			m += 7;
+		} while (c & 0x80);
+
+	if (lws_ptr_diff_size_t(end, *p) < v)
+		return 1;
+
+	*s = *p;
+	*len = v;
+	*p += v;
+
+	return 0;
+}
+
+void
+lws_hpack_enc_table_size(struct lws_h2_netconn *h2n, uint32_t size)
+{
+	/*
+	 * If the peer makes its table smaller and then bigger again before
+	 * our next block, we must tell it about the smallest (rfc7541 4.2)
+	 */
+
+	if (!h2n->hpack_enc_resized || size < h2n->hpack_enc_lowest)
+		h2n->hpack_enc_lowest = size;
+	h2n->hpack_enc_resized = 1;
+}
+
+void
+lws_hpack_enc_destroy(struct lws_h2_netconn *h2n)
+{
+	if (!h2n->hpack_enc)
+		return;
+
+	lws_hpack_enc_release(h2n->hpack_enc,
+			      h2n->hpack_enc->head - h2n->hpack_enc->count,
+			      h2n->hpack_enc->count);
+	lws_free(h2n->hpack_enc->buf);
+	lws_free_set_NULL(h2n->hpack_enc);
+}
+
+/*
+ * Replace *buf / *len with the compressed version of the header block, if it
+ * consists only of lws' own literals.  Anything else is left as it is, since
+ * literals without indexing never change the peer's table, but if the peer
+ * changed its table size, the size update still goes in front of it: it must
+ * start the first block after the change (rfc7541 4.2).
+ *
+ * We're only called for HEADERS, so *buf is always the start of a block.
+ *
+ * The new block is in a buffer belonging to the network connection, with
+ * LWS_PRE in front of it for the frame header.
+ */
+
+int
+lws_hpack_encode_block(struct lws *wsi, unsigned char **buf, size_t *len)
+{
+	struct lws *nwsi = lws_get_network_wsi(wsi);
+	struct lws_h2_netconn *h2n = nwsi->h2.h2n;
+	const uint8_t *p = *buf, *end = p + *len, *name, *value;
+	struct hpack_enc_stage st;
+	struct hpack_enc_table *t;
+	struct hpack_enc_entry *e;
+	uint8_t *o, *oe, rep;
+	uint32_t nl, vl, want;
+	int idx, full, lits = 1;
+	char *nv;
+
+	if (!h2n || !*len ||
+	    lws_check_opt(wsi->a.vhost->options,
+			  LWS_SERVER_OPTION_H2_HPACK_LITERAL_ONLY))
+		return 0;
+
+	while (p < end)
+		if (*p++ || lws_hpack_lit_str(&p, end, &name, &nl) ||
+			    lws_hpack_lit_str(&p, end, &value, &vl)) {
+			lits = 0;
+			break;
+		}
+
+	want = h2n->peer_set.s[H2SET_HEADER_TABLE_SIZE];
+	if (want > LWS_H2_HPACK_ENC_TABLE_MAX)
+		want = LWS_H2_HPACK_ENC_TABLE_MAX;
+
+	if (!lits && !h2n->hpack_enc_resized &&
+	    want == (h2n->hpack_enc ? h2n->hpack_enc->max : 4096))
+		/* nothing for us to do, send it as it is */
+		return 0;
+
+	t = h2n->hpack_enc;
+	if (!t) {
+		t = lws_zalloc(sizeof(*t), __func__);
+		if (!t)
+			return 0;
+		/* what the peer decoder starts with, rfc7540 6.5.2 */
+		t->max = 4096;
+		h2n->hpack_enc = t;
+	}
+
+	if (t->buf_len < LWS_PRE + *len + 32) {
+		lws_free(t->buf);
+		t->buf_len = LWS_PRE + *len + 32;
+		if (t->buf_len < LWS_PRE + 512)
+			t->buf_len = LWS_PRE + 512;
+		t->buf = lws_malloc(t->buf_len, __func__);
+		if (!t->buf) {
+			t->buf_len = 0;
+			return 0;
+		}
+	}
+
+	o = t->buf + LWS_PRE;
+	oe = t->buf + t->buf_len;
+
+	st.size = t->size;
+	st.max = t->max;
+	st.head = t->head;
+	st.count = t->count;
+	st.added = 0;
+
+	/* any table size updates must come first in the block */
+
+	if (h2n->hpack_enc_resized && h2n->hpack_enc_lowest < want &&
+	    h2n->hpack_enc_lowest < st.max) {
+		st.max = h2n->hpack_enc_lowest;
+		lws_hpack_enc_evict(t, &st, st.max);
+		if (lws_hpack_enc_int(&o, oe, 0x20, 5, st.max))
+			goto bail;
+	}
+
+	if (want != st.max) {
+		st.max = want;
+		lws_hpack_enc_evict(t, &st, st.max);
+		if (lws_hpack_enc_int(&o, oe, 0x20, 5, st.max))
+			goto bail;
+	}
+
+	if (!lits) {
+		/* the block follows the updates unchanged */
+		if (lws_ptr_diff_size_t(oe, o) < *len)
+			goto bail;
+		memcpy(o, *buf, *len);
+		o += *len;
+	}
+
+	p = *buf;
+	while (lits && p < end) {
+		p++;
+		lws_hpack_lit_str(&p, end, &name, &nl);
+		lws_hpack_lit_str(&p, end, &value, &vl);
+
+		idx = lws_hpack_enc_find(t, &st, name, nl, value, vl, &full);
+		if (full) {
+			if (lws_hpack_enc_int(&o, oe, 0x80, 7, (unsigned long)idx))
+				goto bail;
+			continue;
+		}
+
+		/*
+		 * Only index it if there's a free slot after everything the
+		 * table held before this block, we can't reuse the slots of
+		 * entries we evict until we know the block is going out
+		 */
+
+		nv = NULL;
+		if (lws_hpack_enc_name_in(hpack_enc_never,
+				(int)LWS_ARRAY_SIZE(hpack_enc_never), name, nl))
+			rep = 0x10;
+		else
+			if (nl + vl + 32 > (st.max * 3) / 4 ||
+			    t->count + st.added >= LWS_H2_HPACK_ENC_ENTRIES ||
+			    lws_hpack_enc_name_in(hpack_enc_unindexed,
+					(int)LWS_ARRAY_SIZE(hpack_enc_unindexed),
+					name, nl))
+				rep = 0;
+			else {
+				nv = lws_malloc(nl + vl + 1, __func__);
+				/* if OOM, just don't index it */
+				rep = nv ? 0x40 : 0;
+			}
+
+		if (lws_hpack_enc_int(&o, oe, rep, rep == 0x40 ? 6 : 4,
+				      (unsigned long)idx) ||
+		    (!idx && lws_hpack_enc_str(&o, oe, name, nl)) ||
+		    lws_hpack_enc_str(&o, oe, value, vl)) {
+			lws_free(nv);
+			goto bail;
+		}
+
+		if (!nv)
+			continue;
+
+		/* the peer adds it to its table, so we do the same */
+
+		lws_hpack_enc_evict(t, &st, st.max - (nl + vl + 32));
+		memcpy(nv, name, nl);
+		memcpy(nv + nl, value, vl);
+		e = &t->entries[st.head & LWS_HPACK_ENC_MASK];
+		assert(!e->nv);
+		e->nv = nv;
+		e->name_len = (uint16_t)nl;
+		e->value_len = (uint16_t)vl;
+		st.head = (uint16_t)((st.head + 1) & LWS_HPACK_ENC_MASK);
+		st.count++;
+		st.added++;
+		st.size += nl + vl + 32;
+	}
+
+	/*
+	 * The whole block fits, so it's going out and the peer's table will
+	 * change the way we staged it.  Free what it will evict.
+	 */
+
+	lws_hpack_enc_release(t, t->head - t->count,
+			      t->count + st.added - st.count);
+	t->size = st.size;
+	t->max = st.max;
+	t->head = st.head;
+	t->count = st.count;
+	h2n->hpack_enc_resized = 0;
+
+	lwsl_header("%s: %u -> %u\n", __func__, (unsigned int)*len,
+		    (unsigned int)lws_ptr_diff_size_t(o, t->buf + LWS_PRE));
+
+	*buf = t->buf + LWS_PRE;
+	*len = lws_ptr_diff_size_t(o, *buf);
+
+	return 0;
+
+bail:
+	/* can't happen, the buffer is always big enough */
+	lwsl_wsi_err(wsi, "hpack encode overflow");
+
+	/* the peer never sees the block, so its table stays as it was */
+	lws_hpack_enc_release(t, t->head, st.added);
+
+	return -1;
+}
@@ -120,6 +120,22 @@ lws_h2_dump_settings(struct http2_settings *set)
 }
 #endif
 
+/*
+ * How long the network wsi may go without any frames before we close it
+ */
+
+static int
+lws_h2_idle_secs(struct lws *nwsi)
+{
+#if defined(LWS_WITH_CLIENT)
+	if (lwsi_role_client(nwsi) && nwsi->a.vhost->cli_idle_secs)
+		return (int)nwsi->a.vhost->cli_idle_secs;
+#endif
+
+	return nwsi->a.vhost->keepalive_timeout ?
+			nwsi->a.vhost->keepalive_timeout : 31;
+}
+
 struct lws_h2_protocol_send *
 lws_h2_new_pps(enum lws_h2_protocol_send_type type)
 {
@@ -179,6 +195,18 @@ lws_h2_update_peer_txcredit(struct lws *wsi, unsigned int sid, int bump)
 
 	lws_pps_schedule(wsi, pps);
 
+	/*
+	 * Each new stream also bumps the nwsi window, which only comes back
+	 * down as data actually arrives.  With many short streams it would
+	 * eventually pass the 31-bit window limit, which the peer must treat
+	 * as a connection error, so stop well short of that
+	 */
+
+	if (nwsi->txc.peer_tx_cr_est > LWS_H2_NWSI_TXCR_MAX - bump)
+		bump = LWS_H2_NWSI_TXCR_MAX - nwsi->txc.peer_tx_cr_est;
+	if (bump <= 0)
+		return 0;
+
 	pps = lws_h2_new_pps(LWS_H2_PPS_UPDATE_WINDOW);
 	if (!pps)
 		return 1;
@@ -281,6 +309,15 @@ __lws_wsi_server_new(struct lws_vhost *vh, struct lws *parent_wsi,
 	wsi->mux_substream = 1;
 	wsi->seen_nonpseudoheader = 0;
 
+	wsi->h2.prio_urgency = LWS_H2_PRIO_URGENCY_DEFAULT;
+	if (h2n->prio_pending_sid == sid) {
+		/* a PRIORITY_UPDATE for this stream came before it opened */
+		wsi->h2.prio_urgency = h2n->prio_pending_urgency;
+		wsi->h2.prio_incremental = !!h2n->prio_pending_incremental;
+		wsi->h2.prio_from_frame = 1;
+		h2n->prio_pending_sid = 0;
+	}
+
 	wsi->txc.tx_cr = (int32_t)nwsi->h2.h2n->peer_set.s[H2SET_INITIAL_WINDOW_SIZE];
 	wsi->txc.peer_tx_cr_est =
 			(int32_t)nwsi->h2.h2n->our_set.s[H2SET_INITIAL_WINDOW_SIZE];
@@ -317,7 +354,7 @@ bail1:
 		lws_free_set_NULL(wsi->user_space);
 	vh->protocols[0].callback(wsi, LWS_CALLBACK_WSI_DESTROY, NULL, NULL, 0);
 	__lws_vhost_unbind_wsi(wsi);
-	lws_free(wsi);
+	lws_wsi_free_mem(wsi);
 
 	return NULL;
 }
@@ -341,6 +378,7 @@ lws_wsi_h2_adopt(struct lws *parent_wsi, struct lws *wsi)
 	wsi->client_mux_substream = 1;
 #endif
 	wsi->h2.initialized = 1;
+	wsi->h2.prio_urgency = LWS_H2_PRIO_URGENCY_DEFAULT;
 
 #if 0
 	/* only assign sid at header send time when we know it */
@@ -379,7 +417,7 @@ bail1:
 	if (wsi->user_space)
 		lws_free_set_NULL(wsi->user_space);
 	wsi->a.protocol->callback(wsi, LWS_CALLBACK_WSI_DESTROY, NULL, NULL, 0);
-	lws_free(wsi);
+	lws_wsi_free_mem(wsi);
 
 	return NULL;
 }
@@ -515,6 +553,8 @@ lws_h2_settings(struct lws *wsi, struct http2_settings *settings,
 
 		switch (a) {
 		case H2SET_HEADER_TABLE_SIZE:
+			if (nwsi->h2.h2n && settings == &nwsi->h2.h2n->peer_set)
+				lws_hpack_enc_table_size(nwsi->h2.h2n, b);
 			break;
 		case H2SET_ENABLE_PUSH:
 			if (b > 1) {
@@ -699,6 +739,262 @@ int lws_h2_frame_write(struct lws *wsi, int type, int flags,
 	return n;
 }
 
+/*
+ * While the network wsi services its children in one POLLOUT, what they write
+ * on it is gathered in a per-pt buffer, so the frames from many streams go out
+ * in one write, rather than one write (and tls record) per frame.
+ */
+
+void
+lws_h2_tx_coalesce_begin(struct lws *nwsi)
+{
+	struct lws_context_per_thread *pt = &nwsi->a.context->pt[(int)nwsi->tsi];
+	size_t lim;
+
+	if (!nwsi->a.context->h2_tx_coalesce_size || lws_has_buffered_out(nwsi))
+		return;
+
+	if (!pt->h2_tx_coalesce) {
+		pt->h2_tx_coalesce = lws_malloc(
+				nwsi->a.context->h2_tx_coalesce_size,
+				"h2 tx coalesce");
+		if (!pt->h2_tx_coalesce)
+			return;
+	}
+
+	/* no point going beyond what lws_issue_raw() will send at once */
+
+	if (nwsi->a.protocol->tx_packet_size)
+		lim = nwsi->a.protocol->tx_packet_size;
+	else {
+		lim = nwsi->a.protocol->rx_buffer_size;
+		if (!lim)
+			lim = nwsi->a.context->pt_serv_buf_size;
+	}
+	lim += LWS_PRE + 4;
+	if (lim > nwsi->a.context->h2_tx_coalesce_size)
+		lim = nwsi->a.context->h2_tx_coalesce_size;
+
+	pt->h2_tx_coalesce_max = lim;
+	pt->h2_tx_coalesce_len = 0;
+	nwsi->h2_tx_coalescing = 1;
+}
+
+static int
+lws_h2_tx_coalesce_flush(struct lws *nwsi)
+{
+	struct lws_context_per_thread *pt = &nwsi->a.context->pt[(int)nwsi->tsi];
+	size_t len = pt->h2_tx_coalesce_len;
+	int n;
+
+	if (!len)
+		return 0;
+
+	pt->h2_tx_coalesce_len = 0;
+
+	/*
+	 * Any part that doesn't go out is copied onto nwsi buflist_out, which
+	 * makes the connection look choked and ends the POLLOUT pass
+	 */
+
+	nwsi->h2_tx_coalescing = 0;
+	n = lws_issue_raw(nwsi, pt->h2_tx_coalesce, len);
+	nwsi->h2_tx_coalescing = 1;
+
+	return n < 0;
+}
+
+/*
+ * Called from lws_issue_raw() while coalescing.  Returns len if buf was taken,
+ * 0 if the caller should send it the usual way, or -1 for a fatal error.
+ */
+
+int
+lws_h2_tx_coalesce(struct lws *nwsi, const uint8_t *buf, size_t len)
+{
+	struct lws_context_per_thread *pt = &nwsi->a.context->pt[(int)nwsi->tsi];
+
+	if (pt->h2_tx_coalesce_len + len > pt->h2_tx_coalesce_max) {
+		/* no room, what we gathered so far has to go first */
+		if (lws_h2_tx_coalesce_flush(nwsi))
+			return -1;
+
+		if (len > pt->h2_tx_coalesce_max || lws_has_buffered_out(nwsi))
+			return 0;
+	}
+
+	memcpy(pt->h2_tx_coalesce + pt->h2_tx_coalesce_len, buf, len);
+	pt->h2_tx_coalesce_len += len;
+
+	return (int)len;
+}
+
+int
+lws_h2_tx_coalesce_end(struct lws *nwsi, int flush)
+{
+	struct lws_context_per_thread *pt = &nwsi->a.context->pt[(int)nwsi->tsi];
+	int n = 0;
+
+	if (!nwsi->h2_tx_coalescing)
+		return 0;
+
+	if (flush)
+		n = lws_h2_tx_coalesce_flush(nwsi);
+
+	pt->h2_tx_coalesce_len = 0;
+	nwsi->h2_tx_coalescing = 0;
+
+	return n;
+}
+
+/*
+ * RFC9218 priority field value, a structured field dictionary like "u=1, i".
+ *
+ * We only care about u (integer 0 - 7) and i (boolean)... members with other
+ * keys or with values of the wrong type are ignored, as are any parameters.
+ * The caller sets the defaults, any member we understand overrides them.
+ */
+
+static void
+lws_h2_priority_parse(const char *s, size_t len, uint8_t *urgency,
+		      uint8_t *incremental)
+{
+	const char *end = s + len, *k, *v;
+	size_t kl, vl;
+
+	while (s < end) {
+		while (s < end && (*s == ' ' || *s == '\t' || *s == ','))
+			s++;
+
+		k = s;
+		while (s < end && *s != '=' && *s != ',' && *s != ';' &&
+		       *s != ' ' && *s != '\t')
+			s++;
+		kl = lws_ptr_diff_size_t(s, k);
+
+		v = NULL;
+		vl = 0;
+		if (s < end && *s == '=') {
+			v = ++s;
+			while (s < end && *s != ',' && *s != ';' &&
+			       *s != ' ' && *s != '\t')
+				s++;
+			vl = lws_ptr_diff_size_t(s, v);
+		}
+
+		/* skip any parameters */
+		while (s < end && *s != ',')
+			s++;
+
+		if (kl != 1)
+			continue;
+
+		switch (*k) {
+		case 'u':
+			if (!v || !vl || vl > 15)
+				break;
+			while (vl > 1 && *v == '0') {
+				v++;
+				vl--;
+			}
+			if (vl == 1 && *v >= '0' && *v <= '7')
+				*urgency = (uint8_t)(*v - '0');
+			break;
+		case 'i':
+			if (!v) {
+				*incremental = 1;
+				break;
+			}
+			if (vl == 2 && v[0] == '?' && (v[1] == '0' || v[1] == '1'))
+				*incremental = v[1] == '1';
+			break;
+		}
+	}
+}
+
+/*
+ * RFC9218 scheduling... the children waiting for POLLOUT are kept on the
+ * network connection in one list per urgency and incremental flag, so
+ * finding who should write next doesn't need a walk of all the children.
+ * Lower urgency value wins, at the same urgency non-incremental streams go
+ * before incremental ones.  Non-incremental streams are listed in stream
+ * order, since each is only useful complete.  Incremental ones go on the
+ * tail each time they ask for writeable, so they share the connection
+ * round-robin.
+ */
+
+void
+lws_h2_sched_queue(struct lws *wsi)
+{
+	struct lws *nwsi = lws_get_network_wsi(wsi);
+	struct lws_dll2 *d, *before = NULL;
+	lws_dll2_owner_t *o;
+
+	if (nwsi == wsi || !nwsi->h2.h2n ||
+	    !lws_check_opt(nwsi->a.vhost->options,
+			   LWS_SERVER_OPTION_H2_PRIORITIES) ||
+	    !lws_dll2_is_detached(&wsi->h2.sched_list))
+		return;
+
+	o = &nwsi->h2.h2n->sched[((wsi->h2.prio_urgency & 7) << 1) |
+				 wsi->h2.prio_incremental];
+
+	/* new streams usually belong on the end anyway */
+
+	if (!wsi->h2.prio_incremental)
+		for (d = lws_dll2_get_tail(o); d; d = d->prev) {
+			if (lws_container_of(d, struct lws,
+				     h2.sched_list)->mux.my_sid < wsi->mux.my_sid)
+				break;
+			before = d;
+		}
+
+	if (before)
+		lws_dll2_add_before(&wsi->h2.sched_list, before);
+	else
+		lws_dll2_add_tail(&wsi->h2.sched_list, o);
+}
+
+/* his priority changed, if he's waiting, move him to the right list */
+
+void
+lws_h2_sched_requeue(struct lws *wsi)
+{
+	if (lws_dll2_is_detached(&wsi->h2.sched_list))
+		return;
+
+	lws_dll2_remove(&wsi->h2.sched_list);
+	lws_h2_sched_queue(wsi);
+}
+
+/*
+ * Take the child that should write next off the lists and clear his
+ * POLLOUT request, or return NULL if nobody is waiting
+ */
+
+struct lws *
+lws_h2_sched_pick(struct lws *nwsi)
+{
+	struct lws_h2_netconn *h2n = nwsi->h2.h2n;
+	struct lws *w;
+	int n;
+
+	for (n = 0; n < LWS_H2_PRIO_LISTS; n++)
+		while (lws_dll2_get_head(&h2n->sched[n])) {
+			w = lws_container_of(lws_dll2_get_head(&h2n->sched[n]),
+					     struct lws, h2.sched_list);
+			lws_dll2_remove(&w->h2.sched_list);
+			if (!w->mux.requested_POLLOUT)
+				continue;
+
+			w->mux.requested_POLLOUT = 0;
+
+			return w;
+		}
+
+	return NULL;
+}
+
 static void lws_h2_set_bin(struct lws *wsi, int n, unsigned char *buf)
 {
 	*buf++ = (uint8_t)(n >> 8);
@@ -981,8 +1277,7 @@ lws_h2_parse_frame_header(struct lws *wsi)
 
 	if (!wsi->immortal_substream_count)
 		lws_set_timeout(wsi, PENDING_TIMEOUT_HTTP_KEEPALIVE_IDLE,
-				wsi->a.vhost->keepalive_timeout ?
-					wsi->a.vhost->keepalive_timeout : 31);
+				lws_h2_idle_secs(wsi));
 
 	if (h2n->sid)
 		h2n->swsi = lws_wsi_mux_from_id(wsi, h2n->sid);
@@ -994,6 +1289,28 @@ lws_h2_parse_frame_header(struct lws *wsi)
 	if (h2n->we_told_goaway && h2n->sid > h2n->highest_sid)
 		h2n->type = LWS_H2_FRAME_TYPE_COUNT; /* ie, IGNORE */
 
+	if (h2n->type == LWS_H2_FRAME_TYPE_PRIORITY_UPDATE &&
+	    lws_check_opt(wsi->a.vhost->options,
+			  LWS_SERVER_OPTION_H2_PRIORITIES)) {
+		/* RFC9218 7.1: only on stream 0, and only from the client */
+		if (h2n->sid
+#if defined(LWS_WITH_CLIENT)
+			|| wsi->client_h2_alpn
+#endif
+		) {
+			lws_h2_goaway(wsi, H2_ERR_PROTOCOL_ERROR,
+				      "PRIORITY_UPDATE not allowed");
+			return 0;
+		}
+		if (h2n->length < 4) {
+			lws_h2_goaway(wsi, H2_ERR_FRAME_SIZE_ERROR,
+				      "PRIORITY_UPDATE too short");
+			return 0;
+		}
+		/* there are no flags defined for it */
+		h2n->flags = 0;
+		h2n->hpack_e_dep = 0;
+	} else
 	if (h2n->type >= LWS_H2_FRAME_TYPE_COUNT) {
 		lwsl_info("%s: ignoring unknown frame type %d (len %d)\n", __func__, h2n->type, (unsigned int)h2n->length);
 		/* we MUST ignore frames we don't understand */
@@ -1384,6 +1701,9 @@ cleanup_wsi:
 		}
 		lwsl_info("LWS_H2_FRAME_TYPE_WINDOW_UPDATE\n");
 		break;
+	case LWS_H2_FRAME_TYPE_PRIORITY_UPDATE:
+		lwsl_info("LWS_H2_FRAME_TYPE_PRIORITY_UPDATE\n");
+		break;
 	case LWS_H2_FRAME_TYPE_COUNT:
 		if (h2n->length == 0)
 			lws_h2_parse_end_of_frame(wsi);
@@ -1797,6 +2117,28 @@ lws_h2_parse_end_of_frame(struct lws *wsi)
 				break;
 			}
 
+		/*
+		 * RFC9218: the priority: header gives the initial priority,
+		 * unless a PRIORITY_UPDATE for the stream already arrived
+		 */
+		if (lws_check_opt(wsi->a.vhost->options,
+				  LWS_SERVER_OPTION_H2_PRIORITIES) &&
+		    !h2n->swsi->h2.prio_from_frame &&
+		    lws_hdr_total_length(h2n->swsi, WSI_TOKEN_HTTP_PRIORITY) > 0) {
+			uint8_t u = h2n->swsi->h2.prio_urgency,
+				i = h2n->swsi->h2.prio_incremental;
+
+			lws_h2_priority_parse(
+				lws_hdr_simple_ptr(h2n->swsi,
+						   WSI_TOKEN_HTTP_PRIORITY),
+				(size_t)lws_hdr_total_length(h2n->swsi,
+						   WSI_TOKEN_HTTP_PRIORITY),
+				&u, &i);
+			h2n->swsi->h2.prio_urgency = u;
+			h2n->swsi->h2.prio_incremental = !!i;
+			lws_h2_sched_requeue(h2n->swsi);
+		}
+
 		{
 			lwsl_debug("%s: setting DEF_ACT from 0x%x\n", __func__,
 				   (unsigned int)h2n->swsi->wsistate);
@@ -1904,12 +2246,16 @@ lws_h2_parse_end_of_frame(struct lws *wsi)
 
 		if (eff_wsi->a.vhost->options &
 		        LWS_SERVER_OPTION_H2_JUST_FIX_WINDOW_UPDATE_OVERFLOW &&
-		    (uint64_t)eff_wsi->txc.tx_cr + (uint64_t)h2n->hpack_e_dep >
-		    (uint64_t)0x7fffffff)
+		    (int64_t)eff_wsi->txc.tx_cr + (int64_t)h2n->hpack_e_dep >
+		    (int64_t)0x7fffffff)
 			h2n->hpack_e_dep = (uint32_t)(0x7fffffff - eff_wsi->txc.tx_cr);
 
-		if ((uint64_t)eff_wsi->txc.tx_cr + (uint64_t)h2n->hpack_e_dep >
-		    (uint64_t)0x7fffffff) {
+		/*
+		 * tx_cr may legitimately be negative, eg, if we overdrew it or
+		 * the peer reduced the initial window, so compare signed
+		 */
+		if ((int64_t)eff_wsi->txc.tx_cr + (int64_t)h2n->hpack_e_dep >
+		    (int64_t)0x7fffffff) {
 			lwsl_warn("%s: WINDOW_UPDATE 0x%llx + 0x%llx = 0x%llx, too high\n",
 					__func__, (unsigned long long)eff_wsi->txc.tx_cr,
 					(unsigned long long)h2n->hpack_e_dep,
@@ -1975,6 +2321,50 @@ lws_h2_parse_end_of_frame(struct lws *wsi)
 			  (unsigned int)h2n->hpack_e_dep);
 		break;
 
+	case LWS_H2_FRAME_TYPE_PRIORITY_UPDATE: {
+		uint32_t psid = h2n->hpack_e_dep & 0x7fffffff;
+		uint8_t u = LWS_H2_PRIO_URGENCY_DEFAULT, i = 0;
+
+		if (!psid) {
+			lws_h2_goaway(wsi, H2_ERR_PROTOCOL_ERROR,
+				      "PRIORITY_UPDATE for sid 0");
+			break;
+		}
+		if (!(psid & 1))
+			/* we don't do push, so no server streams to update */
+			break;
+
+		n = (int)h2n->length - 4;
+		if (n > (int)sizeof(h2n->prio_update))
+			n = (int)sizeof(h2n->prio_update);
+
+		lws_h2_priority_parse(h2n->prio_update, (size_t)n, &u, &i);
+
+		lwsl_info("%s: PRIORITY_UPDATE: sid %u: u=%d, i=%d\n",
+			  __func__, (unsigned int)psid, u, i);
+
+		eff_wsi = lws_wsi_mux_from_id(wsi, psid);
+		if (eff_wsi) {
+			eff_wsi->h2.prio_urgency = u;
+			eff_wsi->h2.prio_incremental = !!i;
+			eff_wsi->h2.prio_from_frame = 1;
+			lws_h2_sched_requeue(eff_wsi);
+			break;
+		}
+
+		if (psid > h2n->highest_sid_opened) {
+			/*
+			 * Not opened yet... RFC9218 says we should hold on to
+			 * the most recent one of these and apply it when the
+			 * stream turns up
+			 */
+			h2n->prio_pending_sid = psid;
+			h2n->prio_pending_urgency = u;
+			h2n->prio_pending_incremental = i;
+		}
+		break;
+	}
+
 	case LWS_H2_FRAME_TYPE_COUNT: /* IGNORING FRAME */
 		break;
 	}
@@ -2119,11 +2509,30 @@ lws_h2_parser(struct lws *wsi, unsigned char *in, lws_filepos_t _inlen,
 			case LWS_H2_FRAME_TYPE_HEADERS:
 				if (!h2n->swsi)
 					break;
-				if (lws_hpack_interpret(h2n->swsi, c)) {
+
+				/*
+				 * Pass hpack all of the header block we have
+				 * for this frame at once, stopping short of
+				 * any padding
+				 */
+
+				n = (int)lws_ptr_diff_size_t(iend, in) + 1;
+				m = (int)h2n->length - (int)h2n->padding -
+				    (int)h2n->count + 1;
+				if (m < 1)
+					m = 1;
+				if (n > m)
+					n = m;
+
+				if (lws_hpack_interpret_buf(h2n->swsi, in - 1,
+							    (size_t)n)) {
 					lwsl_info("%s: hpack failed\n",
 						  __func__);
 					goto fail;
 				}
+
+				in += n - 1;
+				h2n->count += (unsigned int)n - 1;
 				break;
 
 			case LWS_H2_FRAME_TYPE_GOAWAY:
@@ -2169,8 +2578,7 @@ lws_h2_parser(struct lws *wsi, unsigned char *in, lws_filepos_t _inlen,
 				if (!wsi->immortal_substream_count)
 					lws_set_timeout(wsi,
 					PENDING_TIMEOUT_HTTP_KEEPALIVE_IDLE,
-						wsi->a.vhost->keepalive_timeout ?
-					    wsi->a.vhost->keepalive_timeout : 31);
+						lws_h2_idle_secs(wsi));
 
 				if (!h2n->swsi)
 					break;
@@ -2396,6 +2804,17 @@ do_windows:
 				h2n->hpack_e_dep |= c;
 				break;
 
+			case LWS_H2_FRAME_TYPE_PRIORITY_UPDATE:
+				if (h2n->count <= 4) {
+					/* prioritized stream id */
+					h2n->hpack_e_dep <<= 8;
+					h2n->hpack_e_dep |= c;
+					break;
+				}
+				if (h2n->count - 5 < sizeof(h2n->prio_update))
+					h2n->prio_update[h2n->count - 5] = (char)c;
+				break;
+
 			case LWS_H2_FRAME_TYPE_COUNT: /* IGNORING FRAME */
 				//lwsl_debug("%s: consuming for ignored %u %u\n", __func__, (unsigned int)h2n->count, (unsigned int)h2n->length);
 				h2n->count++;
@@ -1,4 +1,4 @@
-static unsigned char lextable[] = {
+static const unsigned char lextable[] = {
 /* pos 0000:   0 */    /* 0 */ 0x42  /* (to 0x0084 state  98) */,
                        /* 1 */ 0x01  /* (to 0x0002 state   1) */,
 /* pos 0002:   1 */    /* 0 */ 0x5C  /* (to 0x00BA state 151) */,
@@ -514,7 +514,7 @@ static unsigned char lextable[] = {
 /* total size 512 bytes, biggest jump 200/256, fails=0 */
 };
 
- static unsigned char lextable_terms[] = {
+ static const unsigned char lextable_terms[] = {
 
 	0x00, 0x00, 0x00, 0x03, 0x01, 0x00, 0x03, 0x00, 
 	0x34, 0x0f, 0x43, 0x03, 0xf1, 0x3c, 0xfc, 0x3c, 
@@ -528,3 +528,1608 @@ static unsigned char lextable[] = {
 
 /* state that points to 0x100 for disambiguation with 0x0 */
 #define HUFTABLE_0x100_PREV 118
+
+/*
+ * 4-bit at a time decode state machine.  For each state and
+ * nibble, MSB first: the next state, flags, and the symbol if
+ * HUFTABLE_FSM_SYM is set
+ */
+
+#define HUFTABLE_FSM_SYM	1 /* nibble completed a symbol */
+#define HUFTABLE_FSM_ACCEPT	2 /* the string may end here */
+#define HUFTABLE_FSM_FAIL	4 /* nibble completed EOS */
+
+static const unsigned char huftable_fsm[256][16][3] = {
+/* state   0 */ {
+	{ 0x57, 0, 0x00 }, { 0x58, 0, 0x00 }, { 0x83, 0, 0x00 }, { 0x87, 0, 0x00 },
+	{ 0x8f, 0, 0x00 }, { 0x45, 0, 0x00 }, { 0x53, 0, 0x00 }, { 0x5a, 0, 0x00 },
+	{ 0x64, 0, 0x00 }, { 0x84, 0, 0x00 }, { 0x8a, 0, 0x00 }, { 0x5f, 0, 0x00 },
+	{ 0x69, 0, 0x00 }, { 0x70, 0, 0x00 }, { 0x77, 0, 0x00 }, { 0x04, 2, 0x00 },
+},
+/* state   1 */ {
+	{ 0x65, 0, 0x00 }, { 0x81, 0, 0x00 }, { 0x85, 0, 0x00 }, { 0x86, 0, 0x00 },
+	{ 0x8b, 0, 0x00 }, { 0x8c, 0, 0x00 }, { 0x8e, 0, 0x00 }, { 0x60, 0, 0x00 },
+	{ 0x6a, 0, 0x00 }, { 0x6d, 0, 0x00 }, { 0x71, 0, 0x00 }, { 0x74, 0, 0x00 },
+	{ 0x78, 0, 0x00 }, { 0x88, 0, 0x00 }, { 0x90, 0, 0x00 }, { 0x05, 2, 0x00 },
+},
+/* state   2 */ {
+	{ 0x6b, 0, 0x00 }, { 0x6c, 0, 0x00 }, { 0x6e, 0, 0x00 }, { 0x6f, 0, 0x00 },
+	{ 0x72, 0, 0x00 }, { 0x73, 0, 0x00 }, { 0x75, 0, 0x00 }, { 0x76, 0, 0x00 },
+	{ 0x79, 0, 0x00 }, { 0x7a, 0, 0x00 }, { 0x89, 0, 0x00 }, { 0x8d, 0, 0x00 },
+	{ 0x91, 0, 0x00 }, { 0x92, 0, 0x00 }, { 0x4b, 0, 0x00 }, { 0x06, 2, 0x00 },
+},
+/* state   3 */ {
+	{ 0x00, 3, 0x55 }, { 0x00, 3, 0x56 }, { 0x00, 3, 0x57 }, { 0x00, 3, 0x59 },
+	{ 0x00, 3, 0x6a }, { 0x00, 3, 0x6b }, { 0x00, 3, 0x71 }, { 0x00, 3, 0x76 },
+	{ 0x00, 3, 0x77 }, { 0x00, 3, 0x78 }, { 0x00, 3, 0x79 }, { 0x00, 3, 0x7a },
+	{ 0x4c, 0, 0x00 }, { 0x50, 0, 0x00 }, { 0x7b, 0, 0x00 }, { 0x07, 2, 0x00 },
+},
+/* state   4 */ {
+	{ 0x42, 1, 0x77 }, { 0x01, 3, 0x77 }, { 0x42, 1, 0x78 }, { 0x01, 3, 0x78 },
+	{ 0x42, 1, 0x79 }, { 0x01, 3, 0x79 }, { 0x42, 1, 0x7a }, { 0x01, 3, 0x7a },
+	{ 0x00, 3, 0x26 }, { 0x00, 3, 0x2a }, { 0x00, 3, 0x2c }, { 0x00, 3, 0x3b },
+	{ 0x00, 3, 0x58 }, { 0x00, 3, 0x5a }, { 0x47, 0, 0x00 }, { 0x08, 0, 0x00 },
+},
+/* state   5 */ {
+	{ 0x42, 1, 0x26 }, { 0x01, 3, 0x26 }, { 0x42, 1, 0x2a }, { 0x01, 3, 0x2a },
+	{ 0x42, 1, 0x2c }, { 0x01, 3, 0x2c }, { 0x42, 1, 0x3b }, { 0x01, 3, 0x3b },
+	{ 0x42, 1, 0x58 }, { 0x01, 3, 0x58 }, { 0x42, 1, 0x5a }, { 0x01, 3, 0x5a },
+	{ 0x48, 0, 0x00 }, { 0x4f, 0, 0x00 }, { 0x4d, 0, 0x00 }, { 0x09, 0, 0x00 },
+},
+/* state   6 */ {
+	{ 0x55, 1, 0x58 }, { 0x43, 1, 0x58 }, { 0x5d, 1, 0x58 }, { 0x02, 3, 0x58 },
+	{ 0x55, 1, 0x5a }, { 0x43, 1, 0x5a }, { 0x5d, 1, 0x5a }, { 0x02, 3, 0x5a },
+	{ 0x00, 3, 0x21 }, { 0x00, 3, 0x22 }, { 0x00, 3, 0x28 }, { 0x00, 3, 0x29 },
+	{ 0x00, 3, 0x3f }, { 0x4e, 0, 0x00 }, { 0x49, 0, 0x00 }, { 0x0a, 0, 0x00 },
+},
+/* state   7 */ {
+	{ 0x42, 1, 0x21 }, { 0x01, 3, 0x21 }, { 0x42, 1, 0x22 }, { 0x01, 3, 0x22 },
+	{ 0x42, 1, 0x28 }, { 0x01, 3, 0x28 }, { 0x42, 1, 0x29 }, { 0x01, 3, 0x29 },
+	{ 0x42, 1, 0x3f }, { 0x01, 3, 0x3f }, { 0x00, 3, 0x27 }, { 0x00, 3, 0x2b },
+	{ 0x00, 3, 0x7c }, { 0x4a, 0, 0x00 }, { 0x0b, 0, 0x00 }, { 0x0d, 0, 0x00 },
+},
+/* state   8 */ {
+	{ 0x55, 1, 0x3f }, { 0x43, 1, 0x3f }, { 0x5d, 1, 0x3f }, { 0x02, 3, 0x3f },
+	{ 0x42, 1, 0x27 }, { 0x01, 3, 0x27 }, { 0x42, 1, 0x2b }, { 0x01, 3, 0x2b },
+	{ 0x42, 1, 0x7c }, { 0x01, 3, 0x7c }, { 0x00, 3, 0x23 }, { 0x00, 3, 0x3e },
+	{ 0x0c, 0, 0x00 }, { 0x66, 0, 0x00 }, { 0x7f, 0, 0x00 }, { 0x0e, 0, 0x00 },
+},
+/* state   9 */ {
+	{ 0x55, 1, 0x7c }, { 0x43, 1, 0x7c }, { 0x5d, 1, 0x7c }, { 0x02, 3, 0x7c },
+	{ 0x42, 1, 0x23 }, { 0x01, 3, 0x23 }, { 0x42, 1, 0x3e }, { 0x01, 3, 0x3e },
+	{ 0x00, 3, 0x00 }, { 0x00, 3, 0x24 }, { 0x00, 3, 0x40 }, { 0x00, 3, 0x5b },
+	{ 0x00, 3, 0x5d }, { 0x00, 3, 0x7e }, { 0x80, 0, 0x00 }, { 0x0f, 0, 0x00 },
+},
+/* state  10 */ {
+	{ 0x42, 1, 0x00 }, { 0x01, 3, 0x00 }, { 0x42, 1, 0x24 }, { 0x01, 3, 0x24 },
+	{ 0x42, 1, 0x40 }, { 0x01, 3, 0x40 }, { 0x42, 1, 0x5b }, { 0x01, 3, 0x5b },
+	{ 0x42, 1, 0x5d }, { 0x01, 3, 0x5d }, { 0x42, 1, 0x7e }, { 0x01, 3, 0x7e },
+	{ 0x00, 3, 0x5e }, { 0x00, 3, 0x7d }, { 0x62, 0, 0x00 }, { 0x10, 0, 0x00 },
+},
+/* state  11 */ {
+	{ 0x55, 1, 0x00 }, { 0x43, 1, 0x00 }, { 0x5d, 1, 0x00 }, { 0x02, 3, 0x00 },
+	{ 0x55, 1, 0x24 }, { 0x43, 1, 0x24 }, { 0x5d, 1, 0x24 }, { 0x02, 3, 0x24 },
+	{ 0x55, 1, 0x40 }, { 0x43, 1, 0x40 }, { 0x5d, 1, 0x40 }, { 0x02, 3, 0x40 },
+	{ 0x55, 1, 0x5b }, { 0x43, 1, 0x5b }, { 0x5d, 1, 0x5b }, { 0x02, 3, 0x5b },
+},
+/* state  12 */ {
+	{ 0x56, 1, 0x00 }, { 0x82, 1, 0x00 }, { 0x44, 1, 0x00 }, { 0x52, 1, 0x00 },
+	{ 0x63, 1, 0x00 }, { 0x5e, 1, 0x00 }, { 0x68, 1, 0x00 }, { 0x03, 3, 0x00 },
+	{ 0x56, 1, 0x24 }, { 0x82, 1, 0x24 }, { 0x44, 1, 0x24 }, { 0x52, 1, 0x24 },
+	{ 0x63, 1, 0x24 }, { 0x5e, 1, 0x24 }, { 0x68, 1, 0x24 }, { 0x03, 3, 0x24 },
+},
+/* state  13 */ {
+	{ 0x55, 1, 0x5d }, { 0x43, 1, 0x5d }, { 0x5d, 1, 0x5d }, { 0x02, 3, 0x5d },
+	{ 0x55, 1, 0x7e }, { 0x43, 1, 0x7e }, { 0x5d, 1, 0x7e }, { 0x02, 3, 0x7e },
+	{ 0x42, 1, 0x5e }, { 0x01, 3, 0x5e }, { 0x42, 1, 0x7d }, { 0x01, 3, 0x7d },
+	{ 0x00, 3, 0x3c }, { 0x00, 3, 0x60 }, { 0x00, 3, 0x7b }, { 0x11, 0, 0x00 },
+},
+/* state  14 */ {
+	{ 0x55, 1, 0x5e }, { 0x43, 1, 0x5e }, { 0x5d, 1, 0x5e }, { 0x02, 3, 0x5e },
+	{ 0x55, 1, 0x7d }, { 0x43, 1, 0x7d }, { 0x5d, 1, 0x7d }, { 0x02, 3, 0x7d },
+	{ 0x42, 1, 0x3c }, { 0x01, 3, 0x3c }, { 0x42, 1, 0x60 }, { 0x01, 3, 0x60 },
+	{ 0x42, 1, 0x7b }, { 0x01, 3, 0x7b }, { 0x7c, 0, 0x00 }, { 0x12, 0, 0x00 },
+},
+/* state  15 */ {
+	{ 0x55, 1, 0x3c }, { 0x43, 1, 0x3c }, { 0x5d, 1, 0x3c }, { 0x02, 3, 0x3c },
+	{ 0x55, 1, 0x60 }, { 0x43, 1, 0x60 }, { 0x5d, 1, 0x60 }, { 0x02, 3, 0x60 },
+	{ 0x55, 1, 0x7b }, { 0x43, 1, 0x7b }, { 0x5d, 1, 0x7b }, { 0x02, 3, 0x7b },
+	{ 0x7d, 0, 0x00 }, { 0x9b, 0, 0x00 }, { 0x96, 0, 0x00 }, { 0x13, 0, 0x00 },
+},
+/* state  16 */ {
+	{ 0x56, 1, 0x7b }, { 0x82, 1, 0x7b }, { 0x44, 1, 0x7b }, { 0x52, 1, 0x7b },
+	{ 0x63, 1, 0x7b }, { 0x5e, 1, 0x7b }, { 0x68, 1, 0x7b }, { 0x03, 3, 0x7b },
+	{ 0x7e, 0, 0x00 }, { 0x94, 0, 0x00 }, { 0x9c, 0, 0x00 }, { 0xaf, 0, 0x00 },
+	{ 0xc4, 0, 0x00 }, { 0x97, 0, 0x00 }, { 0x14, 0, 0x00 }, { 0x19, 0, 0x00 },
+},
+/* state  17 */ {
+	{ 0x00, 3, 0x5c }, { 0x00, 3, 0xc3 }, { 0x00, 3, 0xd0 }, { 0x95, 0, 0x00 },
+	{ 0x9d, 0, 0x00 }, { 0xcc, 0, 0x00 }, { 0xf1, 0, 0x00 }, { 0xb0, 0, 0x00 },
+	{ 0xc5, 0, 0x00 }, { 0xeb, 0, 0x00 }, { 0x98, 0, 0x00 }, { 0xb2, 0, 0x00 },
+	{ 0xc7, 0, 0x00 }, { 0x15, 0, 0x00 }, { 0xa7, 0, 0x00 }, { 0x1a, 0, 0x00 },
+},
+/* state  18 */ {
+	{ 0xc6, 0, 0x00 }, { 0xca, 0, 0x00 }, { 0xec, 0, 0x00 }, { 0xf2, 0, 0x00 },
+	{ 0x99, 0, 0x00 }, { 0x9e, 0, 0x00 }, { 0xb3, 0, 0x00 }, { 0xb7, 0, 0x00 },
+	{ 0xc8, 0, 0x00 }, { 0xce, 0, 0x00 }, { 0xd8, 0, 0x00 }, { 0x16, 0, 0x00 },
+	{ 0xa8, 0, 0x00 }, { 0xb9, 0, 0x00 }, { 0x29, 0, 0x00 }, { 0x1b, 0, 0x00 },
+},
+/* state  19 */ {
+	{ 0xc9, 0, 0x00 }, { 0xcd, 0, 0x00 }, { 0xcf, 0, 0x00 }, { 0xd2, 0, 0x00 },
+	{ 0xd9, 0, 0x00 }, { 0xf3, 0, 0x00 }, { 0x17, 0, 0x00 }, { 0xa2, 0, 0x00 },
+	{ 0xa9, 0, 0x00 }, { 0xad, 0, 0x00 }, { 0xba, 0, 0x00 }, { 0xc2, 0, 0x00 },
+	{ 0xd0, 0, 0x00 }, { 0x2a, 0, 0x00 }, { 0xbf, 0, 0x00 }, { 0x1c, 0, 0x00 },
+},
+/* state  20 */ {
+	{ 0x00, 3, 0xb2 }, { 0x00, 3, 0xb5 }, { 0x00, 3, 0xb9 }, { 0x00, 3, 0xba },
+	{ 0x00, 3, 0xbb }, { 0x00, 3, 0xbd }, { 0x00, 3, 0xbe }, { 0x00, 3, 0xc4 },
+	{ 0x00, 3, 0xc6 }, { 0x00, 3, 0xe4 }, { 0x00, 3, 0xe8 }, { 0x00, 3, 0xe9 },
+	{ 0x18, 0, 0x00 }, { 0xa1, 0, 0x00 }, { 0xa3, 0, 0x00 }, { 0xa4, 0, 0x00 },
+},
+/* state  21 */ {
+	{ 0x42, 1, 0xc6 }, { 0x01, 3, 0xc6 }, { 0x42, 1, 0xe4 }, { 0x01, 3, 0xe4 },
+	{ 0x42, 1, 0xe8 }, { 0x01, 3, 0xe8 }, { 0x42, 1, 0xe9 }, { 0x01, 3, 0xe9 },
+	{ 0x00, 3, 0x01 }, { 0x00, 3, 0x87 }, { 0x00, 3, 0x89 }, { 0x00, 3, 0x8a },
+	{ 0x00, 3, 0x8b }, { 0x00, 3, 0x8c }, { 0x00, 3, 0x8d }, { 0x00, 3, 0x8f },
+},
+/* state  22 */ {
+	{ 0x42, 1, 0x01 }, { 0x01, 3, 0x01 }, { 0x42, 1, 0x87 }, { 0x01, 3, 0x87 },
+	{ 0x42, 1, 0x89 }, { 0x01, 3, 0x89 }, { 0x42, 1, 0x8a }, { 0x01, 3, 0x8a },
+	{ 0x42, 1, 0x8b }, { 0x01, 3, 0x8b }, { 0x42, 1, 0x8c }, { 0x01, 3, 0x8c },
+	{ 0x42, 1, 0x8d }, { 0x01, 3, 0x8d }, { 0x42, 1, 0x8f }, { 0x01, 3, 0x8f },
+},
+/* state  23 */ {
+	{ 0x55, 1, 0x01 }, { 0x43, 1, 0x01 }, { 0x5d, 1, 0x01 }, { 0x02, 3, 0x01 },
+	{ 0x55, 1, 0x87 }, { 0x43, 1, 0x87 }, { 0x5d, 1, 0x87 }, { 0x02, 3, 0x87 },
+	{ 0x55, 1, 0x89 }, { 0x43, 1, 0x89 }, { 0x5d, 1, 0x89 }, { 0x02, 3, 0x89 },
+	{ 0x55, 1, 0x8a }, { 0x43, 1, 0x8a }, { 0x5d, 1, 0x8a }, { 0x02, 3, 0x8a },
+},
+/* state  24 */ {
+	{ 0x56, 1, 0x01 }, { 0x82, 1, 0x01 }, { 0x44, 1, 0x01 }, { 0x52, 1, 0x01 },
+	{ 0x63, 1, 0x01 }, { 0x5e, 1, 0x01 }, { 0x68, 1, 0x01 }, { 0x03, 3, 0x01 },
+	{ 0x56, 1, 0x87 }, { 0x82, 1, 0x87 }, { 0x44, 1, 0x87 }, { 0x52, 1, 0x87 },
+	{ 0x63, 1, 0x87 }, { 0x5e, 1, 0x87 }, { 0x68, 1, 0x87 }, { 0x03, 3, 0x87 },
+},
+/* state  25 */ {
+	{ 0xaa, 0, 0x00 }, { 0xac, 0, 0x00 }, { 0xae, 0, 0x00 }, { 0xb5, 0, 0x00 },
+	{ 0xbb, 0, 0x00 }, { 0xbd, 0, 0x00 }, { 0xc3, 0, 0x00 }, { 0xcb, 0, 0x00 },
+	{ 0xd1, 0, 0x00 }, { 0xd7, 0, 0x00 }, { 0x2b, 0, 0x00 }, { 0xa5, 0, 0x00 },
+	{ 0xc0, 0, 0x00 }, { 0xda, 0, 0x00 }, { 0xd3, 0, 0x00 }, { 0x1d, 0, 0x00 },
+},
+/* state  26 */ {
+	{ 0x00, 3, 0xbc }, { 0x00, 3, 0xbf }, { 0x00, 3, 0xc5 }, { 0x00, 3, 0xe7 },
+	{ 0x00, 3, 0xef }, { 0x2c, 0, 0x00 }, { 0xa6, 0, 0x00 }, { 0xab, 0, 0x00 },
+	{ 0xc1, 0, 0x00 }, { 0xea, 0, 0x00 }, { 0xf5, 0, 0x00 }, { 0xdb, 0, 0x00 },
+	{ 0xd4, 0, 0x00 }, { 0xe0, 0, 0x00 }, { 0xe5, 0, 0x00 }, { 0x1e, 0, 0x00 },
+},
+/* state  27 */ {
+	{ 0x00, 3, 0xab }, { 0x00, 3, 0xce }, { 0x00, 3, 0xd7 }, { 0x00, 3, 0xe1 },
+	{ 0x00, 3, 0xec }, { 0x00, 3, 0xed }, { 0xdc, 0, 0x00 }, { 0xf4, 0, 0x00 },
+	{ 0xd5, 0, 0x00 }, { 0xde, 0, 0x00 }, { 0xed, 0, 0x00 }, { 0xe1, 0, 0x00 },
+	{ 0xe6, 0, 0x00 }, { 0xf9, 0, 0x00 }, { 0x1f, 0, 0x00 }, { 0x2d, 0, 0x00 },
+},
+/* state  28 */ {
+	{ 0xd6, 0, 0x00 }, { 0xdd, 0, 0x00 }, { 0xdf, 0, 0x00 }, { 0xe4, 0, 0x00 },
+	{ 0xee, 0, 0x00 }, { 0xf6, 0, 0x00 }, { 0xf8, 0, 0x00 }, { 0xe2, 0, 0x00 },
+	{ 0xe7, 0, 0x00 }, { 0xef, 0, 0x00 }, { 0xfa, 0, 0x00 }, { 0xfd, 0, 0x00 },
+	{ 0x20, 0, 0x00 }, { 0x26, 0, 0x00 }, { 0x37, 0, 0x00 }, { 0x2e, 0, 0x00 },
+},
+/* state  29 */ {
+	{ 0xe8, 0, 0x00 }, { 0xe9, 0, 0x00 }, { 0xf0, 0, 0x00 }, { 0xf7, 0, 0x00 },
+	{ 0xfb, 0, 0x00 }, { 0xfc, 0, 0x00 }, { 0xfe, 0, 0x00 }, { 0xff, 0, 0x00 },
+	{ 0x21, 0, 0x00 }, { 0x23, 0, 0x00 }, { 0x27, 0, 0x00 }, { 0x34, 0, 0x00 },
+	{ 0x38, 0, 0x00 }, { 0x3c, 0, 0x00 }, { 0x3f, 0, 0x00 }, { 0x2f, 0, 0x00 },
+},
+/* state  30 */ {
+	{ 0x00, 3, 0xfe }, { 0x22, 0, 0x00 }, { 0x24, 0, 0x00 }, { 0x25, 0, 0x00 },
+	{ 0x28, 0, 0x00 }, { 0x33, 0, 0x00 }, { 0x35, 0, 0x00 }, { 0x36, 0, 0x00 },
+	{ 0x39, 0, 0x00 }, { 0x3a, 0, 0x00 }, { 0x3d, 0, 0x00 }, { 0x3e, 0, 0x00 },
+	{ 0x40, 0, 0x00 }, { 0x41, 0, 0x00 }, { 0x93, 0, 0x00 }, { 0x30, 0, 0x00 },
+},
+/* state  31 */ {
+	{ 0x42, 1, 0xfe }, { 0x01, 3, 0xfe }, { 0x00, 3, 0x02 }, { 0x00, 3, 0x03 },
+	{ 0x00, 3, 0x04 }, { 0x00, 3, 0x05 }, { 0x00, 3, 0x06 }, { 0x00, 3, 0x07 },
+	{ 0x00, 3, 0x08 }, { 0x00, 3, 0x0b }, { 0x00, 3, 0x0c }, { 0x00, 3, 0x0e },
+	{ 0x00, 3, 0x0f }, { 0x00, 3, 0x10 }, { 0x00, 3, 0x11 }, { 0x00, 3, 0x12 },
+},
+/* state  32 */ {
+	{ 0x55, 1, 0xfe }, { 0x43, 1, 0xfe }, { 0x5d, 1, 0xfe }, { 0x02, 3, 0xfe },
+	{ 0x42, 1, 0x02 }, { 0x01, 3, 0x02 }, { 0x42, 1, 0x03 }, { 0x01, 3, 0x03 },
+	{ 0x42, 1, 0x04 }, { 0x01, 3, 0x04 }, { 0x42, 1, 0x05 }, { 0x01, 3, 0x05 },
+	{ 0x42, 1, 0x06 }, { 0x01, 3, 0x06 }, { 0x42, 1, 0x07 }, { 0x01, 3, 0x07 },
+},
+/* state  33 */ {
+	{ 0x56, 1, 0xfe }, { 0x82, 1, 0xfe }, { 0x44, 1, 0xfe }, { 0x52, 1, 0xfe },
+	{ 0x63, 1, 0xfe }, { 0x5e, 1, 0xfe }, { 0x68, 1, 0xfe }, { 0x03, 3, 0xfe },
+	{ 0x55, 1, 0x02 }, { 0x43, 1, 0x02 }, { 0x5d, 1, 0x02 }, { 0x02, 3, 0x02 },
+	{ 0x55, 1, 0x03 }, { 0x43, 1, 0x03 }, { 0x5d, 1, 0x03 }, { 0x02, 3, 0x03 },
+},
+/* state  34 */ {
+	{ 0x56, 1, 0x02 }, { 0x82, 1, 0x02 }, { 0x44, 1, 0x02 }, { 0x52, 1, 0x02 },
+	{ 0x63, 1, 0x02 }, { 0x5e, 1, 0x02 }, { 0x68, 1, 0x02 }, { 0x03, 3, 0x02 },
+	{ 0x56, 1, 0x03 }, { 0x82, 1, 0x03 }, { 0x44, 1, 0x03 }, { 0x52, 1, 0x03 },
+	{ 0x63, 1, 0x03 }, { 0x5e, 1, 0x03 }, { 0x68, 1, 0x03 }, { 0x03, 3, 0x03 },
+},
+/* state  35 */ {
+	{ 0x55, 1, 0x04 }, { 0x43, 1, 0x04 }, { 0x5d, 1, 0x04 }, { 0x02, 3, 0x04 },
+	{ 0x55, 1, 0x05 }, { 0x43, 1, 0x05 }, { 0x5d, 1, 0x05 }, { 0x02, 3, 0x05 },
+	{ 0x55, 1, 0x06 }, { 0x43, 1, 0x06 }, { 0x5d, 1, 0x06 }, { 0x02, 3, 0x06 },
+	{ 0x55, 1, 0x07 }, { 0x43, 1, 0x07 }, { 0x5d, 1, 0x07 }, { 0x02, 3, 0x07 },
+},
+/* state  36 */ {
+	{ 0x56, 1, 0x04 }, { 0x82, 1, 0x04 }, { 0x44, 1, 0x04 }, { 0x52, 1, 0x04 },
+	{ 0x63, 1, 0x04 }, { 0x5e, 1, 0x04 }, { 0x68, 1, 0x04 }, { 0x03, 3, 0x04 },
+	{ 0x56, 1, 0x05 }, { 0x82, 1, 0x05 }, { 0x44, 1, 0x05 }, { 0x52, 1, 0x05 },
+	{ 0x63, 1, 0x05 }, { 0x5e, 1, 0x05 }, { 0x68, 1, 0x05 }, { 0x03, 3, 0x05 },
+},
+/* state  37 */ {
+	{ 0x56, 1, 0x06 }, { 0x82, 1, 0x06 }, { 0x44, 1, 0x06 }, { 0x52, 1, 0x06 },
+	{ 0x63, 1, 0x06 }, { 0x5e, 1, 0x06 }, { 0x68, 1, 0x06 }, { 0x03, 3, 0x06 },
+	{ 0x56, 1, 0x07 }, { 0x82, 1, 0x07 }, { 0x44, 1, 0x07 }, { 0x52, 1, 0x07 },
+	{ 0x63, 1, 0x07 }, { 0x5e, 1, 0x07 }, { 0x68, 1, 0x07 }, { 0x03, 3, 0x07 },
+},
+/* state  38 */ {
+	{ 0x42, 1, 0x08 }, { 0x01, 3, 0x08 }, { 0x42, 1, 0x0b }, { 0x01, 3, 0x0b },
+	{ 0x42, 1, 0x0c }, { 0x01, 3, 0x0c }, { 0x42, 1, 0x0e }, { 0x01, 3, 0x0e },
+	{ 0x42, 1, 0x0f }, { 0x01, 3, 0x0f }, { 0x42, 1, 0x10 }, { 0x01, 3, 0x10 },
+	{ 0x42, 1, 0x11 }, { 0x01, 3, 0x11 }, { 0x42, 1, 0x12 }, { 0x01, 3, 0x12 },
+},
+/* state  39 */ {
+	{ 0x55, 1, 0x08 }, { 0x43, 1, 0x08 }, { 0x5d, 1, 0x08 }, { 0x02, 3, 0x08 },
+	{ 0x55, 1, 0x0b }, { 0x43, 1, 0x0b }, { 0x5d, 1, 0x0b }, { 0x02, 3, 0x0b },
+	{ 0x55, 1, 0x0c }, { 0x43, 1, 0x0c }, { 0x5d, 1, 0x0c }, { 0x02, 3, 0x0c },
+	{ 0x55, 1, 0x0e }, { 0x43, 1, 0x0e }, { 0x5d, 1, 0x0e }, { 0x02, 3, 0x0e },
+},
+/* state  40 */ {
+	{ 0x56, 1, 0x08 }, { 0x82, 1, 0x08 }, { 0x44, 1, 0x08 }, { 0x52, 1, 0x08 },
+	{ 0x63, 1, 0x08 }, { 0x5e, 1, 0x08 }, { 0x68, 1, 0x08 }, { 0x03, 3, 0x08 },
+	{ 0x56, 1, 0x0b }, { 0x82, 1, 0x0b }, { 0x44, 1, 0x0b }, { 0x52, 1, 0x0b },
+	{ 0x63, 1, 0x0b }, { 0x5e, 1, 0x0b }, { 0x68, 1, 0x0b }, { 0x03, 3, 0x0b },
+},
+/* state  41 */ {
+	{ 0x42, 1, 0xbc }, { 0x01, 3, 0xbc }, { 0x42, 1, 0xbf }, { 0x01, 3, 0xbf },
+	{ 0x42, 1, 0xc5 }, { 0x01, 3, 0xc5 }, { 0x42, 1, 0xe7 }, { 0x01, 3, 0xe7 },
+	{ 0x42, 1, 0xef }, { 0x01, 3, 0xef }, { 0x00, 3, 0x09 }, { 0x00, 3, 0x8e },
+	{ 0x00, 3, 0x90 }, { 0x00, 3, 0x91 }, { 0x00, 3, 0x94 }, { 0x00, 3, 0x9f },
+},
+/* state  42 */ {
+	{ 0x55, 1, 0xef }, { 0x43, 1, 0xef }, { 0x5d, 1, 0xef }, { 0x02, 3, 0xef },
+	{ 0x42, 1, 0x09 }, { 0x01, 3, 0x09 }, { 0x42, 1, 0x8e }, { 0x01, 3, 0x8e },
+	{ 0x42, 1, 0x90 }, { 0x01, 3, 0x90 }, { 0x42, 1, 0x91 }, { 0x01, 3, 0x91 },
+	{ 0x42, 1, 0x94 }, { 0x01, 3, 0x94 }, { 0x42, 1, 0x9f }, { 0x01, 3, 0x9f },
+},
+/* state  43 */ {
+	{ 0x56, 1, 0xef }, { 0x82, 1, 0xef }, { 0x44, 1, 0xef }, { 0x52, 1, 0xef },
+	{ 0x63, 1, 0xef }, { 0x5e, 1, 0xef }, { 0x68, 1, 0xef }, { 0x03, 3, 0xef },
+	{ 0x55, 1, 0x09 }, { 0x43, 1, 0x09 }, { 0x5d, 1, 0x09 }, { 0x02, 3, 0x09 },
+	{ 0x55, 1, 0x8e }, { 0x43, 1, 0x8e }, { 0x5d, 1, 0x8e }, { 0x02, 3, 0x8e },
+},
+/* state  44 */ {
+	{ 0x56, 1, 0x09 }, { 0x82, 1, 0x09 }, { 0x44, 1, 0x09 }, { 0x52, 1, 0x09 },
+	{ 0x63, 1, 0x09 }, { 0x5e, 1, 0x09 }, { 0x68, 1, 0x09 }, { 0x03, 3, 0x09 },
+	{ 0x56, 1, 0x8e }, { 0x82, 1, 0x8e }, { 0x44, 1, 0x8e }, { 0x52, 1, 0x8e },
+	{ 0x63, 1, 0x8e }, { 0x5e, 1, 0x8e }, { 0x68, 1, 0x8e }, { 0x03, 3, 0x8e },
+},
+/* state  45 */ {
+	{ 0x00, 3, 0x13 }, { 0x00, 3, 0x14 }, { 0x00, 3, 0x15 }, { 0x00, 3, 0x17 },
+	{ 0x00, 3, 0x18 }, { 0x00, 3, 0x19 }, { 0x00, 3, 0x1a }, { 0x00, 3, 0x1b },
+	{ 0x00, 3, 0x1c }, { 0x00, 3, 0x1d }, { 0x00, 3, 0x1e }, { 0x00, 3, 0x1f },
+	{ 0x00, 3, 0x7f }, { 0x00, 3, 0xdc }, { 0x00, 3, 0xf9 }, { 0x31, 0, 0x00 },
+},
+/* state  46 */ {
+	{ 0x42, 1, 0x1c }, { 0x01, 3, 0x1c }, { 0x42, 1, 0x1d }, { 0x01, 3, 0x1d },
+	{ 0x42, 1, 0x1e }, { 0x01, 3, 0x1e }, { 0x42, 1, 0x1f }, { 0x01, 3, 0x1f },
+	{ 0x42, 1, 0x7f }, { 0x01, 3, 0x7f }, { 0x42, 1, 0xdc }, { 0x01, 3, 0xdc },
+	{ 0x42, 1, 0xf9 }, { 0x01, 3, 0xf9 }, { 0x32, 0, 0x00 }, { 0x3b, 0, 0x00 },
+},
+/* state  47 */ {
+	{ 0x55, 1, 0x7f }, { 0x43, 1, 0x7f }, { 0x5d, 1, 0x7f }, { 0x02, 3, 0x7f },
+	{ 0x55, 1, 0xdc }, { 0x43, 1, 0xdc }, { 0x5d, 1, 0xdc }, { 0x02, 3, 0xdc },
+	{ 0x55, 1, 0xf9 }, { 0x43, 1, 0xf9 }, { 0x5d, 1, 0xf9 }, { 0x02, 3, 0xf9 },
+	{ 0x00, 3, 0x0a }, { 0x00, 3, 0x0d }, { 0x00, 3, 0x16 }, { 0x00, 4, 0x00 },
+},
+/* state  48 */ {
+	{ 0x56, 1, 0xf9 }, { 0x82, 1, 0xf9 }, { 0x44, 1, 0xf9 }, { 0x52, 1, 0xf9 },
+	{ 0x63, 1, 0xf9 }, { 0x5e, 1, 0xf9 }, { 0x68, 1, 0xf9 }, { 0x03, 3, 0xf9 },
+	{ 0x42, 1, 0x0a }, { 0x01, 3, 0x0a }, { 0x42, 1, 0x0d }, { 0x01, 3, 0x0d },
+	{ 0x42, 1, 0x16 }, { 0x01, 3, 0x16 }, { 0x00, 4, 0x00 }, { 0x00, 4, 0x00 },
+},
+/* state  49 */ {
+	{ 0x55, 1, 0x0a }, { 0x43, 1, 0x0a }, { 0x5d, 1, 0x0a }, { 0x02, 3, 0x0a },
+	{ 0x55, 1, 0x0d }, { 0x43, 1, 0x0d }, { 0x5d, 1, 0x0d }, { 0x02, 3, 0x0d },
+	{ 0x55, 1, 0x16 }, { 0x43, 1, 0x16 }, { 0x5d, 1, 0x16 }, { 0x02, 3, 0x16 },
+	{ 0x00, 4, 0x00 }, { 0x00, 4, 0x00 }, { 0x00, 4, 0x00 }, { 0x00, 4, 0x00 },
+},
+/* state  50 */ {
+	{ 0x56, 1, 0x0a }, { 0x82, 1, 0x0a }, { 0x44, 1, 0x0a }, { 0x52, 1, 0x0a },
+	{ 0x63, 1, 0x0a }, { 0x5e, 1, 0x0a }, { 0x68, 1, 0x0a }, { 0x03, 3, 0x0a },
+	{ 0x56, 1, 0x0d }, { 0x82, 1, 0x0d }, { 0x44, 1, 0x0d }, { 0x52, 1, 0x0d },
+	{ 0x63, 1, 0x0d }, { 0x5e, 1, 0x0d }, { 0x68, 1, 0x0d }, { 0x03, 3, 0x0d },
+},
+/* state  51 */ {
+	{ 0x56, 1, 0x0c }, { 0x82, 1, 0x0c }, { 0x44, 1, 0x0c }, { 0x52, 1, 0x0c },
+	{ 0x63, 1, 0x0c }, { 0x5e, 1, 0x0c }, { 0x68, 1, 0x0c }, { 0x03, 3, 0x0c },
+	{ 0x56, 1, 0x0e }, { 0x82, 1, 0x0e }, { 0x44, 1, 0x0e }, { 0x52, 1, 0x0e },
+	{ 0x63, 1, 0x0e }, { 0x5e, 1, 0x0e }, { 0x68, 1, 0x0e }, { 0x03, 3, 0x0e },
+},
+/* state  52 */ {
+	{ 0x55, 1, 0x0f }, { 0x43, 1, 0x0f }, { 0x5d, 1, 0x0f }, { 0x02, 3, 0x0f },
+	{ 0x55, 1, 0x10 }, { 0x43, 1, 0x10 }, { 0x5d, 1, 0x10 }, { 0x02, 3, 0x10 },
+	{ 0x55, 1, 0x11 }, { 0x43, 1, 0x11 }, { 0x5d, 1, 0x11 }, { 0x02, 3, 0x11 },
+	{ 0x55, 1, 0x12 }, { 0x43, 1, 0x12 }, { 0x5d, 1, 0x12 }, { 0x02, 3, 0x12 },
+},
+/* state  53 */ {
+	{ 0x56, 1, 0x0f }, { 0x82, 1, 0x0f }, { 0x44, 1, 0x0f }, { 0x52, 1, 0x0f },
+	{ 0x63, 1, 0x0f }, { 0x5e, 1, 0x0f }, { 0x68, 1, 0x0f }, { 0x03, 3, 0x0f },
+	{ 0x56, 1, 0x10 }, { 0x82, 1, 0x10 }, { 0x44, 1, 0x10 }, { 0x52, 1, 0x10 },
+	{ 0x63, 1, 0x10 }, { 0x5e, 1, 0x10 }, { 0x68, 1, 0x10 }, { 0x03, 3, 0x10 },
+},
+/* state  54 */ {
+	{ 0x56, 1, 0x11 }, { 0x82, 1, 0x11 }, { 0x44, 1, 0x11 }, { 0x52, 1, 0x11 },
+	{ 0x63, 1, 0x11 }, { 0x5e, 1, 0x11 }, { 0x68, 1, 0x11 }, { 0x03, 3, 0x11 },
+	{ 0x56, 1, 0x12 }, { 0x82, 1, 0x12 }, { 0x44, 1, 0x12 }, { 0x52, 1, 0x12 },
+	{ 0x63, 1, 0x12 }, { 0x5e, 1, 0x12 }, { 0x68, 1, 0x12 }, { 0x03, 3, 0x12 },
+},
+/* state  55 */ {
+	{ 0x42, 1, 0x13 }, { 0x01, 3, 0x13 }, { 0x42, 1, 0x14 }, { 0x01, 3, 0x14 },
+	{ 0x42, 1, 0x15 }, { 0x01, 3, 0x15 }, { 0x42, 1, 0x17 }, { 0x01, 3, 0x17 },
+	{ 0x42, 1, 0x18 }, { 0x01, 3, 0x18 }, { 0x42, 1, 0x19 }, { 0x01, 3, 0x19 },
+	{ 0x42, 1, 0x1a }, { 0x01, 3, 0x1a }, { 0x42, 1, 0x1b }, { 0x01, 3, 0x1b },
+},
+/* state  56 */ {
+	{ 0x55, 1, 0x13 }, { 0x43, 1, 0x13 }, { 0x5d, 1, 0x13 }, { 0x02, 3, 0x13 },
+	{ 0x55, 1, 0x14 }, { 0x43, 1, 0x14 }, { 0x5d, 1, 0x14 }, { 0x02, 3, 0x14 },
+	{ 0x55, 1, 0x15 }, { 0x43, 1, 0x15 }, { 0x5d, 1, 0x15 }, { 0x02, 3, 0x15 },
+	{ 0x55, 1, 0x17 }, { 0x43, 1, 0x17 }, { 0x5d, 1, 0x17 }, { 0x02, 3, 0x17 },
+},
+/* state  57 */ {
+	{ 0x56, 1, 0x13 }, { 0x82, 1, 0x13 }, { 0x44, 1, 0x13 }, { 0x52, 1, 0x13 },
+	{ 0x63, 1, 0x13 }, { 0x5e, 1, 0x13 }, { 0x68, 1, 0x13 }, { 0x03, 3, 0x13 },
+	{ 0x56, 1, 0x14 }, { 0x82, 1, 0x14 }, { 0x44, 1, 0x14 }, { 0x52, 1, 0x14 },
+	{ 0x63, 1, 0x14 }, { 0x5e, 1, 0x14 }, { 0x68, 1, 0x14 }, { 0x03, 3, 0x14 },
+},
+/* state  58 */ {
+	{ 0x56, 1, 0x15 }, { 0x82, 1, 0x15 }, { 0x44, 1, 0x15 }, { 0x52, 1, 0x15 },
+	{ 0x63, 1, 0x15 }, { 0x5e, 1, 0x15 }, { 0x68, 1, 0x15 }, { 0x03, 3, 0x15 },
+	{ 0x56, 1, 0x17 }, { 0x82, 1, 0x17 }, { 0x44, 1, 0x17 }, { 0x52, 1, 0x17 },
+	{ 0x63, 1, 0x17 }, { 0x5e, 1, 0x17 }, { 0x68, 1, 0x17 }, { 0x03, 3, 0x17 },
+},
+/* state  59 */ {
+	{ 0x56, 1, 0x16 }, { 0x82, 1, 0x16 }, { 0x44, 1, 0x16 }, { 0x52, 1, 0x16 },
+	{ 0x63, 1, 0x16 }, { 0x5e, 1, 0x16 }, { 0x68, 1, 0x16 }, { 0x03, 3, 0x16 },
+	{ 0x00, 4, 0x00 }, { 0x00, 4, 0x00 }, { 0x00, 4, 0x00 }, { 0x00, 4, 0x00 },
+	{ 0x00, 4, 0x00 }, { 0x00, 4, 0x00 }, { 0x00, 4, 0x00 }, { 0x00, 4, 0x00 },
+},
+/* state  60 */ {
+	{ 0x55, 1, 0x18 }, { 0x43, 1, 0x18 }, { 0x5d, 1, 0x18 }, { 0x02, 3, 0x18 },
+	{ 0x55, 1, 0x19 }, { 0x43, 1, 0x19 }, { 0x5d, 1, 0x19 }, { 0x02, 3, 0x19 },
+	{ 0x55, 1, 0x1a }, { 0x43, 1, 0x1a }, { 0x5d, 1, 0x1a }, { 0x02, 3, 0x1a },
+	{ 0x55, 1, 0x1b }, { 0x43, 1, 0x1b }, { 0x5d, 1, 0x1b }, { 0x02, 3, 0x1b },
+},
+/* state  61 */ {
+	{ 0x56, 1, 0x18 }, { 0x82, 1, 0x18 }, { 0x44, 1, 0x18 }, { 0x52, 1, 0x18 },
+	{ 0x63, 1, 0x18 }, { 0x5e, 1, 0x18 }, { 0x68, 1, 0x18 }, { 0x03, 3, 0x18 },
+	{ 0x56, 1, 0x19 }, { 0x82, 1, 0x19 }, { 0x44, 1, 0x19 }, { 0x52, 1, 0x19 },
+	{ 0x63, 1, 0x19 }, { 0x5e, 1, 0x19 }, { 0x68, 1, 0x19 }, { 0x03, 3, 0x19 },
+},
+/* state  62 */ {
+	{ 0x56, 1, 0x1a }, { 0x82, 1, 0x1a }, { 0x44, 1, 0x1a }, { 0x52, 1, 0x1a },
+	{ 0x63, 1, 0x1a }, { 0x5e, 1, 0x1a }, { 0x68, 1, 0x1a }, { 0x03, 3, 0x1a },
+	{ 0x56, 1, 0x1b }, { 0x82, 1, 0x1b }, { 0x44, 1, 0x1b }, { 0x52, 1, 0x1b },
+	{ 0x63, 1, 0x1b }, { 0x5e, 1, 0x1b }, { 0x68, 1, 0x1b }, { 0x03, 3, 0x1b },
+},
+/* state  63 */ {
+	{ 0x55, 1, 0x1c }, { 0x43, 1, 0x1c }, { 0x5d, 1, 0x1c }, { 0x02, 3, 0x1c },
+	{ 0x55, 1, 0x1d }, { 0x43, 1, 0x1d }, { 0x5d, 1, 0x1d }, { 0x02, 3, 0x1d },
+	{ 0x55, 1, 0x1e }, { 0x43, 1, 0x1e }, { 0x5d, 1, 0x1e }, { 0x02, 3, 0x1e },
+	{ 0x55, 1, 0x1f }, { 0x43, 1, 0x1f }, { 0x5d, 1, 0x1f }, { 0x02, 3, 0x1f },
+},
+/* state  64 */ {
+	{ 0x56, 1, 0x1c }, { 0x82, 1, 0x1c }, { 0x44, 1, 0x1c }, { 0x52, 1, 0x1c },
+	{ 0x63, 1, 0x1c }, { 0x5e, 1, 0x1c }, { 0x68, 1, 0x1c }, { 0x03, 3, 0x1c },
+	{ 0x56, 1, 0x1d }, { 0x82, 1, 0x1d }, { 0x44, 1, 0x1d }, { 0x52, 1, 0x1d },
+	{ 0x63, 1, 0x1d }, { 0x5e, 1, 0x1d }, { 0x68, 1, 0x1d }, { 0x03, 3, 0x1d },
+},
+/* state  65 */ {
+	{ 0x56, 1, 0x1e }, { 0x82, 1, 0x1e }, { 0x44, 1, 0x1e }, { 0x52, 1, 0x1e },
+	{ 0x63, 1, 0x1e }, { 0x5e, 1, 0x1e }, { 0x68, 1, 0x1e }, { 0x03, 3, 0x1e },
+	{ 0x56, 1, 0x1f }, { 0x82, 1, 0x1f }, { 0x44, 1, 0x1f }, { 0x52, 1, 0x1f },
+	{ 0x63, 1, 0x1f }, { 0x5e, 1, 0x1f }, { 0x68, 1, 0x1f }, { 0x03, 3, 0x1f },
+},
+/* state  66 */ {
+	{ 0x00, 3, 0x30 }, { 0x00, 3, 0x31 }, { 0x00, 3, 0x32 }, { 0x00, 3, 0x61 },
+	{ 0x00, 3, 0x63 }, { 0x00, 3, 0x65 }, { 0x00, 3, 0x69 }, { 0x00, 3, 0x6f },
+	{ 0x00, 3, 0x73 }, { 0x00, 3, 0x74 }, { 0x46, 0, 0x00 }, { 0x51, 0, 0x00 },
+	{ 0x54, 0, 0x00 }, { 0x59, 0, 0x00 }, { 0x5b, 0, 0x00 }, { 0x5c, 0, 0x00 },
+},
+/* state  67 */ {
+	{ 0x42, 1, 0x73 }, { 0x01, 3, 0x73 }, { 0x42, 1, 0x74 }, { 0x01, 3, 0x74 },
+	{ 0x00, 3, 0x20 }, { 0x00, 3, 0x25 }, { 0x00, 3, 0x2d }, { 0x00, 3, 0x2e },
+	{ 0x00, 3, 0x2f }, { 0x00, 3, 0x33 }, { 0x00, 3, 0x34 }, { 0x00, 3, 0x35 },
+	{ 0x00, 3, 0x36 }, { 0x00, 3, 0x37 }, { 0x00, 3, 0x38 }, { 0x00, 3, 0x39 },
+},
+/* state  68 */ {
+	{ 0x55, 1, 0x73 }, { 0x43, 1, 0x73 }, { 0x5d, 1, 0x73 }, { 0x02, 3, 0x73 },
+	{ 0x55, 1, 0x74 }, { 0x43, 1, 0x74 }, { 0x5d, 1, 0x74 }, { 0x02, 3, 0x74 },
+	{ 0x42, 1, 0x20 }, { 0x01, 3, 0x20 }, { 0x42, 1, 0x25 }, { 0x01, 3, 0x25 },
+	{ 0x42, 1, 0x2d }, { 0x01, 3, 0x2d }, { 0x42, 1, 0x2e }, { 0x01, 3, 0x2e },
+},
+/* state  69 */ {
+	{ 0x55, 1, 0x20 }, { 0x43, 1, 0x20 }, { 0x5d, 1, 0x20 }, { 0x02, 3, 0x20 },
+	{ 0x55, 1, 0x25 }, { 0x43, 1, 0x25 }, { 0x5d, 1, 0x25 }, { 0x02, 3, 0x25 },
+	{ 0x55, 1, 0x2d }, { 0x43, 1, 0x2d }, { 0x5d, 1, 0x2d }, { 0x02, 3, 0x2d },
+	{ 0x55, 1, 0x2e }, { 0x43, 1, 0x2e }, { 0x5d, 1, 0x2e }, { 0x02, 3, 0x2e },
+},
+/* state  70 */ {
+	{ 0x56, 1, 0x20 }, { 0x82, 1, 0x20 }, { 0x44, 1, 0x20 }, { 0x52, 1, 0x20 },
+	{ 0x63, 1, 0x20 }, { 0x5e, 1, 0x20 }, { 0x68, 1, 0x20 }, { 0x03, 3, 0x20 },
+	{ 0x56, 1, 0x25 }, { 0x82, 1, 0x25 }, { 0x44, 1, 0x25 }, { 0x52, 1, 0x25 },
+	{ 0x63, 1, 0x25 }, { 0x5e, 1, 0x25 }, { 0x68, 1, 0x25 }, { 0x03, 3, 0x25 },
+},
+/* state  71 */ {
+	{ 0x55, 1, 0x21 }, { 0x43, 1, 0x21 }, { 0x5d, 1, 0x21 }, { 0x02, 3, 0x21 },
+	{ 0x55, 1, 0x22 }, { 0x43, 1, 0x22 }, { 0x5d, 1, 0x22 }, { 0x02, 3, 0x22 },
+	{ 0x55, 1, 0x28 }, { 0x43, 1, 0x28 }, { 0x5d, 1, 0x28 }, { 0x02, 3, 0x28 },
+	{ 0x55, 1, 0x29 }, { 0x43, 1, 0x29 }, { 0x5d, 1, 0x29 }, { 0x02, 3, 0x29 },
+},
+/* state  72 */ {
+	{ 0x56, 1, 0x21 }, { 0x82, 1, 0x21 }, { 0x44, 1, 0x21 }, { 0x52, 1, 0x21 },
+	{ 0x63, 1, 0x21 }, { 0x5e, 1, 0x21 }, { 0x68, 1, 0x21 }, { 0x03, 3, 0x21 },
+	{ 0x56, 1, 0x22 }, { 0x82, 1, 0x22 }, { 0x44, 1, 0x22 }, { 0x52, 1, 0x22 },
+	{ 0x63, 1, 0x22 }, { 0x5e, 1, 0x22 }, { 0x68, 1, 0x22 }, { 0x03, 3, 0x22 },
+},
+/* state  73 */ {
+	{ 0x56, 1, 0x7c }, { 0x82, 1, 0x7c }, { 0x44, 1, 0x7c }, { 0x52, 1, 0x7c },
+	{ 0x63, 1, 0x7c }, { 0x5e, 1, 0x7c }, { 0x68, 1, 0x7c }, { 0x03, 3, 0x7c },
+	{ 0x55, 1, 0x23 }, { 0x43, 1, 0x23 }, { 0x5d, 1, 0x23 }, { 0x02, 3, 0x23 },
+	{ 0x55, 1, 0x3e }, { 0x43, 1, 0x3e }, { 0x5d, 1, 0x3e }, { 0x02, 3, 0x3e },
+},
+/* state  74 */ {
+	{ 0x56, 1, 0x23 }, { 0x82, 1, 0x23 }, { 0x44, 1, 0x23 }, { 0x52, 1, 0x23 },
+	{ 0x63, 1, 0x23 }, { 0x5e, 1, 0x23 }, { 0x68, 1, 0x23 }, { 0x03, 3, 0x23 },
+	{ 0x56, 1, 0x3e }, { 0x82, 1, 0x3e }, { 0x44, 1, 0x3e }, { 0x52, 1, 0x3e },
+	{ 0x63, 1, 0x3e }, { 0x5e, 1, 0x3e }, { 0x68, 1, 0x3e }, { 0x03, 3, 0x3e },
+},
+/* state  75 */ {
+	{ 0x55, 1, 0x26 }, { 0x43, 1, 0x26 }, { 0x5d, 1, 0x26 }, { 0x02, 3, 0x26 },
+	{ 0x55, 1, 0x2a }, { 0x43, 1, 0x2a }, { 0x5d, 1, 0x2a }, { 0x02, 3, 0x2a },
+	{ 0x55, 1, 0x2c }, { 0x43, 1, 0x2c }, { 0x5d, 1, 0x2c }, { 0x02, 3, 0x2c },
+	{ 0x55, 1, 0x3b }, { 0x43, 1, 0x3b }, { 0x5d, 1, 0x3b }, { 0x02, 3, 0x3b },
+},
+/* state  76 */ {
+	{ 0x56, 1, 0x26 }, { 0x82, 1, 0x26 }, { 0x44, 1, 0x26 }, { 0x52, 1, 0x26 },
+	{ 0x63, 1, 0x26 }, { 0x5e, 1, 0x26 }, { 0x68, 1, 0x26 }, { 0x03, 3, 0x26 },
+	{ 0x56, 1, 0x2a }, { 0x82, 1, 0x2a }, { 0x44, 1, 0x2a }, { 0x52, 1, 0x2a },
+	{ 0x63, 1, 0x2a }, { 0x5e, 1, 0x2a }, { 0x68, 1, 0x2a }, { 0x03, 3, 0x2a },
+},
+/* state  77 */ {
+	{ 0x56, 1, 0x3f }, { 0x82, 1, 0x3f }, { 0x44, 1, 0x3f }, { 0x52, 1, 0x3f },
+	{ 0x63, 1, 0x3f }, { 0x5e, 1, 0x3f }, { 0x68, 1, 0x3f }, { 0x03, 3, 0x3f },
+	{ 0x55, 1, 0x27 }, { 0x43, 1, 0x27 }, { 0x5d, 1, 0x27 }, { 0x02, 3, 0x27 },
+	{ 0x55, 1, 0x2b }, { 0x43, 1, 0x2b }, { 0x5d, 1, 0x2b }, { 0x02, 3, 0x2b },
+},
+/* state  78 */ {
+	{ 0x56, 1, 0x27 }, { 0x82, 1, 0x27 }, { 0x44, 1, 0x27 }, { 0x52, 1, 0x27 },
+	{ 0x63, 1, 0x27 }, { 0x5e, 1, 0x27 }, { 0x68, 1, 0x27 }, { 0x03, 3, 0x27 },
+	{ 0x56, 1, 0x2b }, { 0x82, 1, 0x2b }, { 0x44, 1, 0x2b }, { 0x52, 1, 0x2b },
+	{ 0x63, 1, 0x2b }, { 0x5e, 1, 0x2b }, { 0x68, 1, 0x2b }, { 0x03, 3, 0x2b },
+},
+/* state  79 */ {
+	{ 0x56, 1, 0x28 }, { 0x82, 1, 0x28 }, { 0x44, 1, 0x28 }, { 0x52, 1, 0x28 },
+	{ 0x63, 1, 0x28 }, { 0x5e, 1, 0x28 }, { 0x68, 1, 0x28 }, { 0x03, 3, 0x28 },
+	{ 0x56, 1, 0x29 }, { 0x82, 1, 0x29 }, { 0x44, 1, 0x29 }, { 0x52, 1, 0x29 },
+	{ 0x63, 1, 0x29 }, { 0x5e, 1, 0x29 }, { 0x68, 1, 0x29 }, { 0x03, 3, 0x29 },
+},
+/* state  80 */ {
+	{ 0x56, 1, 0x2c }, { 0x82, 1, 0x2c }, { 0x44, 1, 0x2c }, { 0x52, 1, 0x2c },
+	{ 0x63, 1, 0x2c }, { 0x5e, 1, 0x2c }, { 0x68, 1, 0x2c }, { 0x03, 3, 0x2c },
+	{ 0x56, 1, 0x3b }, { 0x82, 1, 0x3b }, { 0x44, 1, 0x3b }, { 0x52, 1, 0x3b },
+	{ 0x63, 1, 0x3b }, { 0x5e, 1, 0x3b }, { 0x68, 1, 0x3b }, { 0x03, 3, 0x3b },
+},
+/* state  81 */ {
+	{ 0x56, 1, 0x2d }, { 0x82, 1, 0x2d }, { 0x44, 1, 0x2d }, { 0x52, 1, 0x2d },
+	{ 0x63, 1, 0x2d }, { 0x5e, 1, 0x2d }, { 0x68, 1, 0x2d }, { 0x03, 3, 0x2d },
+	{ 0x56, 1, 0x2e }, { 0x82, 1, 0x2e }, { 0x44, 1, 0x2e }, { 0x52, 1, 0x2e },
+	{ 0x63, 1, 0x2e }, { 0x5e, 1, 0x2e }, { 0x68, 1, 0x2e }, { 0x03, 3, 0x2e },
+},
+/* state  82 */ {
+	{ 0x42, 1, 0x2f }, { 0x01, 3, 0x2f }, { 0x42, 1, 0x33 }, { 0x01, 3, 0x33 },
+	{ 0x42, 1, 0x34 }, { 0x01, 3, 0x34 }, { 0x42, 1, 0x35 }, { 0x01, 3, 0x35 },
+	{ 0x42, 1, 0x36 }, { 0x01, 3, 0x36 }, { 0x42, 1, 0x37 }, { 0x01, 3, 0x37 },
+	{ 0x42, 1, 0x38 }, { 0x01, 3, 0x38 }, { 0x42, 1, 0x39 }, { 0x01, 3, 0x39 },
+},
+/* state  83 */ {
+	{ 0x55, 1, 0x2f }, { 0x43, 1, 0x2f }, { 0x5d, 1, 0x2f }, { 0x02, 3, 0x2f },
+	{ 0x55, 1, 0x33 }, { 0x43, 1, 0x33 }, { 0x5d, 1, 0x33 }, { 0x02, 3, 0x33 },
+	{ 0x55, 1, 0x34 }, { 0x43, 1, 0x34 }, { 0x5d, 1, 0x34 }, { 0x02, 3, 0x34 },
+	{ 0x55, 1, 0x35 }, { 0x43, 1, 0x35 }, { 0x5d, 1, 0x35 }, { 0x02, 3, 0x35 },
+},
+/* state  84 */ {
+	{ 0x56, 1, 0x2f }, { 0x82, 1, 0x2f }, { 0x44, 1, 0x2f }, { 0x52, 1, 0x2f },
+	{ 0x63, 1, 0x2f }, { 0x5e, 1, 0x2f }, { 0x68, 1, 0x2f }, { 0x03, 3, 0x2f },
+	{ 0x56, 1, 0x33 }, { 0x82, 1, 0x33 }, { 0x44, 1, 0x33 }, { 0x52, 1, 0x33 },
+	{ 0x63, 1, 0x33 }, { 0x5e, 1, 0x33 }, { 0x68, 1, 0x33 }, { 0x03, 3, 0x33 },
+},
+/* state  85 */ {
+	{ 0x42, 1, 0x30 }, { 0x01, 3, 0x30 }, { 0x42, 1, 0x31 }, { 0x01, 3, 0x31 },
+	{ 0x42, 1, 0x32 }, { 0x01, 3, 0x32 }, { 0x42, 1, 0x61 }, { 0x01, 3, 0x61 },
+	{ 0x42, 1, 0x63 }, { 0x01, 3, 0x63 }, { 0x42, 1, 0x65 }, { 0x01, 3, 0x65 },
+	{ 0x42, 1, 0x69 }, { 0x01, 3, 0x69 }, { 0x42, 1, 0x6f }, { 0x01, 3, 0x6f },
+},
+/* state  86 */ {
+	{ 0x55, 1, 0x30 }, { 0x43, 1, 0x30 }, { 0x5d, 1, 0x30 }, { 0x02, 3, 0x30 },
+	{ 0x55, 1, 0x31 }, { 0x43, 1, 0x31 }, { 0x5d, 1, 0x31 }, { 0x02, 3, 0x31 },
+	{ 0x55, 1, 0x32 }, { 0x43, 1, 0x32 }, { 0x5d, 1, 0x32 }, { 0x02, 3, 0x32 },
+	{ 0x55, 1, 0x61 }, { 0x43, 1, 0x61 }, { 0x5d, 1, 0x61 }, { 0x02, 3, 0x61 },
+},
+/* state  87 */ {
+	{ 0x56, 1, 0x30 }, { 0x82, 1, 0x30 }, { 0x44, 1, 0x30 }, { 0x52, 1, 0x30 },
+	{ 0x63, 1, 0x30 }, { 0x5e, 1, 0x30 }, { 0x68, 1, 0x30 }, { 0x03, 3, 0x30 },
+	{ 0x56, 1, 0x31 }, { 0x82, 1, 0x31 }, { 0x44, 1, 0x31 }, { 0x52, 1, 0x31 },
+	{ 0x63, 1, 0x31 }, { 0x5e, 1, 0x31 }, { 0x68, 1, 0x31 }, { 0x03, 3, 0x31 },
+},
+/* state  88 */ {
+	{ 0x56, 1, 0x32 }, { 0x82, 1, 0x32 }, { 0x44, 1, 0x32 }, { 0x52, 1, 0x32 },
+	{ 0x63, 1, 0x32 }, { 0x5e, 1, 0x32 }, { 0x68, 1, 0x32 }, { 0x03, 3, 0x32 },
+	{ 0x56, 1, 0x61 }, { 0x82, 1, 0x61 }, { 0x44, 1, 0x61 }, { 0x52, 1, 0x61 },
+	{ 0x63, 1, 0x61 }, { 0x5e, 1, 0x61 }, { 0x68, 1, 0x61 }, { 0x03, 3, 0x61 },
+},
+/* state  89 */ {
+	{ 0x56, 1, 0x34 }, { 0x82, 1, 0x34 }, { 0x44, 1, 0x34 }, { 0x52, 1, 0x34 },
+	{ 0x63, 1, 0x34 }, { 0x5e, 1, 0x34 }, { 0x68, 1, 0x34 }, { 0x03, 3, 0x34 },
+	{ 0x56, 1, 0x35 }, { 0x82, 1, 0x35 }, { 0x44, 1, 0x35 }, { 0x52, 1, 0x35 },
+	{ 0x63, 1, 0x35 }, { 0x5e, 1, 0x35 }, { 0x68, 1, 0x35 }, { 0x03, 3, 0x35 },
+},
+/* state  90 */ {
+	{ 0x55, 1, 0x36 }, { 0x43, 1, 0x36 }, { 0x5d, 1, 0x36 }, { 0x02, 3, 0x36 },
+	{ 0x55, 1, 0x37 }, { 0x43, 1, 0x37 }, { 0x5d, 1, 0x37 }, { 0x02, 3, 0x37 },
+	{ 0x55, 1, 0x38 }, { 0x43, 1, 0x38 }, { 0x5d, 1, 0x38 }, { 0x02, 3, 0x38 },
+	{ 0x55, 1, 0x39 }, { 0x43, 1, 0x39 }, { 0x5d, 1, 0x39 }, { 0x02, 3, 0x39 },
+},
+/* state  91 */ {
+	{ 0x56, 1, 0x36 }, { 0x82, 1, 0x36 }, { 0x44, 1, 0x36 }, { 0x52, 1, 0x36 },
+	{ 0x63, 1, 0x36 }, { 0x5e, 1, 0x36 }, { 0x68, 1, 0x36 }, { 0x03, 3, 0x36 },
+	{ 0x56, 1, 0x37 }, { 0x82, 1, 0x37 }, { 0x44, 1, 0x37 }, { 0x52, 1, 0x37 },
+	{ 0x63, 1, 0x37 }, { 0x5e, 1, 0x37 }, { 0x68, 1, 0x37 }, { 0x03, 3, 0x37 },
+},
+/* state  92 */ {
+	{ 0x56, 1, 0x38 }, { 0x82, 1, 0x38 }, { 0x44, 1, 0x38 }, { 0x52, 1, 0x38 },
+	{ 0x63, 1, 0x38 }, { 0x5e, 1, 0x38 }, { 0x68, 1, 0x38 }, { 0x03, 3, 0x38 },
+	{ 0x56, 1, 0x39 }, { 0x82, 1, 0x39 }, { 0x44, 1, 0x39 }, { 0x52, 1, 0x39 },
+	{ 0x63, 1, 0x39 }, { 0x5e, 1, 0x39 }, { 0x68, 1, 0x39 }, { 0x03, 3, 0x39 },
+},
+/* state  93 */ {
+	{ 0x00, 3, 0x3d }, { 0x00, 3, 0x41 }, { 0x00, 3, 0x5f }, { 0x00, 3, 0x62 },
+	{ 0x00, 3, 0x64 }, { 0x00, 3, 0x66 }, { 0x00, 3, 0x67 }, { 0x00, 3, 0x68 },
+	{ 0x00, 3, 0x6c }, { 0x00, 3, 0x6d }, { 0x00, 3, 0x6e }, { 0x00, 3, 0x70 },
+	{ 0x00, 3, 0x72 }, { 0x00, 3, 0x75 }, { 0x61, 0, 0x00 }, { 0x67, 0, 0x00 },
+},
+/* state  94 */ {
+	{ 0x42, 1, 0x6c }, { 0x01, 3, 0x6c }, { 0x42, 1, 0x6d }, { 0x01, 3, 0x6d },
+	{ 0x42, 1, 0x6e }, { 0x01, 3, 0x6e }, { 0x42, 1, 0x70 }, { 0x01, 3, 0x70 },
+	{ 0x42, 1, 0x72 }, { 0x01, 3, 0x72 }, { 0x42, 1, 0x75 }, { 0x01, 3, 0x75 },
+	{ 0x00, 3, 0x3a }, { 0x00, 3, 0x42 }, { 0x00, 3, 0x43 }, { 0x00, 3, 0x44 },
+},
+/* state  95 */ {
+	{ 0x55, 1, 0x72 }, { 0x43, 1, 0x72 }, { 0x5d, 1, 0x72 }, { 0x02, 3, 0x72 },
+	{ 0x55, 1, 0x75 }, { 0x43, 1, 0x75 }, { 0x5d, 1, 0x75 }, { 0x02, 3, 0x75 },
+	{ 0x42, 1, 0x3a }, { 0x01, 3, 0x3a }, { 0x42, 1, 0x42 }, { 0x01, 3, 0x42 },
+	{ 0x42, 1, 0x43 }, { 0x01, 3, 0x43 }, { 0x42, 1, 0x44 }, { 0x01, 3, 0x44 },
+},
+/* state  96 */ {
+	{ 0x55, 1, 0x3a }, { 0x43, 1, 0x3a }, { 0x5d, 1, 0x3a }, { 0x02, 3, 0x3a },
+	{ 0x55, 1, 0x42 }, { 0x43, 1, 0x42 }, { 0x5d, 1, 0x42 }, { 0x02, 3, 0x42 },
+	{ 0x55, 1, 0x43 }, { 0x43, 1, 0x43 }, { 0x5d, 1, 0x43 }, { 0x02, 3, 0x43 },
+	{ 0x55, 1, 0x44 }, { 0x43, 1, 0x44 }, { 0x5d, 1, 0x44 }, { 0x02, 3, 0x44 },
+},
+/* state  97 */ {
+	{ 0x56, 1, 0x3a }, { 0x82, 1, 0x3a }, { 0x44, 1, 0x3a }, { 0x52, 1, 0x3a },
+	{ 0x63, 1, 0x3a }, { 0x5e, 1, 0x3a }, { 0x68, 1, 0x3a }, { 0x03, 3, 0x3a },
+	{ 0x56, 1, 0x42 }, { 0x82, 1, 0x42 }, { 0x44, 1, 0x42 }, { 0x52, 1, 0x42 },
+	{ 0x63, 1, 0x42 }, { 0x5e, 1, 0x42 }, { 0x68, 1, 0x42 }, { 0x03, 3, 0x42 },
+},
+/* state  98 */ {
+	{ 0x56, 1, 0x3c }, { 0x82, 1, 0x3c }, { 0x44, 1, 0x3c }, { 0x52, 1, 0x3c },
+	{ 0x63, 1, 0x3c }, { 0x5e, 1, 0x3c }, { 0x68, 1, 0x3c }, { 0x03, 3, 0x3c },
+	{ 0x56, 1, 0x60 }, { 0x82, 1, 0x60 }, { 0x44, 1, 0x60 }, { 0x52, 1, 0x60 },
+	{ 0x63, 1, 0x60 }, { 0x5e, 1, 0x60 }, { 0x68, 1, 0x60 }, { 0x03, 3, 0x60 },
+},
+/* state  99 */ {
+	{ 0x42, 1, 0x3d }, { 0x01, 3, 0x3d }, { 0x42, 1, 0x41 }, { 0x01, 3, 0x41 },
+	{ 0x42, 1, 0x5f }, { 0x01, 3, 0x5f }, { 0x42, 1, 0x62 }, { 0x01, 3, 0x62 },
+	{ 0x42, 1, 0x64 }, { 0x01, 3, 0x64 }, { 0x42, 1, 0x66 }, { 0x01, 3, 0x66 },
+	{ 0x42, 1, 0x67 }, { 0x01, 3, 0x67 }, { 0x42, 1, 0x68 }, { 0x01, 3, 0x68 },
+},
+/* state 100 */ {
+	{ 0x55, 1, 0x3d }, { 0x43, 1, 0x3d }, { 0x5d, 1, 0x3d }, { 0x02, 3, 0x3d },
+	{ 0x55, 1, 0x41 }, { 0x43, 1, 0x41 }, { 0x5d, 1, 0x41 }, { 0x02, 3, 0x41 },
+	{ 0x55, 1, 0x5f }, { 0x43, 1, 0x5f }, { 0x5d, 1, 0x5f }, { 0x02, 3, 0x5f },
+	{ 0x55, 1, 0x62 }, { 0x43, 1, 0x62 }, { 0x5d, 1, 0x62 }, { 0x02, 3, 0x62 },
+},
+/* state 101 */ {
+	{ 0x56, 1, 0x3d }, { 0x82, 1, 0x3d }, { 0x44, 1, 0x3d }, { 0x52, 1, 0x3d },
+	{ 0x63, 1, 0x3d }, { 0x5e, 1, 0x3d }, { 0x68, 1, 0x3d }, { 0x03, 3, 0x3d },
+	{ 0x56, 1, 0x41 }, { 0x82, 1, 0x41 }, { 0x44, 1, 0x41 }, { 0x52, 1, 0x41 },
+	{ 0x63, 1, 0x41 }, { 0x5e, 1, 0x41 }, { 0x68, 1, 0x41 }, { 0x03, 3, 0x41 },
+},
+/* state 102 */ {
+	{ 0x56, 1, 0x40 }, { 0x82, 1, 0x40 }, { 0x44, 1, 0x40 }, { 0x52, 1, 0x40 },
+	{ 0x63, 1, 0x40 }, { 0x5e, 1, 0x40 }, { 0x68, 1, 0x40 }, { 0x03, 3, 0x40 },
+	{ 0x56, 1, 0x5b }, { 0x82, 1, 0x5b }, { 0x44, 1, 0x5b }, { 0x52, 1, 0x5b },
+	{ 0x63, 1, 0x5b }, { 0x5e, 1, 0x5b }, { 0x68, 1, 0x5b }, { 0x03, 3, 0x5b },
+},
+/* state 103 */ {
+	{ 0x56, 1, 0x43 }, { 0x82, 1, 0x43 }, { 0x44, 1, 0x43 }, { 0x52, 1, 0x43 },
+	{ 0x63, 1, 0x43 }, { 0x5e, 1, 0x43 }, { 0x68, 1, 0x43 }, { 0x03, 3, 0x43 },
+	{ 0x56, 1, 0x44 }, { 0x82, 1, 0x44 }, { 0x44, 1, 0x44 }, { 0x52, 1, 0x44 },
+	{ 0x63, 1, 0x44 }, { 0x5e, 1, 0x44 }, { 0x68, 1, 0x44 }, { 0x03, 3, 0x44 },
+},
+/* state 104 */ {
+	{ 0x00, 3, 0x45 }, { 0x00, 3, 0x46 }, { 0x00, 3, 0x47 }, { 0x00, 3, 0x48 },
+	{ 0x00, 3, 0x49 }, { 0x00, 3, 0x4a }, { 0x00, 3, 0x4b }, { 0x00, 3, 0x4c },
+	{ 0x00, 3, 0x4d }, { 0x00, 3, 0x4e }, { 0x00, 3, 0x4f }, { 0x00, 3, 0x50 },
+	{ 0x00, 3, 0x51 }, { 0x00, 3, 0x52 }, { 0x00, 3, 0x53 }, { 0x00, 3, 0x54 },
+},
+/* state 105 */ {
+	{ 0x42, 1, 0x45 }, { 0x01, 3, 0x45 }, { 0x42, 1, 0x46 }, { 0x01, 3, 0x46 },
+	{ 0x42, 1, 0x47 }, { 0x01, 3, 0x47 }, { 0x42, 1, 0x48 }, { 0x01, 3, 0x48 },
+	{ 0x42, 1, 0x49 }, { 0x01, 3, 0x49 }, { 0x42, 1, 0x4a }, { 0x01, 3, 0x4a },
+	{ 0x42, 1, 0x4b }, { 0x01, 3, 0x4b }, { 0x42, 1, 0x4c }, { 0x01, 3, 0x4c },
+},
+/* state 106 */ {
+	{ 0x55, 1, 0x45 }, { 0x43, 1, 0x45 }, { 0x5d, 1, 0x45 }, { 0x02, 3, 0x45 },
+	{ 0x55, 1, 0x46 }, { 0x43, 1, 0x46 }, { 0x5d, 1, 0x46 }, { 0x02, 3, 0x46 },
+	{ 0x55, 1, 0x47 }, { 0x43, 1, 0x47 }, { 0x5d, 1, 0x47 }, { 0x02, 3, 0x47 },
+	{ 0x55, 1, 0x48 }, { 0x43, 1, 0x48 }, { 0x5d, 1, 0x48 }, { 0x02, 3, 0x48 },
+},
+/* state 107 */ {
+	{ 0x56, 1, 0x45 }, { 0x82, 1, 0x45 }, { 0x44, 1, 0x45 }, { 0x52, 1, 0x45 },
+	{ 0x63, 1, 0x45 }, { 0x5e, 1, 0x45 }, { 0x68, 1, 0x45 }, { 0x03, 3, 0x45 },
+	{ 0x56, 1, 0x46 }, { 0x82, 1, 0x46 }, { 0x44, 1, 0x46 }, { 0x52, 1, 0x46 },
+	{ 0x63, 1, 0x46 }, { 0x5e, 1, 0x46 }, { 0x68, 1, 0x46 }, { 0x03, 3, 0x46 },
+},
+/* state 108 */ {
+	{ 0x56, 1, 0x47 }, { 0x82, 1, 0x47 }, { 0x44, 1, 0x47 }, { 0x52, 1, 0x47 },
+	{ 0x63, 1, 0x47 }, { 0x5e, 1, 0x47 }, { 0x68, 1, 0x47 }, { 0x03, 3, 0x47 },
+	{ 0x56, 1, 0x48 }, { 0x82, 1, 0x48 }, { 0x44, 1, 0x48 }, { 0x52, 1, 0x48 },
+	{ 0x63, 1, 0x48 }, { 0x5e, 1, 0x48 }, { 0x68, 1, 0x48 }, { 0x03, 3, 0x48 },
+},
+/* state 109 */ {
+	{ 0x55, 1, 0x49 }, { 0x43, 1, 0x49 }, { 0x5d, 1, 0x49 }, { 0x02, 3, 0x49 },
+	{ 0x55, 1, 0x4a }, { 0x43, 1, 0x4a }, { 0x5d, 1, 0x4a }, { 0x02, 3, 0x4a },
+	{ 0x55, 1, 0x4b }, { 0x43, 1, 0x4b }, { 0x5d, 1, 0x4b }, { 0x02, 3, 0x4b },
+	{ 0x55, 1, 0x4c }, { 0x43, 1, 0x4c }, { 0x5d, 1, 0x4c }, { 0x02, 3, 0x4c },
+},
+/* state 110 */ {
+	{ 0x56, 1, 0x49 }, { 0x82, 1, 0x49 }, { 0x44, 1, 0x49 }, { 0x52, 1, 0x49 },
+	{ 0x63, 1, 0x49 }, { 0x5e, 1, 0x49 }, { 0x68, 1, 0x49 }, { 0x03, 3, 0x49 },
+	{ 0x56, 1, 0x4a }, { 0x82, 1, 0x4a }, { 0x44, 1, 0x4a }, { 0x52, 1, 0x4a },
+	{ 0x63, 1, 0x4a }, { 0x5e, 1, 0x4a }, { 0x68, 1, 0x4a }, { 0x03, 3, 0x4a },
+},
+/* state 111 */ {
+	{ 0x56, 1, 0x4b }, { 0x82, 1, 0x4b }, { 0x44, 1, 0x4b }, { 0x52, 1, 0x4b },
+	{ 0x63, 1, 0x4b }, { 0x5e, 1, 0x4b }, { 0x68, 1, 0x4b }, { 0x03, 3, 0x4b },
+	{ 0x56, 1, 0x4c }, { 0x82, 1, 0x4c }, { 0x44, 1, 0x4c }, { 0x52, 1, 0x4c },
+	{ 0x63, 1, 0x4c }, { 0x5e, 1, 0x4c }, { 0x68, 1, 0x4c }, { 0x03, 3, 0x4c },
+},
+/* state 112 */ {
+	{ 0x42, 1, 0x4d }, { 0x01, 3, 0x4d }, { 0x42, 1, 0x4e }, { 0x01, 3, 0x4e },
+	{ 0x42, 1, 0x4f }, { 0x01, 3, 0x4f }, { 0x42, 1, 0x50 }, { 0x01, 3, 0x50 },
+	{ 0x42, 1, 0x51 }, { 0x01, 3, 0x51 }, { 0x42, 1, 0x52 }, { 0x01, 3, 0x52 },
+	{ 0x42, 1, 0x53 }, { 0x01, 3, 0x53 }, { 0x42, 1, 0x54 }, { 0x01, 3, 0x54 },
+},
+/* state 113 */ {
+	{ 0x55, 1, 0x4d }, { 0x43, 1, 0x4d }, { 0x5d, 1, 0x4d }, { 0x02, 3, 0x4d },
+	{ 0x55, 1, 0x4e }, { 0x43, 1, 0x4e }, { 0x5d, 1, 0x4e }, { 0x02, 3, 0x4e },
+	{ 0x55, 1, 0x4f }, { 0x43, 1, 0x4f }, { 0x5d, 1, 0x4f }, { 0x02, 3, 0x4f },
+	{ 0x55, 1, 0x50 }, { 0x43, 1, 0x50 }, { 0x5d, 1, 0x50 }, { 0x02, 3, 0x50 },
+},
+/* state 114 */ {
+	{ 0x56, 1, 0x4d }, { 0x82, 1, 0x4d }, { 0x44, 1, 0x4d }, { 0x52, 1, 0x4d },
+	{ 0x63, 1, 0x4d }, { 0x5e, 1, 0x4d }, { 0x68, 1, 0x4d }, { 0x03, 3, 0x4d },
+	{ 0x56, 1, 0x4e }, { 0x82, 1, 0x4e }, { 0x44, 1, 0x4e }, { 0x52, 1, 0x4e },
+	{ 0x63, 1, 0x4e }, { 0x5e, 1, 0x4e }, { 0x68, 1, 0x4e }, { 0x03, 3, 0x4e },
+},
+/* state 115 */ {
+	{ 0x56, 1, 0x4f }, { 0x82, 1, 0x4f }, { 0x44, 1, 0x4f }, { 0x52, 1, 0x4f },
+	{ 0x63, 1, 0x4f }, { 0x5e, 1, 0x4f }, { 0x68, 1, 0x4f }, { 0x03, 3, 0x4f },
+	{ 0x56, 1, 0x50 }, { 0x82, 1, 0x50 }, { 0x44, 1, 0x50 }, { 0x52, 1, 0x50 },
+	{ 0x63, 1, 0x50 }, { 0x5e, 1, 0x50 }, { 0x68, 1, 0x50 }, { 0x03, 3, 0x50 },
+},
+/* state 116 */ {
+	{ 0x55, 1, 0x51 }, { 0x43, 1, 0x51 }, { 0x5d, 1, 0x51 }, { 0x02, 3, 0x51 },
+	{ 0x55, 1, 0x52 }, { 0x43, 1, 0x52 }, { 0x5d, 1, 0x52 }, { 0x02, 3, 0x52 },
+	{ 0x55, 1, 0x53 }, { 0x43, 1, 0x53 }, { 0x5d, 1, 0x53 }, { 0x02, 3, 0x53 },
+	{ 0x55, 1, 0x54 }, { 0x43, 1, 0x54 }, { 0x5d, 1, 0x54 }, { 0x02, 3, 0x54 },
+},
+/* state 117 */ {
+	{ 0x56, 1, 0x51 }, { 0x82, 1, 0x51 }, { 0x44, 1, 0x51 }, { 0x52, 1, 0x51 },
+	{ 0x63, 1, 0x51 }, { 0x5e, 1, 0x51 }, { 0x68, 1, 0x51 }, { 0x03, 3, 0x51 },
+	{ 0x56, 1, 0x52 }, { 0x82, 1, 0x52 }, { 0x44, 1, 0x52 }, { 0x52, 1, 0x52 },
+	{ 0x63, 1, 0x52 }, { 0x5e, 1, 0x52 }, { 0x68, 1, 0x52 }, { 0x03, 3, 0x52 },
+},
+/* state 118 */ {
+	{ 0x56, 1, 0x53 }, { 0x82, 1, 0x53 }, { 0x44, 1, 0x53 }, { 0x52, 1, 0x53 },
+	{ 0x63, 1, 0x53 }, { 0x5e, 1, 0x53 }, { 0x68, 1, 0x53 }, { 0x03, 3, 0x53 },
+	{ 0x56, 1, 0x54 }, { 0x82, 1, 0x54 }, { 0x44, 1, 0x54 }, { 0x52, 1, 0x54 },
+	{ 0x63, 1, 0x54 }, { 0x5e, 1, 0x54 }, { 0x68, 1, 0x54 }, { 0x03, 3, 0x54 },
+},
+/* state 119 */ {
+	{ 0x42, 1, 0x55 }, { 0x01, 3, 0x55 }, { 0x42, 1, 0x56 }, { 0x01, 3, 0x56 },
+	{ 0x42, 1, 0x57 }, { 0x01, 3, 0x57 }, { 0x42, 1, 0x59 }, { 0x01, 3, 0x59 },
+	{ 0x42, 1, 0x6a }, { 0x01, 3, 0x6a }, { 0x42, 1, 0x6b }, { 0x01, 3, 0x6b },
+	{ 0x42, 1, 0x71 }, { 0x01, 3, 0x71 }, { 0x42, 1, 0x76 }, { 0x01, 3, 0x76 },
+},
+/* state 120 */ {
+	{ 0x55, 1, 0x55 }, { 0x43, 1, 0x55 }, { 0x5d, 1, 0x55 }, { 0x02, 3, 0x55 },
+	{ 0x55, 1, 0x56 }, { 0x43, 1, 0x56 }, { 0x5d, 1, 0x56 }, { 0x02, 3, 0x56 },
+	{ 0x55, 1, 0x57 }, { 0x43, 1, 0x57 }, { 0x5d, 1, 0x57 }, { 0x02, 3, 0x57 },
+	{ 0x55, 1, 0x59 }, { 0x43, 1, 0x59 }, { 0x5d, 1, 0x59 }, { 0x02, 3, 0x59 },
+},
+/* state 121 */ {
+	{ 0x56, 1, 0x55 }, { 0x82, 1, 0x55 }, { 0x44, 1, 0x55 }, { 0x52, 1, 0x55 },
+	{ 0x63, 1, 0x55 }, { 0x5e, 1, 0x55 }, { 0x68, 1, 0x55 }, { 0x03, 3, 0x55 },
+	{ 0x56, 1, 0x56 }, { 0x82, 1, 0x56 }, { 0x44, 1, 0x56 }, { 0x52, 1, 0x56 },
+	{ 0x63, 1, 0x56 }, { 0x5e, 1, 0x56 }, { 0x68, 1, 0x56 }, { 0x03, 3, 0x56 },
+},
+/* state 122 */ {
+	{ 0x56, 1, 0x57 }, { 0x82, 1, 0x57 }, { 0x44, 1, 0x57 }, { 0x52, 1, 0x57 },
+	{ 0x63, 1, 0x57 }, { 0x5e, 1, 0x57 }, { 0x68, 1, 0x57 }, { 0x03, 3, 0x57 },
+	{ 0x56, 1, 0x59 }, { 0x82, 1, 0x59 }, { 0x44, 1, 0x59 }, { 0x52, 1, 0x59 },
+	{ 0x63, 1, 0x59 }, { 0x5e, 1, 0x59 }, { 0x68, 1, 0x59 }, { 0x03, 3, 0x59 },
+},
+/* state 123 */ {
+	{ 0x56, 1, 0x58 }, { 0x82, 1, 0x58 }, { 0x44, 1, 0x58 }, { 0x52, 1, 0x58 },
+	{ 0x63, 1, 0x58 }, { 0x5e, 1, 0x58 }, { 0x68, 1, 0x58 }, { 0x03, 3, 0x58 },
+	{ 0x56, 1, 0x5a }, { 0x82, 1, 0x5a }, { 0x44, 1, 0x5a }, { 0x52, 1, 0x5a },
+	{ 0x63, 1, 0x5a }, { 0x5e, 1, 0x5a }, { 0x68, 1, 0x5a }, { 0x03, 3, 0x5a },
+},
+/* state 124 */ {
+	{ 0x42, 1, 0x5c }, { 0x01, 3, 0x5c }, { 0x42, 1, 0xc3 }, { 0x01, 3, 0xc3 },
+	{ 0x42, 1, 0xd0 }, { 0x01, 3, 0xd0 }, { 0x00, 3, 0x80 }, { 0x00, 3, 0x82 },
+	{ 0x00, 3, 0x83 }, { 0x00, 3, 0xa2 }, { 0x00, 3, 0xb8 }, { 0x00, 3, 0xc2 },
+	{ 0x00, 3, 0xe0 }, { 0x00, 3, 0xe2 }, { 0xb1, 0, 0x00 }, { 0xbc, 0, 0x00 },
+},
+/* state 125 */ {
+	{ 0x55, 1, 0x5c }, { 0x43, 1, 0x5c }, { 0x5d, 1, 0x5c }, { 0x02, 3, 0x5c },
+	{ 0x55, 1, 0xc3 }, { 0x43, 1, 0xc3 }, { 0x5d, 1, 0xc3 }, { 0x02, 3, 0xc3 },
+	{ 0x55, 1, 0xd0 }, { 0x43, 1, 0xd0 }, { 0x5d, 1, 0xd0 }, { 0x02, 3, 0xd0 },
+	{ 0x42, 1, 0x80 }, { 0x01, 3, 0x80 }, { 0x42, 1, 0x82 }, { 0x01, 3, 0x82 },
+},
+/* state 126 */ {
+	{ 0x56, 1, 0x5c }, { 0x82, 1, 0x5c }, { 0x44, 1, 0x5c }, { 0x52, 1, 0x5c },
+	{ 0x63, 1, 0x5c }, { 0x5e, 1, 0x5c }, { 0x68, 1, 0x5c }, { 0x03, 3, 0x5c },
+	{ 0x56, 1, 0xc3 }, { 0x82, 1, 0xc3 }, { 0x44, 1, 0xc3 }, { 0x52, 1, 0xc3 },
+	{ 0x63, 1, 0xc3 }, { 0x5e, 1, 0xc3 }, { 0x68, 1, 0xc3 }, { 0x03, 3, 0xc3 },
+},
+/* state 127 */ {
+	{ 0x56, 1, 0x5d }, { 0x82, 1, 0x5d }, { 0x44, 1, 0x5d }, { 0x52, 1, 0x5d },
+	{ 0x63, 1, 0x5d }, { 0x5e, 1, 0x5d }, { 0x68, 1, 0x5d }, { 0x03, 3, 0x5d },
+	{ 0x56, 1, 0x7e }, { 0x82, 1, 0x7e }, { 0x44, 1, 0x7e }, { 0x52, 1, 0x7e },
+	{ 0x63, 1, 0x7e }, { 0x5e, 1, 0x7e }, { 0x68, 1, 0x7e }, { 0x03, 3, 0x7e },
+},
+/* state 128 */ {
+	{ 0x56, 1, 0x5e }, { 0x82, 1, 0x5e }, { 0x44, 1, 0x5e }, { 0x52, 1, 0x5e },
+	{ 0x63, 1, 0x5e }, { 0x5e, 1, 0x5e }, { 0x68, 1, 0x5e }, { 0x03, 3, 0x5e },
+	{ 0x56, 1, 0x7d }, { 0x82, 1, 0x7d }, { 0x44, 1, 0x7d }, { 0x52, 1, 0x7d },
+	{ 0x63, 1, 0x7d }, { 0x5e, 1, 0x7d }, { 0x68, 1, 0x7d }, { 0x03, 3, 0x7d },
+},
+/* state 129 */ {
+	{ 0x56, 1, 0x5f }, { 0x82, 1, 0x5f }, { 0x44, 1, 0x5f }, { 0x52, 1, 0x5f },
+	{ 0x63, 1, 0x5f }, { 0x5e, 1, 0x5f }, { 0x68, 1, 0x5f }, { 0x03, 3, 0x5f },
+	{ 0x56, 1, 0x62 }, { 0x82, 1, 0x62 }, { 0x44, 1, 0x62 }, { 0x52, 1, 0x62 },
+	{ 0x63, 1, 0x62 }, { 0x5e, 1, 0x62 }, { 0x68, 1, 0x62 }, { 0x03, 3, 0x62 },
+},
+/* state 130 */ {
+	{ 0x55, 1, 0x63 }, { 0x43, 1, 0x63 }, { 0x5d, 1, 0x63 }, { 0x02, 3, 0x63 },
+	{ 0x55, 1, 0x65 }, { 0x43, 1, 0x65 }, { 0x5d, 1, 0x65 }, { 0x02, 3, 0x65 },
+	{ 0x55, 1, 0x69 }, { 0x43, 1, 0x69 }, { 0x5d, 1, 0x69 }, { 0x02, 3, 0x69 },
+	{ 0x55, 1, 0x6f }, { 0x43, 1, 0x6f }, { 0x5d, 1, 0x6f }, { 0x02, 3, 0x6f },
+},
+/* state 131 */ {
+	{ 0x56, 1, 0x63 }, { 0x82, 1, 0x63 }, { 0x44, 1, 0x63 }, { 0x52, 1, 0x63 },
+	{ 0x63, 1, 0x63 }, { 0x5e, 1, 0x63 }, { 0x68, 1, 0x63 }, { 0x03, 3, 0x63 },
+	{ 0x56, 1, 0x65 }, { 0x82, 1, 0x65 }, { 0x44, 1, 0x65 }, { 0x52, 1, 0x65 },
+	{ 0x63, 1, 0x65 }, { 0x5e, 1, 0x65 }, { 0x68, 1, 0x65 }, { 0x03, 3, 0x65 },
+},
+/* state 132 */ {
+	{ 0x55, 1, 0x64 }, { 0x43, 1, 0x64 }, { 0x5d, 1, 0x64 }, { 0x02, 3, 0x64 },
+	{ 0x55, 1, 0x66 }, { 0x43, 1, 0x66 }, { 0x5d, 1, 0x66 }, { 0x02, 3, 0x66 },
+	{ 0x55, 1, 0x67 }, { 0x43, 1, 0x67 }, { 0x5d, 1, 0x67 }, { 0x02, 3, 0x67 },
+	{ 0x55, 1, 0x68 }, { 0x43, 1, 0x68 }, { 0x5d, 1, 0x68 }, { 0x02, 3, 0x68 },
+},
+/* state 133 */ {
+	{ 0x56, 1, 0x64 }, { 0x82, 1, 0x64 }, { 0x44, 1, 0x64 }, { 0x52, 1, 0x64 },
+	{ 0x63, 1, 0x64 }, { 0x5e, 1, 0x64 }, { 0x68, 1, 0x64 }, { 0x03, 3, 0x64 },
+	{ 0x56, 1, 0x66 }, { 0x82, 1, 0x66 }, { 0x44, 1, 0x66 }, { 0x52, 1, 0x66 },
+	{ 0x63, 1, 0x66 }, { 0x5e, 1, 0x66 }, { 0x68, 1, 0x66 }, { 0x03, 3, 0x66 },
+},
+/* state 134 */ {
+	{ 0x56, 1, 0x67 }, { 0x82, 1, 0x67 }, { 0x44, 1, 0x67 }, { 0x52, 1, 0x67 },
+	{ 0x63, 1, 0x67 }, { 0x5e, 1, 0x67 }, { 0x68, 1, 0x67 }, { 0x03, 3, 0x67 },
+	{ 0x56, 1, 0x68 }, { 0x82, 1, 0x68 }, { 0x44, 1, 0x68 }, { 0x52, 1, 0x68 },
+	{ 0x63, 1, 0x68 }, { 0x5e, 1, 0x68 }, { 0x68, 1, 0x68 }, { 0x03, 3, 0x68 },
+},
+/* state 135 */ {
+	{ 0x56, 1, 0x69 }, { 0x82, 1, 0x69 }, { 0x44, 1, 0x69 }, { 0x52, 1, 0x69 },
+	{ 0x63, 1, 0x69 }, { 0x5e, 1, 0x69 }, { 0x68, 1, 0x69 }, { 0x03, 3, 0x69 },
+	{ 0x56, 1, 0x6f }, { 0x82, 1, 0x6f }, { 0x44, 1, 0x6f }, { 0x52, 1, 0x6f },
+	{ 0x63, 1, 0x6f }, { 0x5e, 1, 0x6f }, { 0x68, 1, 0x6f }, { 0x03, 3, 0x6f },
+},
+/* state 136 */ {
+	{ 0x55, 1, 0x6a }, { 0x43, 1, 0x6a }, { 0x5d, 1, 0x6a }, { 0x02, 3, 0x6a },
+	{ 0x55, 1, 0x6b }, { 0x43, 1, 0x6b }, { 0x5d, 1, 0x6b }, { 0x02, 3, 0x6b },
+	{ 0x55, 1, 0x71 }, { 0x43, 1, 0x71 }, { 0x5d, 1, 0x71 }, { 0x02, 3, 0x71 },
+	{ 0x55, 1, 0x76 }, { 0x43, 1, 0x76 }, { 0x5d, 1, 0x76 }, { 0x02, 3, 0x76 },
+},
+/* state 137 */ {
+	{ 0x56, 1, 0x6a }, { 0x82, 1, 0x6a }, { 0x44, 1, 0x6a }, { 0x52, 1, 0x6a },
+	{ 0x63, 1, 0x6a }, { 0x5e, 1, 0x6a }, { 0x68, 1, 0x6a }, { 0x03, 3, 0x6a },
+	{ 0x56, 1, 0x6b }, { 0x82, 1, 0x6b }, { 0x44, 1, 0x6b }, { 0x52, 1, 0x6b },
+	{ 0x63, 1, 0x6b }, { 0x5e, 1, 0x6b }, { 0x68, 1, 0x6b }, { 0x03, 3, 0x6b },
+},
+/* state 138 */ {
+	{ 0x55, 1, 0x6c }, { 0x43, 1, 0x6c }, { 0x5d, 1, 0x6c }, { 0x02, 3, 0x6c },
+	{ 0x55, 1, 0x6d }, { 0x43, 1, 0x6d }, { 0x5d, 1, 0x6d }, { 0x02, 3, 0x6d },
+	{ 0x55, 1, 0x6e }, { 0x43, 1, 0x6e }, { 0x5d, 1, 0x6e }, { 0x02, 3, 0x6e },
+	{ 0x55, 1, 0x70 }, { 0x43, 1, 0x70 }, { 0x5d, 1, 0x70 }, { 0x02, 3, 0x70 },
+},
+/* state 139 */ {
+	{ 0x56, 1, 0x6c }, { 0x82, 1, 0x6c }, { 0x44, 1, 0x6c }, { 0x52, 1, 0x6c },
+	{ 0x63, 1, 0x6c }, { 0x5e, 1, 0x6c }, { 0x68, 1, 0x6c }, { 0x03, 3, 0x6c },
+	{ 0x56, 1, 0x6d }, { 0x82, 1, 0x6d }, { 0x44, 1, 0x6d }, { 0x52, 1, 0x6d },
+	{ 0x63, 1, 0x6d }, { 0x5e, 1, 0x6d }, { 0x68, 1, 0x6d }, { 0x03, 3, 0x6d },
+},
+/* state 140 */ {
+	{ 0x56, 1, 0x6e }, { 0x82, 1, 0x6e }, { 0x44, 1, 0x6e }, { 0x52, 1, 0x6e },
+	{ 0x63, 1, 0x6e }, { 0x5e, 1, 0x6e }, { 0x68, 1, 0x6e }, { 0x03, 3, 0x6e },
+	{ 0x56, 1, 0x70 }, { 0x82, 1, 0x70 }, { 0x44, 1, 0x70 }, { 0x52, 1, 0x70 },
+	{ 0x63, 1, 0x70 }, { 0x5e, 1, 0x70 }, { 0x68, 1, 0x70 }, { 0x03, 3, 0x70 },
+},
+/* state 141 */ {
+	{ 0x56, 1, 0x71 }, { 0x82, 1, 0x71 }, { 0x44, 1, 0x71 }, { 0x52, 1, 0x71 },
+	{ 0x63, 1, 0x71 }, { 0x5e, 1, 0x71 }, { 0x68, 1, 0x71 }, { 0x03, 3, 0x71 },
+	{ 0x56, 1, 0x76 }, { 0x82, 1, 0x76 }, { 0x44, 1, 0x76 }, { 0x52, 1, 0x76 },
+	{ 0x63, 1, 0x76 }, { 0x5e, 1, 0x76 }, { 0x68, 1, 0x76 }, { 0x03, 3, 0x76 },
+},
+/* state 142 */ {
+	{ 0x56, 1, 0x72 }, { 0x82, 1, 0x72 }, { 0x44, 1, 0x72 }, { 0x52, 1, 0x72 },
+	{ 0x63, 1, 0x72 }, { 0x5e, 1, 0x72 }, { 0x68, 1, 0x72 }, { 0x03, 3, 0x72 },
+	{ 0x56, 1, 0x75 }, { 0x82, 1, 0x75 }, { 0x44, 1, 0x75 }, { 0x52, 1, 0x75 },
+	{ 0x63, 1, 0x75 }, { 0x5e, 1, 0x75 }, { 0x68, 1, 0x75 }, { 0x03, 3, 0x75 },
+},
+/* state 143 */ {
+	{ 0x56, 1, 0x73 }, { 0x82, 1, 0x73 }, { 0x44, 1, 0x73 }, { 0x52, 1, 0x73 },
+	{ 0x63, 1, 0x73 }, { 0x5e, 1, 0x73 }, { 0x68, 1, 0x73 }, { 0x03, 3, 0x73 },
+	{ 0x56, 1, 0x74 }, { 0x82, 1, 0x74 }, { 0x44, 1, 0x74 }, { 0x52, 1, 0x74 },
+	{ 0x63, 1, 0x74 }, { 0x5e, 1, 0x74 }, { 0x68, 1, 0x74 }, { 0x03, 3, 0x74 },
+},
+/* state 144 */ {
+	{ 0x55, 1, 0x77 }, { 0x43, 1, 0x77 }, { 0x5d, 1, 0x77 }, { 0x02, 3, 0x77 },
+	{ 0x55, 1, 0x78 }, { 0x43, 1, 0x78 }, { 0x5d, 1, 0x78 }, { 0x02, 3, 0x78 },
+	{ 0x55, 1, 0x79 }, { 0x43, 1, 0x79 }, { 0x5d, 1, 0x79 }, { 0x02, 3, 0x79 },
+	{ 0x55, 1, 0x7a }, { 0x43, 1, 0x7a }, { 0x5d, 1, 0x7a }, { 0x02, 3, 0x7a },
+},
+/* state 145 */ {
+	{ 0x56, 1, 0x77 }, { 0x82, 1, 0x77 }, { 0x44, 1, 0x77 }, { 0x52, 1, 0x77 },
+	{ 0x63, 1, 0x77 }, { 0x5e, 1, 0x77 }, { 0x68, 1, 0x77 }, { 0x03, 3, 0x77 },
+	{ 0x56, 1, 0x78 }, { 0x82, 1, 0x78 }, { 0x44, 1, 0x78 }, { 0x52, 1, 0x78 },
+	{ 0x63, 1, 0x78 }, { 0x5e, 1, 0x78 }, { 0x68, 1, 0x78 }, { 0x03, 3, 0x78 },
+},
+/* state 146 */ {
+	{ 0x56, 1, 0x79 }, { 0x82, 1, 0x79 }, { 0x44, 1, 0x79 }, { 0x52, 1, 0x79 },
+	{ 0x63, 1, 0x79 }, { 0x5e, 1, 0x79 }, { 0x68, 1, 0x79 }, { 0x03, 3, 0x79 },
+	{ 0x56, 1, 0x7a }, { 0x82, 1, 0x7a }, { 0x44, 1, 0x7a }, { 0x52, 1, 0x7a },
+	{ 0x63, 1, 0x7a }, { 0x5e, 1, 0x7a }, { 0x68, 1, 0x7a }, { 0x03, 3, 0x7a },
+},
+/* state 147 */ {
+	{ 0x56, 1, 0x7f }, { 0x82, 1, 0x7f }, { 0x44, 1, 0x7f }, { 0x52, 1, 0x7f },
+	{ 0x63, 1, 0x7f }, { 0x5e, 1, 0x7f }, { 0x68, 1, 0x7f }, { 0x03, 3, 0x7f },
+	{ 0x56, 1, 0xdc }, { 0x82, 1, 0xdc }, { 0x44, 1, 0xdc }, { 0x52, 1, 0xdc },
+	{ 0x63, 1, 0xdc }, { 0x5e, 1, 0xdc }, { 0x68, 1, 0xdc }, { 0x03, 3, 0xdc },
+},
+/* state 148 */ {
+	{ 0x56, 1, 0xd0 }, { 0x82, 1, 0xd0 }, { 0x44, 1, 0xd0 }, { 0x52, 1, 0xd0 },
+	{ 0x63, 1, 0xd0 }, { 0x5e, 1, 0xd0 }, { 0x68, 1, 0xd0 }, { 0x03, 3, 0xd0 },
+	{ 0x55, 1, 0x80 }, { 0x43, 1, 0x80 }, { 0x5d, 1, 0x80 }, { 0x02, 3, 0x80 },
+	{ 0x55, 1, 0x82 }, { 0x43, 1, 0x82 }, { 0x5d, 1, 0x82 }, { 0x02, 3, 0x82 },
+},
+/* state 149 */ {
+	{ 0x56, 1, 0x80 }, { 0x82, 1, 0x80 }, { 0x44, 1, 0x80 }, { 0x52, 1, 0x80 },
+	{ 0x63, 1, 0x80 }, { 0x5e, 1, 0x80 }, { 0x68, 1, 0x80 }, { 0x03, 3, 0x80 },
+	{ 0x56, 1, 0x82 }, { 0x82, 1, 0x82 }, { 0x44, 1, 0x82 }, { 0x52, 1, 0x82 },
+	{ 0x63, 1, 0x82 }, { 0x5e, 1, 0x82 }, { 0x68, 1, 0x82 }, { 0x03, 3, 0x82 },
+},
+/* state 150 */ {
+	{ 0x00, 3, 0xb0 }, { 0x00, 3, 0xb1 }, { 0x00, 3, 0xb3 }, { 0x00, 3, 0xd1 },
+	{ 0x00, 3, 0xd8 }, { 0x00, 3, 0xd9 }, { 0x00, 3, 0xe3 }, { 0x00, 3, 0xe5 },
+	{ 0x00, 3, 0xe6 }, { 0x9a, 0, 0x00 }, { 0x9f, 0, 0x00 }, { 0xa0, 0, 0x00 },
+	{ 0xb4, 0, 0x00 }, { 0xb6, 0, 0x00 }, { 0xb8, 0, 0x00 }, { 0xbe, 0, 0x00 },
+},
+/* state 151 */ {
+	{ 0x42, 1, 0xe6 }, { 0x01, 3, 0xe6 }, { 0x00, 3, 0x81 }, { 0x00, 3, 0x84 },
+	{ 0x00, 3, 0x85 }, { 0x00, 3, 0x86 }, { 0x00, 3, 0x88 }, { 0x00, 3, 0x92 },
+	{ 0x00, 3, 0x9a }, { 0x00, 3, 0x9c }, { 0x00, 3, 0xa0 }, { 0x00, 3, 0xa3 },
+	{ 0x00, 3, 0xa4 }, { 0x00, 3, 0xa9 }, { 0x00, 3, 0xaa }, { 0x00, 3, 0xad },
+},
+/* state 152 */ {
+	{ 0x55, 1, 0xe6 }, { 0x43, 1, 0xe6 }, { 0x5d, 1, 0xe6 }, { 0x02, 3, 0xe6 },
+	{ 0x42, 1, 0x81 }, { 0x01, 3, 0x81 }, { 0x42, 1, 0x84 }, { 0x01, 3, 0x84 },
+	{ 0x42, 1, 0x85 }, { 0x01, 3, 0x85 }, { 0x42, 1, 0x86 }, { 0x01, 3, 0x86 },
+	{ 0x42, 1, 0x88 }, { 0x01, 3, 0x88 }, { 0x42, 1, 0x92 }, { 0x01, 3, 0x92 },
+},
+/* state 153 */ {
+	{ 0x56, 1, 0xe6 }, { 0x82, 1, 0xe6 }, { 0x44, 1, 0xe6 }, { 0x52, 1, 0xe6 },
+	{ 0x63, 1, 0xe6 }, { 0x5e, 1, 0xe6 }, { 0x68, 1, 0xe6 }, { 0x03, 3, 0xe6 },
+	{ 0x55, 1, 0x81 }, { 0x43, 1, 0x81 }, { 0x5d, 1, 0x81 }, { 0x02, 3, 0x81 },
+	{ 0x55, 1, 0x84 }, { 0x43, 1, 0x84 }, { 0x5d, 1, 0x84 }, { 0x02, 3, 0x84 },
+},
+/* state 154 */ {
+	{ 0x56, 1, 0x81 }, { 0x82, 1, 0x81 }, { 0x44, 1, 0x81 }, { 0x52, 1, 0x81 },
+	{ 0x63, 1, 0x81 }, { 0x5e, 1, 0x81 }, { 0x68, 1, 0x81 }, { 0x03, 3, 0x81 },
+	{ 0x56, 1, 0x84 }, { 0x82, 1, 0x84 }, { 0x44, 1, 0x84 }, { 0x52, 1, 0x84 },
+	{ 0x63, 1, 0x84 }, { 0x5e, 1, 0x84 }, { 0x68, 1, 0x84 }, { 0x03, 3, 0x84 },
+},
+/* state 155 */ {
+	{ 0x42, 1, 0x83 }, { 0x01, 3, 0x83 }, { 0x42, 1, 0xa2 }, { 0x01, 3, 0xa2 },
+	{ 0x42, 1, 0xb8 }, { 0x01, 3, 0xb8 }, { 0x42, 1, 0xc2 }, { 0x01, 3, 0xc2 },
+	{ 0x42, 1, 0xe0 }, { 0x01, 3, 0xe0 }, { 0x42, 1, 0xe2 }, { 0x01, 3, 0xe2 },
+	{ 0x00, 3, 0x99 }, { 0x00, 3, 0xa1 }, { 0x00, 3, 0xa7 }, { 0x00, 3, 0xac },
+},
+/* state 156 */ {
+	{ 0x55, 1, 0x83 }, { 0x43, 1, 0x83 }, { 0x5d, 1, 0x83 }, { 0x02, 3, 0x83 },
+	{ 0x55, 1, 0xa2 }, { 0x43, 1, 0xa2 }, { 0x5d, 1, 0xa2 }, { 0x02, 3, 0xa2 },
+	{ 0x55, 1, 0xb8 }, { 0x43, 1, 0xb8 }, { 0x5d, 1, 0xb8 }, { 0x02, 3, 0xb8 },
+	{ 0x55, 1, 0xc2 }, { 0x43, 1, 0xc2 }, { 0x5d, 1, 0xc2 }, { 0x02, 3, 0xc2 },
+},
+/* state 157 */ {
+	{ 0x56, 1, 0x83 }, { 0x82, 1, 0x83 }, { 0x44, 1, 0x83 }, { 0x52, 1, 0x83 },
+	{ 0x63, 1, 0x83 }, { 0x5e, 1, 0x83 }, { 0x68, 1, 0x83 }, { 0x03, 3, 0x83 },
+	{ 0x56, 1, 0xa2 }, { 0x82, 1, 0xa2 }, { 0x44, 1, 0xa2 }, { 0x52, 1, 0xa2 },
+	{ 0x63, 1, 0xa2 }, { 0x5e, 1, 0xa2 }, { 0x68, 1, 0xa2 }, { 0x03, 3, 0xa2 },
+},
+/* state 158 */ {
+	{ 0x55, 1, 0x85 }, { 0x43, 1, 0x85 }, { 0x5d, 1, 0x85 }, { 0x02, 3, 0x85 },
+	{ 0x55, 1, 0x86 }, { 0x43, 1, 0x86 }, { 0x5d, 1, 0x86 }, { 0x02, 3, 0x86 },
+	{ 0x55, 1, 0x88 }, { 0x43, 1, 0x88 }, { 0x5d, 1, 0x88 }, { 0x02, 3, 0x88 },
+	{ 0x55, 1, 0x92 }, { 0x43, 1, 0x92 }, { 0x5d, 1, 0x92 }, { 0x02, 3, 0x92 },
+},
+/* state 159 */ {
+	{ 0x56, 1, 0x85 }, { 0x82, 1, 0x85 }, { 0x44, 1, 0x85 }, { 0x52, 1, 0x85 },
+	{ 0x63, 1, 0x85 }, { 0x5e, 1, 0x85 }, { 0x68, 1, 0x85 }, { 0x03, 3, 0x85 },
+	{ 0x56, 1, 0x86 }, { 0x82, 1, 0x86 }, { 0x44, 1, 0x86 }, { 0x52, 1, 0x86 },
+	{ 0x63, 1, 0x86 }, { 0x5e, 1, 0x86 }, { 0x68, 1, 0x86 }, { 0x03, 3, 0x86 },
+},
+/* state 160 */ {
+	{ 0x56, 1, 0x88 }, { 0x82, 1, 0x88 }, { 0x44, 1, 0x88 }, { 0x52, 1, 0x88 },
+	{ 0x63, 1, 0x88 }, { 0x5e, 1, 0x88 }, { 0x68, 1, 0x88 }, { 0x03, 3, 0x88 },
+	{ 0x56, 1, 0x92 }, { 0x82, 1, 0x92 }, { 0x44, 1, 0x92 }, { 0x52, 1, 0x92 },
+	{ 0x63, 1, 0x92 }, { 0x5e, 1, 0x92 }, { 0x68, 1, 0x92 }, { 0x03, 3, 0x92 },
+},
+/* state 161 */ {
+	{ 0x56, 1, 0x89 }, { 0x82, 1, 0x89 }, { 0x44, 1, 0x89 }, { 0x52, 1, 0x89 },
+	{ 0x63, 1, 0x89 }, { 0x5e, 1, 0x89 }, { 0x68, 1, 0x89 }, { 0x03, 3, 0x89 },
+	{ 0x56, 1, 0x8a }, { 0x82, 1, 0x8a }, { 0x44, 1, 0x8a }, { 0x52, 1, 0x8a },
+	{ 0x63, 1, 0x8a }, { 0x5e, 1, 0x8a }, { 0x68, 1, 0x8a }, { 0x03, 3, 0x8a },
+},
+/* state 162 */ {
+	{ 0x55, 1, 0x8b }, { 0x43, 1, 0x8b }, { 0x5d, 1, 0x8b }, { 0x02, 3, 0x8b },
+	{ 0x55, 1, 0x8c }, { 0x43, 1, 0x8c }, { 0x5d, 1, 0x8c }, { 0x02, 3, 0x8c },
+	{ 0x55, 1, 0x8d }, { 0x43, 1, 0x8d }, { 0x5d, 1, 0x8d }, { 0x02, 3, 0x8d },
+	{ 0x55, 1, 0x8f }, { 0x43, 1, 0x8f }, { 0x5d, 1, 0x8f }, { 0x02, 3, 0x8f },
+},
+/* state 163 */ {
+	{ 0x56, 1, 0x8b }, { 0x82, 1, 0x8b }, { 0x44, 1, 0x8b }, { 0x52, 1, 0x8b },
+	{ 0x63, 1, 0x8b }, { 0x5e, 1, 0x8b }, { 0x68, 1, 0x8b }, { 0x03, 3, 0x8b },
+	{ 0x56, 1, 0x8c }, { 0x82, 1, 0x8c }, { 0x44, 1, 0x8c }, { 0x52, 1, 0x8c },
+	{ 0x63, 1, 0x8c }, { 0x5e, 1, 0x8c }, { 0x68, 1, 0x8c }, { 0x03, 3, 0x8c },
+},
+/* state 164 */ {
+	{ 0x56, 1, 0x8d }, { 0x82, 1, 0x8d }, { 0x44, 1, 0x8d }, { 0x52, 1, 0x8d },
+	{ 0x63, 1, 0x8d }, { 0x5e, 1, 0x8d }, { 0x68, 1, 0x8d }, { 0x03, 3, 0x8d },
+	{ 0x56, 1, 0x8f }, { 0x82, 1, 0x8f }, { 0x44, 1, 0x8f }, { 0x52, 1, 0x8f },
+	{ 0x63, 1, 0x8f }, { 0x5e, 1, 0x8f }, { 0x68, 1, 0x8f }, { 0x03, 3, 0x8f },
+},
+/* state 165 */ {
+	{ 0x55, 1, 0x90 }, { 0x43, 1, 0x90 }, { 0x5d, 1, 0x90 }, { 0x02, 3, 0x90 },
+	{ 0x55, 1, 0x91 }, { 0x43, 1, 0x91 }, { 0x5d, 1, 0x91 }, { 0x02, 3, 0x91 },
+	{ 0x55, 1, 0x94 }, { 0x43, 1, 0x94 }, { 0x5d, 1, 0x94 }, { 0x02, 3, 0x94 },
+	{ 0x55, 1, 0x9f }, { 0x43, 1, 0x9f }, { 0x5d, 1, 0x9f }, { 0x02, 3, 0x9f },
+},
+/* state 166 */ {
+	{ 0x56, 1, 0x90 }, { 0x82, 1, 0x90 }, { 0x44, 1, 0x90 }, { 0x52, 1, 0x90 },
+	{ 0x63, 1, 0x90 }, { 0x5e, 1, 0x90 }, { 0x68, 1, 0x90 }, { 0x03, 3, 0x90 },
+	{ 0x56, 1, 0x91 }, { 0x82, 1, 0x91 }, { 0x44, 1, 0x91 }, { 0x52, 1, 0x91 },
+	{ 0x63, 1, 0x91 }, { 0x5e, 1, 0x91 }, { 0x68, 1, 0x91 }, { 0x03, 3, 0x91 },
+},
+/* state 167 */ {
+	{ 0x00, 3, 0x93 }, { 0x00, 3, 0x95 }, { 0x00, 3, 0x96 }, { 0x00, 3, 0x97 },
+	{ 0x00, 3, 0x98 }, { 0x00, 3, 0x9b }, { 0x00, 3, 0x9d }, { 0x00, 3, 0x9e },
+	{ 0x00, 3, 0xa5 }, { 0x00, 3, 0xa6 }, { 0x00, 3, 0xa8 }, { 0x00, 3, 0xae },
+	{ 0x00, 3, 0xaf }, { 0x00, 3, 0xb4 }, { 0x00, 3, 0xb6 }, { 0x00, 3, 0xb7 },
+},
+/* state 168 */ {
+	{ 0x42, 1, 0x93 }, { 0x01, 3, 0x93 }, { 0x42, 1, 0x95 }, { 0x01, 3, 0x95 },
+	{ 0x42, 1, 0x96 }, { 0x01, 3, 0x96 }, { 0x42, 1, 0x97 }, { 0x01, 3, 0x97 },
+	{ 0x42, 1, 0x98 }, { 0x01, 3, 0x98 }, { 0x42, 1, 0x9b }, { 0x01, 3, 0x9b },
+	{ 0x42, 1, 0x9d }, { 0x01, 3, 0x9d }, { 0x42, 1, 0x9e }, { 0x01, 3, 0x9e },
+},
+/* state 169 */ {
+	{ 0x55, 1, 0x93 }, { 0x43, 1, 0x93 }, { 0x5d, 1, 0x93 }, { 0x02, 3, 0x93 },
+	{ 0x55, 1, 0x95 }, { 0x43, 1, 0x95 }, { 0x5d, 1, 0x95 }, { 0x02, 3, 0x95 },
+	{ 0x55, 1, 0x96 }, { 0x43, 1, 0x96 }, { 0x5d, 1, 0x96 }, { 0x02, 3, 0x96 },
+	{ 0x55, 1, 0x97 }, { 0x43, 1, 0x97 }, { 0x5d, 1, 0x97 }, { 0x02, 3, 0x97 },
+},
+/* state 170 */ {
+	{ 0x56, 1, 0x93 }, { 0x82, 1, 0x93 }, { 0x44, 1, 0x93 }, { 0x52, 1, 0x93 },
+	{ 0x63, 1, 0x93 }, { 0x5e, 1, 0x93 }, { 0x68, 1, 0x93 }, { 0x03, 3, 0x93 },
+	{ 0x56, 1, 0x95 }, { 0x82, 1, 0x95 }, { 0x44, 1, 0x95 }, { 0x52, 1, 0x95 },
+	{ 0x63, 1, 0x95 }, { 0x5e, 1, 0x95 }, { 0x68, 1, 0x95 }, { 0x03, 3, 0x95 },
+},
+/* state 171 */ {
+	{ 0x56, 1, 0x94 }, { 0x82, 1, 0x94 }, { 0x44, 1, 0x94 }, { 0x52, 1, 0x94 },
+	{ 0x63, 1, 0x94 }, { 0x5e, 1, 0x94 }, { 0x68, 1, 0x94 }, { 0x03, 3, 0x94 },
+	{ 0x56, 1, 0x9f }, { 0x82, 1, 0x9f }, { 0x44, 1, 0x9f }, { 0x52, 1, 0x9f },
+	{ 0x63, 1, 0x9f }, { 0x5e, 1, 0x9f }, { 0x68, 1, 0x9f }, { 0x03, 3, 0x9f },
+},
+/* state 172 */ {
+	{ 0x56, 1, 0x96 }, { 0x82, 1, 0x96 }, { 0x44, 1, 0x96 }, { 0x52, 1, 0x96 },
+	{ 0x63, 1, 0x96 }, { 0x5e, 1, 0x96 }, { 0x68, 1, 0x96 }, { 0x03, 3, 0x96 },
+	{ 0x56, 1, 0x97 }, { 0x82, 1, 0x97 }, { 0x44, 1, 0x97 }, { 0x52, 1, 0x97 },
+	{ 0x63, 1, 0x97 }, { 0x5e, 1, 0x97 }, { 0x68, 1, 0x97 }, { 0x03, 3, 0x97 },
+},
+/* state 173 */ {
+	{ 0x55, 1, 0x98 }, { 0x43, 1, 0x98 }, { 0x5d, 1, 0x98 }, { 0x02, 3, 0x98 },
+	{ 0x55, 1, 0x9b }, { 0x43, 1, 0x9b }, { 0x5d, 1, 0x9b }, { 0x02, 3, 0x9b },
+	{ 0x55, 1, 0x9d }, { 0x43, 1, 0x9d }, { 0x5d, 1, 0x9d }, { 0x02, 3, 0x9d },
+	{ 0x55, 1, 0x9e }, { 0x43, 1, 0x9e }, { 0x5d, 1, 0x9e }, { 0x02, 3, 0x9e },
+},
+/* state 174 */ {
+	{ 0x56, 1, 0x98 }, { 0x82, 1, 0x98 }, { 0x44, 1, 0x98 }, { 0x52, 1, 0x98 },
+	{ 0x63, 1, 0x98 }, { 0x5e, 1, 0x98 }, { 0x68, 1, 0x98 }, { 0x03, 3, 0x98 },
+	{ 0x56, 1, 0x9b }, { 0x82, 1, 0x9b }, { 0x44, 1, 0x9b }, { 0x52, 1, 0x9b },
+	{ 0x63, 1, 0x9b }, { 0x5e, 1, 0x9b }, { 0x68, 1, 0x9b }, { 0x03, 3, 0x9b },
+},
+/* state 175 */ {
+	{ 0x55, 1, 0xe0 }, { 0x43, 1, 0xe0 }, { 0x5d, 1, 0xe0 }, { 0x02, 3, 0xe0 },
+	{ 0x55, 1, 0xe2 }, { 0x43, 1, 0xe2 }, { 0x5d, 1, 0xe2 }, { 0x02, 3, 0xe2 },
+	{ 0x42, 1, 0x99 }, { 0x01, 3, 0x99 }, { 0x42, 1, 0xa1 }, { 0x01, 3, 0xa1 },
+	{ 0x42, 1, 0xa7 }, { 0x01, 3, 0xa7 }, { 0x42, 1, 0xac }, { 0x01, 3, 0xac },
+},
+/* state 176 */ {
+	{ 0x55, 1, 0x99 }, { 0x43, 1, 0x99 }, { 0x5d, 1, 0x99 }, { 0x02, 3, 0x99 },
+	{ 0x55, 1, 0xa1 }, { 0x43, 1, 0xa1 }, { 0x5d, 1, 0xa1 }, { 0x02, 3, 0xa1 },
+	{ 0x55, 1, 0xa7 }, { 0x43, 1, 0xa7 }, { 0x5d, 1, 0xa7 }, { 0x02, 3, 0xa7 },
+	{ 0x55, 1, 0xac }, { 0x43, 1, 0xac }, { 0x5d, 1, 0xac }, { 0x02, 3, 0xac },
+},
+/* state 177 */ {
+	{ 0x56, 1, 0x99 }, { 0x82, 1, 0x99 }, { 0x44, 1, 0x99 }, { 0x52, 1, 0x99 },
+	{ 0x63, 1, 0x99 }, { 0x5e, 1, 0x99 }, { 0x68, 1, 0x99 }, { 0x03, 3, 0x99 },
+	{ 0x56, 1, 0xa1 }, { 0x82, 1, 0xa1 }, { 0x44, 1, 0xa1 }, { 0x52, 1, 0xa1 },
+	{ 0x63, 1, 0xa1 }, { 0x5e, 1, 0xa1 }, { 0x68, 1, 0xa1 }, { 0x03, 3, 0xa1 },
+},
+/* state 178 */ {
+	{ 0x42, 1, 0x9a }, { 0x01, 3, 0x9a }, { 0x42, 1, 0x9c }, { 0x01, 3, 0x9c },
+	{ 0x42, 1, 0xa0 }, { 0x01, 3, 0xa0 }, { 0x42, 1, 0xa3 }, { 0x01, 3, 0xa3 },
+	{ 0x42, 1, 0xa4 }, { 0x01, 3, 0xa4 }, { 0x42, 1, 0xa9 }, { 0x01, 3, 0xa9 },
+	{ 0x42, 1, 0xaa }, { 0x01, 3, 0xaa }, { 0x42, 1, 0xad }, { 0x01, 3, 0xad },
+},
+/* state 179 */ {
+	{ 0x55, 1, 0x9a }, { 0x43, 1, 0x9a }, { 0x5d, 1, 0x9a }, { 0x02, 3, 0x9a },
+	{ 0x55, 1, 0x9c }, { 0x43, 1, 0x9c }, { 0x5d, 1, 0x9c }, { 0x02, 3, 0x9c },
+	{ 0x55, 1, 0xa0 }, { 0x43, 1, 0xa0 }, { 0x5d, 1, 0xa0 }, { 0x02, 3, 0xa0 },
+	{ 0x55, 1, 0xa3 }, { 0x43, 1, 0xa3 }, { 0x5d, 1, 0xa3 }, { 0x02, 3, 0xa3 },
+},
+/* state 180 */ {
+	{ 0x56, 1, 0x9a }, { 0x82, 1, 0x9a }, { 0x44, 1, 0x9a }, { 0x52, 1, 0x9a },
+	{ 0x63, 1, 0x9a }, { 0x5e, 1, 0x9a }, { 0x68, 1, 0x9a }, { 0x03, 3, 0x9a },
+	{ 0x56, 1, 0x9c }, { 0x82, 1, 0x9c }, { 0x44, 1, 0x9c }, { 0x52, 1, 0x9c },
+	{ 0x63, 1, 0x9c }, { 0x5e, 1, 0x9c }, { 0x68, 1, 0x9c }, { 0x03, 3, 0x9c },
+},
+/* state 181 */ {
+	{ 0x56, 1, 0x9d }, { 0x82, 1, 0x9d }, { 0x44, 1, 0x9d }, { 0x52, 1, 0x9d },
+	{ 0x63, 1, 0x9d }, { 0x5e, 1, 0x9d }, { 0x68, 1, 0x9d }, { 0x03, 3, 0x9d },
+	{ 0x56, 1, 0x9e }, { 0x82, 1, 0x9e }, { 0x44, 1, 0x9e }, { 0x52, 1, 0x9e },
+	{ 0x63, 1, 0x9e }, { 0x5e, 1, 0x9e }, { 0x68, 1, 0x9e }, { 0x03, 3, 0x9e },
+},
+/* state 182 */ {
+	{ 0x56, 1, 0xa0 }, { 0x82, 1, 0xa0 }, { 0x44, 1, 0xa0 }, { 0x52, 1, 0xa0 },
+	{ 0x63, 1, 0xa0 }, { 0x5e, 1, 0xa0 }, { 0x68, 1, 0xa0 }, { 0x03, 3, 0xa0 },
+	{ 0x56, 1, 0xa3 }, { 0x82, 1, 0xa3 }, { 0x44, 1, 0xa3 }, { 0x52, 1, 0xa3 },
+	{ 0x63, 1, 0xa3 }, { 0x5e, 1, 0xa3 }, { 0x68, 1, 0xa3 }, { 0x03, 3, 0xa3 },
+},
+/* state 183 */ {
+	{ 0x55, 1, 0xa4 }, { 0x43, 1, 0xa4 }, { 0x5d, 1, 0xa4 }, { 0x02, 3, 0xa4 },
+	{ 0x55, 1, 0xa9 }, { 0x43, 1, 0xa9 }, { 0x5d, 1, 0xa9 }, { 0x02, 3, 0xa9 },
+	{ 0x55, 1, 0xaa }, { 0x43, 1, 0xaa }, { 0x5d, 1, 0xaa }, { 0x02, 3, 0xaa },
+	{ 0x55, 1, 0xad }, { 0x43, 1, 0xad }, { 0x5d, 1, 0xad }, { 0x02, 3, 0xad },
+},
+/* state 184 */ {
+	{ 0x56, 1, 0xa4 }, { 0x82, 1, 0xa4 }, { 0x44, 1, 0xa4 }, { 0x52, 1, 0xa4 },
+	{ 0x63, 1, 0xa4 }, { 0x5e, 1, 0xa4 }, { 0x68, 1, 0xa4 }, { 0x03, 3, 0xa4 },
+	{ 0x56, 1, 0xa9 }, { 0x82, 1, 0xa9 }, { 0x44, 1, 0xa9 }, { 0x52, 1, 0xa9 },
+	{ 0x63, 1, 0xa9 }, { 0x5e, 1, 0xa9 }, { 0x68, 1, 0xa9 }, { 0x03, 3, 0xa9 },
+},
+/* state 185 */ {
+	{ 0x42, 1, 0xa5 }, { 0x01, 3, 0xa5 }, { 0x42, 1, 0xa6 }, { 0x01, 3, 0xa6 },
+	{ 0x42, 1, 0xa8 }, { 0x01, 3, 0xa8 }, { 0x42, 1, 0xae }, { 0x01, 3, 0xae },
+	{ 0x42, 1, 0xaf }, { 0x01, 3, 0xaf }, { 0x42, 1, 0xb4 }, { 0x01, 3, 0xb4 },
+	{ 0x42, 1, 0xb6 }, { 0x01, 3, 0xb6 }, { 0x42, 1, 0xb7 }, { 0x01, 3, 0xb7 },
+},
+/* state 186 */ {
+	{ 0x55, 1, 0xa5 }, { 0x43, 1, 0xa5 }, { 0x5d, 1, 0xa5 }, { 0x02, 3, 0xa5 },
+	{ 0x55, 1, 0xa6 }, { 0x43, 1, 0xa6 }, { 0x5d, 1, 0xa6 }, { 0x02, 3, 0xa6 },
+	{ 0x55, 1, 0xa8 }, { 0x43, 1, 0xa8 }, { 0x5d, 1, 0xa8 }, { 0x02, 3, 0xa8 },
+	{ 0x55, 1, 0xae }, { 0x43, 1, 0xae }, { 0x5d, 1, 0xae }, { 0x02, 3, 0xae },
+},
+/* state 187 */ {
+	{ 0x56, 1, 0xa5 }, { 0x82, 1, 0xa5 }, { 0x44, 1, 0xa5 }, { 0x52, 1, 0xa5 },
+	{ 0x63, 1, 0xa5 }, { 0x5e, 1, 0xa5 }, { 0x68, 1, 0xa5 }, { 0x03, 3, 0xa5 },
+	{ 0x56, 1, 0xa6 }, { 0x82, 1, 0xa6 }, { 0x44, 1, 0xa6 }, { 0x52, 1, 0xa6 },
+	{ 0x63, 1, 0xa6 }, { 0x5e, 1, 0xa6 }, { 0x68, 1, 0xa6 }, { 0x03, 3, 0xa6 },
+},
+/* state 188 */ {
+	{ 0x56, 1, 0xa7 }, { 0x82, 1, 0xa7 }, { 0x44, 1, 0xa7 }, { 0x52, 1, 0xa7 },
+	{ 0x63, 1, 0xa7 }, { 0x5e, 1, 0xa7 }, { 0x68, 1, 0xa7 }, { 0x03, 3, 0xa7 },
+	{ 0x56, 1, 0xac }, { 0x82, 1, 0xac }, { 0x44, 1, 0xac }, { 0x52, 1, 0xac },
+	{ 0x63, 1, 0xac }, { 0x5e, 1, 0xac }, { 0x68, 1, 0xac }, { 0x03, 3, 0xac },
+},
+/* state 189 */ {
+	{ 0x56, 1, 0xa8 }, { 0x82, 1, 0xa8 }, { 0x44, 1, 0xa8 }, { 0x52, 1, 0xa8 },
+	{ 0x63, 1, 0xa8 }, { 0x5e, 1, 0xa8 }, { 0x68, 1, 0xa8 }, { 0x03, 3, 0xa8 },
+	{ 0x56, 1, 0xae }, { 0x82, 1, 0xae }, { 0x44, 1, 0xae }, { 0x52, 1, 0xae },
+	{ 0x63, 1, 0xae }, { 0x5e, 1, 0xae }, { 0x68, 1, 0xae }, { 0x03, 3, 0xae },
+},
+/* state 190 */ {
+	{ 0x56, 1, 0xaa }, { 0x82, 1, 0xaa }, { 0x44, 1, 0xaa }, { 0x52, 1, 0xaa },
+	{ 0x63, 1, 0xaa }, { 0x5e, 1, 0xaa }, { 0x68, 1, 0xaa }, { 0x03, 3, 0xaa },
+	{ 0x56, 1, 0xad }, { 0x82, 1, 0xad }, { 0x44, 1, 0xad }, { 0x52, 1, 0xad },
+	{ 0x63, 1, 0xad }, { 0x5e, 1, 0xad }, { 0x68, 1, 0xad }, { 0x03, 3, 0xad },
+},
+/* state 191 */ {
+	{ 0x42, 1, 0xab }, { 0x01, 3, 0xab }, { 0x42, 1, 0xce }, { 0x01, 3, 0xce },
+	{ 0x42, 1, 0xd7 }, { 0x01, 3, 0xd7 }, { 0x42, 1, 0xe1 }, { 0x01, 3, 0xe1 },
+	{ 0x42, 1, 0xec }, { 0x01, 3, 0xec }, { 0x42, 1, 0xed }, { 0x01, 3, 0xed },
+	{ 0x00, 3, 0xc7 }, { 0x00, 3, 0xcf }, { 0x00, 3, 0xea }, { 0x00, 3, 0xeb },
+},
+/* state 192 */ {
+	{ 0x55, 1, 0xab }, { 0x43, 1, 0xab }, { 0x5d, 1, 0xab }, { 0x02, 3, 0xab },
+	{ 0x55, 1, 0xce }, { 0x43, 1, 0xce }, { 0x5d, 1, 0xce }, { 0x02, 3, 0xce },
+	{ 0x55, 1, 0xd7 }, { 0x43, 1, 0xd7 }, { 0x5d, 1, 0xd7 }, { 0x02, 3, 0xd7 },
+	{ 0x55, 1, 0xe1 }, { 0x43, 1, 0xe1 }, { 0x5d, 1, 0xe1 }, { 0x02, 3, 0xe1 },
+},
+/* state 193 */ {
+	{ 0x56, 1, 0xab }, { 0x82, 1, 0xab }, { 0x44, 1, 0xab }, { 0x52, 1, 0xab },
+	{ 0x63, 1, 0xab }, { 0x5e, 1, 0xab }, { 0x68, 1, 0xab }, { 0x03, 3, 0xab },
+	{ 0x56, 1, 0xce }, { 0x82, 1, 0xce }, { 0x44, 1, 0xce }, { 0x52, 1, 0xce },
+	{ 0x63, 1, 0xce }, { 0x5e, 1, 0xce }, { 0x68, 1, 0xce }, { 0x03, 3, 0xce },
+},
+/* state 194 */ {
+	{ 0x55, 1, 0xaf }, { 0x43, 1, 0xaf }, { 0x5d, 1, 0xaf }, { 0x02, 3, 0xaf },
+	{ 0x55, 1, 0xb4 }, { 0x43, 1, 0xb4 }, { 0x5d, 1, 0xb4 }, { 0x02, 3, 0xb4 },
+	{ 0x55, 1, 0xb6 }, { 0x43, 1, 0xb6 }, { 0x5d, 1, 0xb6 }, { 0x02, 3, 0xb6 },
+	{ 0x55, 1, 0xb7 }, { 0x43, 1, 0xb7 }, { 0x5d, 1, 0xb7 }, { 0x02, 3, 0xb7 },
+},
+/* state 195 */ {
+	{ 0x56, 1, 0xaf }, { 0x82, 1, 0xaf }, { 0x44, 1, 0xaf }, { 0x52, 1, 0xaf },
+	{ 0x63, 1, 0xaf }, { 0x5e, 1, 0xaf }, { 0x68, 1, 0xaf }, { 0x03, 3, 0xaf },
+	{ 0x56, 1, 0xb4 }, { 0x82, 1, 0xb4 }, { 0x44, 1, 0xb4 }, { 0x52, 1, 0xb4 },
+	{ 0x63, 1, 0xb4 }, { 0x5e, 1, 0xb4 }, { 0x68, 1, 0xb4 }, { 0x03, 3, 0xb4 },
+},
+/* state 196 */ {
+	{ 0x42, 1, 0xb0 }, { 0x01, 3, 0xb0 }, { 0x42, 1, 0xb1 }, { 0x01, 3, 0xb1 },
+	{ 0x42, 1, 0xb3 }, { 0x01, 3, 0xb3 }, { 0x42, 1, 0xd1 }, { 0x01, 3, 0xd1 },
+	{ 0x42, 1, 0xd8 }, { 0x01, 3, 0xd8 }, { 0x42, 1, 0xd9 }, { 0x01, 3, 0xd9 },
+	{ 0x42, 1, 0xe3 }, { 0x01, 3, 0xe3 }, { 0x42, 1, 0xe5 }, { 0x01, 3, 0xe5 },
+},
+/* state 197 */ {
+	{ 0x55, 1, 0xb0 }, { 0x43, 1, 0xb0 }, { 0x5d, 1, 0xb0 }, { 0x02, 3, 0xb0 },
+	{ 0x55, 1, 0xb1 }, { 0x43, 1, 0xb1 }, { 0x5d, 1, 0xb1 }, { 0x02, 3, 0xb1 },
+	{ 0x55, 1, 0xb3 }, { 0x43, 1, 0xb3 }, { 0x5d, 1, 0xb3 }, { 0x02, 3, 0xb3 },
+	{ 0x55, 1, 0xd1 }, { 0x43, 1, 0xd1 }, { 0x5d, 1, 0xd1 }, { 0x02, 3, 0xd1 },
+},
+/* state 198 */ {
+	{ 0x56, 1, 0xb0 }, { 0x82, 1, 0xb0 }, { 0x44, 1, 0xb0 }, { 0x52, 1, 0xb0 },
+	{ 0x63, 1, 0xb0 }, { 0x5e, 1, 0xb0 }, { 0x68, 1, 0xb0 }, { 0x03, 3, 0xb0 },
+	{ 0x56, 1, 0xb1 }, { 0x82, 1, 0xb1 }, { 0x44, 1, 0xb1 }, { 0x52, 1, 0xb1 },
+	{ 0x63, 1, 0xb1 }, { 0x5e, 1, 0xb1 }, { 0x68, 1, 0xb1 }, { 0x03, 3, 0xb1 },
+},
+/* state 199 */ {
+	{ 0x42, 1, 0xb2 }, { 0x01, 3, 0xb2 }, { 0x42, 1, 0xb5 }, { 0x01, 3, 0xb5 },
+	{ 0x42, 1, 0xb9 }, { 0x01, 3, 0xb9 }, { 0x42, 1, 0xba }, { 0x01, 3, 0xba },
+	{ 0x42, 1, 0xbb }, { 0x01, 3, 0xbb }, { 0x42, 1, 0xbd }, { 0x01, 3, 0xbd },
+	{ 0x42, 1, 0xbe }, { 0x01, 3, 0xbe }, { 0x42, 1, 0xc4 }, { 0x01, 3, 0xc4 },
+},
+/* state 200 */ {
+	{ 0x55, 1, 0xb2 }, { 0x43, 1, 0xb2 }, { 0x5d, 1, 0xb2 }, { 0x02, 3, 0xb2 },
+	{ 0x55, 1, 0xb5 }, { 0x43, 1, 0xb5 }, { 0x5d, 1, 0xb5 }, { 0x02, 3, 0xb5 },
+	{ 0x55, 1, 0xb9 }, { 0x43, 1, 0xb9 }, { 0x5d, 1, 0xb9 }, { 0x02, 3, 0xb9 },
+	{ 0x55, 1, 0xba }, { 0x43, 1, 0xba }, { 0x5d, 1, 0xba }, { 0x02, 3, 0xba },
+},
+/* state 201 */ {
+	{ 0x56, 1, 0xb2 }, { 0x82, 1, 0xb2 }, { 0x44, 1, 0xb2 }, { 0x52, 1, 0xb2 },
+	{ 0x63, 1, 0xb2 }, { 0x5e, 1, 0xb2 }, { 0x68, 1, 0xb2 }, { 0x03, 3, 0xb2 },
+	{ 0x56, 1, 0xb5 }, { 0x82, 1, 0xb5 }, { 0x44, 1, 0xb5 }, { 0x52, 1, 0xb5 },
+	{ 0x63, 1, 0xb5 }, { 0x5e, 1, 0xb5 }, { 0x68, 1, 0xb5 }, { 0x03, 3, 0xb5 },
+},
+/* state 202 */ {
+	{ 0x56, 1, 0xb3 }, { 0x82, 1, 0xb3 }, { 0x44, 1, 0xb3 }, { 0x52, 1, 0xb3 },
+	{ 0x63, 1, 0xb3 }, { 0x5e, 1, 0xb3 }, { 0x68, 1, 0xb3 }, { 0x03, 3, 0xb3 },
+	{ 0x56, 1, 0xd1 }, { 0x82, 1, 0xd1 }, { 0x44, 1, 0xd1 }, { 0x52, 1, 0xd1 },
+	{ 0x63, 1, 0xd1 }, { 0x5e, 1, 0xd1 }, { 0x68, 1, 0xd1 }, { 0x03, 3, 0xd1 },
+},
+/* state 203 */ {
+	{ 0x56, 1, 0xb6 }, { 0x82, 1, 0xb6 }, { 0x44, 1, 0xb6 }, { 0x52, 1, 0xb6 },
+	{ 0x63, 1, 0xb6 }, { 0x5e, 1, 0xb6 }, { 0x68, 1, 0xb6 }, { 0x03, 3, 0xb6 },
+	{ 0x56, 1, 0xb7 }, { 0x82, 1, 0xb7 }, { 0x44, 1, 0xb7 }, { 0x52, 1, 0xb7 },
+	{ 0x63, 1, 0xb7 }, { 0x5e, 1, 0xb7 }, { 0x68, 1, 0xb7 }, { 0x03, 3, 0xb7 },
+},
+/* state 204 */ {
+	{ 0x56, 1, 0xb8 }, { 0x82, 1, 0xb8 }, { 0x44, 1, 0xb8 }, { 0x52, 1, 0xb8 },
+	{ 0x63, 1, 0xb8 }, { 0x5e, 1, 0xb8 }, { 0x68, 1, 0xb8 }, { 0x03, 3, 0xb8 },
+	{ 0x56, 1, 0xc2 }, { 0x82, 1, 0xc2 }, { 0x44, 1, 0xc2 }, { 0x52, 1, 0xc2 },
+	{ 0x63, 1, 0xc2 }, { 0x5e, 1, 0xc2 }, { 0x68, 1, 0xc2 }, { 0x03, 3, 0xc2 },
+},
+/* state 205 */ {
+	{ 0x56, 1, 0xb9 }, { 0x82, 1, 0xb9 }, { 0x44, 1, 0xb9 }, { 0x52, 1, 0xb9 },
+	{ 0x63, 1, 0xb9 }, { 0x5e, 1, 0xb9 }, { 0x68, 1, 0xb9 }, { 0x03, 3, 0xb9 },
+	{ 0x56, 1, 0xba }, { 0x82, 1, 0xba }, { 0x44, 1, 0xba }, { 0x52, 1, 0xba },
+	{ 0x63, 1, 0xba }, { 0x5e, 1, 0xba }, { 0x68, 1, 0xba }, { 0x03, 3, 0xba },
+},
+/* state 206 */ {
+	{ 0x55, 1, 0xbb }, { 0x43, 1, 0xbb }, { 0x5d, 1, 0xbb }, { 0x02, 3, 0xbb },
+	{ 0x55, 1, 0xbd }, { 0x43, 1, 0xbd }, { 0x5d, 1, 0xbd }, { 0x02, 3, 0xbd },
+	{ 0x55, 1, 0xbe }, { 0x43, 1, 0xbe }, { 0x5d, 1, 0xbe }, { 0x02, 3, 0xbe },
+	{ 0x55, 1, 0xc4 }, { 0x43, 1, 0xc4 }, { 0x5d, 1, 0xc4 }, { 0x02, 3, 0xc4 },
+},
+/* state 207 */ {
+	{ 0x56, 1, 0xbb }, { 0x82, 1, 0xbb }, { 0x44, 1, 0xbb }, { 0x52, 1, 0xbb },
+	{ 0x63, 1, 0xbb }, { 0x5e, 1, 0xbb }, { 0x68, 1, 0xbb }, { 0x03, 3, 0xbb },
+	{ 0x56, 1, 0xbd }, { 0x82, 1, 0xbd }, { 0x44, 1, 0xbd }, { 0x52, 1, 0xbd },
+	{ 0x63, 1, 0xbd }, { 0x5e, 1, 0xbd }, { 0x68, 1, 0xbd }, { 0x03, 3, 0xbd },
+},
+/* state 208 */ {
+	{ 0x55, 1, 0xbc }, { 0x43, 1, 0xbc }, { 0x5d, 1, 0xbc }, { 0x02, 3, 0xbc },
+	{ 0x55, 1, 0xbf }, { 0x43, 1, 0xbf }, { 0x5d, 1, 0xbf }, { 0x02, 3, 0xbf },
+	{ 0x55, 1, 0xc5 }, { 0x43, 1, 0xc5 }, { 0x5d, 1, 0xc5 }, { 0x02, 3, 0xc5 },
+	{ 0x55, 1, 0xe7 }, { 0x43, 1, 0xe7 }, { 0x5d, 1, 0xe7 }, { 0x02, 3, 0xe7 },
+},
+/* state 209 */ {
+	{ 0x56, 1, 0xbc }, { 0x82, 1, 0xbc }, { 0x44, 1, 0xbc }, { 0x52, 1, 0xbc },
+	{ 0x63, 1, 0xbc }, { 0x5e, 1, 0xbc }, { 0x68, 1, 0xbc }, { 0x03, 3, 0xbc },
+	{ 0x56, 1, 0xbf }, { 0x82, 1, 0xbf }, { 0x44, 1, 0xbf }, { 0x52, 1, 0xbf },
+	{ 0x63, 1, 0xbf }, { 0x5e, 1, 0xbf }, { 0x68, 1, 0xbf }, { 0x03, 3, 0xbf },
+},
+/* state 210 */ {
+	{ 0x56, 1, 0xbe }, { 0x82, 1, 0xbe }, { 0x44, 1, 0xbe }, { 0x52, 1, 0xbe },
+	{ 0x63, 1, 0xbe }, { 0x5e, 1, 0xbe }, { 0x68, 1, 0xbe }, { 0x03, 3, 0xbe },
+	{ 0x56, 1, 0xc4 }, { 0x82, 1, 0xc4 }, { 0x44, 1, 0xc4 }, { 0x52, 1, 0xc4 },
+	{ 0x63, 1, 0xc4 }, { 0x5e, 1, 0xc4 }, { 0x68, 1, 0xc4 }, { 0x03, 3, 0xc4 },
+},
+/* state 211 */ {
+	{ 0x00, 3, 0xc0 }, { 0x00, 3, 0xc1 }, { 0x00, 3, 0xc8 }, { 0x00, 3, 0xc9 },
+	{ 0x00, 3, 0xca }, { 0x00, 3, 0xcd }, { 0x00, 3, 0xd2 }, { 0x00, 3, 0xd5 },
+	{ 0x00, 3, 0xda }, { 0x00, 3, 0xdb }, { 0x00, 3, 0xee }, { 0x00, 3, 0xf0 },
+	{ 0x00, 3, 0xf2 }, { 0x00, 3, 0xf3 }, { 0x00, 3, 0xff }, { 0xe3, 0, 0x00 },
+},
+/* state 212 */ {
+	{ 0x42, 1, 0xc0 }, { 0x01, 3, 0xc0 }, { 0x42, 1, 0xc1 }, { 0x01, 3, 0xc1 },
+	{ 0x42, 1, 0xc8 }, { 0x01, 3, 0xc8 }, { 0x42, 1, 0xc9 }, { 0x01, 3, 0xc9 },
+	{ 0x42, 1, 0xca }, { 0x01, 3, 0xca }, { 0x42, 1, 0xcd }, { 0x01, 3, 0xcd },
+	{ 0x42, 1, 0xd2 }, { 0x01, 3, 0xd2 }, { 0x42, 1, 0xd5 }, { 0x01, 3, 0xd5 },
+},
+/* state 213 */ {
+	{ 0x55, 1, 0xc0 }, { 0x43, 1, 0xc0 }, { 0x5d, 1, 0xc0 }, { 0x02, 3, 0xc0 },
+	{ 0x55, 1, 0xc1 }, { 0x43, 1, 0xc1 }, { 0x5d, 1, 0xc1 }, { 0x02, 3, 0xc1 },
+	{ 0x55, 1, 0xc8 }, { 0x43, 1, 0xc8 }, { 0x5d, 1, 0xc8 }, { 0x02, 3, 0xc8 },
+	{ 0x55, 1, 0xc9 }, { 0x43, 1, 0xc9 }, { 0x5d, 1, 0xc9 }, { 0x02, 3, 0xc9 },
+},
+/* state 214 */ {
+	{ 0x56, 1, 0xc0 }, { 0x82, 1, 0xc0 }, { 0x44, 1, 0xc0 }, { 0x52, 1, 0xc0 },
+	{ 0x63, 1, 0xc0 }, { 0x5e, 1, 0xc0 }, { 0x68, 1, 0xc0 }, { 0x03, 3, 0xc0 },
+	{ 0x56, 1, 0xc1 }, { 0x82, 1, 0xc1 }, { 0x44, 1, 0xc1 }, { 0x52, 1, 0xc1 },
+	{ 0x63, 1, 0xc1 }, { 0x5e, 1, 0xc1 }, { 0x68, 1, 0xc1 }, { 0x03, 3, 0xc1 },
+},
+/* state 215 */ {
+	{ 0x56, 1, 0xc5 }, { 0x82, 1, 0xc5 }, { 0x44, 1, 0xc5 }, { 0x52, 1, 0xc5 },
+	{ 0x63, 1, 0xc5 }, { 0x5e, 1, 0xc5 }, { 0x68, 1, 0xc5 }, { 0x03, 3, 0xc5 },
+	{ 0x56, 1, 0xe7 }, { 0x82, 1, 0xe7 }, { 0x44, 1, 0xe7 }, { 0x52, 1, 0xe7 },
+	{ 0x63, 1, 0xe7 }, { 0x5e, 1, 0xe7 }, { 0x68, 1, 0xe7 }, { 0x03, 3, 0xe7 },
+},
+/* state 216 */ {
+	{ 0x55, 1, 0xc6 }, { 0x43, 1, 0xc6 }, { 0x5d, 1, 0xc6 }, { 0x02, 3, 0xc6 },
+	{ 0x55, 1, 0xe4 }, { 0x43, 1, 0xe4 }, { 0x5d, 1, 0xe4 }, { 0x02, 3, 0xe4 },
+	{ 0x55, 1, 0xe8 }, { 0x43, 1, 0xe8 }, { 0x5d, 1, 0xe8 }, { 0x02, 3, 0xe8 },
+	{ 0x55, 1, 0xe9 }, { 0x43, 1, 0xe9 }, { 0x5d, 1, 0xe9 }, { 0x02, 3, 0xe9 },
+},
+/* state 217 */ {
+	{ 0x56, 1, 0xc6 }, { 0x82, 1, 0xc6 }, { 0x44, 1, 0xc6 }, { 0x52, 1, 0xc6 },
+	{ 0x63, 1, 0xc6 }, { 0x5e, 1, 0xc6 }, { 0x68, 1, 0xc6 }, { 0x03, 3, 0xc6 },
+	{ 0x56, 1, 0xe4 }, { 0x82, 1, 0xe4 }, { 0x44, 1, 0xe4 }, { 0x52, 1, 0xe4 },
+	{ 0x63, 1, 0xe4 }, { 0x5e, 1, 0xe4 }, { 0x68, 1, 0xe4 }, { 0x03, 3, 0xe4 },
+},
+/* state 218 */ {
+	{ 0x55, 1, 0xec }, { 0x43, 1, 0xec }, { 0x5d, 1, 0xec }, { 0x02, 3, 0xec },
+	{ 0x55, 1, 0xed }, { 0x43, 1, 0xed }, { 0x5d, 1, 0xed }, { 0x02, 3, 0xed },
+	{ 0x42, 1, 0xc7 }, { 0x01, 3, 0xc7 }, { 0x42, 1, 0xcf }, { 0x01, 3, 0xcf },
+	{ 0x42, 1, 0xea }, { 0x01, 3, 0xea }, { 0x42, 1, 0xeb }, { 0x01, 3, 0xeb },
+},
+/* state 219 */ {
+	{ 0x55, 1, 0xc7 }, { 0x43, 1, 0xc7 }, { 0x5d, 1, 0xc7 }, { 0x02, 3, 0xc7 },
+	{ 0x55, 1, 0xcf }, { 0x43, 1, 0xcf }, { 0x5d, 1, 0xcf }, { 0x02, 3, 0xcf },
+	{ 0x55, 1, 0xea }, { 0x43, 1, 0xea }, { 0x5d, 1, 0xea }, { 0x02, 3, 0xea },
+	{ 0x55, 1, 0xeb }, { 0x43, 1, 0xeb }, { 0x5d, 1, 0xeb }, { 0x02, 3, 0xeb },
+},
+/* state 220 */ {
+	{ 0x56, 1, 0xc7 }, { 0x82, 1, 0xc7 }, { 0x44, 1, 0xc7 }, { 0x52, 1, 0xc7 },
+	{ 0x63, 1, 0xc7 }, { 0x5e, 1, 0xc7 }, { 0x68, 1, 0xc7 }, { 0x03, 3, 0xc7 },
+	{ 0x56, 1, 0xcf }, { 0x82, 1, 0xcf }, { 0x44, 1, 0xcf }, { 0x52, 1, 0xcf },
+	{ 0x63, 1, 0xcf }, { 0x5e, 1, 0xcf }, { 0x68, 1, 0xcf }, { 0x03, 3, 0xcf },
+},
+/* state 221 */ {
+	{ 0x56, 1, 0xc8 }, { 0x82, 1, 0xc8 }, { 0x44, 1, 0xc8 }, { 0x52, 1, 0xc8 },
+	{ 0x63, 1, 0xc8 }, { 0x5e, 1, 0xc8 }, { 0x68, 1, 0xc8 }, { 0x03, 3, 0xc8 },
+	{ 0x56, 1, 0xc9 }, { 0x82, 1, 0xc9 }, { 0x44, 1, 0xc9 }, { 0x52, 1, 0xc9 },
+	{ 0x63, 1, 0xc9 }, { 0x5e, 1, 0xc9 }, { 0x68, 1, 0xc9 }, { 0x03, 3, 0xc9 },
+},
+/* state 222 */ {
+	{ 0x55, 1, 0xca }, { 0x43, 1, 0xca }, { 0x5d, 1, 0xca }, { 0x02, 3, 0xca },
+	{ 0x55, 1, 0xcd }, { 0x43, 1, 0xcd }, { 0x5d, 1, 0xcd }, { 0x02, 3, 0xcd },
+	{ 0x55, 1, 0xd2 }, { 0x43, 1, 0xd2 }, { 0x5d, 1, 0xd2 }, { 0x02, 3, 0xd2 },
+	{ 0x55, 1, 0xd5 }, { 0x43, 1, 0xd5 }, { 0x5d, 1, 0xd5 }, { 0x02, 3, 0xd5 },
+},
+/* state 223 */ {
+	{ 0x56, 1, 0xca }, { 0x82, 1, 0xca }, { 0x44, 1, 0xca }, { 0x52, 1, 0xca },
+	{ 0x63, 1, 0xca }, { 0x5e, 1, 0xca }, { 0x68, 1, 0xca }, { 0x03, 3, 0xca },
+	{ 0x56, 1, 0xcd }, { 0x82, 1, 0xcd }, { 0x44, 1, 0xcd }, { 0x52, 1, 0xcd },
+	{ 0x63, 1, 0xcd }, { 0x5e, 1, 0xcd }, { 0x68, 1, 0xcd }, { 0x03, 3, 0xcd },
+},
+/* state 224 */ {
+	{ 0x42, 1, 0xda }, { 0x01, 3, 0xda }, { 0x42, 1, 0xdb }, { 0x01, 3, 0xdb },
+	{ 0x42, 1, 0xee }, { 0x01, 3, 0xee }, { 0x42, 1, 0xf0 }, { 0x01, 3, 0xf0 },
+	{ 0x42, 1, 0xf2 }, { 0x01, 3, 0xf2 }, { 0x42, 1, 0xf3 }, { 0x01, 3, 0xf3 },
+	{ 0x42, 1, 0xff }, { 0x01, 3, 0xff }, { 0x00, 3, 0xcb }, { 0x00, 3, 0xcc },
+},
+/* state 225 */ {
+	{ 0x55, 1, 0xf2 }, { 0x43, 1, 0xf2 }, { 0x5d, 1, 0xf2 }, { 0x02, 3, 0xf2 },
+	{ 0x55, 1, 0xf3 }, { 0x43, 1, 0xf3 }, { 0x5d, 1, 0xf3 }, { 0x02, 3, 0xf3 },
+	{ 0x55, 1, 0xff }, { 0x43, 1, 0xff }, { 0x5d, 1, 0xff }, { 0x02, 3, 0xff },
+	{ 0x42, 1, 0xcb }, { 0x01, 3, 0xcb }, { 0x42, 1, 0xcc }, { 0x01, 3, 0xcc },
+},
+/* state 226 */ {
+	{ 0x56, 1, 0xff }, { 0x82, 1, 0xff }, { 0x44, 1, 0xff }, { 0x52, 1, 0xff },
+	{ 0x63, 1, 0xff }, { 0x5e, 1, 0xff }, { 0x68, 1, 0xff }, { 0x03, 3, 0xff },
+	{ 0x55, 1, 0xcb }, { 0x43, 1, 0xcb }, { 0x5d, 1, 0xcb }, { 0x02, 3, 0xcb },
+	{ 0x55, 1, 0xcc }, { 0x43, 1, 0xcc }, { 0x5d, 1, 0xcc }, { 0x02, 3, 0xcc },
+},
+/* state 227 */ {
+	{ 0x56, 1, 0xcb }, { 0x82, 1, 0xcb }, { 0x44, 1, 0xcb }, { 0x52, 1, 0xcb },
+	{ 0x63, 1, 0xcb }, { 0x5e, 1, 0xcb }, { 0x68, 1, 0xcb }, { 0x03, 3, 0xcb },
+	{ 0x56, 1, 0xcc }, { 0x82, 1, 0xcc }, { 0x44, 1, 0xcc }, { 0x52, 1, 0xcc },
+	{ 0x63, 1, 0xcc }, { 0x5e, 1, 0xcc }, { 0x68, 1, 0xcc }, { 0x03, 3, 0xcc },
+},
+/* state 228 */ {
+	{ 0x56, 1, 0xd2 }, { 0x82, 1, 0xd2 }, { 0x44, 1, 0xd2 }, { 0x52, 1, 0xd2 },
+	{ 0x63, 1, 0xd2 }, { 0x5e, 1, 0xd2 }, { 0x68, 1, 0xd2 }, { 0x03, 3, 0xd2 },
+	{ 0x56, 1, 0xd5 }, { 0x82, 1, 0xd5 }, { 0x44, 1, 0xd5 }, { 0x52, 1, 0xd5 },
+	{ 0x63, 1, 0xd5 }, { 0x5e, 1, 0xd5 }, { 0x68, 1, 0xd5 }, { 0x03, 3, 0xd5 },
+},
+/* state 229 */ {
+	{ 0x00, 3, 0xd3 }, { 0x00, 3, 0xd4 }, { 0x00, 3, 0xd6 }, { 0x00, 3, 0xdd },
+	{ 0x00, 3, 0xde }, { 0x00, 3, 0xdf }, { 0x00, 3, 0xf1 }, { 0x00, 3, 0xf4 },
+	{ 0x00, 3, 0xf5 }, { 0x00, 3, 0xf6 }, { 0x00, 3, 0xf7 }, { 0x00, 3, 0xf8 },
+	{ 0x00, 3, 0xfa }, { 0x00, 3, 0xfb }, { 0x00, 3, 0xfc }, { 0x00, 3, 0xfd },
+},
+/* state 230 */ {
+	{ 0x42, 1, 0xd3 }, { 0x01, 3, 0xd3 }, { 0x42, 1, 0xd4 }, { 0x01, 3, 0xd4 },
+	{ 0x42, 1, 0xd6 }, { 0x01, 3, 0xd6 }, { 0x42, 1, 0xdd }, { 0x01, 3, 0xdd },
+	{ 0x42, 1, 0xde }, { 0x01, 3, 0xde }, { 0x42, 1, 0xdf }, { 0x01, 3, 0xdf },
+	{ 0x42, 1, 0xf1 }, { 0x01, 3, 0xf1 }, { 0x42, 1, 0xf4 }, { 0x01, 3, 0xf4 },
+},
+/* state 231 */ {
+	{ 0x55, 1, 0xd3 }, { 0x43, 1, 0xd3 }, { 0x5d, 1, 0xd3 }, { 0x02, 3, 0xd3 },
+	{ 0x55, 1, 0xd4 }, { 0x43, 1, 0xd4 }, { 0x5d, 1, 0xd4 }, { 0x02, 3, 0xd4 },
+	{ 0x55, 1, 0xd6 }, { 0x43, 1, 0xd6 }, { 0x5d, 1, 0xd6 }, { 0x02, 3, 0xd6 },
+	{ 0x55, 1, 0xdd }, { 0x43, 1, 0xdd }, { 0x5d, 1, 0xdd }, { 0x02, 3, 0xdd },
+},
+/* state 232 */ {
+	{ 0x56, 1, 0xd3 }, { 0x82, 1, 0xd3 }, { 0x44, 1, 0xd3 }, { 0x52, 1, 0xd3 },
+	{ 0x63, 1, 0xd3 }, { 0x5e, 1, 0xd3 }, { 0x68, 1, 0xd3 }, { 0x03, 3, 0xd3 },
+	{ 0x56, 1, 0xd4 }, { 0x82, 1, 0xd4 }, { 0x44, 1, 0xd4 }, { 0x52, 1, 0xd4 },
+	{ 0x63, 1, 0xd4 }, { 0x5e, 1, 0xd4 }, { 0x68, 1, 0xd4 }, { 0x03, 3, 0xd4 },
+},
+/* state 233 */ {
+	{ 0x56, 1, 0xd6 }, { 0x82, 1, 0xd6 }, { 0x44, 1, 0xd6 }, { 0x52, 1, 0xd6 },
+	{ 0x63, 1, 0xd6 }, { 0x5e, 1, 0xd6 }, { 0x68, 1, 0xd6 }, { 0x03, 3, 0xd6 },
+	{ 0x56, 1, 0xdd }, { 0x82, 1, 0xdd }, { 0x44, 1, 0xdd }, { 0x52, 1, 0xdd },
+	{ 0x63, 1, 0xdd }, { 0x5e, 1, 0xdd }, { 0x68, 1, 0xdd }, { 0x03, 3, 0xdd },
+},
+/* state 234 */ {
+	{ 0x56, 1, 0xd7 }, { 0x82, 1, 0xd7 }, { 0x44, 1, 0xd7 }, { 0x52, 1, 0xd7 },
+	{ 0x63, 1, 0xd7 }, { 0x5e, 1, 0xd7 }, { 0x68, 1, 0xd7 }, { 0x03, 3, 0xd7 },
+	{ 0x56, 1, 0xe1 }, { 0x82, 1, 0xe1 }, { 0x44, 1, 0xe1 }, { 0x52, 1, 0xe1 },
+	{ 0x63, 1, 0xe1 }, { 0x5e, 1, 0xe1 }, { 0x68, 1, 0xe1 }, { 0x03, 3, 0xe1 },
+},
+/* state 235 */ {
+	{ 0x55, 1, 0xd8 }, { 0x43, 1, 0xd8 }, { 0x5d, 1, 0xd8 }, { 0x02, 3, 0xd8 },
+	{ 0x55, 1, 0xd9 }, { 0x43, 1, 0xd9 }, { 0x5d, 1, 0xd9 }, { 0x02, 3, 0xd9 },
+	{ 0x55, 1, 0xe3 }, { 0x43, 1, 0xe3 }, { 0x5d, 1, 0xe3 }, { 0x02, 3, 0xe3 },
+	{ 0x55, 1, 0xe5 }, { 0x43, 1, 0xe5 }, { 0x5d, 1, 0xe5 }, { 0x02, 3, 0xe5 },
+},
+/* state 236 */ {
+	{ 0x56, 1, 0xd8 }, { 0x82, 1, 0xd8 }, { 0x44, 1, 0xd8 }, { 0x52, 1, 0xd8 },
+	{ 0x63, 1, 0xd8 }, { 0x5e, 1, 0xd8 }, { 0x68, 1, 0xd8 }, { 0x03, 3, 0xd8 },
+	{ 0x56, 1, 0xd9 }, { 0x82, 1, 0xd9 }, { 0x44, 1, 0xd9 }, { 0x52, 1, 0xd9 },
+	{ 0x63, 1, 0xd9 }, { 0x5e, 1, 0xd9 }, { 0x68, 1, 0xd9 }, { 0x03, 3, 0xd9 },
+},
+/* state 237 */ {
+	{ 0x55, 1, 0xda }, { 0x43, 1, 0xda }, { 0x5d, 1, 0xda }, { 0x02, 3, 0xda },
+	{ 0x55, 1, 0xdb }, { 0x43, 1, 0xdb }, { 0x5d, 1, 0xdb }, { 0x02, 3, 0xdb },
+	{ 0x55, 1, 0xee }, { 0x43, 1, 0xee }, { 0x5d, 1, 0xee }, { 0x02, 3, 0xee },
+	{ 0x55, 1, 0xf0 }, { 0x43, 1, 0xf0 }, { 0x5d, 1, 0xf0 }, { 0x02, 3, 0xf0 },
+},
+/* state 238 */ {
+	{ 0x56, 1, 0xda }, { 0x82, 1, 0xda }, { 0x44, 1, 0xda }, { 0x52, 1, 0xda },
+	{ 0x63, 1, 0xda }, { 0x5e, 1, 0xda }, { 0x68, 1, 0xda }, { 0x03, 3, 0xda },
+	{ 0x56, 1, 0xdb }, { 0x82, 1, 0xdb }, { 0x44, 1, 0xdb }, { 0x52, 1, 0xdb },
+	{ 0x63, 1, 0xdb }, { 0x5e, 1, 0xdb }, { 0x68, 1, 0xdb }, { 0x03, 3, 0xdb },
+},
+/* state 239 */ {
+	{ 0x55, 1, 0xde }, { 0x43, 1, 0xde }, { 0x5d, 1, 0xde }, { 0x02, 3, 0xde },
+	{ 0x55, 1, 0xdf }, { 0x43, 1, 0xdf }, { 0x5d, 1, 0xdf }, { 0x02, 3, 0xdf },
+	{ 0x55, 1, 0xf1 }, { 0x43, 1, 0xf1 }, { 0x5d, 1, 0xf1 }, { 0x02, 3, 0xf1 },
+	{ 0x55, 1, 0xf4 }, { 0x43, 1, 0xf4 }, { 0x5d, 1, 0xf4 }, { 0x02, 3, 0xf4 },
+},
+/* state 240 */ {
+	{ 0x56, 1, 0xde }, { 0x82, 1, 0xde }, { 0x44, 1, 0xde }, { 0x52, 1, 0xde },
+	{ 0x63, 1, 0xde }, { 0x5e, 1, 0xde }, { 0x68, 1, 0xde }, { 0x03, 3, 0xde },
+	{ 0x56, 1, 0xdf }, { 0x82, 1, 0xdf }, { 0x44, 1, 0xdf }, { 0x52, 1, 0xdf },
+	{ 0x63, 1, 0xdf }, { 0x5e, 1, 0xdf }, { 0x68, 1, 0xdf }, { 0x03, 3, 0xdf },
+},
+/* state 241 */ {
+	{ 0x56, 1, 0xe0 }, { 0x82, 1, 0xe0 }, { 0x44, 1, 0xe0 }, { 0x52, 1, 0xe0 },
+	{ 0x63, 1, 0xe0 }, { 0x5e, 1, 0xe0 }, { 0x68, 1, 0xe0 }, { 0x03, 3, 0xe0 },
+	{ 0x56, 1, 0xe2 }, { 0x82, 1, 0xe2 }, { 0x44, 1, 0xe2 }, { 0x52, 1, 0xe2 },
+	{ 0x63, 1, 0xe2 }, { 0x5e, 1, 0xe2 }, { 0x68, 1, 0xe2 }, { 0x03, 3, 0xe2 },
+},
+/* state 242 */ {
+	{ 0x56, 1, 0xe3 }, { 0x82, 1, 0xe3 }, { 0x44, 1, 0xe3 }, { 0x52, 1, 0xe3 },
+	{ 0x63, 1, 0xe3 }, { 0x5e, 1, 0xe3 }, { 0x68, 1, 0xe3 }, { 0x03, 3, 0xe3 },
+	{ 0x56, 1, 0xe5 }, { 0x82, 1, 0xe5 }, { 0x44, 1, 0xe5 }, { 0x52, 1, 0xe5 },
+	{ 0x63, 1, 0xe5 }, { 0x5e, 1, 0xe5 }, { 0x68, 1, 0xe5 }, { 0x03, 3, 0xe5 },
+},
+/* state 243 */ {
+	{ 0x56, 1, 0xe8 }, { 0x82, 1, 0xe8 }, { 0x44, 1, 0xe8 }, { 0x52, 1, 0xe8 },
+	{ 0x63, 1, 0xe8 }, { 0x5e, 1, 0xe8 }, { 0x68, 1, 0xe8 }, { 0x03, 3, 0xe8 },
+	{ 0x56, 1, 0xe9 }, { 0x82, 1, 0xe9 }, { 0x44, 1, 0xe9 }, { 0x52, 1, 0xe9 },
+	{ 0x63, 1, 0xe9 }, { 0x5e, 1, 0xe9 }, { 0x68, 1, 0xe9 }, { 0x03, 3, 0xe9 },
+},
+/* state 244 */ {
+	{ 0x56, 1, 0xea }, { 0x82, 1, 0xea }, { 0x44, 1, 0xea }, { 0x52, 1, 0xea },
+	{ 0x63, 1, 0xea }, { 0x5e, 1, 0xea }, { 0x68, 1, 0xea }, { 0x03, 3, 0xea },
+	{ 0x56, 1, 0xeb }, { 0x82, 1, 0xeb }, { 0x44, 1, 0xeb }, { 0x52, 1, 0xeb },
+	{ 0x63, 1, 0xeb }, { 0x5e, 1, 0xeb }, { 0x68, 1, 0xeb }, { 0x03, 3, 0xeb },
+},
+/* state 245 */ {
+	{ 0x56, 1, 0xec }, { 0x82, 1, 0xec }, { 0x44, 1, 0xec }, { 0x52, 1, 0xec },
+	{ 0x63, 1, 0xec }, { 0x5e, 1, 0xec }, { 0x68, 1, 0xec }, { 0x03, 3, 0xec },
+	{ 0x56, 1, 0xed }, { 0x82, 1, 0xed }, { 0x44, 1, 0xed }, { 0x52, 1, 0xed },
+	{ 0x63, 1, 0xed }, { 0x5e, 1, 0xed }, { 0x68, 1, 0xed }, { 0x03, 3, 0xed },
+},
+/* state 246 */ {
+	{ 0x56, 1, 0xee }, { 0x82, 1, 0xee }, { 0x44, 1, 0xee }, { 0x52, 1, 0xee },
+	{ 0x63, 1, 0xee }, { 0x5e, 1, 0xee }, { 0x68, 1, 0xee }, { 0x03, 3, 0xee },
+	{ 0x56, 1, 0xf0 }, { 0x82, 1, 0xf0 }, { 0x44, 1, 0xf0 }, { 0x52, 1, 0xf0 },
+	{ 0x63, 1, 0xf0 }, { 0x5e, 1, 0xf0 }, { 0x68, 1, 0xf0 }, { 0x03, 3, 0xf0 },
+},
+/* state 247 */ {
+	{ 0x56, 1, 0xf1 }, { 0x82, 1, 0xf1 }, { 0x44, 1, 0xf1 }, { 0x52, 1, 0xf1 },
+	{ 0x63, 1, 0xf1 }, { 0x5e, 1, 0xf1 }, { 0x68, 1, 0xf1 }, { 0x03, 3, 0xf1 },
+	{ 0x56, 1, 0xf4 }, { 0x82, 1, 0xf4 }, { 0x44, 1, 0xf4 }, { 0x52, 1, 0xf4 },
+	{ 0x63, 1, 0xf4 }, { 0x5e, 1, 0xf4 }, { 0x68, 1, 0xf4 }, { 0x03, 3, 0xf4 },
+},
+/* state 248 */ {
+	{ 0x56, 1, 0xf2 }, { 0x82, 1, 0xf2 }, { 0x44, 1, 0xf2 }, { 0x52, 1, 0xf2 },
+	{ 0x63, 1, 0xf2 }, { 0x5e, 1, 0xf2 }, { 0x68, 1, 0xf2 }, { 0x03, 3, 0xf2 },
+	{ 0x56, 1, 0xf3 }, { 0x82, 1, 0xf3 }, { 0x44, 1, 0xf3 }, { 0x52, 1, 0xf3 },
+	{ 0x63, 1, 0xf3 }, { 0x5e, 1, 0xf3 }, { 0x68, 1, 0xf3 }, { 0x03, 3, 0xf3 },
+},
+/* state 249 */ {
+	{ 0x42, 1, 0xf5 }, { 0x01, 3, 0xf5 }, { 0x42, 1, 0xf6 }, { 0x01, 3, 0xf6 },
+	{ 0x42, 1, 0xf7 }, { 0x01, 3, 0xf7 }, { 0x42, 1, 0xf8 }, { 0x01, 3, 0xf8 },
+	{ 0x42, 1, 0xfa }, { 0x01, 3, 0xfa }, { 0x42, 1, 0xfb }, { 0x01, 3, 0xfb },
+	{ 0x42, 1, 0xfc }, { 0x01, 3, 0xfc }, { 0x42, 1, 0xfd }, { 0x01, 3, 0xfd },
+},
+/* state 250 */ {
+	{ 0x55, 1, 0xf5 }, { 0x43, 1, 0xf5 }, { 0x5d, 1, 0xf5 }, { 0x02, 3, 0xf5 },
+	{ 0x55, 1, 0xf6 }, { 0x43, 1, 0xf6 }, { 0x5d, 1, 0xf6 }, { 0x02, 3, 0xf6 },
+	{ 0x55, 1, 0xf7 }, { 0x43, 1, 0xf7 }, { 0x5d, 1, 0xf7 }, { 0x02, 3, 0xf7 },
+	{ 0x55, 1, 0xf8 }, { 0x43, 1, 0xf8 }, { 0x5d, 1, 0xf8 }, { 0x02, 3, 0xf8 },
+},
+/* state 251 */ {
+	{ 0x56, 1, 0xf5 }, { 0x82, 1, 0xf5 }, { 0x44, 1, 0xf5 }, { 0x52, 1, 0xf5 },
+	{ 0x63, 1, 0xf5 }, { 0x5e, 1, 0xf5 }, { 0x68, 1, 0xf5 }, { 0x03, 3, 0xf5 },
+	{ 0x56, 1, 0xf6 }, { 0x82, 1, 0xf6 }, { 0x44, 1, 0xf6 }, { 0x52, 1, 0xf6 },
+	{ 0x63, 1, 0xf6 }, { 0x5e, 1, 0xf6 }, { 0x68, 1, 0xf6 }, { 0x03, 3, 0xf6 },
+},
+/* state 252 */ {
+	{ 0x56, 1, 0xf7 }, { 0x82, 1, 0xf7 }, { 0x44, 1, 0xf7 }, { 0x52, 1, 0xf7 },
+	{ 0x63, 1, 0xf7 }, { 0x5e, 1, 0xf7 }, { 0x68, 1, 0xf7 }, { 0x03, 3, 0xf7 },
+	{ 0x56, 1, 0xf8 }, { 0x82, 1, 0xf8 }, { 0x44, 1, 0xf8 }, { 0x52, 1, 0xf8 },
+	{ 0x63, 1, 0xf8 }, { 0x5e, 1, 0xf8 }, { 0x68, 1, 0xf8 }, { 0x03, 3, 0xf8 },
+},
+/* state 253 */ {
+	{ 0x55, 1, 0xfa }, { 0x43, 1, 0xfa }, { 0x5d, 1, 0xfa }, { 0x02, 3, 0xfa },
+	{ 0x55, 1, 0xfb }, { 0x43, 1, 0xfb }, { 0x5d, 1, 0xfb }, { 0x02, 3, 0xfb },
+	{ 0x55, 1, 0xfc }, { 0x43, 1, 0xfc }, { 0x5d, 1, 0xfc }, { 0x02, 3, 0xfc },
+	{ 0x55, 1, 0xfd }, { 0x43, 1, 0xfd }, { 0x5d, 1, 0xfd }, { 0x02, 3, 0xfd },
+},
+/* state 254 */ {
+	{ 0x56, 1, 0xfa }, { 0x82, 1, 0xfa }, { 0x44, 1, 0xfa }, { 0x52, 1, 0xfa },
+	{ 0x63, 1, 0xfa }, { 0x5e, 1, 0xfa }, { 0x68, 1, 0xfa }, { 0x03, 3, 0xfa },
+	{ 0x56, 1, 0xfb }, { 0x82, 1, 0xfb }, { 0x44, 1, 0xfb }, { 0x52, 1, 0xfb },
+	{ 0x63, 1, 0xfb }, { 0x5e, 1, 0xfb }, { 0x68, 1, 0xfb }, { 0x03, 3, 0xfb },
+},
+/* state 255 */ {
+	{ 0x56, 1, 0xfc }, { 0x82, 1, 0xfc }, { 0x44, 1, 0xfc }, { 0x52, 1, 0xfc },
+	{ 0x63, 1, 0xfc }, { 0x5e, 1, 0xfc }, { 0x68, 1, 0xfc }, { 0x03, 3, 0xfc },
+	{ 0x56, 1, 0xfd }, { 0x82, 1, 0xfd }, { 0x44, 1, 0xfd }, { 0x52, 1, 0xfd },
+	{ 0x63, 1, 0xfd }, { 0x5e, 1, 0xfd }, { 0x68, 1, 0xfd }, { 0x03, 3, 0xfd },
+},
+};
+
+/* huffman codes and their lengths in bits, for encoding */
+
+static const uint32_t huftable_enc_code[256] = {
+	0x1ff8, 0x7fffd8, 0xfffffe2, 0xfffffe3, 0xfffffe4, 0xfffffe5, 0xfffffe6, 0xfffffe7,
+	0xfffffe8, 0xffffea, 0x3ffffffc, 0xfffffe9, 0xfffffea, 0x3ffffffd, 0xfffffeb, 0xfffffec,
+	0xfffffed, 0xfffffee, 0xfffffef, 0xffffff0, 0xffffff1, 0xffffff2, 0x3ffffffe, 0xffffff3,
+	0xffffff4, 0xffffff5, 0xffffff6, 0xffffff7, 0xffffff8, 0xffffff9, 0xffffffa, 0xffffffb,
+	0x14, 0x3f8, 0x3f9, 0xffa, 0x1ff9, 0x15, 0xf8, 0x7fa,
+	0x3fa, 0x3fb, 0xf9, 0x7fb, 0xfa, 0x16, 0x17, 0x18,
+	0x0, 0x1, 0x2, 0x19, 0x1a, 0x1b, 0x1c, 0x1d,
+	0x1e, 0x1f, 0x5c, 0xfb, 0x7ffc, 0x20, 0xffb, 0x3fc,
+	0x1ffa, 0x21, 0x5d, 0x5e, 0x5f, 0x60, 0x61, 0x62,
+	0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a,
+	0x6b, 0x6c, 0x6d, 0x6e, 0x6f, 0x70, 0x71, 0x72,
+	0xfc, 0x73, 0xfd, 0x1ffb, 0x7fff0, 0x1ffc, 0x3ffc, 0x22,
+	0x7ffd, 0x3, 0x23, 0x4, 0x24, 0x5, 0x25, 0x26,
+	0x27, 0x6, 0x74, 0x75, 0x28, 0x29, 0x2a, 0x7,
+	0x2b, 0x76, 0x2c, 0x8, 0x9, 0x2d, 0x77, 0x78,
+	0x79, 0x7a, 0x7b, 0x7ffe, 0x7fc, 0x3ffd, 0x1ffd, 0xffffffc,
+	0xfffe6, 0x3fffd2, 0xfffe7, 0xfffe8, 0x3fffd3, 0x3fffd4, 0x3fffd5, 0x7fffd9,
+	0x3fffd6, 0x7fffda, 0x7fffdb, 0x7fffdc, 0x7fffdd, 0x7fffde, 0xffffeb, 0x7fffdf,
+	0xffffec, 0xffffed, 0x3fffd7, 0x7fffe0, 0xffffee, 0x7fffe1, 0x7fffe2, 0x7fffe3,
+	0x7fffe4, 0x1fffdc, 0x3fffd8, 0x7fffe5, 0x3fffd9, 0x7fffe6, 0x7fffe7, 0xffffef,
+	0x3fffda, 0x1fffdd, 0xfffe9, 0x3fffdb, 0x3fffdc, 0x7fffe8, 0x7fffe9, 0x1fffde,
+	0x7fffea, 0x3fffdd, 0x3fffde, 0xfffff0, 0x1fffdf, 0x3fffdf, 0x7fffeb, 0x7fffec,
+	0x1fffe0, 0x1fffe1, 0x3fffe0, 0x1fffe2, 0x7fffed, 0x3fffe1, 0x7fffee, 0x7fffef,
+	0xfffea, 0x3fffe2, 0x3fffe3, 0x3fffe4, 0x7ffff0, 0x3fffe5, 0x3fffe6, 0x7ffff1,
+	0x3ffffe0, 0x3ffffe1, 0xfffeb, 0x7fff1, 0x3fffe7, 0x7ffff2, 0x3fffe8, 0x1ffffec,
+	0x3ffffe2, 0x3ffffe3, 0x3ffffe4, 0x7ffffde, 0x7ffffdf, 0x3ffffe5, 0xfffff1, 0x1ffffed,
+	0x7fff2, 0x1fffe3, 0x3ffffe6, 0x7ffffe0, 0x7ffffe1, 0x3ffffe7, 0x7ffffe2, 0xfffff2,
+	0x1fffe4, 0x1fffe5, 0x3ffffe8, 0x3ffffe9, 0xffffffd, 0x7ffffe3, 0x7ffffe4, 0x7ffffe5,
+	0xfffec, 0xfffff3, 0xfffed, 0x1fffe6, 0x3fffe9, 0x1fffe7, 0x1fffe8, 0x7ffff3,
+	0x3fffea, 0x3fffeb, 0x1ffffee, 0x1ffffef, 0xfffff4, 0xfffff5, 0x3ffffea, 0x7ffff4,
+	0x3ffffeb, 0x7ffffe6, 0x3ffffec, 0x3ffffed, 0x7ffffe7, 0x7ffffe8, 0x7ffffe9, 0x7ffffea,
+	0x7ffffeb, 0xffffffe, 0x7ffffec, 0x7ffffed, 0x7ffffee, 0x7ffffef, 0x7fffff0, 0x3ffffee,
+};
+
+static const uint8_t huftable_enc_len[256] = {
+	13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+	28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+	6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+	5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+	13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+	7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+	15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+	6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+	20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+	24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+	22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+	21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+	26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+	19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+	20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+	26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+};
@@ -10,11 +10,15 @@
  * Usage: gcc minihuf.c -o minihuf && ./minihuf > huftable.h
  *
  * Run it twice to test parsing on the generated table on stderr
+ *
+ * It also emits the 4-bit state machine used to decode 4 bits at a time, and
+ * the code table for encoding
  */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 
 #define LWS_ARRAY_SIZE(n) (sizeof(n) / sizeof(n[0]))
 
@@ -324,6 +328,215 @@ int lextable_decode(int pos, char c)
 	return pos + (lextable[q] << 1);
 }
 
+/*
+ * The 4-bit state machine... the states are the internal nodes of the huffman
+ * tree, with the root as state 0.  For each state and nibble we walk the tree
+ * four bits, noting the symbol if we reach a leaf (codes are at least 5 bits,
+ * so there can only be one per nibble) and carrying on from the root.  If we
+ * end on the root, or on a node we reached by fewer than 8 1 bits from it, we
+ * are somewhere the string is allowed to end.
+ */
+
+#define FSM_SYM		1
+#define FSM_ACCEPT	2
+#define FSM_FAIL	4
+
+struct fsm_node {
+	int child[2];
+	int sym;
+	int id;
+	int ones; /* depth if only 1 bits from the root, else -1 */
+};
+
+static struct fsm_node fn[600];
+static unsigned char fsm[256][16][3];
+static int fsm_nodes = 1, fsm_states = 1;
+
+static int
+fsm_build(void)
+{
+	int n, m, b, walk, q, s, v;
+
+	fn[0].child[0] = fn[0].child[1] = -1;
+	fn[0].sym = -1;
+
+	for (n = 0; n < (int)LWS_ARRAY_SIZE(huf_literal); n++) {
+		walk = 0;
+		for (m = 0; m < huf_literal[n].len; m++) {
+			b = code_bit(n, m);
+			if (fn[walk].child[b] < 0) {
+				q = fsm_nodes++;
+				fn[q].child[0] = fn[q].child[1] = -1;
+				fn[q].sym = -1;
+				fn[q].ones = fn[walk].ones >= 0 && b ?
+							fn[walk].ones + 1 : -1;
+				fn[walk].child[b] = q;
+			}
+			walk = fn[walk].child[b];
+		}
+		fn[walk].sym = n;
+	}
+
+	/* give the internal nodes their state numbers, the root is 0 */
+
+	for (n = 1; n < fsm_nodes; n++)
+		if (fn[n].sym < 0)
+			fn[n].id = fsm_states++;
+
+	if (fsm_states != 256) {
+		fprintf(stderr, "fsm: %d states\n", fsm_states);
+		return 1;
+	}
+
+	for (n = 0; n < fsm_nodes; n++) {
+		if (fn[n].sym >= 0)
+			continue;
+		s = fn[n].id;
+		for (v = 0; v < 16; v++) {
+			walk = n;
+			fsm[s][v][1] = 0;
+			fsm[s][v][2] = 0;
+			for (b = 3; b >= 0; b--) {
+				walk = fn[walk].child[(v >> b) & 1];
+				if (fn[walk].sym < 0)
+					continue;
+				if (fn[walk].sym == 256 ||
+				    (fsm[s][v][1] & FSM_SYM)) {
+					fsm[s][v][1] = FSM_FAIL;
+					break;
+				}
+				fsm[s][v][1] |= FSM_SYM;
+				fsm[s][v][2] = (unsigned char)fn[walk].sym;
+				walk = 0;
+			}
+			if (fsm[s][v][1] & FSM_FAIL) {
+				fsm[s][v][0] = 0;
+				continue;
+			}
+			fsm[s][v][0] = (unsigned char)fn[walk].id;
+			if (fn[walk].ones >= 0 && fn[walk].ones < 8)
+				fsm[s][v][1] |= FSM_ACCEPT;
+		}
+	}
+
+	return 0;
+}
+
+/* decode a huffman string with the state machine, returns the length or -1 */
+
+static int
+fsm_decode(const unsigned char *in, int len, unsigned char *out)
+{
+	int s = 0, o = 0, n, v, f = FSM_ACCEPT;
+
+	for (n = 0; n < len * 2; n++) {
+		v = n & 1 ? in[n >> 1] & 0xf : in[n >> 1] >> 4;
+		f = fsm[s][v][1];
+		if (f & FSM_FAIL)
+			return -1;
+		if (f & FSM_SYM)
+			out[o++] = fsm[s][v][2];
+		s = fsm[s][v][0];
+	}
+
+	return f & FSM_ACCEPT ? o : -1;
+}
+
+static int
+fsm_test(void)
+{
+	unsigned char in[16], out[16];
+	unsigned long long acc;
+	int n, m, bits, len;
+
+	for (n = 0; n < 256; n++)
+		for (m = 0; m < 256; m += 17) {
+			/* two symbols, then padded with 1s */
+			acc = ((unsigned long long)huf_literal[n].code <<
+						huf_literal[m].len) |
+			      huf_literal[m].code;
+			bits = huf_literal[n].len + huf_literal[m].len;
+			len = (bits + 7) / 8;
+			acc = (acc << (len * 8 - bits)) |
+			      ((1ull << (len * 8 - bits)) - 1);
+			for (bits = 0; bits < len; bits++)
+				in[bits] = (unsigned char)(acc >>
+						(8 * (len - 1 - bits)));
+			if (fsm_decode(in, len, out) != 2 ||
+			    out[0] != n || out[1] != m) {
+				fprintf(stderr, "fsm decode %d %d failed\n",
+					n, m);
+				return 1;
+			}
+		}
+
+	/* 8 bits of padding, and padding with a 0 in it, are illegal */
+
+	in[0] = 0xff;
+	in[1] = 0x1b; /* 'a' then 011 */
+	if (fsm_decode(in, 1, out) >= 0 || fsm_decode(in + 1, 1, out) >= 0) {
+		fprintf(stderr, "fsm accepted bad padding\n");
+		return 1;
+	}
+
+	/* EOS is illegal */
+
+	in[0] = in[1] = in[2] = 0xff;
+	in[3] = 0xfc;
+	if (fsm_decode(in, 4, out) >= 0) {
+		fprintf(stderr, "fsm accepted EOS\n");
+		return 1;
+	}
+
+	return 0;
+}
+
+static void
+fsm_emit(void)
+{
+	int n, v;
+
+	fprintf(stdout,
+		"\n/*\n"
+		" * 4-bit at a time decode state machine.  For each state and\n"
+		" * nibble, MSB first: the next state, flags, and the symbol if\n"
+		" * HUFTABLE_FSM_SYM is set\n"
+		" */\n\n"
+		"#define HUFTABLE_FSM_SYM\t%d /* nibble completed a symbol */\n"
+		"#define HUFTABLE_FSM_ACCEPT\t%d /* the string may end here */\n"
+		"#define HUFTABLE_FSM_FAIL\t%d /* nibble completed EOS */\n"
+		"\nstatic const unsigned char huftable_fsm[256][16][3] = {\n",
+		FSM_SYM, FSM_ACCEPT, FSM_FAIL);
+
+	for (n = 0; n < 256; n++) {
+		fprintf(stdout, "/* state %3d */ {", n);
+		for (v = 0; v < 16; v++)
+			fprintf(stdout, "%s{ 0x%02x, %d, 0x%02x },",
+				v & 3 ? " " : "\n\t", fsm[n][v][0],
+				fsm[n][v][1], fsm[n][v][2]);
+		fprintf(stdout, "\n},\n");
+	}
+
+	fprintf(stdout, "};\n");
+}
+
+static void
+enc_emit(void)
+{
+	int n;
+
+	fprintf(stdout, "\n/* huffman codes and their lengths in bits, for encoding */\n"
+			"\nstatic const uint32_t huftable_enc_code[256] = {");
+	for (n = 0; n < 256; n++)
+		fprintf(stdout, "%s0x%x,", n & 7 ? " " : "\n\t",
+			huf_literal[n].code);
+	fprintf(stdout, "\n};\n\nstatic const uint8_t huftable_enc_len[256] = {");
+	for (n = 0; n < 256; n++)
+		fprintf(stdout, "%s%d,", n & 15 ? " " : "\n\t",
+			huf_literal[n].len);
+	fprintf(stdout, "\n};\n");
+}
+
 int main(void)
 {
 	int n = 0;
@@ -394,7 +607,7 @@ again:
 		walk ++;
 	}
 
-	fprintf(stdout, "static unsigned char lextable[] = {\n");
+	fprintf(stdout, "static const unsigned char lextable[] = {\n");
 
 #define TERMINAL_MASK 0x8000
 
@@ -434,7 +647,7 @@ again:
 				continue;
 			}
 
-			j = (state[saw].real_pos - q) >> 1;
+			j = (state[saw].real_pos - state[n].real_pos) >> 1;
 
 			if (j > biggest)
 				biggest = j;
@@ -458,7 +671,7 @@ again:
 	}
 
 	fprintf(stdout, "/* total size %d bytes, biggest jump %d/256, fails=%d */\n};\n"
-			"\n static unsigned char lextable_terms[] = {\n",
+			"\n static const unsigned char lextable_terms[] = {\n",
 	 		pos, biggest, fails);
 
 	for (n = 0; n < (walk + 7) / 8; n++) {
@@ -512,5 +725,13 @@ again:
 
 	fprintf(stderr, "All decode OK\n");
 
+	if (fsm_build() || fsm_test())
+		return 5;
+
+	fsm_emit();
+	enc_emit();
+
+	fprintf(stderr, "All fsm decode OK\n");
+
 	return 0;
 }
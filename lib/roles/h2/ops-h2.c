@@ -509,6 +509,10 @@ rops_write_role_protocol_h2(struct lws *wsi, unsigned char *buf, size_t len,
 		wsi->h2.send_END_STREAM = 1;
 	}
 
+	if (n == LWS_H2_FRAME_TYPE_HEADERS &&
+	    lws_hpack_encode_block(wsi, &buf, &len))
+		return -1;
+
 	n = lws_h2_frame_write(wsi, n, flags, wsi->mux.my_sid, (unsigned int)len, buf);
 	if (n < 0)
 		return n;
@@ -591,7 +595,7 @@ rops_pt_init_destroy_h2(struct lws_context *context,
 
 		pt->sul_ah_lifecheck.cb = lws_sul_http_ah_lifecheck;
 
-		__lws_sul_insert_us(&pt->pt_sul_owner[LWSSULLI_MISS_IF_SUSPENDED],
+		__lws_sul_insert_us(pt, LWSSULLI_MISS_IF_SUSPENDED,
 				 &pt->sul_ah_lifecheck, 30 * LWS_US_PER_SEC);
 	} else
 		lws_dll2_remove(&pt->sul_ah_lifecheck.list);
@@ -667,8 +671,11 @@ rops_destroy_role_h2(struct lws *wsi)
 	if (wsi->upgraded_to_http2 || wsi->mux_substream) {
 		lws_hpack_destroy_dynamic_header(wsi);
 
-		if (wsi->h2.h2n)
-			lws_free_set_NULL(wsi->h2.h2n);
+		if (wsi->h2.h2n) {
+			lws_hpack_enc_destroy(wsi->h2.h2n);
+			lws_freelist_free(&pt->fl_h2n, wsi->h2.h2n);
+			wsi->h2.h2n = NULL;
+		}
 	}
 
 	return 0;
@@ -734,6 +741,7 @@ rops_close_kill_connection_h2(struct lws *wsi, enum lws_close_status reason)
 #endif
 			wsi->mux_substream) &&
 	     wsi->mux.parent_wsi) {
+		lws_dll2_remove(&wsi->h2.sched_list);
 		lws_wsi_mux_sibling_disconnect(wsi);
 		if (wsi->h2.pending_status_body)
 			lws_free_set_NULL(wsi->h2.pending_status_body);
@@ -778,6 +786,7 @@ rops_callback_on_writable_h2(struct lws *wsi)
 	network_wsi = lws_get_network_wsi(wsi);
 #endif
 	already = lws_wsi_mux_mark_parents_needing_writeable(wsi);
+	lws_h2_sched_queue(wsi);
 
 	/* for network action, act only on the network wsi */
 
@@ -914,6 +923,11 @@ lws_h2_bind_for_post_before_action(struct lws *wsi)
  *
  * In addition children may be closed / deleted / added between POLLOUT
  * notifications, so we can't hold pointers
+ *
+ * With LWS_SERVER_OPTION_H2_PRIORITIES, instead of taking the next waiting
+ * child in list order, we ask lws_h2_sched_pick() which waiting child is
+ * most deserving according to its RFC9218 priority.  It's still one child
+ * per POLLOUT unless we're coalescing.
  */
 
 static int
@@ -923,6 +937,8 @@ rops_perform_user_POLLOUT_h2(struct lws *wsi)
 #if defined(LWS_ROLE_WS)
 	int write_type = LWS_WRITE_PONG;
 #endif
+	unsigned int budget;
+	char sched;
 	int n;
 
 	wsi = lws_get_network_wsi(wsi);
@@ -939,25 +955,58 @@ rops_perform_user_POLLOUT_h2(struct lws *wsi)
 	if (!*wsi2)
 		return 0;
 
+	lws_h2_tx_coalesce_begin(wsi);
+	budget = wsi->mux.child_count;
+	sched = !!lws_check_opt(wsi->a.vhost->options,
+				LWS_SERVER_OPTION_H2_PRIORITIES);
+
 	do {
 		struct lws *w, **wa;
 
-		wa = &(*wsi2)->mux.sibling_list;
-		if (!(*wsi2)->mux.requested_POLLOUT)
-			goto next_child;
+		if (sched) {
+			if (!budget)
+				break;
+			w = lws_h2_sched_pick(wsi);
+			if (!w)
+				break;
+			budget--;
+			wa = &wsi->mux.child_list;
+		} else {
+			wa = &(*wsi2)->mux.sibling_list;
+			if (!(*wsi2)->mux.requested_POLLOUT)
+				goto next_child;
 
-		/*
-		 * we're going to do writable callback for this child.
-		 * move him to be the last child
-		 */
+			/*
+			 * Each child may get serviced once per pass at most,
+			 * since he may ask for writeable again.  Once we have
+			 * been round them all, the child at the head is one we
+			 * already did, so stop before servicing him again.
+			 */
+			if (!budget)
+				break;
+			budget--;
 
-		lwsl_debug("servicing child %s\n", lws_wsi_tag(*wsi2));
+			/*
+			 * we're going to do writable callback for this child.
+			 * move him to be the last child
+			 */
 
-		w = lws_wsi_mux_move_child_to_tail(wsi2);
+			lwsl_debug("servicing child %s\n", lws_wsi_tag(*wsi2));
 
-		if (!w) {
-			wa = &wsi->mux.child_list;
-			goto next_child;
+			w = lws_wsi_mux_move_child_to_tail(wsi2);
+
+			if (!w) {
+				wa = &wsi->mux.child_list;
+				goto next_child;
+			}
+
+			/*
+			 * Normally we're done after servicing one child, since
+			 * he is last now.  But if we're coalescing, carry on
+			 * with the child that took his place
+			 */
+			if (wsi->h2_tx_coalescing)
+				wa = wsi2;
 		}
 
 		lwsl_info("%s: child %s, sid %d, (wsistate 0x%x)\n",
@@ -1033,7 +1082,7 @@ rops_perform_user_POLLOUT_h2(struct lws *wsi)
 #if defined(LWS_WITH_CLIENT)
 		if (lwsi_state(w) == LRS_H2_WAITING_TO_SEND_HEADERS) {
 			if (lws_h2_client_handshake(w))
-				return -1;
+				goto bail;
 
 			goto next_child;
 		}
@@ -1063,7 +1112,7 @@ rops_perform_user_POLLOUT_h2(struct lws *wsi)
 			}
 
 			if (lws_h2_bind_for_post_before_action(w))
-				return -1;
+				goto bail;
 
 			/*
 			 * Well, we could be getting a POST from the client, it
@@ -1141,10 +1190,11 @@ rops_perform_user_POLLOUT_h2(struct lws *wsi)
 			}
 			if (n > 0)
 				if (lws_http_transaction_completed(w))
-					return -1;
+					goto bail;
 			if (!n) {
 				lws_callback_on_writable(w);
 				(w)->mux.requested_POLLOUT = 1;
+				lws_h2_sched_queue(w);
 			}
 
 			goto next_child;
@@ -1188,7 +1238,7 @@ rops_perform_user_POLLOUT_h2(struct lws *wsi)
 			n = lws_write(w, &w->ws->pong_payload_buf[LWS_PRE],
 				      w->ws->pong_payload_len, (enum lws_write_protocol)write_type);
 			if (n < 0)
-				return -1;
+				goto bail;
 
 			/* well he is sent, mark him done */
 			w->ws->pong_pending_flag = 0;
@@ -1205,6 +1255,7 @@ rops_perform_user_POLLOUT_h2(struct lws *wsi)
 
 			lws_callback_on_writable(w);
 			(w)->mux.requested_POLLOUT = 1;
+			lws_h2_sched_queue(w);
 
 			/* otherwise for PING, leave POLLOUT active both ways */
 			goto next_child;
@@ -1234,6 +1285,31 @@ rops_perform_user_POLLOUT_h2(struct lws *wsi)
 			goto next_child;
 		}
 
+#if defined(LWS_ROLE_WS)
+		if (lwsi_role_ws(w) && w->ws) {
+			/* broadcasts queued on a ws stream go before the user */
+
+			if (w->ws->bcq_count && !w->ws->tx_mid_message) {
+				n = lws_ws_bcast_drain(w);
+				if (n < 0) {
+					lws_close_free_wsi(w,
+						LWS_CLOSE_STATUS_NOSTATUS,
+						"h2 ws bcast");
+					wa = &wsi->mux.child_list;
+					goto next_child;
+				}
+				if (n || w->ws->user_pollout) {
+					lws_callback_on_writable(w);
+					(w)->mux.requested_POLLOUT = 1;
+					lws_h2_sched_queue(w);
+				}
+
+				goto next_child;
+			}
+			w->ws->user_pollout = 0;
+		}
+#endif
+
 		if (lws_callback_as_writeable(w)) {
 			lwsl_info("Closing POLLOUT child (end stream %d)\n",
 				  w->h2.send_END_STREAM);
@@ -1246,14 +1322,35 @@ rops_perform_user_POLLOUT_h2(struct lws *wsi)
 
 next_child:
 		wsi2 = wa;
-	} while (wsi2 && *wsi2 && !lws_send_pipe_choked(wsi));
+		if (sched && !wsi->h2_tx_coalescing)
+			/*
+			 * The scheduler picks again only if we're coalescing,
+			 * budget limits how many times it may go round
+			 */
+			break;
+		/*
+		 * While coalescing, nothing reached the socket unless the
+		 * buffer filled, and if that write was partial, the remainder
+		 * is on buflist_out... so that is all we need to check
+		 */
+	} while (wsi2 && *wsi2 && (wsi->h2_tx_coalescing ?
+					!lws_has_buffered_out(wsi) :
+					!lws_send_pipe_choked(wsi)));
 
 	// lws_wsi_mux_dump_waiting_children(wsi);
 
+	if (lws_h2_tx_coalesce_end(wsi, 1))
+		return -1;
+
 	if (lws_wsi_mux_action_pending_writeable_reqs(wsi))
 		return -1;
 
 	return 0;
+
+bail:
+	lws_h2_tx_coalesce_end(wsi, 0);
+
+	return -1;
 }
 
 static struct lws *
@@ -1291,7 +1388,8 @@ rops_alpn_negotiated_h2(struct lws *wsi, const char *alpn)
 	wsi->http.ah = ah;
 
 	if (!wsi->h2.h2n)
-		wsi->h2.h2n = lws_zalloc(sizeof(*wsi->h2.h2n), "h2n");
+		wsi->h2.h2n = lws_freelist_zalloc(
+			&wsi->a.context->pt[(int)wsi->tsi].fl_h2n, "h2n");
 	if (!wsi->h2.h2n)
 		return 1;
 
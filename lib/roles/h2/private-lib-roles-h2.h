@@ -45,9 +45,16 @@ enum lws_h2_wellknown_frame_types {
 	LWS_H2_FRAME_TYPE_WINDOW_UPDATE,
 	LWS_H2_FRAME_TYPE_CONTINUATION,
 
-	LWS_H2_FRAME_TYPE_COUNT /* always last */
+	LWS_H2_FRAME_TYPE_COUNT, /* always last */
+
+	/* extension frame types, outside the rx validity bitmaps */
+
+	LWS_H2_FRAME_TYPE_PRIORITY_UPDATE	= 0x10, /* RFC9218 */
 };
 
+#define LWS_H2_PRIO_URGENCY_DEFAULT 3 /* RFC9218 u=3 */
+#define LWS_H2_PRIO_LISTS 16 /* urgency 0 - 7 x incremental */
+
 enum lws_h2_flags {
 	LWS_H2_FLAG_END_STREAM = 1,
 	LWS_H2_FLAG_END_HEADERS = 4,
@@ -143,6 +150,8 @@ lws_h2_state(struct lws *wsi, enum lws_h2_states s);
 #define LWS_H2_STREAM_ID_MASTER 0
 #define LWS_H2_SETTINGS_LEN 6
 #define LWS_H2_FLAG_SETTINGS_ACK 1
+/* most credit we will allow the peer for the whole connection */
+#define LWS_H2_NWSI_TXCR_MAX 0x3fffffff
 
 enum http2_hpack_state {
 	HPKS_TYPE,
@@ -194,6 +203,30 @@ struct hpack_dynamic_table {
 	uint16_t num_entries;
 };
 
+/*
+ * Our hpack encoder's view of the peer decoder's dynamic table, so we can
+ * refer to headers we sent before on the connection by index
+ */
+
+#define LWS_H2_HPACK_ENC_TABLE_MAX	4096
+#define LWS_H2_HPACK_ENC_ENTRIES	(LWS_H2_HPACK_ENC_TABLE_MAX / 32)
+
+struct hpack_enc_entry {
+	char *nv; /* malloc'd, name then value */
+	uint16_t name_len;
+	uint16_t value_len;
+};
+
+struct hpack_enc_table {
+	struct hpack_enc_entry entries[LWS_H2_HPACK_ENC_ENTRIES];
+	uint8_t *buf; /* malloc'd, LWS_PRE + re-encoded header block */
+	size_t buf_len;
+	uint32_t size; /* rfc7541 4.1 accounting */
+	uint32_t max; /* table size the peer decoder is using */
+	uint16_t head; /* next entry to fill, newest is before it */
+	uint16_t count;
+};
+
 enum lws_h2_protocol_send_type {
 	LWS_PPS_NONE,
 	LWS_H2_PPS_MY_SETTINGS,
@@ -252,11 +285,14 @@ struct lws_h2_netconn {
 	struct http2_settings our_set;
 	struct http2_settings peer_set;
 	struct hpack_dynamic_table hpack_dyn_table;
+	struct hpack_enc_table *hpack_enc; /* malloc'd on first use */
 	uint8_t	ping_payload[8];
 	uint8_t one_setting[LWS_H2_SETTINGS_LEN];
 	char goaway_str[32]; /* for rx */
+	char prio_update[48]; /* for rx PRIORITY_UPDATE field value */
 	struct lws *swsi;
 	struct lws_h2_protocol_send *pps; /* linked list */
+	lws_dll2_owner_t sched[LWS_H2_PRIO_LISTS]; /* children wanting POLLOUT */
 
 	enum http2_hpack_state hpack;
 	enum http2_hpack_type hpack_type;
@@ -273,6 +309,7 @@ struct lws_h2_netconn {
 	unsigned int zero_huff_padding:1;
 	unsigned int last_action_dyntable_resize:1;
 	unsigned int sent_preface:1;
+	unsigned int hpack_enc_resized:1;
 
 	uint32_t hdr_idx;
 	uint32_t hpack_len;
@@ -289,6 +326,8 @@ struct lws_h2_netconn {
 	uint32_t goaway_last_sid;
 	uint32_t goaway_err;
 	uint32_t hpack_hdr_len;
+	uint32_t prio_pending_sid; /* PRIORITY_UPDATE for unopened stream */
+	uint32_t hpack_enc_lowest; /* lowest peer table size since last block */
 
 	uint16_t hpack_pos;
 
@@ -301,6 +340,8 @@ struct lws_h2_netconn {
 	char first_hdr_char;
 	uint8_t hpack_m;
 	uint8_t ext_count;
+	uint8_t prio_pending_urgency;
+	uint8_t prio_pending_incremental;
 };
 
 struct _lws_h2_related {
@@ -308,14 +349,18 @@ struct _lws_h2_related {
 	struct lws_h2_netconn	*h2n; /* malloc'd for root net conn */
 
 	char			*pending_status_body;
+	lws_dll2_t		sched_list; /* on nwsi h2n sched[] */
 
 	uint8_t			h2_state; /* RFC7540 state of the connection */
+	uint8_t			prio_urgency; /* RFC9218 0 (most urgent) - 7 */
 
 	uint8_t			END_STREAM:1;
 	uint8_t			END_HEADERS:1;
 	uint8_t			send_END_STREAM:1;
 	uint8_t			long_poll:1;
 	uint8_t			initialized:1;
+	uint8_t			prio_incremental:1; /* RFC9218 i */
+	uint8_t			prio_from_frame:1; /* ignore priority: hdr */
 };
 
 #define HTTP2_IS_TOPLEVEL_WSI(wsi) (!wsi->mux.parent_wsi)
@@ -335,11 +380,25 @@ lws_h2_do_pps_send(struct lws *wsi);
 int
 lws_h2_frame_write(struct lws *wsi, int type, int flags, unsigned int sid,
 		   unsigned int len, unsigned char *buf);
+void
+lws_h2_tx_coalesce_begin(struct lws *nwsi);
+int
+lws_h2_tx_coalesce(struct lws *nwsi, const uint8_t *buf, size_t len);
+int
+lws_h2_tx_coalesce_end(struct lws *nwsi, int flush);
+void
+lws_h2_sched_queue(struct lws *wsi);
+void
+lws_h2_sched_requeue(struct lws *wsi);
+struct lws *
+lws_h2_sched_pick(struct lws *nwsi);
 struct lws *
 lws_wsi_mux_from_id(struct lws *wsi, unsigned int sid);
 int
 lws_hpack_interpret(struct lws *wsi, unsigned char c);
 int
+lws_hpack_interpret_buf(struct lws *wsi, const unsigned char *buf, size_t len);
+int
 lws_add_http2_header_by_name(struct lws *wsi,
 			     const unsigned char *name,
 			     const unsigned char *value, int length,
@@ -356,6 +415,12 @@ lws_add_http2_header_status(struct lws *wsi,
 void
 lws_hpack_destroy_dynamic_header(struct lws *wsi);
 int
+lws_hpack_encode_block(struct lws *wsi, unsigned char **buf, size_t *len);
+void
+lws_hpack_enc_table_size(struct lws_h2_netconn *h2n, uint32_t size);
+void
+lws_hpack_enc_destroy(struct lws_h2_netconn *h2n);
+int
 lws_hpack_dynamic_size(struct lws *wsi, int size);
 int
 lws_h2_goaway(struct lws *wsi, uint32_t err, const char *reason);
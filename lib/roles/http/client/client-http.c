@@ -1258,7 +1258,8 @@ lws_generate_client_handshake(struct lws *wsi, char *pkt)
 	} else
 #endif
 	{
-		if (!wsi->client_pipeline)
+		/* unless the vhost keeps idle conns, this is our only txn */
+		if (!wsi->client_pipeline && !wsi->a.vhost->cli_idle_max)
 			p += lws_snprintf(p, 64, "connection: close\x0d\x0a");
 	}
 
@@ -42,16 +42,31 @@ static const unsigned char lextable_h1[] = {
 static struct allocated_headers *
 _lws_create_ah(struct lws_context_per_thread *pt, ah_data_idx_t data_size)
 {
-	struct allocated_headers *ah = lws_zalloc(sizeof(*ah), "ah struct");
+	struct allocated_headers *ah = pt->http.ah_free_list;
+	char *data;
 
-	if (!ah)
-		return NULL;
+	/*
+	 * If we kept any destroyed ones, reuse the struct and its data
+	 * together (the data size is set at context creation)
+	 */
 
-	ah->data = lws_malloc(data_size, "ah data");
-	if (!ah->data) {
-		lws_free(ah);
+	if (ah && ah->data_length == data_size) {
+		pt->http.ah_free_list = ah->next;
+		pt->http.ah_free_count--;
+		data = ah->data;
+		memset(ah, 0, sizeof(*ah));
+		ah->data = data;
+	} else {
+		ah = lws_zalloc(sizeof(*ah), "ah struct");
+		if (!ah)
+			return NULL;
+
+		ah->data = lws_malloc(data_size, "ah data");
+		if (!ah->data) {
+			lws_free(ah);
 
-		return NULL;
+			return NULL;
+		}
 	}
 	ah->next = pt->http.ah_list;
 	pt->http.ah_list = ah;
@@ -74,6 +89,16 @@ _lws_destroy_ah(struct lws_context_per_thread *pt, struct allocated_headers *ah)
 			lwsl_info("%s: freed ah %p : pool length %u\n",
 				    __func__, ah,
 				    (unsigned int)pt->http.ah_pool_length);
+
+			if (ah->data && pt->http.ah_free_count <
+					pt->context->conn_freelist_max) {
+				ah->next = pt->http.ah_free_list;
+				pt->http.ah_free_list = ah;
+				pt->http.ah_free_count++;
+
+				return 0;
+			}
+
 			if (ah->data)
 				lws_free(ah->data);
 			lws_free(ah);
@@ -85,6 +110,20 @@ _lws_destroy_ah(struct lws_context_per_thread *pt, struct allocated_headers *ah)
 	return 1;
 }
 
+void
+_lws_ah_free_list_destroy(struct lws_context_per_thread *pt)
+{
+	struct allocated_headers *ah;
+
+	while (pt->http.ah_free_list) {
+		ah = pt->http.ah_free_list;
+		pt->http.ah_free_list = ah->next;
+		lws_free(ah->data);
+		lws_free(ah);
+	}
+	pt->http.ah_free_count = 0;
+}
+
 void
 _lws_header_table_reset(struct allocated_headers *ah)
 {
@@ -267,10 +306,7 @@ lws_header_table_attach(struct lws *wsi, int autoservice)
 
 #if defined(LWS_WITH_PEER_LIMITS) && (defined(LWS_ROLE_H1) || \
     defined(LWS_ROLE_H2))
-	lws_context_lock(context, "ah attach"); /* <========================= */
-	if (wsi->peer)
-		wsi->peer->http.count_ah++;
-	lws_context_unlock(context); /* ====================================> */
+	lws_peer_track_ah_attach(context, wsi->peer);
 #endif
 
 	_lws_change_pollfd(wsi, 0, LWS_POLLIN, &pa);
@@ -389,10 +425,7 @@ int __lws_header_table_detach(struct lws *wsi, int autoservice)
 	__lws_header_table_reset(wsi, autoservice);
 #if defined(LWS_WITH_PEER_LIMITS) && (defined(LWS_ROLE_H1) || \
     defined(LWS_ROLE_H2))
-	lws_context_lock(context, "ah detach"); /* <========================= */
-	if (wsi->peer)
-		wsi->peer->http.count_ah++;
-	lws_context_unlock(context); /* ====================================> */
+	lws_peer_track_ah_attach(context, wsi->peer);
 #endif
 
 	/* clients acquire the ah and then insert themselves in fds table... */
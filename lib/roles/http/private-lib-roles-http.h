@@ -175,16 +175,56 @@ LWS_EXTERN int
 lws_rewrite_parse(struct lws_rewrite *r, const unsigned char *in, int in_len);
 #endif
 
+#if defined(LWS_WITH_ACCESS_LOG_ASYNC)
+/* spans of queued records going to the same log file are written at once */
+#define LWS_ALOG_MAX_RUNS 64
+
+struct lws_alog_run {
+	int			fd;
+	uint32_t		len;
+};
+
+/* each pt queues its formatted access log records here for the writer */
+struct lws_alog_queue {
+	pthread_mutex_t		lock;
+	char			*buf;
+	struct lws_alog_run	run[LWS_ALOG_MAX_RUNS];
+	uint64_t		dropped;
+	uint32_t		len;
+	uint32_t		count_runs;
+	char			kicked; /* writer was told we're filling up */
+};
+
+/* the context's background thread that writes the queued records */
+struct lws_alog_writer {
+	pthread_mutex_t		lock; /* for cond and stop */
+	pthread_cond_t		cond;
+	pthread_mutex_t		flush_lock; /* one flush at a time */
+	pthread_t		thread;
+	char			*buf; /* swapped with a queue's buf to write it */
+	struct lws_alog_run	run[LWS_ALOG_MAX_RUNS];
+	uint64_t		dropped_reported;
+	uint32_t		size; /* of each queue buf, 0 if not in use */
+	char			stop;
+};
+#endif
+
 struct lws_pt_role_http {
 	struct allocated_headers *ah_list;
+	struct allocated_headers *ah_free_list; /* destroyed, kept for reuse */
 	struct lws *ah_wait_list;
 #ifdef LWS_WITH_CGI
 	struct lws_cgi *cgi_list;
 #endif
 	int ah_wait_list_length;
 	uint32_t ah_pool_length;
+	uint32_t ah_free_count;
 
 	int ah_count_in_use;
+
+#if defined(LWS_WITH_ACCESS_LOG_ASYNC)
+	struct lws_alog_queue alog;
+#endif
 };
 
 struct lws_peer_role_http {
@@ -197,6 +237,9 @@ struct lws_vhost_role_http {
 	char http_proxy_address[128];
 #endif
 	const struct lws_http_mount *mount_list;
+#if defined(LWS_WITH_SERVER)
+	struct lws_mount_tree_node *mount_tree; /* NULL = scan mount_list */
+#endif
 	const char *error_document_404;
 #if defined(LWS_CLIENT_HTTP_PROXYING)
 	unsigned int http_proxy_port;
@@ -279,6 +322,9 @@ struct _lws_http_mode_related {
 	unsigned int multipart:1;
 	unsigned int cgi_transaction_complete:1;
 	unsigned int multipart_issue_boundary:1;
+#if defined(LWS_WITH_FILE_OPS)
+	unsigned int no_sendfile:1; /* sendfile() refused this file */
+#endif
 };
 
 
@@ -321,6 +367,8 @@ _lws_header_table_reset(struct allocated_headers *ah);
 
 LWS_EXTERN int
 _lws_destroy_ah(struct lws_context_per_thread *pt, struct allocated_headers *ah);
+void
+_lws_ah_free_list_destroy(struct lws_context_per_thread *pt);
 
 int
 lws_http_proxy_start(struct lws *wsi, const struct lws_http_mount *hit,
@@ -341,6 +389,19 @@ lws_http_date_render_from_unix(char *buf, size_t len, const time_t *t);
 int
 lws_http_date_parse_unix(const char *b, size_t len, time_t *t);
 
+#if defined(LWS_WITH_SERVER)
+/* vhosts with fewer mounts than this just scan the mount list */
+#define LWS_HTTP_MOUNT_TREE_MIN 8
+
+int
+lws_vhost_mount_tree_build(struct lws_vhost *vh);
+void
+lws_vhost_mount_tree_destroy(struct lws_vhost *vh);
+const struct lws_http_mount *
+__lws_vhost_find_mount(struct lws_vhost *vh, const char *uri, int uri_len,
+		       int has_method);
+#endif
+
 enum {
 	CCTLS_RETURN_ERROR		= -1,
 	CCTLS_RETURN_DONE		= 0,
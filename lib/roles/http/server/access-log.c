@@ -22,6 +22,10 @@
  * IN THE SOFTWARE.
  */
 
+#if !defined(_GNU_SOURCE)
+#define _GNU_SOURCE /* for pthread_setname_np() */
+#endif
+
 #include "private-lib-core.h"
 
 /*
@@ -47,7 +51,7 @@ lws_prepare_access_log_info(struct lws *wsi, char *uri_ptr, int uri_len, int met
 	time_t t = time(NULL);
 	struct lws *nwsi;
 	const char *me;
-	int l = 256, m;
+	int l = 256, m, json;
 	struct tm *ptm = NULL;
 #if defined(LWS_HAVE_LOCALTIME_R)
 	struct tm tm;
@@ -63,6 +67,10 @@ lws_prepare_access_log_info(struct lws *wsi, char *uri_ptr, int uri_len, int met
 	if (wsi->access_log_pending)
 		lws_access_log(wsi);
 
+	json = wsi->a.vhost->log_format == LWS_ACCESS_LOG_FMT_JSON;
+	if (json)
+		l = 768; /* room for the escaped uri */
+
 	wsi->http.access_log.header_log = lws_malloc((unsigned int)l, "access log");
 	if (!wsi->http.access_log.header_log)
 		return;
@@ -73,9 +81,11 @@ lws_prepare_access_log_info(struct lws *wsi, char *uri_ptr, int uri_len, int met
 	ptm = localtime(&t);
 #endif
 	if (ptm)
-		strftime(da, sizeof(da), "%d/%b/%Y:%H:%M:%S %z", ptm);
+		strftime(da, sizeof(da), json ? "%Y-%m-%dT%H:%M:%S%z" :
+					 "%d/%b/%Y:%H:%M:%S %z", ptm);
 	else
-		strcpy(da, "01/Jan/1970:00:00:00 +0000");
+		strcpy(da, json ? "1970-01-01T00:00:00+0000" :
+				  "01/Jan/1970:00:00:00 +0000");
 
 #if defined(LWS_ROLE_H2)
 	if (wsi->mux_substream)
@@ -101,9 +111,21 @@ lws_prepare_access_log_info(struct lws *wsi, char *uri_ptr, int uri_len, int met
 	else
 		strncpy(ta, "unknown", sizeof(ta));
 
-	lws_snprintf(wsi->http.access_log.header_log, (size_t)l,
-		     "%s - - [%s] \"%s %s %s\"",
-		     ta, da, me, uri, hver[wsi->http.request_version]);
+	if (json) {
+		char eme[32], euri[512];
+
+		/* lws_json_purify() may produce up to twice what we allow */
+		lws_json_purify(eme, me, (int)sizeof(eme) / 2, NULL);
+		lws_json_purify(euri, uri, (int)sizeof(euri) / 2, NULL);
+
+		lws_snprintf(wsi->http.access_log.header_log, (size_t)l,
+			     "\"time\":\"%s\",\"peer\":\"%s\",\"method\":\"%s\","
+			     "\"uri\":\"%s\",\"proto\":\"%s\"", da, ta, eme,
+			     euri, hver[wsi->http.request_version]);
+	} else
+		lws_snprintf(wsi->http.access_log.header_log, (size_t)l,
+			     "%s - - [%s] \"%s %s %s\"",
+			     ta, da, me, uri, hver[wsi->http.request_version]);
 
 	//lwsl_notice("%s\n", wsi->http.access_log.header_log);
 
@@ -119,7 +141,7 @@ lws_prepare_access_log_info(struct lws *wsi, char *uri_ptr, int uri_len, int met
 		wsi->http.access_log.user_agent[0] = '\0';
 
 		if (lws_hdr_copy(wsi, wsi->http.access_log.user_agent, l + 4,
-				 WSI_TOKEN_HTTP_USER_AGENT) >= 0)
+				 WSI_TOKEN_HTTP_USER_AGENT) >= 0 && !json)
 			for (m = 0; m < l; m++)
 				if (wsi->http.access_log.user_agent[m] == '\"')
 					wsi->http.access_log.user_agent[m] = '\'';
@@ -135,7 +157,7 @@ lws_prepare_access_log_info(struct lws *wsi, char *uri_ptr, int uri_len, int met
 		}
 		wsi->http.access_log.referrer[0] = '\0';
 		if (lws_hdr_copy(wsi, wsi->http.access_log.referrer,
-				l + 4, WSI_TOKEN_HTTP_REFERER) >= 0)
+				l + 4, WSI_TOKEN_HTTP_REFERER) >= 0 && !json)
 
 			for (m = 0; m < l; m++)
 				if (wsi->http.access_log.referrer[m] == '\"')
@@ -145,10 +167,310 @@ lws_prepare_access_log_info(struct lws *wsi, char *uri_ptr, int uri_len, int met
 }
 
 
+#if defined(LWS_WITH_ACCESS_LOG_ASYNC)
+
+/*
+ * With a nonzero access_log_queue_size, the service threads don't write the
+ * records themselves, since that can block the event loop on a slow disk,
+ * and it's a syscall per request.  Instead each pt appends them to its own
+ * queue, and a background thread swaps the queue buffer for an empty one
+ * every second, or sooner if it's getting full, and writes what was in it
+ * with one write() per run of records going to the same log file.
+ *
+ * If the queue is full, the record is dropped and counted rather than block
+ * the service thread.
+ */
+
+static void
+lws_alog_write(int fd, const char *p, size_t len)
+{
+	ssize_t n;
+
+	while (len) {
+		n = write(fd, p, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0) {
+			lwsl_err("Failed to write log\n");
+			return;
+		}
+		p += n;
+		len -= (size_t)n;
+	}
+}
+
+void
+lws_access_log_async_flush(struct lws_context *cx)
+{
+	struct lws_alog_writer *w = &cx->alog;
+	uint32_t n, m, count_runs;
+	uint64_t dropped = 0;
+	char *p;
+
+	pthread_mutex_lock(&w->flush_lock);
+
+	for (n = 0; n < (uint32_t)cx->count_threads; n++) {
+		struct lws_alog_queue *q = &cx->pt[n].http.alog;
+
+		/* take the pt's queue, leaving it our empty buffer */
+
+		pthread_mutex_lock(&q->lock);
+		p = q->buf;
+		q->buf = w->buf;
+		w->buf = p;
+		count_runs = q->count_runs;
+		memcpy(w->run, q->run, count_runs * sizeof(w->run[0]));
+		q->count_runs = 0;
+		q->len = 0;
+		q->kicked = 0;
+		dropped += q->dropped;
+		pthread_mutex_unlock(&q->lock);
+
+		for (m = 0; m < count_runs; m++) {
+			lws_alog_write(w->run[m].fd, p, w->run[m].len);
+			p += w->run[m].len;
+		}
+	}
+
+	if (dropped != w->dropped_reported) {
+		lwsl_cx_warn(cx, "%llu access log records dropped so far",
+			     (unsigned long long)dropped);
+		w->dropped_reported = dropped;
+	}
+
+	pthread_mutex_unlock(&w->flush_lock);
+}
+
+static void *
+lws_alog_thread(void *d)
+{
+	struct lws_context *cx = (struct lws_context *)d;
+	struct lws_alog_writer *w = &cx->alog;
+	struct timespec abstime;
+	char stop;
+
+	do {
+		pthread_mutex_lock(&w->lock);
+		if (!w->stop) {
+			abstime.tv_sec = time(NULL) + 1;
+			abstime.tv_nsec = 0;
+			pthread_cond_timedwait(&w->cond, &w->lock, &abstime);
+		}
+		stop = w->stop;
+		pthread_mutex_unlock(&w->lock);
+
+		lws_access_log_async_flush(cx);
+	} while (!stop);
+
+	return NULL;
+}
+
+static void
+lws_alog_queue(struct lws_context_per_thread *pt, int fd, const char *rec,
+	       int len)
+{
+	struct lws_alog_writer *w = &pt->context->alog;
+	struct lws_alog_queue *q = &pt->http.alog;
+	struct lws_alog_run *r = NULL;
+	char kick = 0;
+
+	pthread_mutex_lock(&q->lock);
+
+	if (q->count_runs && q->run[q->count_runs - 1].fd == fd)
+		r = &q->run[q->count_runs - 1];
+
+	if (q->len + (uint32_t)len > w->size ||
+	    (!r && q->count_runs == LWS_ALOG_MAX_RUNS)) {
+		q->dropped++;
+		pthread_mutex_unlock(&q->lock);
+
+		return;
+	}
+
+	if (!r) {
+		r = &q->run[q->count_runs++];
+		r->fd = fd;
+		r->len = 0;
+	}
+
+	memcpy(q->buf + q->len, rec, (size_t)len);
+	q->len += (uint32_t)len;
+	r->len += (uint32_t)len;
+
+	if (!q->kicked && q->len >= w->size / 2) {
+		q->kicked = 1;
+		kick = 1;
+	}
+
+	pthread_mutex_unlock(&q->lock);
+
+	if (kick) {
+		/* don't wait for the timeout, we're filling up */
+		pthread_mutex_lock(&w->lock);
+		pthread_cond_signal(&w->cond);
+		pthread_mutex_unlock(&w->lock);
+	}
+}
+
+int
+lws_access_log_async_init(struct lws_context *cx, unsigned int size)
+{
+	struct lws_alog_writer *w = &cx->alog;
+	int n;
+
+	if (!size)
+		return 0;
+
+	/* a queue must at least be able to hold the largest record */
+	if (size < 2048)
+		size = 2048;
+
+	w->buf = lws_malloc(size, "alog");
+	if (!w->buf)
+		return 1;
+
+	for (n = 0; n < cx->count_threads; n++) {
+		cx->pt[n].http.alog.buf = lws_malloc(size, "alog");
+		if (!cx->pt[n].http.alog.buf)
+			goto bail;
+		pthread_mutex_init(&cx->pt[n].http.alog.lock, NULL);
+	}
+
+	pthread_mutex_init(&w->lock, NULL);
+	pthread_mutex_init(&w->flush_lock, NULL);
+	pthread_cond_init(&w->cond, NULL);
+	w->size = size;
+
+	if (pthread_create(&w->thread, NULL, lws_alog_thread, cx)) {
+		lwsl_cx_err(cx, "access log thread creation failed");
+		w->size = 0;
+		pthread_cond_destroy(&w->cond);
+		pthread_mutex_destroy(&w->flush_lock);
+		pthread_mutex_destroy(&w->lock);
+		goto bail;
+	}
+#if defined(LWS_HAS_PTHREAD_SETNAME_NP)
+	pthread_setname_np(w->thread, "lws-alog");
+#endif
+
+	return 0;
+
+bail:
+	while (n-- > 0) {
+		pthread_mutex_destroy(&cx->pt[n].http.alog.lock);
+		lws_free_set_NULL(cx->pt[n].http.alog.buf);
+	}
+	lws_free_set_NULL(w->buf);
+
+	return 1;
+}
+
+/* everything still queued is written before we return */
+
+void
+lws_access_log_async_destroy(struct lws_context *cx)
+{
+	struct lws_alog_writer *w = &cx->alog;
+	int n;
+
+	if (!w->size)
+		return;
+
+	pthread_mutex_lock(&w->lock);
+	w->stop = 1;
+	pthread_cond_signal(&w->cond);
+	pthread_mutex_unlock(&w->lock);
+
+	pthread_join(w->thread, NULL);
+
+	for (n = 0; n < cx->count_threads; n++) {
+		pthread_mutex_destroy(&cx->pt[n].http.alog.lock);
+		lws_free_set_NULL(cx->pt[n].http.alog.buf);
+	}
+	lws_free_set_NULL(w->buf);
+	pthread_cond_destroy(&w->cond);
+	pthread_mutex_destroy(&w->flush_lock);
+	pthread_mutex_destroy(&w->lock);
+	w->size = 0;
+}
+#endif
+
+uint64_t
+lws_access_log_dropped(struct lws_context *cx)
+{
+	uint64_t dropped = 0;
+#if defined(LWS_WITH_ACCESS_LOG_ASYNC)
+	int n;
+
+	if (!cx->alog.size)
+		return 0;
+
+	for (n = 0; n < cx->count_threads; n++) {
+		pthread_mutex_lock(&cx->pt[n].http.alog.lock);
+		dropped += cx->pt[n].http.alog.dropped;
+		pthread_mutex_unlock(&cx->pt[n].http.alog.lock);
+	}
+#endif
+
+	return dropped;
+}
+
+static void
+lws_access_log_emit(struct lws *wsi, const char *rec, int len)
+{
+#if defined(LWS_WITH_ACCESS_LOG_ASYNC)
+	struct lws_context *cx = wsi->a.context;
+
+	if (cx->alog.size) {
+		lws_alog_queue(&cx->pt[(int)wsi->tsi], wsi->a.vhost->log_fd,
+			       rec, len);
+		return;
+	}
+#endif
+
+	if ((int)write(wsi->a.vhost->log_fd, rec, (size_t)len) != len)
+		lwsl_err("Failed to write log\n");
+}
+
+/*
+ * The JSON version is one object per line, like
+ *
+ * {"time":"2016-03-27T03:22:44+0800","peer":"2.31.234.19","method":"GET",
+ *  "uri":"/aep-screen.png","proto":"HTTP/1.1","status":200,"bytes":152987,
+ *  "referer":"https://libwebsockets.org/index.html","ua":"Mozilla/5.0 ..."}
+ */
+
+static int
+lws_access_log_json(struct lws *wsi, char *ass, size_t len, const char *ref,
+		    const char *ua)
+{
+	size_t l;
+
+	l = (size_t)lws_snprintf(ass, len,
+				 "{%s,\"status\":%d,\"bytes\":%lu,\"referer\":\"",
+				 wsi->http.access_log.header_log,
+				 wsi->http.access_log.response,
+				 wsi->http.access_log.sent);
+
+	/*
+	 * lws_json_purify() may produce up to twice what we allow, the
+	 * referrer can have up to half of what's left, and the useragent up
+	 * to all of what's left after that, less the closing "}\n
+	 */
+	lws_json_purify(ass + l, ref, (int)((len - l) / 4), NULL);
+	l += strlen(ass + l);
+	l += (size_t)lws_snprintf(ass + l, len - l, "\",\"ua\":\"");
+	lws_json_purify(ass + l, ua, (int)((len - l - 4) / 2), NULL);
+	l += strlen(ass + l);
+	l += (size_t)lws_snprintf(ass + l, len - l, "\"}\n");
+
+	return (int)l;
+}
+
 int
 lws_access_log(struct lws *wsi)
 {
-	char *p = wsi->http.access_log.user_agent, ass[512],
+	char *p = wsi->http.access_log.user_agent, ass[1024],
 	     *p1 = wsi->http.access_log.referrer;
 	int l;
 
@@ -170,25 +492,30 @@ lws_access_log(struct lws *wsi)
 	if (!p1)
 		p1 = "";
 
-	/*
-	 * We do this in two parts to restrict an oversize referrer such that
-	 * we will always have space left to append an empty useragent, while
-	 * maintaining the structure of the log text
-	 */
-	l = lws_snprintf(ass, sizeof(ass) - 7, "%s %d %lu \"%s",
-			 wsi->http.access_log.header_log,
-			 wsi->http.access_log.response,
-			 wsi->http.access_log.sent, p1);
-	if (strlen(p) > sizeof(ass) - 6 - (unsigned int)l) {
-		p[sizeof(ass) - 6 - (unsigned int)l] = '\0';
-		l--;
+	if (wsi->a.vhost->log_format == LWS_ACCESS_LOG_FMT_JSON)
+		l = lws_access_log_json(wsi, ass, sizeof(ass), p1, p);
+	else {
+		/*
+		 * We do this in two parts to restrict an oversize referrer such
+		 * that we will always have space left to append an empty
+		 * useragent, while maintaining the structure of the log text
+		 */
+		l = lws_snprintf(ass, sizeof(ass) - 7, "%s %d %lu \"%s",
+				 wsi->http.access_log.header_log,
+				 wsi->http.access_log.response,
+				 wsi->http.access_log.sent, p1);
+		if (strlen(p) > sizeof(ass) - 6 - (unsigned int)l) {
+			p[sizeof(ass) - 6 - (unsigned int)l] = '\0';
+			l--;
+		}
+		l += lws_snprintf(ass + (unsigned int)l,
+				  sizeof(ass) - 1 - (unsigned int)l,
+				  "\" \"%s\"\n", p);
 	}
-	l += lws_snprintf(ass + (unsigned int)l, sizeof(ass) - 1 - (unsigned int)l, "\" \"%s\"\n", p);
 
 	ass[sizeof(ass) - 1] = '\0';
 
-	if ((int)write(wsi->a.vhost->log_fd, ass, (size_t)l) != l)
-		lwsl_err("Failed to write log\n");
+	lws_access_log_emit(wsi, ass, l);
 
 	if (wsi->http.access_log.header_log) {
 		lws_free(wsi->http.access_log.header_log);
@@ -48,6 +48,7 @@ static const char * const paths_global[] = {
 	"global.ip-limit-ah",
 	"global.ip-limit-wsi",
 	"global.rlimit-nofile",
+	"global.access-log-queue",
 };
 
 enum lejp_global_paths {
@@ -67,6 +68,7 @@ enum lejp_global_paths {
 	LWJPGP_IP_LIMIT_AH,
 	LWJPGP_IP_LIMIT_WSI,
 	LWJPGP_FD_LIMIT_PT,
+	LWJPGP_ACCESS_LOG_QUEUE,
 };
 
 static const char * const paths_vhosts[] = {
@@ -136,6 +138,7 @@ static const char * const paths_vhosts[] = {
 
 	"vhosts[].disable-no-protocol-ws-upgrades",
 	"vhosts[].h2-half-closed-long-poll",
+	"vhosts[].access-log-format",
 };
 
 enum lejp_vhost_paths {
@@ -205,6 +208,7 @@ enum lejp_vhost_paths {
 
 	LEJPVP_FLAG_DISABLE_NO_PROTOCOL_WS_UPGRADES,
 	LEJPVP_FLAG_H2_HALF_CLOSED_LONG_POLL,
+	LEJPVP_ACCESS_LOG_FORMAT,
 };
 
 #define MAX_PLUGIN_DIRS 10
@@ -357,6 +361,12 @@ lejp_globals_cb(struct lejp_ctx *ctx, char reason)
 		a->info->rlimit_nofile = atoi(ctx->buf);
 		return 0;
 
+#if defined(LWS_WITH_ACCESS_LOG)
+	case LWJPGP_ACCESS_LOG_QUEUE:
+		a->info->access_log_queue_size = (unsigned int)atoi(ctx->buf);
+		return 0;
+#endif
+
 	default:
 		return 0;
 	}
@@ -658,6 +668,13 @@ lejp_vhosts_cb(struct lejp_ctx *ctx, char reason)
 	case LEJPVP_ACCESS_LOG:
 		a->info->log_filepath = a->p;
 		break;
+#if defined(LWS_WITH_ACCESS_LOG)
+	case LEJPVP_ACCESS_LOG_FORMAT:
+		a->info->access_log_format = !strcmp(ctx->buf, "json") ?
+				LWS_ACCESS_LOG_FMT_JSON :
+				LWS_ACCESS_LOG_FMT_COMBINED;
+		return 0;
+#endif
 	case LEJPVP_MOUNTPOINT:
 		a->m.mountpoint = a->p;
 		a->m.mountpoint_len = (unsigned char)strlen(ctx->buf);
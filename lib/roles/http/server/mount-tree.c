@@ -0,0 +1,223 @@
+/*
+ * libwebsockets - small server side websockets and web server implementation
+ *
+ * Copyright (C) 2010 - 2021 Andy Green <andy@warmcat.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include "private-lib-core.h"
+
+/*
+ * A mount matches a url path if its mountpoint is a prefix of the path, ending
+ * at the end of the path or at a '/' in it (or if the mountpoint is just one
+ * char, ie, "/").  The longest matching mountpoint wins, if there are several
+ * mounts with the same mountpoint the first one in the list wins.  An empty
+ * mountpoint never matches.
+ *
+ * With a lot of mounts, comparing the path against every mountpoint for every
+ * request adds up, so for vhosts with LWS_HTTP_MOUNT_TREE_MIN or more mounts
+ * we compile the mountpoints into a radix tree when the vhost is created.
+ * Then we walk down it once with the path, noting the deepest node that ends a
+ * mountpoint at a place it matches, that is O(path length).
+ *
+ * The tree lives in one allocation... each mount inserted adds at most one
+ * leaf and one node from splitting an existing edge, so 2n + 1 nodes is always
+ * enough.  The edge labels point into the mountpoint strings, which the user
+ * code must keep around for the life of the vhost anyway.
+ */
+
+struct lws_mount_tree_node {
+	const struct lws_mount_tree_node	*child;
+	const struct lws_mount_tree_node	*sibling;
+	/* first mount with a mountpoint ending here */
+	const struct lws_http_mount		*mount;
+	/* first mount ending here that is usable without a method uri */
+	const struct lws_http_mount		*mount_nm;
+	const char				*edge;
+	unsigned int				edge_len;
+};
+
+/*
+ * Without a method uri in the request, only mounts that can handle it anyway
+ * are candidates
+ */
+
+static int
+lws_mount_usable_without_method(const struct lws_http_mount *m)
+{
+	return m->origin_protocol == LWSMPRO_CALLBACK ||
+	       m->origin_protocol == LWSMPRO_CGI ||
+	       m->protocol;
+}
+
+static int
+lws_mount_ends_here(const char *uri, int uri_len, int d)
+{
+	return d >= uri_len || uri[d] == '\0' || uri[d] == '/' || d == 1;
+}
+
+void
+lws_vhost_mount_tree_destroy(struct lws_vhost *vh)
+{
+	lws_free_set_NULL(vh->http.mount_tree);
+}
+
+int
+lws_vhost_mount_tree_build(struct lws_vhost *vh)
+{
+	struct lws_mount_tree_node *t, *n, *c, *tail;
+	const struct lws_http_mount *m;
+	unsigned int count = 0, used = 1, kl, common;
+	const char *k;
+
+	lws_vhost_mount_tree_destroy(vh);
+
+	for (m = vh->http.mount_list; m; m = m->mount_next)
+		count++;
+
+	if (count < LWS_HTTP_MOUNT_TREE_MIN)
+		/* the linear scan is as good for a few mounts */
+		return 0;
+
+	t = lws_zalloc(sizeof(*t) * ((count * 2) + 1), __func__);
+	if (!t) {
+		lwsl_vhost_warn(vh, "OOM, using linear mount scan");
+		return 1;
+	}
+
+	for (m = vh->http.mount_list; m; m = m->mount_next) {
+		k = m->mountpoint;
+		kl = m->mountpoint_len;
+		n = t; /* the root has an empty edge */
+
+		while (kl) {
+			for (c = (struct lws_mount_tree_node *)n->child;
+			     c && c->edge[0] != k[0];
+			     c = (struct lws_mount_tree_node *)c->sibling)
+				;
+
+			if (!c) {
+				/* nothing shares this first char, new leaf */
+				c = &t[used++];
+				c->edge = k;
+				c->edge_len = kl;
+				c->sibling = n->child;
+				n->child = c;
+				n = c;
+				break;
+			}
+
+			common = 1;
+			while (common < kl && common < c->edge_len &&
+			       c->edge[common] == k[common])
+				common++;
+
+			if (common < c->edge_len) {
+				/*
+				 * We diverge partway along c's edge, split it
+				 * so c ends at the divergence, and a new node
+				 * takes over the rest of the edge and
+				 * everything c had below it
+				 */
+				tail = &t[used++];
+				*tail = *c;
+				tail->sibling = NULL;
+				tail->edge += common;
+				tail->edge_len -= common;
+
+				c->child = tail;
+				c->edge_len = common;
+				c->mount = NULL;
+				c->mount_nm = NULL;
+			}
+
+			k += common;
+			kl -= common;
+			n = c;
+		}
+
+		assert(used <= (count * 2) + 1);
+
+		if (!n->mount)
+			n->mount = m;
+		if (!n->mount_nm && lws_mount_usable_without_method(m))
+			n->mount_nm = m;
+	}
+
+	vh->http.mount_tree = t;
+
+	lwsl_vhost_info(vh, "%u mounts, %u tree nodes", count, used);
+
+	return 0;
+}
+
+const struct lws_http_mount *
+__lws_vhost_find_mount(struct lws_vhost *vh, const char *uri, int uri_len,
+		       int has_method)
+{
+	const struct lws_mount_tree_node *n = vh->http.mount_tree, *c;
+	const struct lws_http_mount *hm, *hit = NULL;
+	int d = 0, best = 0;
+
+	if (!n) {
+		/* no tree, scan the list */
+
+		for (hm = vh->http.mount_list; hm; hm = hm->mount_next)
+			if (uri_len >= hm->mountpoint_len &&
+			    !strncmp(uri, hm->mountpoint, hm->mountpoint_len) &&
+			    lws_mount_ends_here(uri, uri_len,
+						hm->mountpoint_len) &&
+			    (has_method ||
+			     lws_mount_usable_without_method(hm)) &&
+			    hm->mountpoint_len > best) {
+				best = hm->mountpoint_len;
+				hit = hm;
+			}
+
+		return hit;
+	}
+
+	while (1) {
+		hm = has_method ? n->mount : n->mount_nm;
+		if (hm && d && lws_mount_ends_here(uri, uri_len, d))
+			hit = hm;
+
+		if (d >= uri_len || !uri[d])
+			break;
+
+		for (c = n->child; c && c->edge[0] != uri[d]; c = c->sibling)
+			;
+
+		if (!c || (int)c->edge_len > uri_len - d ||
+		    strncmp(uri + d, c->edge, c->edge_len))
+			break;
+
+		d += (int)c->edge_len;
+		n = c;
+	}
+
+	return hit;
+}
+
+const struct lws_http_mount *
+lws_vhost_find_mount(struct lws_vhost *vh, const char *uri, int uri_len)
+{
+	return __lws_vhost_find_mount(vh, uri, uri_len, 1);
+}
@@ -501,7 +501,7 @@ single:
 struct lws_vhost *
 lws_select_vhost(struct lws_context *context, int port, const char *servername)
 {
-	struct lws_vhost *vhost = context->vhost_list;
+	struct lws_vhost *vhost;
 	const char *p;
 	int n, colon;
 
@@ -513,35 +513,41 @@ lws_select_vhost(struct lws_context *context, int port, const char *servername)
 
 	/* Priotity 1: first try exact matches */
 
-	while (vhost) {
-		if (port == vhost->listen_port &&
-		    !strncmp(vhost->name, servername, (unsigned int)colon)) {
-			lwsl_info("SNI: Found: %s\n", servername);
-			return vhost;
-		}
-		vhost = vhost->vhost_next;
+	vhost = lws_vhost_by_name_len(context, servername, (size_t)colon, 0,
+				      port);
+	if (vhost) {
+		lwsl_info("SNI: Found: %s\n", servername);
+		return vhost;
 	}
 
 	/*
-	 * Priority 2: if no exact matches, try matching *.vhost-name
-	 * unintentional matches are possible but resolve to x.com for *.x.com
-	 * which is reasonable.  If exact match exists we already chose it and
-	 * never reach here.  SSL will still fail it if the cert doesn't allow
-	 * *.x.com.
+	 * Priority 2: if no exact matches, try wildcard matches on the parent
+	 * domains, most specific first.  For a.b.x.com, that's a vhost named
+	 * *.b.x.com, then one named b.x.com, then *.x.com, then x.com.
+	 *
+	 * Resolving a.x.com to a vhost named x.com is reasonable, if an exact
+	 * match exists we already chose it and never reach here.  SSL will
+	 * still fail it if the cert doesn't allow *.x.com.
 	 */
-	vhost = context->vhost_list;
-	while (vhost) {
-		int m = (int)strlen(vhost->name);
-		if (port && port == vhost->listen_port &&
-		    m <= (colon - 2) &&
-		    servername[colon - m - 1] == '.' &&
-		    !strncmp(vhost->name, servername + colon - m, (unsigned int)m)) {
-			lwsl_info("SNI: Found %s on wildcard: %s\n",
-				    servername, vhost->name);
-			return vhost;
+
+	if (port)
+		for (n = 1; n < colon - 1; n++) {
+			if (servername[n] != '.')
+				continue;
+
+			vhost = lws_vhost_by_name_len(context, servername + n,
+						      (size_t)(colon - n), 1,
+						      port);
+			if (!vhost)
+				vhost = lws_vhost_by_name_len(context,
+						servername + n + 1,
+						(size_t)(colon - n - 1), 0, port);
+			if (vhost) {
+				lwsl_info("SNI: Found %s on wildcard: %s\n",
+					  servername, vhost->name);
+				return vhost;
+			}
 		}
-		vhost = vhost->vhost_next;
-	}
 
 	/* Priority 3: match the first vhost on our port */
 
@@ -938,44 +944,27 @@ notfound:
 const struct lws_http_mount *
 lws_find_mount(struct lws *wsi, const char *uri_ptr, int uri_len)
 {
-	const struct lws_http_mount *hm, *hit = NULL;
-	int best = 0;
-
-	hm = wsi->a.vhost->http.mount_list;
-	while (hm) {
-		if (uri_len >= hm->mountpoint_len &&
-		    !strncmp(uri_ptr, hm->mountpoint, hm->mountpoint_len) &&
-		    (uri_ptr[hm->mountpoint_len] == '\0' ||
-		     uri_ptr[hm->mountpoint_len] == '/' ||
-		     hm->mountpoint_len == 1)
-		    ) {
-#if defined(LWS_WITH_SYS_METRICS)
-			lws_metrics_tag_wsi_add(wsi, "mnt", hm->mountpoint);
-#endif
+	const struct lws_http_mount *hit;
 
-			if (hm->origin_protocol == LWSMPRO_CALLBACK ||
-			    ((hm->origin_protocol == LWSMPRO_CGI ||
-			     lws_hdr_total_length(wsi, WSI_TOKEN_GET_URI) ||
-			     lws_hdr_total_length(wsi, WSI_TOKEN_POST_URI) ||
+	hit = __lws_vhost_find_mount(wsi->a.vhost, uri_ptr, uri_len,
+			lws_hdr_total_length(wsi, WSI_TOKEN_GET_URI) ||
+			lws_hdr_total_length(wsi, WSI_TOKEN_POST_URI) ||
 #if defined(LWS_WITH_HTTP_UNCOMMON_HEADERS)
-			     lws_hdr_total_length(wsi, WSI_TOKEN_PUT_URI) ||
-			     lws_hdr_total_length(wsi, WSI_TOKEN_PATCH_URI) ||
-			     lws_hdr_total_length(wsi, WSI_TOKEN_DELETE_URI) ||
+			lws_hdr_total_length(wsi, WSI_TOKEN_PUT_URI) ||
+			lws_hdr_total_length(wsi, WSI_TOKEN_PATCH_URI) ||
+			lws_hdr_total_length(wsi, WSI_TOKEN_DELETE_URI) ||
 #endif
-			     lws_hdr_total_length(wsi, WSI_TOKEN_HEAD_URI) ||
+			lws_hdr_total_length(wsi, WSI_TOKEN_HEAD_URI)
 #if defined(LWS_ROLE_H2)
-			     (wsi->mux_substream &&
-				lws_hdr_total_length(wsi,
-						WSI_TOKEN_HTTP_COLON_PATH)) ||
-#endif
-			     hm->protocol) &&
-			    hm->mountpoint_len > best)) {
-				best = hm->mountpoint_len;
-				hit = hm;
-			}
-		}
-		hm = hm->mount_next;
-	}
+			|| (wsi->mux_substream &&
+			    lws_hdr_total_length(wsi, WSI_TOKEN_HTTP_COLON_PATH))
+#endif
+			);
+
+#if defined(LWS_WITH_SYS_METRICS)
+	if (hit)
+		lws_metrics_tag_wsi_add(wsi, "mnt", hit->mountpoint);
+#endif
 
 	return hit;
 }
@@ -2426,7 +2415,8 @@ upgrade_h2c:
 		wsi->http.ah = ah;
 
 		if (!wsi->h2.h2n) {
-			wsi->h2.h2n = lws_zalloc(sizeof(*wsi->h2.h2n), "h2n");
+			wsi->h2.h2n = lws_freelist_zalloc(
+				&wsi->a.context->pt[(int)wsi->tsi].fl_h2n, "h2n");
 			if (!wsi->h2.h2n)
 				return 1;
 		}
@@ -2957,6 +2947,7 @@ lws_serve_http_file(struct lws *wsi, const char *file, const char *content_type,
 	}
 
 	wsi->http.filepos = 0;
+	wsi->http.no_sendfile = 0;
 	lwsi_set_state(wsi, LRS_ISSUING_FILE);
 
 	if (lws_hdr_total_length(wsi, WSI_TOKEN_HEAD_URI)) {
@@ -2981,6 +2972,47 @@ bail:
 
 #if defined(LWS_WITH_FILE_OPS)
 
+#if defined(LWS_HAVE_SENDFILE)
+/*
+ * Max we will ask the kernel to send in one go, so one big download doesn't
+ * starve everything else on the pt
+ */
+#define LWS_HTTP_SENDFILE_MAX (1024 * 1024)
+
+/*
+ * The kernel can copy the file content to the socket directly, if it goes out
+ * untransformed on an http/1.x connection from a platform fops file, and
+ * either there's no tls or the kernel is doing it (kTLS).  Otherwise we must
+ * read it through serv_buf.
+ */
+
+static int
+lws_http_can_sendfile(struct lws *wsi)
+{
+	if (wsi->http.no_sendfile || wsi->mux_substream || !lwsi_role_h1(wsi) ||
+	    wsi->sending_chunked || wsi->interpreting ||
+	    wsi->http.fop_fd->fops != &wsi->a.context->fops_platform)
+		return 0;
+
+#if defined(LWS_WITH_TLS)
+	/* unless the kernel is doing the tls for us */
+	if (wsi->tls.ssl && !wsi->tls.ktls_tx)
+		return 0;
+#endif
+#if defined(LWS_WITH_HTTP_STREAM_COMPRESSION)
+	if (wsi->http.lcs)
+		return 0;
+#endif
+#if defined(LWS_WITH_RANGES)
+	/* multipart ranges need boundaries sent between the parts */
+	if (wsi->http.range.count_ranges > 1)
+		return 0;
+#endif
+
+	return 1;
+}
+#endif
+
 int lws_serve_http_file_fragment(struct lws *wsi)
 {
 	struct lws_context *context = wsi->a.context;
@@ -3133,6 +3165,55 @@ int lws_serve_http_file_fragment(struct lws *wsi)
 				poss = wsi->http.range.budget;
 		}
 #endif
+
+#if defined(LWS_HAVE_SENDFILE)
+		if (lws_http_can_sendfile(wsi)) {
+			lws_filepos_t sf = wsi->http.filelen - wsi->http.filepos;
+
+#if defined(LWS_WITH_RANGES)
+			if (wsi->http.range.count_ranges &&
+			    sf > wsi->http.range.budget)
+				sf = wsi->http.range.budget;
+#endif
+			if (wsi->http.tx_content_length &&
+			    sf > wsi->http.tx_content_remain)
+				sf = wsi->http.tx_content_remain;
+			if (wsi->a.protocol->tx_packet_size &&
+			    sf > wsi->a.protocol->tx_packet_size)
+				sf = wsi->a.protocol->tx_packet_size;
+			if (sf > LWS_HTTP_SENDFILE_MAX)
+				sf = LWS_HTTP_SENDFILE_MAX;
+
+			m = lws_plat_file_sendfile(wsi, wsi->http.fop_fd, sf,
+						   &amount);
+			if (m < 0)
+				goto file_had_it;
+
+			if (!m) {
+				if (!amount)
+					/* socket is full, wait for POLLOUT */
+					break;
+
+				lws_set_timeout(wsi, PENDING_TIMEOUT_HTTP_CONTENT,
+						(int)context->timeout_secs);
+#ifdef LWS_WITH_ACCESS_LOG
+				wsi->http.access_log.sent += amount;
+#endif
+#if defined(LWS_WITH_SYS_METRICS)
+				if (wsi->a.vhost)
+					lws_metric_event(wsi->a.vhost->mt_traffic_tx,
+							 METRES_GO, (u_mt_t)amount);
+#endif
+				/* the kernel sent it all, nothing to adjust */
+				n = m = (int)amount;
+				goto sent;
+			}
+
+			/* fall back to read + write for the rest of this file */
+			wsi->http.no_sendfile = 1;
+		}
+#endif
+
 		if (wsi->sending_chunked) {
 			/* we need to drop the chunk size in here */
 			p += 10;
@@ -3189,6 +3270,9 @@ int lws_serve_http_file_fragment(struct lws *wsi)
 			if (m < 0)
 				goto file_had_it;
 
+#if defined(LWS_HAVE_SENDFILE)
+sent:
+#endif
 			wsi->http.filepos += amount;
 
 #if defined(LWS_WITH_RANGES)
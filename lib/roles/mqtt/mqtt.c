@@ -2090,7 +2090,7 @@ do_write:
 		 * we must RETRY the publish
 		 */
 		wsi->mqtt->sul_qos_puback_pubrec_wait.cb = lws_mqtt_publish_resend;
-		__lws_sul_insert_us(&pt->pt_sul_owner[wsi->conn_validity_wakesuspend],
+		__lws_sul_insert_us(pt, wsi->conn_validity_wakesuspend,
 				    &wsi->mqtt->sul_qos_puback_pubrec_wait,
 				    3 * LWS_USEC_PER_SEC);
 	}
@@ -2430,7 +2430,7 @@ lws_mqtt_client_send_unsubcribe(struct lws *wsi,
 	wsi->mqtt->inside_unsubscribe = 1;
 
 	wsi->mqtt->sul_unsuback_wait.cb = lws_mqtt_unsuback_timeout;
-	__lws_sul_insert_us(&pt->pt_sul_owner[wsi->conn_validity_wakesuspend],
+	__lws_sul_insert_us(pt, wsi->conn_validity_wakesuspend,
 			    &wsi->mqtt->sul_unsuback_wait,
 			    3 * LWS_USEC_PER_SEC);
 
@@ -2475,7 +2475,7 @@ bail1:
 		lws_free_set_NULL(wsi->user_space);
 
 	wsi->a.protocol->callback(wsi, LWS_CALLBACK_WSI_DESTROY, NULL, NULL, 0);
-	lws_free(wsi);
+	lws_wsi_free_mem(wsi);
 
 	return NULL;
 }
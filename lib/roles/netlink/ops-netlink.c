@@ -593,7 +593,7 @@ bail2:
 	__lws_lc_untag(wsi->a.context, &wsi->lc);
 	compatible_close(wsi->desc.sockfd);
 bail1:
-	lws_free(wsi);
+	lws_wsi_free_mem(wsi);
 bail:
 	return ret;
 }
@@ -0,0 +1,415 @@
+/*
+ * libwebsockets - small server side websockets and web server implementation
+ *
+ * Copyright (C) 2010 - 2021 Andy Green <andy@warmcat.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+
+#include <private-lib-core.h>
+
+/*
+ * Shared, preframed ws messages queued on many connections, see
+ * lws-ws-bcast.h
+ */
+
+static void
+lws_ws_bcast_ref(struct lws_ws_bcast *bc, int delta)
+{
+	int n;
+
+#if LWS_MAX_SMP > 1
+	pthread_mutex_lock(&bc->lock);
+#endif
+	bc->refcount += delta;
+	n = bc->refcount;
+#if LWS_MAX_SMP > 1
+	pthread_mutex_unlock(&bc->lock);
+#endif
+
+	assert(n >= 0);
+	if (n)
+		return;
+
+#if LWS_MAX_SMP > 1
+	pthread_mutex_destroy(&bc->lock);
+#endif
+	lws_free(bc);
+}
+
+struct lws_ws_bcast *
+lws_ws_bcast_create(const void *payload, size_t len, int binary)
+{
+	struct lws_ws_bcast *bc;
+	uint8_t *p;
+
+	bc = lws_malloc(sizeof(*bc) + LWS_PRE + len, __func__);
+	if (!bc)
+		return NULL;
+
+	memset(bc, 0, sizeof(*bc));
+#if LWS_MAX_SMP > 1
+	pthread_mutex_init(&bc->lock, NULL);
+#endif
+	bc->refcount = 1;
+	bc->len = len;
+	bc->wp = binary ? LWS_WRITE_BINARY : LWS_WRITE_TEXT;
+
+	p = lws_ws_bcast_payload(bc);
+	if (len)
+		memcpy(p, payload, len);
+
+	/* a complete, unmasked server frame */
+
+	if (len < 126) {
+		bc->hdr_len = 2;
+		p[-1] = (uint8_t)len;
+	} else if (len < 65536) {
+		bc->hdr_len = 4;
+		p[-3] = 126;
+		lws_ser_wu16be(p - 2, (uint16_t)len);
+	} else {
+		bc->hdr_len = 10;
+		p[-9] = 127;
+		lws_ser_wu64be(p - 8, (uint64_t)len);
+	}
+
+	p[-bc->hdr_len] = (uint8_t)(0x80 | (binary ? LWSWSOPC_BINARY_FRAME :
+						     LWSWSOPC_TEXT_FRAME));
+
+	return bc;
+}
+
+void
+lws_ws_bcast_unref(struct lws_ws_bcast *bc)
+{
+	lws_ws_bcast_ref(bc, -1);
+}
+
+/*
+ * Server connections without extensions can be sent the shared frame as it
+ * is.  Clients must mask it, and ws-over-h2 and extensions need to process
+ * each frame, so those have to go through lws_write() on a copy.
+ */
+
+static int
+lws_ws_bcast_can_share(struct lws *wsi)
+{
+	return !lwsi_role_client(wsi) && !wsi->mux_substream
+#if !defined(LWS_WITHOUT_EXTENSIONS)
+		&& !wsi->ws->count_act_ext
+#endif
+		;
+}
+
+/* ask for POLLOUT without it looking like the user asked for WRITEABLE */
+
+void
+lws_ws_bcast_req_pollout(struct lws *wsi)
+{
+	wsi->ws->bcast_pollout = 1;
+	lws_callback_on_writable(wsi);
+	wsi->ws->bcast_pollout = 0;
+}
+
+/* caller must have taken a ref on bc for this connection */
+
+static int
+lws_ws_bcast_enqueue(struct lws *wsi, struct lws_ws_bcast *bc,
+		     unsigned int max_pending, int flags)
+{
+	struct lws_context_per_thread *pt = &wsi->a.context->pt[(int)wsi->tsi];
+	struct _lws_websocket_related *ws = wsi->ws;
+	struct lws_ws_bcast **q;
+	uint32_t na, m;
+	int ret = 0;
+
+	if (!lwsi_role_ws(wsi) || !ws || lwsi_state(wsi) != LRS_ESTABLISHED ||
+	    wsi->socket_is_permanently_unusable)
+		return -1;
+
+	if (!max_pending)
+		max_pending = 1;
+
+	lws_pt_lock(pt, __func__);
+
+	if (ws->bcq_count >= max_pending) {
+		ret = 1;
+		goto bail;
+	}
+
+	if (ws->bcq_count == ws->bcq_size) {
+		/* grow the ring, unwrapping it into the new allocation */
+		na = ws->bcq_size ? ws->bcq_size * 2 : 8;
+		if (na > max_pending)
+			na = max_pending;
+
+		q = lws_malloc(na * sizeof(*q), __func__);
+		if (!q) {
+			ret = -1;
+			goto bail;
+		}
+
+		for (m = 0; m < ws->bcq_count; m++)
+			q[m] = ws->bcq[(ws->bcq_head + m) % ws->bcq_size];
+
+		lws_free(ws->bcq);
+		ws->bcq = q;
+		ws->bcq_head = 0;
+		ws->bcq_size = na;
+	}
+
+	ws->bcq[(ws->bcq_head + ws->bcq_count) % ws->bcq_size] = bc;
+	if (!ws->bcq_count++)
+		lws_ws_bcast_req_pollout(wsi);
+
+bail:
+	lws_pt_unlock(pt);
+
+	if (ret == 1) {
+		lwsl_wsi_info(wsi, "lagging, %u pending", ws->bcq_count);
+		if (flags & LWSBCF_CLOSE_SLOW)
+			lws_set_timeout(wsi, PENDING_TIMEOUT_LAGGING,
+					LWS_TO_KILL_ASYNC);
+	}
+
+	return ret;
+}
+
+int
+lws_ws_bcast_queue(struct lws *wsi, struct lws_ws_bcast *bc,
+		   unsigned int max_pending, int flags)
+{
+	int n;
+
+	lws_ws_bcast_ref(bc, 1);
+	n = lws_ws_bcast_enqueue(wsi, bc, max_pending, flags);
+	if (n)
+		lws_ws_bcast_unref(bc);
+
+	return n;
+}
+
+int
+lws_ws_bcast_queue_vhost_protocol(struct lws_vhost *vh,
+				  const struct lws_protocols *protocol,
+				  struct lws_ws_bcast *bc,
+				  unsigned int max_pending, int flags)
+{
+	uint32_t held, queued = 0;
+	struct lws *wsi;
+	int n;
+
+	if (protocol < vh->protocols ||
+	    protocol >= (vh->protocols + vh->count_protocols)) {
+		lwsl_vhost_err(vh, "protocol %p is not from vhost", protocol);
+
+		return -1;
+	}
+
+	n = (int)(protocol - vh->protocols);
+
+	/*
+	 * Take the refs for everyone at once up front, so connections on other
+	 * service threads sending and releasing it can't take the count to
+	 * zero before we finished, and give back any we didn't use after
+	 */
+
+	held = vh->same_vh_protocol_owner[n].count;
+	if (!held)
+		return 0;
+
+	lws_ws_bcast_ref(bc, (int)held);
+
+	lws_start_foreach_dll_safe(struct lws_dll2 *, d, d1,
+			lws_dll2_get_head(&vh->same_vh_protocol_owner[n])) {
+		wsi = lws_container_of(d, struct lws, same_vh_protocol);
+
+		if (queued == held)
+			break;
+
+		if (!lws_ws_bcast_enqueue(wsi, bc, max_pending, flags))
+			queued++;
+
+	} lws_end_foreach_dll_safe(d, d1);
+
+	if (queued != held)
+		lws_ws_bcast_ref(bc, -(int)(held - queued));
+
+	return (int)queued;
+}
+
+static struct lws_ws_bcast *
+lws_ws_bcast_pop(struct lws *wsi)
+{
+	struct lws_context_per_thread *pt = &wsi->a.context->pt[(int)wsi->tsi];
+	struct _lws_websocket_related *ws = wsi->ws;
+	struct lws_ws_bcast *bc = NULL;
+
+	lws_pt_lock(pt, __func__);
+	if (ws->bcq_count) {
+		bc = ws->bcq[ws->bcq_head];
+		ws->bcq_head = (ws->bcq_head + 1) % ws->bcq_size;
+		ws->bcq_count--;
+	}
+	lws_pt_unlock(pt);
+
+	return bc;
+}
+
+static int
+lws_ws_bcast_write_copy(struct lws *wsi, struct lws_ws_bcast *bc)
+{
+	struct lws_context_per_thread *pt = &wsi->a.context->pt[(int)wsi->tsi];
+	uint8_t *p = pt->serv_buf, *heap = NULL;
+	int n;
+
+	if (bc->len > wsi->a.context->pt_serv_buf_size - LWS_PRE) {
+		heap = lws_malloc(LWS_PRE + bc->len, __func__);
+		if (!heap)
+			return -1;
+		p = heap;
+	}
+
+	memcpy(p + LWS_PRE, lws_ws_bcast_payload(bc), bc->len);
+	n = lws_write(wsi, p + LWS_PRE, bc->len,
+		      (enum lws_write_protocol)bc->wp);
+	lws_free(heap);
+
+	return n < (int)bc->len ? -1 : 0;
+}
+
+/*
+ * Send what we can of the queue, returns -1 for fatal, 0 if the queue is
+ * empty or 1 if there's more waiting
+ */
+
+int
+lws_ws_bcast_drain(struct lws *wsi)
+{
+	int share = lws_ws_bcast_can_share(wsi), ret = 0;
+	struct lws_ws_bcast *bc;
+	size_t flen;
+	uint8_t *p;
+	int m;
+
+	while ((bc = lws_ws_bcast_pop(wsi))) {
+
+		if (!share) {
+			/* one lws_write() per writeable */
+			m = lws_ws_bcast_write_copy(wsi, bc);
+			lws_ws_bcast_unref(bc);
+			if (m)
+				return -1;
+			break;
+		}
+
+		p = lws_ws_bcast_payload(bc) - bc->hdr_len;
+		flen = bc->len + bc->hdr_len;
+
+		m = lws_ssl_capable_write(wsi, p, flen);
+		wsi->could_have_pending = 1;
+		if (m == LWS_SSL_CAPABLE_ERROR) {
+			lws_ws_bcast_unref(bc);
+			wsi->socket_is_permanently_unusable = 1;
+
+			return -1;
+		}
+		if (m < 0) /* LWS_SSL_CAPABLE_MORE_SERVICE */
+			m = 0;
+
+		if ((size_t)m != flen) {
+			/*
+			 * Only now do we have to copy it, the remainder goes on
+			 * buflist_out which is always sent first when we're
+			 * writeable again, so everything stays in order
+			 */
+			m = lws_buflist_append_segment(&wsi->buflist_out,
+						       p + m, flen - (size_t)m);
+			lws_ws_bcast_unref(bc);
+			if (m < 0)
+				return -1;
+			break;
+		}
+
+		lws_ws_bcast_unref(bc);
+	}
+
+	if (wsi->ws->bcq_count || lws_has_buffered_out(wsi)) {
+		lws_ws_bcast_req_pollout(wsi);
+		ret = 1;
+	}
+
+	return ret;
+}
+
+/*
+ * Called from the ws role POLLOUT handling when it would otherwise go on to
+ * the user WRITEABLE callback, returns the LWS_HP_RET_ code to use
+ */
+
+int
+lws_ws_bcast_pollout(struct lws *wsi)
+{
+	struct _lws_websocket_related *ws = wsi->ws;
+	int n;
+
+	/*
+	 * If the user is in the middle of sending a fragmented message, we
+	 * must let them finish it first, we'll be back when they send FIN
+	 */
+
+	if (!ws->bcq_count || ws->tx_mid_message) {
+		ws->user_pollout = 0;
+		return LWS_HP_RET_USER_SERVICE;
+	}
+
+	n = lws_ws_bcast_drain(wsi);
+	if (n < 0)
+		return LWS_HP_RET_BAIL_DIE;
+	if (n)
+		return LWS_HP_RET_BAIL_OK;
+
+	if (!ws->user_pollout)
+		/* nobody else asked to be writeable */
+		return LWS_HP_RET_DROP_POLLOUT;
+
+	ws->user_pollout = 0;
+
+	return LWS_HP_RET_USER_SERVICE;
+}
+
+/* the connection is closing, drop anything still queued */
+
+void
+lws_ws_bcast_flush(struct lws *wsi)
+{
+	struct lws_ws_bcast *bc;
+
+	if (!wsi->ws)
+		return;
+
+	while ((bc = lws_ws_bcast_pop(wsi)))
+		lws_ws_bcast_unref(bc);
+
+	lws_free_set_NULL(wsi->ws->bcq);
+	wsi->ws->bcq_size = 0;
+	wsi->ws->bcq_head = 0;
+}
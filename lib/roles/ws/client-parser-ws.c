@@ -320,6 +320,7 @@ int lws_ws_client_rx_sm(struct lws *wsi, unsigned char c)
 		wsi->ws->mask[3] = c;
 		if (c)
 			wsi->ws->all_zero_nonce = 0;
+		wsi->ws->mask_idx = 0;
 
 		if (wsi->ws->rx_packet_length)
 			wsi->lws_rx_parse_state =
@@ -332,11 +333,12 @@ int lws_ws_client_rx_sm(struct lws *wsi, unsigned char c)
 
 	case LWS_RXPS_WS_FRAME_PAYLOAD:
 
-		assert(wsi->ws->rx_ubuf);
 #if !defined(LWS_WITHOUT_EXTENSIONS)
 		if (wsi->ws->rx_draining_ext)
 			goto drain_extension;
 #endif
+		if (!wsi->ws->rx_ubuf && lws_ws_rx_buf_get(wsi))
+			return -1;
 		if (wsi->ws->this_frame_masked && !wsi->ws->all_zero_nonce)
 			c ^= wsi->ws->mask[(wsi->ws->mask_idx++) & 3];
 
@@ -373,6 +375,10 @@ spill:
 
 		handled = 0;
 
+		/* even empty frames are passed on as being in rx_ubuf */
+		if (!wsi->ws->rx_ubuf && lws_ws_rx_buf_get(wsi))
+			return -1;
+
 		/*
 		 * is this frame a control packet we should take care of at this
 		 * layer?  If so service it and hide it from the user callback
@@ -663,6 +669,7 @@ utf8_fail:
 
 already_done:
 		wsi->ws->rx_ubuf_head = 0;
+		lws_ws_rx_buf_idle(wsi);
 		break;
 	default:
 		lwsl_wsi_err(wsi, "client rx illegal state");
@@ -49,7 +49,8 @@ lws_create_client_ws_object(const struct lws_client_connect_info *i,
 	int v = SPEC_LATEST_SUPPORTED;
 
 	/* allocate the ws struct for the wsi */
-	wsi->ws = lws_zalloc(sizeof(*wsi->ws), "client ws struct");
+	wsi->ws = lws_freelist_zalloc(&wsi->a.context->pt[(int)wsi->tsi].fl_ws,
+				      "client ws struct");
 	if (!wsi->ws) {
 		lwsl_wsi_notice(wsi, "OOM");
 		return 1;
@@ -66,10 +67,145 @@ lws_create_client_ws_object(const struct lws_client_connect_info *i,
 }
 
 #if defined(LWS_WITH_CLIENT)
+/*
+ * Once we are in LWS_RXPS_WS_FRAME_PAYLOAD, we know how much payload to
+ * expect and can collect all but the last byte of the run that would next
+ * make the parser spill (end of frame, end of input or full rx_ubuf) in
+ * one go, unmasking it a word at a time.  The last byte is left for
+ * lws_ws_client_rx_sm(), so it still makes all the spill decisions.
+ *
+ * Returns how much of the input it used.
+ */
+
+static size_t
+lws_ws_client_rx_payload_bulk(struct lws *wsi, unsigned char **buf,
+			      size_t len)
+{
+	size_t avail = wsi->a.protocol->rx_buffer_size ?
+			wsi->a.protocol->rx_buffer_size :
+			wsi->a.context->pt_serv_buf_size;
+	uint8_t *p;
+
+	if (wsi->ws->rx_ubuf_head >= avail ||
+	    avail + LWS_PRE > wsi->ws->rx_ubuf_alloc)
+		return 0;
+
+	avail -= wsi->ws->rx_ubuf_head;
+	if (avail > wsi->ws->rx_packet_length)
+		avail = wsi->ws->rx_packet_length;
+	if (avail > len)
+		avail = len;
+	if (avail < 2)
+		return 0;
+
+	avail--;
+	if (!wsi->ws->rx_ubuf && lws_ws_rx_buf_get(wsi))
+		return 0; /* the parser will fail on it too */
+	p = &wsi->ws->rx_ubuf[LWS_PRE + wsi->ws->rx_ubuf_head];
+	memcpy(p, *buf, avail);
+	if (wsi->ws->this_frame_masked && !wsi->ws->all_zero_nonce)
+		lws_ws_mask_buf(p, avail, wsi->ws->mask, &wsi->ws->mask_idx);
+
+	wsi->ws->rx_ubuf_head += (uint32_t)avail;
+	wsi->ws->rx_packet_length -= avail;
+	*buf += avail;
+
+	return avail;
+}
+
+/*
+ * For data frames with no extension active, where nothing is already
+ * collected in rx_ubuf, we can pass the payload to the user callback
+ * directly from the read buffer without copying it.
+ *
+ * CLIENT_RECEIVE has always seen the payload NUL-terminated, we keep that by
+ * borrowing the next byte in the buffer for the duration of the callback,
+ * so this is only done when the payload is followed by more input.
+ *
+ * Returns how much of the input it used, 0 if it can't help or -1 if the
+ * connection must be closed.
+ */
+
+static int
+lws_ws_client_frame_rest_is_payload(struct lws *wsi, unsigned char **buf,
+				    size_t len)
+{
+	size_t avail = wsi->a.protocol->rx_buffer_size ?
+			wsi->a.protocol->rx_buffer_size :
+			wsi->a.context->pt_serv_buf_size;
+	uint8_t *p = *buf, borrowed;
+	int m = 0;
+
+	if ((wsi->ws->opcode != LWSWSOPC_TEXT_FRAME &&
+	     wsi->ws->opcode != LWSWSOPC_BINARY_FRAME &&
+	     wsi->ws->opcode != LWSWSOPC_CONTINUATION) ||
+#if !defined(LWS_WITHOUT_EXTENSIONS)
+	    wsi->ws->count_act_ext || wsi->ws->rx_draining_ext ||
+#endif
+	    wsi->ws->rx_ubuf_head)
+		return 0;
+
+	if (avail > wsi->ws->rx_packet_length)
+		avail = wsi->ws->rx_packet_length;
+	if (avail >= len)
+		/* no following byte to borrow for the NUL */
+		return 0;
+
+	if (wsi->ws->this_frame_masked && !wsi->ws->all_zero_nonce)
+		lws_ws_mask_buf(p, avail, wsi->ws->mask, &wsi->ws->mask_idx);
+
+	*buf += avail;
+	wsi->ws->rx_packet_length -= avail;
+	if (!wsi->ws->rx_packet_length)
+		wsi->lws_rx_parse_state = LWS_RXPS_NEW;
+
+	if (wsi->ws->check_utf8 && !wsi->ws->defeat_check_utf8) {
+		if (lws_check_utf8(&wsi->ws->utf8, p, avail)) {
+			lws_close_reason(wsi, LWS_CLOSE_STATUS_INVALID_PAYLOAD,
+					 (uint8_t *)"bad utf8", 8);
+			goto utf8_fail;
+		}
+
+		/* we are ending partway through utf-8 character? */
+		if (!wsi->ws->rx_packet_length && wsi->ws->final &&
+		    wsi->ws->utf8) {
+			lwsl_wsi_info(wsi, "FINAL utf8 error");
+			lws_close_reason(wsi, LWS_CLOSE_STATUS_INVALID_PAYLOAD,
+					 (uint8_t *)"partial utf8", 12);
+utf8_fail:
+			lwsl_wsi_info(wsi, "utf8 error");
+			lwsl_hexdump_wsi_info(wsi, p, avail);
+
+			return -1;
+		}
+	}
+
+	if (!wsi->a.protocol->callback ||
+	    lwsi_state(wsi) == LRS_RETURNED_CLOSE ||
+	    lwsi_state(wsi) == LRS_WAITING_TO_SEND_CLOSE ||
+	    lwsi_state(wsi) == LRS_AWAITING_CLOSE_ACK)
+		return (int)avail;
+
+	borrowed = p[avail];
+	p[avail] = '\0';
+	m = wsi->a.protocol->callback(wsi, LWS_CALLBACK_CLIENT_RECEIVE,
+				      wsi->user_space, p, avail);
+	p[avail] = borrowed;
+
+	wsi->ws->first_fragment = 0;
+
+	/* if user code wants to close, let caller know */
+	if (m)
+		return -1;
+
+	return (int)avail;
+}
+
 int
 lws_ws_handshake_client(struct lws *wsi, unsigned char **buf, size_t len)
 {
 	unsigned char *bufin = *buf;
+	int m;
 
 	if ((lwsi_state(wsi) != LRS_WAITING_PROXY_REPLY) &&
 	    (lwsi_state(wsi) != LRS_H1C_ISSUE_HANDSHAKE) &&
@@ -112,8 +248,6 @@ lws_ws_handshake_client(struct lws *wsi, unsigned char **buf, size_t len)
 		}
 #if !defined(LWS_WITHOUT_EXTENSIONS)
 		if (wsi->ws->rx_draining_ext) {
-			int m;
-
 			lwsl_wsi_info(wsi, "draining ext");
 			if (lwsi_role_client(wsi))
 				m = lws_ws_client_rx_sm(wsi, 0);
@@ -129,6 +263,28 @@ lws_ws_handshake_client(struct lws *wsi, unsigned char **buf, size_t len)
 		 * happened to *buf
 		 */
 
+		/* decode the rest of the frame header in one go if it's all here */
+		if (wsi->lws_rx_parse_state == LWS_RXPS_04_FRAME_HDR_LEN) {
+			m = lws_ws_frame_hdr_len_bulk(wsi, *buf, len);
+			if (m) {
+				*buf += m;
+				len -= (size_t)m;
+				continue;
+			}
+		}
+
+		if (wsi->lws_rx_parse_state == LWS_RXPS_WS_FRAME_PAYLOAD) {
+			m = lws_ws_client_frame_rest_is_payload(wsi, buf, len);
+			if (m < 0)
+				return -1;
+			if (m) {
+				len -= (size_t)m;
+				continue;
+			}
+
+			len -= lws_ws_client_rx_payload_bulk(wsi, buf, len);
+		}
+
 		if (lws_ws_client_rx_sm(wsi, *(*buf)++)) {
 			lwsl_wsi_info(wsi, "client_rx_sm exited, DROPPING %d",
 				      (int)len);
@@ -633,12 +789,14 @@ check_accept:
 	/*
 	 * create the frame buffer for this connection according to the
 	 * size mentioned in the protocol definition.  If 0 there, then
-	 * use a big default for compatibility
+	 * use a big default for compatibility.  With the rx pool, it's only
+	 * borrowed when the parser needs it.
 	 */
 	n = (int)wsi->a.protocol->rx_buffer_size;
 	if (!n)
 		n = (int)context->pt_serv_buf_size;
 	n += LWS_PRE;
+#if !defined(LWS_WITH_WS_RX_POOL)
 	wsi->ws->rx_ubuf = lws_malloc((unsigned int)n + 4 /* 0x0000ffff zlib */,
 				"client frame buffer");
 	if (!wsi->ws->rx_ubuf) {
@@ -646,6 +804,7 @@ check_accept:
 		*cce = "HS: OOM";
 		goto bail2;
 	}
+#endif
 	wsi->ws->rx_ubuf_alloc = (unsigned int)n;
 
 	lwsl_wsi_debug(wsi, "handshake OK for protocol %s", wsi->a.protocol->name);
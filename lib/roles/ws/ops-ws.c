@@ -384,13 +384,13 @@ handle_first:
 
 
 	case LWS_RXPS_WS_FRAME_PAYLOAD:
-		assert(wsi->ws->rx_ubuf);
-
 		if (wsi->ws->rx_ubuf_head + LWS_PRE >= wsi->ws->rx_ubuf_alloc) {
 			lwsl_err("Attempted overflow \n");
 			return -1;
 		}
 		if (!(already_processed & ALREADY_PROCESSED_IGNORE_CHAR)) {
+			if (!wsi->ws->rx_ubuf && lws_ws_rx_buf_get(wsi))
+				return -1;
 			if (wsi->ws->all_zero_nonce)
 				wsi->ws->rx_ubuf[LWS_PRE +
 				                 (wsi->ws->rx_ubuf_head++)] = c;
@@ -436,6 +436,10 @@ spill:
 
 		lwsl_parser("spill on %s\n", wsi->a.protocol->name);
 
+		/* even empty frames are passed on as being in rx_ubuf */
+		if (!wsi->ws->rx_ubuf && lws_ws_rx_buf_get(wsi))
+			return -1;
+
 		switch (wsi->ws->opcode) {
 		case LWSWSOPC_CLOSE:
 
@@ -539,6 +543,7 @@ process_as_ping:
 			lws_callback_on_writable(wsi);
 ping_drop:
 			wsi->ws->rx_ubuf_head = 0;
+			lws_ws_rx_buf_idle(wsi);
 			return 0;
 
 		case LWSWSOPC_PONG:
@@ -735,6 +740,7 @@ utf8_fail:
 
 already_done:
 		wsi->ws->rx_ubuf_head = 0;
+		lws_ws_rx_buf_idle(wsi);
 		break;
 	}
 
@@ -803,6 +809,133 @@ lws_remove_wsi_from_draining_ext_list(struct lws *wsi)
 #endif
 }
 
+/*
+ * XOR len bytes at p in place with the 4-byte ws mask, starting at mask
+ * phase *mask_idx, and leave *mask_idx at the phase for the next byte.
+ *
+ * After lining up p, the body goes a machine word at a time with the mask
+ * replicated (and rotated to the current phase) across the word.  The
+ * word width is a multiple of 4, so the phase is the same at the end of
+ * every word.  Loads and stores go via memcpy() so there are no alignment
+ * or aliasing issues, the compiler turns them into plain word moves and
+ * is free to vectorize the loop further.
+ */
+
+void
+lws_ws_mask_buf(uint8_t *p, size_t len, const uint8_t *mask,
+		uint8_t *mask_idx)
+{
+	unsigned int idx = *mask_idx;
+	uint8_t rot[sizeof(size_t)];
+	size_t w, m, n;
+
+	/* bytewise until p is word-aligned */
+
+	while (len && ((uintptr_t)p & (sizeof(size_t) - 1))) {
+		*p++ ^= mask[idx++ & 3];
+		len--;
+	}
+
+	if (len >= sizeof(size_t)) {
+		for (n = 0; n < sizeof(size_t); n++)
+			rot[n] = mask[(idx + n) & 3];
+		memcpy(&m, rot, sizeof(m));
+
+		n = len / sizeof(size_t);
+		len -= n * sizeof(size_t);
+		while (n--) {
+			memcpy(&w, p, sizeof(w));
+			w ^= m;
+			memcpy(p, &w, sizeof(w));
+			p += sizeof(w);
+		}
+	}
+
+	/* and the remaining bytes bytewise */
+
+	while (len--)
+		*p++ ^= mask[idx++ & 3];
+
+	*mask_idx = (uint8_t)(idx & 3);
+}
+
+/*
+ * The rx parsers arrive at LWS_RXPS_04_FRAME_HDR_LEN after the first header
+ * byte.  If the rest of the header, ie, the length and any mask key, is
+ * all in the buffer at p, decode it in one step and move the parser on to
+ * LWS_RXPS_WS_FRAME_PAYLOAD.
+ *
+ * Anything unusual (a split header, a zero length payload that needs to be
+ * spilled, or an illegal length the parser has to reject) is left to the
+ * byte state machine, signalled by returning 0.  Otherwise returns the
+ * number of header bytes used.
+ */
+
+int
+lws_ws_frame_hdr_len_bulk(struct lws *wsi, const uint8_t *p, size_t len)
+{
+	size_t plen, hl = 1;
+	int n;
+
+	if (!len)
+		return 0;
+
+	switch (p[0] & 0x7f) {
+	case 126:
+		hl += 2;
+		break;
+	case 127:
+		hl += 8;
+		break;
+	}
+	if (p[0] & 0x80)
+		hl += 4;
+
+	if (len < hl)
+		/* the header is split, let the state machine collect it */
+		return 0;
+
+	switch (p[0] & 0x7f) {
+	case 126:
+		if (wsi->ws->opcode & 8)
+			return 0;
+		plen = (size_t)((p[1] << 8) | p[2]);
+		break;
+	case 127:
+		if ((wsi->ws->opcode & 8) || (p[1] & 0x80))
+			return 0;
+		plen = 0;
+		for (n = 1; n < 9; n++) {
+#if !defined __LP64__
+			if (n < 5)
+				continue;
+#endif
+			plen = (plen << 8) | p[n];
+		}
+		break;
+	default:
+		plen = p[0] & 0x7f;
+		break;
+	}
+
+	if (!plen)
+		return 0;
+
+	wsi->ws->rx_packet_length = plen;
+	wsi->ws->this_frame_masked = !!(p[0] & 0x80);
+	if (wsi->ws->this_frame_masked) {
+		memcpy(wsi->ws->mask, p + hl - 4, 4);
+		if (wsi->ws->mask[0] | wsi->ws->mask[1] |
+		    wsi->ws->mask[2] | wsi->ws->mask[3])
+			wsi->ws->all_zero_nonce = 0;
+		wsi->ws->mask_idx = 0;
+	}
+
+	wsi->lws_rx_parse_state = LWS_RXPS_WS_FRAME_PAYLOAD;
+
+	return (int)hl;
+}
+
 static int
 lws_0405_frame_mask_generate(struct lws *wsi)
 {
@@ -832,18 +965,21 @@ lws_server_init_wsi_for_ws(struct lws *wsi)
 	/*
 	 * create the frame buffer for this connection according to the
 	 * size mentioned in the protocol definition.  If 0 there, use
-	 * a big default for compatibility
+	 * a big default for compatibility.  With the rx pool, it's only
+	 * borrowed when the parser needs it.
 	 */
 
 	n = (int)wsi->a.protocol->rx_buffer_size;
 	if (!n)
 		n = (int)wsi->a.context->pt_serv_buf_size;
 	n += LWS_PRE;
+#if !defined(LWS_WITH_WS_RX_POOL)
 	wsi->ws->rx_ubuf = lws_malloc((unsigned int)n + 4 /* 0x0000ffff zlib */, "rx_ubuf");
 	if (!wsi->ws->rx_ubuf) {
 		lwsl_err("Out of Mem allocating rx buffer %d\n", n);
 		return 1;
 	}
+#endif
 	wsi->ws->rx_ubuf_alloc = (uint32_t)n;
 
 	/* notify user code that we're ready to roll */
@@ -1369,7 +1505,7 @@ int rops_handle_POLLOUT_ws(struct lws *wsi)
 	 */
 	if (!wsi->ws->extension_data_pending && !wsi->ws->tx_draining_ext) {
 		lwsl_ext("%s: !wsi->ws->extension_data_pending\n", __func__);
-		return LWS_HP_RET_USER_SERVICE;
+		return lws_ws_bcast_pollout(wsi);
 	}
 
 	/*
@@ -1460,7 +1596,9 @@ int rops_handle_POLLOUT_ws(struct lws *wsi)
 	wsi->ws->extension_data_pending = 0;
 #endif
 
-	return LWS_HP_RET_USER_SERVICE;
+	/* Priority 7: broadcasts queued on us, then the user callback */
+
+	return lws_ws_bcast_pollout(wsi);
 }
 
 static int
@@ -1563,7 +1701,12 @@ rops_close_role_ws(struct lws_context_per_thread *pt, struct lws *wsi)
 		wsi->ws->tx_draining_ext_list = NULL;
 	}
 #endif
+#if defined(LWS_WITH_WS_RX_POOL)
+	lws_ws_rx_buf_put(wsi);
+#else
 	lws_free_set_NULL(wsi->ws->rx_ubuf);
+#endif
+	lws_ws_bcast_flush(wsi);
 
 	wsi->ws->pong_payload_len = 0;
 	wsi->ws->pong_pending_flag = 0;
@@ -1788,6 +1931,14 @@ rops_write_role_protocol_ws(struct lws *wsi, unsigned char *buf, size_t len,
 		if (!((*wp) & LWS_WRITE_NO_FIN))
 			n |= 1 << 7;
 
+		if ((n & 0xf) < LWSWSOPC_CLOSE) {
+			/* data frames: queued broadcasts must wait for FIN */
+			wsi->ws->tx_mid_message = !(n & (1 << 7));
+			if (!wsi->ws->tx_mid_message && wsi->ws->bcq_count)
+				/* just for the queue, not a user WRITEABLE */
+				lws_ws_bcast_req_pollout(wsi);
+		}
+
 		if (len < 126) {
 			pre += 2;
 			buf[-pre] = (uint8_t)n;
@@ -1841,9 +1992,8 @@ do_more_inside_frame:
 		 * in v7, just mask the payload
 		 */
 		if (dropmask) { /* never set if already inside frame */
-			for (n = 4; n < (int)len + 4; n++)
-				dropmask[n] = dropmask[n] ^ wsi->ws->mask[
-					(wsi->ws->mask_idx++) & 3];
+			lws_ws_mask_buf(dropmask + 4, len, wsi->ws->mask,
+					&wsi->ws->mask_idx);
 
 			/* copy the frame nonce into place */
 			memcpy(dropmask, wsi->ws->mask, 4);
@@ -1939,6 +2089,9 @@ rops_close_kill_connection_ws(struct lws *wsi, enum lws_close_status reason)
 static int
 rops_callback_on_writable_ws(struct lws *wsi)
 {
+	if (wsi->ws && !wsi->ws->bcast_pollout)
+		wsi->ws->user_pollout = 1;
+
 #if defined(LWS_WITH_HTTP2)
 	if (lwsi_role_h2_ENCAPSULATION(wsi)) {
 		/* we know then that it has an h2 parent */
@@ -2033,7 +2186,9 @@ rops_destroy_role_ws(struct lws *wsi)
 	lws_dll2_foreach_safe(&wsi->ws->proxy_owner, NULL, ws_destroy_proxy_buf);
 #endif
 
-	lws_free_set_NULL(wsi->ws);
+	lws_ws_bcast_flush(wsi);
+	lws_freelist_free(&wsi->a.context->pt[(int)wsi->tsi].fl_ws, wsi->ws);
+	wsi->ws = NULL;
 
 	return 0;
 }
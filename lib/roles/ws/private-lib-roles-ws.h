@@ -89,8 +89,44 @@ struct lws_pt_role_ws {
 
 #define PAYLOAD_BUF_SIZE 128 - 3 + LWS_PRE
 
+#if defined(LWS_WITH_WS_RX_POOL)
+/* idle rx buffers each pt keeps for reuse, beyond this they are freed */
+#define LWS_WS_RX_POOL_IDLE_MAX 32
+
+struct lws_ws_rx_pool {
+	lws_dll2_owner_t	idle; /* lws_ws_rxbuf_t, oldest at head */
+	size_t			bytes_in_use;
+	size_t			bytes_idle;
+	uint64_t		lent;
+	uint64_t		allocated;
+	uint32_t		in_use;
+	uint32_t		peak_in_use;
+};
+#endif
+
+/*
+ * A refcounted, preframed ws message that may be queued on many connections,
+ * the frame header is built at the end of the LWS_PRE area just before the
+ * payload, so the whole frame is contiguous
+ */
+
+struct lws_ws_bcast {
+#if LWS_MAX_SMP > 1
+	pthread_mutex_t		lock; /* protects refcount */
+#endif
+	size_t			len; /* payload length */
+	int			refcount;
+	uint8_t			hdr_len;
+	uint8_t			wp; /* for connections that can't share it */
+
+	/* LWS_PRE then the payload follow */
+};
+
+#define lws_ws_bcast_payload(_bc) ((uint8_t *)&(_bc)[1] + LWS_PRE)
+
 struct _lws_websocket_related {
 	unsigned char *rx_ubuf;
+	struct lws_ws_bcast **bcq; /* ring of queued broadcasts */
 #if !defined(LWS_WITHOUT_EXTENSIONS)
 	const struct lws_extension *active_extensions[LWS_MAX_EXTENSIONS_ACTIVE];
 	void *act_ext_user[LWS_MAX_EXTENSIONS_ACTIVE];
@@ -124,6 +160,9 @@ struct _lws_websocket_related {
 	unsigned int send_check_ping:1;
 	unsigned int first_fragment:1;
 	unsigned int peer_has_sent_close:1;
+	unsigned int tx_mid_message:1; /* sent a frame without FIN */
+	unsigned int user_pollout:1; /* user asked for WRITEABLE */
+	unsigned int bcast_pollout:1; /* we are asking for POLLOUT */
 #if !defined(LWS_WITHOUT_EXTENSIONS)
 	unsigned int extension_data_pending:1;
 	unsigned int rx_draining_ext:1;
@@ -136,6 +175,9 @@ struct _lws_websocket_related {
 	size_t rx_packet_length;
 	uint32_t rx_ubuf_head;
 	uint32_t rx_ubuf_alloc;
+	uint32_t bcq_size;
+	uint32_t bcq_head;
+	uint32_t bcq_count;
 
 	uint8_t pong_payload_len;
 	uint8_t mask_idx;
@@ -196,3 +238,37 @@ lws_server_init_wsi_for_ws(struct lws *wsi);
 
 void
 lws_sul_wsping_cb(lws_sorted_usec_list_t *sul);
+
+void
+lws_ws_mask_buf(uint8_t *p, size_t len, const uint8_t *mask,
+		uint8_t *mask_idx);
+
+int
+lws_ws_frame_hdr_len_bulk(struct lws *wsi, const uint8_t *p, size_t len);
+
+#if defined(LWS_WITH_WS_RX_POOL)
+int
+lws_ws_rx_buf_get(struct lws *wsi);
+void
+lws_ws_rx_buf_put(struct lws *wsi);
+void
+lws_ws_rx_buf_idle(struct lws *wsi);
+void
+lws_ws_rx_pool_destroy(struct lws_context_per_thread *pt);
+#else
+/* the connection always has its own rx_ubuf */
+#define lws_ws_rx_buf_get(_w) (1)
+#define lws_ws_rx_buf_idle(_w)
+#endif
+
+int
+lws_ws_bcast_pollout(struct lws *wsi);
+
+void
+lws_ws_bcast_req_pollout(struct lws *wsi);
+
+int
+lws_ws_bcast_drain(struct lws *wsi);
+
+void
+lws_ws_bcast_flush(struct lws *wsi);
@@ -0,0 +1,199 @@
+/*
+ * libwebsockets - small server side websockets and web server implementation
+ *
+ * Copyright (C) 2010 - 2021 Andy Green <andy@warmcat.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#include <private-lib-core.h>
+
+/*
+ * With LWS_WITH_WS_RX_POOL, ws connections don't own an rx_ubuf for their
+ * whole life.  They borrow one from their pt's pool when the parser needs to
+ * collect payload, and give it back as soon as the frame content has been
+ * passed on, so mostly-idle connections don't hold one at all.
+ *
+ * Each buffer is allocated with a header in front of it, which lists it in
+ * the pool while it is idle.  Protocols may have different rx_buffer_size,
+ * so an idle buffer is only reused for a connection needing the same size.
+ */
+
+typedef struct lws_ws_rxbuf {
+	lws_dll2_t		list; /* pt->ws_rx_pool.idle */
+	uint32_t		alloc;
+	/* the buffer follows */
+} lws_ws_rxbuf_t;
+
+static void
+lws_ws_rxbuf_free(struct lws_ws_rx_pool *rp, lws_ws_rxbuf_t *rb)
+{
+	lws_dll2_remove(&rb->list);
+	rp->bytes_idle -= rb->alloc;
+	lws_free(rb);
+}
+
+int
+lws_ws_rx_buf_get(struct lws *wsi)
+{
+	struct lws_context_per_thread *pt = &wsi->a.context->pt[(int)wsi->tsi];
+	struct lws_ws_rx_pool *rp = &pt->ws_rx_pool;
+	lws_ws_rxbuf_t *rb = NULL;
+	struct lws_dll2 *d;
+	int reused = 0;
+
+	assert(!wsi->ws->rx_ubuf);
+
+	lws_pt_lock(pt, __func__);
+
+	/* prefer the most recently idled one of the right size */
+
+	d = lws_dll2_get_tail(&rp->idle);
+	while (d) {
+		lws_ws_rxbuf_t *r = lws_container_of(d, lws_ws_rxbuf_t, list);
+
+		if (r->alloc == wsi->ws->rx_ubuf_alloc) {
+			rb = r;
+			break;
+		}
+		d = d->prev;
+	}
+
+	if (rb) {
+		lws_dll2_remove(&rb->list);
+		rp->bytes_idle -= rb->alloc;
+		reused = 1;
+	} else {
+		rb = lws_malloc(sizeof(*rb) + wsi->ws->rx_ubuf_alloc +
+				4 /* 0x0000ffff zlib */, "rx_ubuf");
+		if (!rb) {
+			lws_pt_unlock(pt);
+			lwsl_wsi_err(wsi, "OOM allocating rx buffer %u",
+				     (unsigned int)wsi->ws->rx_ubuf_alloc);
+
+			return 1;
+		}
+		memset(&rb->list, 0, sizeof(rb->list));
+		rb->alloc = wsi->ws->rx_ubuf_alloc;
+		rp->allocated++;
+	}
+
+	rp->lent++;
+	rp->bytes_in_use += rb->alloc;
+	if (++rp->in_use > rp->peak_in_use)
+		rp->peak_in_use = rp->in_use;
+
+#if defined(LWS_WITH_SYS_METRICS)
+	/* go means reused from the pool, the value is the occupancy */
+	lws_metric_event(wsi->a.context->mt_ws_rx_pool,
+			 reused ? METRES_GO : METRES_NOGO, rp->in_use);
+#endif
+
+	lws_pt_unlock(pt);
+
+	wsi->ws->rx_ubuf = (uint8_t *)&rb[1];
+
+	return 0;
+}
+
+void
+lws_ws_rx_buf_put(struct lws *wsi)
+{
+	struct lws_context_per_thread *pt = &wsi->a.context->pt[(int)wsi->tsi];
+	struct lws_ws_rx_pool *rp = &pt->ws_rx_pool;
+	lws_ws_rxbuf_t *rb;
+
+	if (!wsi->ws || !wsi->ws->rx_ubuf)
+		return;
+
+	rb = (lws_ws_rxbuf_t *)wsi->ws->rx_ubuf - 1;
+	wsi->ws->rx_ubuf = NULL;
+	wsi->ws->rx_ubuf_head = 0;
+
+	lws_pt_lock(pt, __func__);
+
+	rp->in_use--;
+	rp->bytes_in_use -= rb->alloc;
+
+	/* only keep so many idle, we drop the least recently used */
+
+	if (rp->idle.count >= LWS_WS_RX_POOL_IDLE_MAX)
+		lws_ws_rxbuf_free(rp, lws_container_of(
+				lws_dll2_get_head(&rp->idle),
+				lws_ws_rxbuf_t, list));
+
+	lws_dll2_add_tail(&rb->list, &rp->idle);
+	rp->bytes_idle += rb->alloc;
+
+	lws_pt_unlock(pt);
+}
+
+/*
+ * The parser calls this when it has finished with what was in the buffer,
+ * but an extension that is still draining may be using it as its input
+ */
+
+void
+lws_ws_rx_buf_idle(struct lws *wsi)
+{
+#if !defined(LWS_WITHOUT_EXTENSIONS)
+	if (wsi->ws->rx_draining_ext)
+		return;
+#endif
+
+	lws_ws_rx_buf_put(wsi);
+}
+
+void
+lws_ws_rx_pool_destroy(struct lws_context_per_thread *pt)
+{
+	struct lws_ws_rx_pool *rp = &pt->ws_rx_pool;
+
+	lws_start_foreach_dll_safe(struct lws_dll2 *, d, d1,
+				   lws_dll2_get_head(&rp->idle)) {
+		lws_ws_rxbuf_free(rp, lws_container_of(d, lws_ws_rxbuf_t,
+						       list));
+	} lws_end_foreach_dll_safe(d, d1);
+}
+
+int
+lws_ws_rx_pool_stats(struct lws_context *cx, int tsi,
+		     struct lws_ws_rx_pool_stats *s)
+{
+	struct lws_context_per_thread *pt;
+	struct lws_ws_rx_pool *rp;
+
+	if (tsi < 0 || tsi >= cx->count_threads)
+		return 1;
+
+	pt = &cx->pt[tsi];
+	rp = &pt->ws_rx_pool;
+
+	lws_pt_lock(pt, __func__);
+	s->bytes_in_use		= rp->bytes_in_use;
+	s->bytes_idle		= rp->bytes_idle;
+	s->in_use		= rp->in_use;
+	s->idle			= rp->idle.count;
+	s->peak_in_use		= rp->peak_in_use;
+	s->lent			= rp->lent;
+	s->allocated		= rp->allocated;
+	lws_pt_unlock(pt);
+
+	return 0;
+}
@@ -332,7 +332,7 @@ lws_process_ws_upgrade2(struct lws *wsi)
 
 	/* allocate the ws struct for the wsi */
 
-	wsi->ws = lws_zalloc(sizeof(*wsi->ws), "ws struct");
+	wsi->ws = lws_freelist_zalloc(&pt->fl_ws, "ws struct");
 	if (!wsi->ws) {
 		lwsl_notice("OOM\n");
 		return 1;
@@ -806,7 +806,7 @@ lws_ws_frame_rest_is_payload(struct lws *wsi, uint8_t **buf, size_t len)
 {
 	struct lws_ext_pm_deflate_rx_ebufs pmdrx;
 	unsigned int avail = (unsigned int)len;
-	uint8_t *buffer = *buf, mask[4];
+	uint8_t *buffer = *buf;
 #if !defined(LWS_WITHOUT_EXTENSIONS)
 	unsigned int old_packet_length = (unsigned int)wsi->ws->rx_packet_length;
 #endif
@@ -846,31 +846,9 @@ lws_ws_frame_rest_is_payload(struct lws *wsi, uint8_t **buf, size_t len)
 	pmdrx.eb_out.token = buffer;
 	pmdrx.eb_out.len = (int)avail;
 
-	if (!wsi->ws->all_zero_nonce) {
-
-		for (n = 0; n < 4; n++)
-			mask[n] = wsi->ws->mask[(wsi->ws->mask_idx + n) & 3];
-
-		/* deal with 4-byte chunks using unwrapped loop */
-		n = (int)(avail >> 2);
-		while (n--) {
-			*(buffer) = *(buffer) ^ mask[0];
-			buffer++;
-			*(buffer) = *(buffer) ^ mask[1];
-			buffer++;
-			*(buffer) = *(buffer) ^ mask[2];
-			buffer++;
-			*(buffer) = *(buffer) ^ mask[3];
-			buffer++;
-		}
-		/* and the remaining bytes bytewise */
-		for (n = 0; n < (int)(avail & 3); n++) {
-			*(buffer) = *(buffer) ^ mask[n];
-			buffer++;
-		}
-
-		wsi->ws->mask_idx = (wsi->ws->mask_idx + avail) & 3;
-	}
+	if (!wsi->ws->all_zero_nonce)
+		lws_ws_mask_buf(buffer, avail, wsi->ws->mask,
+				&wsi->ws->mask_idx);
 
 	lwsl_info("%s: using %d of raw input (total %d on offer)\n", __func__,
 		    avail, (int)len);
@@ -1040,6 +1018,16 @@ lws_parse_ws(struct lws *wsi, unsigned char **buf, size_t len)
 		}
 #endif
 
+		/* decode the rest of the frame header in one go if it's all here */
+		if (wsi->lws_rx_parse_state == LWS_RXPS_04_FRAME_HDR_LEN) {
+			m = lws_ws_frame_hdr_len_bulk(wsi, *buf, len);
+			if (m) {
+				*buf += m;
+				len -= (size_t)m;
+				continue;
+			}
+		}
+
 		/* consume payload bytes efficiently */
 		while (wsi->lws_rx_parse_state == LWS_RXPS_WS_FRAME_PAYLOAD &&
 				(wsi->ws->opcode == LWSWSOPC_TEXT_FRAME ||
@@ -431,6 +431,8 @@ skip:
 		*cp = '\0';
 	}
 
+	lws_adns_q_hash_name(q->dns, q);
+
 	lws_callback_on_writable(q->dns->wsi);
 
 	return 2;
@@ -559,8 +561,7 @@ lws_adns_parse_udp(lws_async_dns_t *dns, const uint8_t *pkt, size_t len)
 
 	/* match both A and AAAA queries if any */
 
-	q = lws_adns_get_query(dns, 0, &dns->waiting,
-			       lws_ser_ru16be(pkt + DHO_TID), NULL);
+	q = lws_adns_get_query(dns, 0, lws_ser_ru16be(pkt + DHO_TID), NULL);
 	if (!q) {
 		lwsl_info("%s: dropping unknown query tid 0x%x\n",
 			    __func__, lws_ser_ru16be(pkt + DHO_TID));
@@ -681,7 +682,7 @@ lws_adns_parse_udp(lws_async_dns_t *dns, const uint8_t *pkt, size_t len)
 		 */
 
 		c->flags = adst.flags;
-		lws_dll2_add_head(&c->list, &dns->cached);
+		lws_adns_cache_add(dns, c);
 		lws_sul_schedule(q->context, 0, &c->sul, sul_cb_expire,
 				 lws_now_usecs() +
 				 (adst.smallest_ttl * LWS_US_PER_SEC));
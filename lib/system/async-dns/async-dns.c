@@ -31,44 +31,133 @@ static const lws_retry_bo_t retry_policy = {
 	botable, LWS_ARRAY_SIZE(botable), LWS_RETRY_CONCEAL_ALWAYS,
 	/* don't conceal after the last table entry */ 0, 0, 20 };
 
+/*
+ * Cached results and ongoing queries are also listed in hash buckets, so we
+ * can find them by name (or, for queries, by tid) without walking
+ * everything.  dns->hash is one allocation holding three tables of
+ * dns->hash_buckets each: cache objects by name, queries by their current
+ * name, and queries by each of their recent tids.
+ *
+ * The cached and waiting lists are unchanged and still give the LRU order
+ * and ownership.  Names are hashed case-insensitively.
+ */
+
+static uint32_t
+lws_adns_hash_name(const char *name)
+{
+	uint32_t h = 0x811c9dc5; /* FNV-1a */
+
+	while (*name) {
+		h ^= (uint8_t)tolower((uint8_t)*name++);
+		h *= 0x01000193;
+	}
+
+	return h;
+}
+
+#define lws_adns_bucket_cache(_dns, _name) \
+	(&(_dns)->hash[lws_adns_hash_name(_name) & \
+		       ((_dns)->hash_buckets - 1)])
+#define lws_adns_bucket_q(_dns, _name) \
+	(&(_dns)->hash[(_dns)->hash_buckets + (lws_adns_hash_name(_name) & \
+		       ((_dns)->hash_buckets - 1))])
+/* the tid lsb just selects A or AAAA for the same query */
+#define lws_adns_bucket_tid(_dns, _tid) \
+	(&(_dns)->hash[(2 * (_dns)->hash_buckets) + \
+		       (((unsigned int)(_tid) >> 1) & ((_dns)->hash_buckets - 1))])
+
+static unsigned int
+lws_adns_cache_max(lws_async_dns_t *dns)
+{
+	return dns->cache_max_items ? dns->cache_max_items : MAX_CACHE_ENTRIES;
+}
+
+static int
+lws_adns_hash_init(lws_async_dns_t *dns)
+{
+	unsigned int n = MIN_HASH_BUCKETS;
+
+	if (dns->hash)
+		return 0;
+
+	while (n < lws_adns_cache_max(dns))
+		n <<= 1;
+
+	dns->hash = lws_zalloc(3 * n * sizeof(*dns->hash), "adns-hash");
+	if (!dns->hash)
+		return 1;
+
+	dns->hash_buckets = n;
+
+	return 0;
+}
+
+void
+lws_adns_cache_add(lws_async_dns_t *dns, lws_adns_cache_t *c)
+{
+	lws_dll2_add_head(&c->list, &dns->cached);
+	if (dns->hash)
+		lws_dll2_add_head(&c->hash_list,
+				  lws_adns_bucket_cache(dns, c->name));
+}
+
+void
+lws_adns_q_hash_name(lws_async_dns_t *dns, lws_adns_q_t *q)
+{
+	lws_dll2_remove(&q->hash_list);
+	if (dns->hash)
+		lws_dll2_add_head(&q->hash_list,
+				  lws_adns_bucket_q(dns, (const char *)&q[1]));
+}
+
 void
 lws_adns_q_destroy(lws_adns_q_t *q)
 {
+	size_t n;
+
 	lws_metrics_caliper_report(q->metcal, (char)q->go_nogo);
 
 	lws_sul_cancel(&q->sul);
 	lws_sul_cancel(&q->write_sul);
 	lws_dll2_remove(&q->list);
+	lws_dll2_remove(&q->hash_list);
+	for (n = 0; n < LWS_ARRAY_SIZE(q->tid_idx); n++)
+		lws_dll2_remove(&q->tid_idx[n].list);
 	lws_free(q);
 }
 
 lws_adns_q_t *
 lws_adns_get_query(lws_async_dns_t *dns, adns_query_type_t qtype,
-		   lws_dll2_owner_t *owner, uint16_t tid, const char *name)
+		   uint16_t tid, const char *name)
 {
-	lws_start_foreach_dll_safe(struct lws_dll2 *, d, d1,
-				   lws_dll2_get_head(owner)) {
-		lws_adns_q_t *q = lws_container_of(d, lws_adns_q_t, list);
-		int n = 0, nmax = q->tids >= LWS_ARRAY_SIZE(q->tid) ?
-				  LWS_ARRAY_SIZE(q->tid) : q->tids;
+	if (!dns->hash)
+		return NULL;
+
+	if (!name) {
+		lws_start_foreach_dll(struct lws_dll2 *, d,
+			lws_dll2_get_head(lws_adns_bucket_tid(dns, tid))) {
+			lws_adns_q_t *q = lws_container_of(d,
+						lws_adns_tid_idx_t, list)->q;
+			int n = 0, nmax = q->tids >= LWS_ARRAY_SIZE(q->tid) ?
+					  LWS_ARRAY_SIZE(q->tid) : q->tids;
 
-		if (!name)
 			for (n = 0; n < nmax; n++)
 				if ((tid & 0xfffe) == (q->tid[n] & 0xfffe))
 					return q;
+		} lws_end_foreach_dll(d);
 
-		if (name && q->qtype == ((tid & 1) ? LWS_ADNS_RECORD_AAAA :
-						     LWS_ADNS_RECORD_A) &&
-		    !strcasecmp(name, (const char *)&q[1])) {
-			if (owner == &dns->cached) {
-				/* Keep sorted by LRU: move to the head */
-				lws_dll2_remove(&q->list);
-				lws_dll2_add_head(&q->list, &dns->cached);
-			}
+		return NULL;
+	}
+
+	lws_start_foreach_dll(struct lws_dll2 *, d,
+			lws_dll2_get_head(lws_adns_bucket_q(dns, name))) {
+		lws_adns_q_t *q = lws_container_of(d, lws_adns_q_t, hash_list);
 
+		if (q->qtype == ((tid & 1) ? LWS_ADNS_RECORD_AAAA :
+					     LWS_ADNS_RECORD_A) &&
+		    !strcasecmp(name, (const char *)&q[1]))
 			return q;
-		}
-	} lws_end_foreach_dll_safe(d, d1);
+	} lws_end_foreach_dll(d);
 
 	return NULL;
 }
@@ -395,20 +484,29 @@ lws_adns_get_cache(lws_async_dns_t *dns, const char *name)
 		return NULL;
 	}
 
-	lws_start_foreach_dll_safe(struct lws_dll2 *, d, d1,
-				   lws_dll2_get_head(&dns->cached)) {
-		c = lws_container_of(d, lws_adns_cache_t, list);
+	if (!dns->hash)
+		return NULL;
+
+	lws_start_foreach_dll(struct lws_dll2 *, d,
+		lws_dll2_get_head(lws_adns_bucket_cache(dns, name))) {
+		c = lws_container_of(d, lws_adns_cache_t, hash_list);
 
 		// lwsl_wsi_notice(dns->wsi, "%s vs %s (inc %d)", name, c->name, c->incomplete);
 
 		if (!c->incomplete && !strcasecmp(name, c->name)) {
-			/* Keep sorted by LRU: move to the head */
+			/*
+			 * Keep sorted by LRU: move to the head, also in the
+			 * bucket so the newest match is still found first
+			 */
 			lws_dll2_remove(&c->list);
 			lws_dll2_add_head(&c->list, &dns->cached);
+			lws_dll2_remove(&c->hash_list);
+			lws_dll2_add_head(&c->hash_list,
+					  lws_adns_bucket_cache(dns, name));
 
 			return c;
 		}
-	} lws_end_foreach_dll_safe(d, d1);
+	} lws_end_foreach_dll(d);
 
 	return NULL;
 }
@@ -451,6 +549,7 @@ lws_adns_cache_destroy(lws_adns_cache_t *c)
 {
 	lws_dll2_remove(&c->sul.list);
 	lws_dll2_remove(&c->list);
+	lws_dll2_remove(&c->hash_list);
 	if (c->chain)
 		lws_free(c->chain);
 	lws_free(c);
@@ -526,7 +625,7 @@ lws_async_dns_trim_cache(lws_async_dns_t *dns)
 {
 	lws_adns_cache_t *c1;
 
-	if (dns->cached.count + 1< MAX_CACHE_ENTRIES)
+	if (dns->cached.count + 1 < lws_adns_cache_max(dns))
 		return;
 
 	c1 = lws_container_of(lws_dll2_get_tail(&dns->cached),
@@ -552,6 +651,7 @@ lws_async_dns_deinit(lws_async_dns_t *dns)
 {
 	lws_dll2_foreach_safe(&dns->waiting, NULL, clean);
 	lws_dll2_foreach_safe(&dns->cached, NULL, cache_clean);
+	lws_free_set_NULL(dns->hash);
 
 	if (dns->wsi && !dns->dns_server_connected) {
 		lwsl_wsi_notice(dns->wsi, "late free of incomplete dns wsi");
@@ -613,16 +713,19 @@ lws_async_dns_cancel(struct lws *wsi)
 
 
 static int
-check_tid(struct lws_dll2 *d, void *user)
+check_tid(lws_async_dns_t *dns, uint16_t check)
 {
-	lws_adns_q_t *q = lws_container_of(d, lws_adns_q_t, list);
-	int n = 0, nmax = q->tids >= LWS_ARRAY_SIZE(q->tid) ?
-			  LWS_ARRAY_SIZE(q->tid) : q->tids;
-	uint16_t check = (uint16_t)(intptr_t)user;
+	lws_start_foreach_dll(struct lws_dll2 *, d,
+			lws_dll2_get_head(lws_adns_bucket_tid(dns, check))) {
+		lws_adns_q_t *q = lws_container_of(d,
+						lws_adns_tid_idx_t, list)->q;
+		int n = 0, nmax = q->tids >= LWS_ARRAY_SIZE(q->tid) ?
+				  LWS_ARRAY_SIZE(q->tid) : q->tids;
 
-	for (n = 0; n < nmax; n++)
-		if (check == q->tid[n])
-			return 1;
+		for (n = 0; n < nmax; n++)
+			if (check == q->tid[n])
+				return 1;
+	} lws_end_foreach_dll(d);
 
 	return 0;
 }
@@ -631,6 +734,7 @@ int
 lws_async_dns_get_new_tid(struct lws_context *context, lws_adns_q_t *q)
 {
 	lws_async_dns_t *dns = &context->async_dns;
+	lws_adns_tid_idx_t *ti;
 	int budget = 10;
 
 	/*
@@ -642,13 +746,19 @@ lws_async_dns_get_new_tid(struct lws_context *context, lws_adns_q_t *q)
 		if (lws_get_random(context, &tid, 2) != 2)
 			return -1;
 
-		if (lws_dll2_foreach_safe(&dns->waiting,
-					  (void *)(intptr_t)tid, check_tid))
+		if (check_tid(dns, tid))
 			continue;
 
 		q->tids++;
 		LADNS_MOST_RECENT_TID(q) = tid;
 
+		/* the slot's previous tid, if any, drops out of the index */
+		ti = &q->tid_idx[(int)(q->tids - 1) %
+				 (int)LWS_ARRAY_SIZE(q->tid_idx)];
+		ti->q = q;
+		lws_dll2_remove(&ti->list);
+		lws_dll2_add_head(&ti->list, lws_adns_bucket_tid(dns, tid));
+
 		return 0;
 
 	} while (budget--);
@@ -702,7 +812,7 @@ lws_async_dns_query(struct lws_context *context, int tsi, const char *name,
 	}
 #endif
 
-	if (nlen >= DNS_MAX - 1)
+	if (nlen >= DNS_MAX - 1 || lws_adns_hash_init(dns))
 		goto failed;
 
 	/*
@@ -792,7 +902,7 @@ lws_async_dns_query(struct lws_context *context, int tsi, const char *name,
 			tmq.tq.standalone_cb = cb;
 		lws_strncpy(tmq.name, name, sizeof(tmq.name));
 
-		lws_dll2_add_head(&c->list, &dns->cached);
+		lws_adns_cache_add(dns, c);
 		lws_sul_schedule(context, 0, &c->sul, sul_cb_expire,
 				 3600ll * LWS_US_PER_SEC);
 
@@ -837,7 +947,7 @@ lws_async_dns_query(struct lws_context *context, int tsi, const char *name,
 
 	/* there's an ongoing query we can share the result of */
 
-	q = lws_adns_get_query(dns, qtype, &dns->waiting, 0, name);
+	q = lws_adns_get_query(dns, qtype, 0, name);
 	if (q) {
 		lwsl_cx_debug(context, "dns piggybacking: %d:%s",
 				qtype, name);
@@ -882,7 +992,7 @@ lws_async_dns_query(struct lws_context *context, int tsi, const char *name,
 
 	if (lws_async_dns_get_new_tid(context, q)) {
 		lwsl_cx_err(context, "tid fail");
-		goto failed;
+		goto failed_q;
 	}
 
 	LADNS_MOST_RECENT_TID(q) &= 0xfffe;
@@ -901,7 +1011,7 @@ lws_async_dns_query(struct lws_context *context, int tsi, const char *name,
 	/* schedule a retry according to the retry policy on the wsi */
 	if (lws_retry_sul_schedule_retry_wsi(dns->wsi, &q->sul,
 					 lws_async_dns_sul_cb_retry, &q->retry))
-		goto failed;
+		goto failed_q;
 
 	/* fail us if we can't write by this timeout */
 	lws_sul_schedule(context, 0, &q->write_sul, sul_cb_write, LWS_US_PER_SEC);
@@ -923,6 +1033,7 @@ lws_async_dns_query(struct lws_context *context, int tsi, const char *name,
 	lws_callback_on_writable(dns->wsi);
 
 	lws_dll2_add_head(&q->list, &dns->waiting);
+	lws_adns_q_hash_name(dns, q);
 
 	lws_metrics_caliper_bind(q->metcal, context->mt_conn_dns);
 	q->go_nogo = METRES_NOGO;
@@ -933,6 +1044,17 @@ lws_async_dns_query(struct lws_context *context, int tsi, const char *name,
 
 	return LADNS_RET_CONTINUING;
 
+failed_q:
+	/*
+	 * The new query may already be in the tid index, take it back out
+	 * of everything and free it, so nobody can find it later
+	 */
+	if (wsi)
+		lws_dll2_remove(&wsi->adns);
+	if (pq)
+		*pq = NULL;
+	lws_adns_q_destroy(q);
+
 failed:
 	lwsl_cx_notice(context, "failed");
 	if (!cb(wsi, NULL, NULL, LADNS_RET_FAILED, opaque))
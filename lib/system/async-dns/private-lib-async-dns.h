@@ -26,7 +26,8 @@
 #define DNS_MAX			96	/* Maximum host name		*/
 #define DNS_RECURSION_LIMIT	3
 #define DNS_PACKET_LEN		1400	/* Buffer size for DNS packet	*/
-#define MAX_CACHE_ENTRIES	10	/* Dont cache more than that	*/
+#define MAX_CACHE_ENTRIES	10	/* Default max cached names	*/
+#define MIN_HASH_BUCKETS	16
 #define DNS_QUERY_TIMEOUT	30	/* Query timeout, seconds	*/
 
 /*
@@ -38,6 +39,7 @@
 typedef struct lws_adns_cache {
 	lws_sorted_usec_list_t	sul;	/* for cache TTL management */
 	lws_dll2_t		list;
+	lws_dll2_t		hash_list; /* in dns->hash by name */
 
 	struct lws_adns_cache	*firstcache;
 	struct lws_adns_cache	*chain;
@@ -49,6 +51,15 @@ typedef struct lws_adns_cache {
 	/* addrinfo, lws_sa46, then name overallocated here */
 } lws_adns_cache_t;
 
+/*
+ * an ongoing query is listed in a dns->hash tid bucket for each recent tid
+ */
+
+typedef struct lws_adns_tid_idx {
+	lws_dll2_t		list;
+	struct lws_adns_q	*q;
+} lws_adns_tid_idx_t;
+
 /*
  * these objects are used while a query is ongoing...
  */
@@ -57,6 +68,8 @@ typedef struct lws_adns_q {
 	lws_sorted_usec_list_t	sul;	/* per-query write retry timer */
 	lws_sorted_usec_list_t	write_sul;	/* fail if unable to write by this time */
 	lws_dll2_t		list;
+	lws_dll2_t		hash_list; /* in dns->hash by current name */
+	lws_adns_tid_idx_t	tid_idx[3]; /* in dns->hash by tid[n] */
 
 	lws_metrics_caliper_compose(metcal)
 
@@ -124,7 +137,13 @@ lws_adns_get_cache(lws_async_dns_t *dns, const char *name);
 
 lws_adns_q_t *
 lws_adns_get_query(lws_async_dns_t *dns, adns_query_type_t qtype,
-		   lws_dll2_owner_t *owner, uint16_t tid, const char *name);
+		   uint16_t tid, const char *name);
+
+void
+lws_adns_cache_add(lws_async_dns_t *dns, lws_adns_cache_t *c);
+
+void
+lws_adns_q_hash_name(lws_async_dns_t *dns, lws_adns_q_t *q);
 
 void
 lws_async_dns_trim_cache(lws_async_dns_t *dns);
@@ -26,9 +26,11 @@
 
 typedef struct lws_tls_session_cache_mbedtls {
 	lws_dll2_t			list;
+	lws_dll2_t			hash_list; /* vh->tls_sessions_hash */
 
  	mbedtls_ssl_session		session;
 	lws_sorted_usec_list_t		sul_ttl;
+	uint32_t			hash; /* of the tag */
 
 	/* name is overallocated here */
 } lws_tls_scm_t;
@@ -46,6 +48,7 @@ __lws_tls_session_destroy(lws_tls_scm_t *ts)
 	lws_sul_cancel(&ts->sul_ttl);
 	mbedtls_ssl_session_free(&ts->session);
 	lws_dll2_remove(&ts->list);		/* vh lock */
+	lws_dll2_remove(&ts->hash_list);
 
 	lws_free(ts);
 }
@@ -53,6 +56,23 @@ __lws_tls_session_destroy(lws_tls_scm_t *ts)
 static lws_tls_scm_t *
 __lws_tls_session_lookup_by_name(struct lws_vhost *vh, const char *name)
 {
+	uint32_t h = lws_tls_session_hash(name);
+	lws_dll2_owner_t *b = lws_tls_session_bucket(vh, h);
+
+	if (b) {
+		lws_start_foreach_dll(struct lws_dll2 *, p,
+				      lws_dll2_get_head(b)) {
+			lws_tls_scm_t *ts = lws_container_of(p, lws_tls_scm_t,
+							     hash_list);
+
+			if (ts->hash == h && !strcmp(name, (const char *)&ts[1]))
+				return ts;
+
+		} lws_end_foreach_dll(p);
+
+		return NULL;
+	}
+
 	lws_start_foreach_dll(struct lws_dll2 *, p,
 			      lws_dll2_get_head(&vh->tls_sessions)) {
 		lws_tls_scm_t *ts = lws_container_of(p, lws_tls_scm_t, list);
@@ -89,6 +109,11 @@ lws_tls_reuse_session(struct lws *wsi)
 
 	ts = __lws_tls_session_lookup_by_name(wsi->a.vhost, buf);
 
+#if defined(LWS_WITH_SYS_METRICS) && defined(LWS_WITH_CLIENT)
+	lws_metric_event(wsi->a.context->mt_tls_sess,
+			 ts ? METRES_GO : METRES_NOGO, 0);
+#endif
+
 	if (!ts) {
 		lwsl_tlssess("%s: no existing session for %s\n", __func__, buf);
 		goto bail;
@@ -140,6 +165,7 @@ lws_tls_session_vh_destroy(struct lws_vhost *vh)
 {
 	lws_dll2_foreach_safe(&vh->tls_sessions, NULL,
 			      lws_tls_session_destroy_dll);
+	lws_tls_session_hash_destroy(vh);
 }
 
 static void
@@ -167,6 +193,7 @@ lws_tls_session_new_mbedtls(struct lws *wsi)
 	mbedtls_ssl_context *msc;
 	struct lws_vhost *vh;
 	lws_tls_scm_t *ts;
+	lws_dll2_owner_t *b;
 	size_t nl;
 #if !defined(LWS_WITH_NO_LOGS) && defined(_DEBUG)
 	const char *disposition = "reuse";
@@ -225,6 +252,10 @@ lws_tls_session_new_mbedtls(struct lws *wsi)
 			goto bail;
 		}
 
+		ts->hash = lws_tls_session_hash(buf);
+		b = lws_tls_session_bucket(vh, ts->hash);
+		if (b)
+			lws_dll2_add_head(&ts->hash_list, b);
 		lws_dll2_add_tail(&ts->list, &vh->tls_sessions);
 
 		lws_sul_schedule(wsi->a.context, wsi->tsi, &ts->sul_ttl,
@@ -318,3 +349,22 @@ lws_tls_session_dump_load(struct lws_vhost *vh, const char *host, uint16_t port,
 
 	return 1;
 }
+
+int
+lws_tls_session_foreach(struct lws_vhost *vh, lws_tls_sess_cb_t cb, void *opq)
+{
+	/* there seems no serialization / deserialization helper in mbedtls */
+	lwsl_warn("%s: only supported on openssl atm\n", __func__);
+
+	return 1;
+}
+
+int
+lws_tls_session_add_blob(struct lws_vhost *vh, const char *tag,
+			 const uint8_t *blob, size_t len)
+{
+	/* there seems no serialization / deserialization helper in mbedtls */
+	lwsl_warn("%s: only supported on openssl atm\n", __func__);
+
+	return 1;
+}
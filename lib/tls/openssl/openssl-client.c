@@ -585,6 +585,7 @@ lws_tls_client_connect(struct lws *wsi, char *errbuf, size_t elen)
 
 		lwsl_info("client connect OK\n");
 		lws_openssl_describe_cipher(wsi);
+		lws_tls_openssl_ktls_check(wsi);
 		return LWS_SSL_CAPABLE_DONE;
 	}
 
@@ -804,6 +805,11 @@ lws_tls_client_create_vhost_context(struct lws_vhost *vh,
 		EVP_DigestUpdate(mdctx, &c, 1);
 	}
 
+	if (lws_check_opt(vh->options, LWS_SERVER_OPTION_TLS_KTLS)) {
+		c = 2;
+		EVP_DigestUpdate(mdctx, &c, 1);
+	}
+
 	if (ca_filepath)
 		EVP_DigestUpdate(mdctx, ca_filepath, strlen(ca_filepath));
 
@@ -899,6 +905,7 @@ lws_tls_client_create_vhost_context(struct lws_vhost *vh,
 
 	SSL_CTX_set_options(vh->tls.ssl_client_ctx,
 			    SSL_OP_CIPHER_SERVER_PREFERENCE);
+	lws_tls_openssl_ktls_ctx(vh, vh->tls.ssl_client_ctx);
 
 	SSL_CTX_set_mode(vh->tls.ssl_client_ctx,
 			 SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER |
@@ -0,0 +1,296 @@
+/*
+ * libwebsockets - small server side websockets and web server implementation
+ *
+ * Copyright (C) 2010 - 2021 Andy Green <andy@warmcat.com>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+ */
+
+#if defined(WIN32)
+#define HAVE_STRUCT_TIMESPEC
+#if defined(pid_t)
+#undef pid_t
+#endif
+#endif
+#include <pthread.h>
+
+#include "private-lib-core.h"
+#include "private-lib-tls-openssl.h"
+
+/*
+ * With info->tls_handshake_threads, the SSL_accept() steps of server tls
+ * handshakes are passed to a threadpool, so the expensive crypto in them
+ * doesn't stall the service thread and everything else on it.
+ *
+ * While a step is with the workers, the service thread doesn't touch the SSL
+ * and the connection has no POLLIN or POLLOUT interest.  When the worker is
+ * done, the threadpool asks for a writeable callback on the connection from
+ * its own service thread, which brings us back to
+ * lws_server_socket_service_ssl() to act on the result, just as if
+ * SSL_accept() had been called there.
+ *
+ * If the connection closes meanwhile, a step still in the queue is removed,
+ * and a step already on a worker is waited for.  It can't take long, since
+ * SSL_accept() on the nonblocking socket returns as soon as it needs more
+ * from the peer.
+ */
+
+struct lws_tls_hs_job {
+	pthread_mutex_t			lock; /* protects done and released */
+	pthread_cond_t			cond;
+	struct lws_threadpool_task	*task;
+	lws_tls_conn			*ssl;
+	lws_usec_t			us_queued;
+	int				n; /* what SSL_accept() returned */
+	int				m; /* and the SSL_get_error() for it */
+	char				done; /* the worker did the step */
+	char				released; /* the threadpool let go of us */
+};
+
+static enum lws_threadpool_task_return
+lws_tls_hs_task(void *user, enum lws_threadpool_task_status s)
+{
+	struct lws_tls_hs_job *job = (struct lws_tls_hs_job *)user;
+	int m = 0, n;
+
+	/* the connection went away before we got to it */
+	if (s == LWS_TP_STATUS_STOPPING)
+		return LWS_TP_RETURN_STOPPED;
+
+	n = lws_tls_server_accept_ssl(job->ssl, &m);
+
+	pthread_mutex_lock(&job->lock);
+	job->n = n;
+	job->m = m;
+	job->done = 1;
+	pthread_mutex_unlock(&job->lock);
+
+	return LWS_TP_RETURN_FINISHED;
+}
+
+static void
+lws_tls_hs_task_cleanup(struct lws *wsi, void *user)
+{
+	struct lws_tls_hs_job *job = (struct lws_tls_hs_job *)user;
+
+	pthread_mutex_lock(&job->lock);
+	job->released = 1;
+	pthread_cond_signal(&job->cond);
+	pthread_mutex_unlock(&job->lock);
+}
+
+static void
+lws_tls_hs_job_free(struct lws_tls_hs_job *job)
+{
+	pthread_mutex_destroy(&job->lock);
+	pthread_cond_destroy(&job->cond);
+	lws_free(job);
+}
+
+/*
+ * Take the job back from the threadpool, whatever state it is in.  If the task
+ * is still on a worker, this detaches it from the wsi so the threadpool
+ * cleans it up itself when the worker is done, and we wait for that.
+ */
+
+static struct lws_tls_hs_job *
+lws_tls_hs_job_collect(struct lws *wsi)
+{
+	struct lws_context_per_thread *pt = &wsi->a.context->pt[(int)wsi->tsi];
+	struct lws_tls_hs_job *job = wsi->tls.hs_job;
+
+	lws_threadpool_dequeue_task(job->task);
+
+	pthread_mutex_lock(&job->lock);
+	while (!job->released)
+		pthread_cond_wait(&job->cond, &job->lock);
+	pthread_mutex_unlock(&job->lock);
+
+	wsi->tls.hs_job = NULL;
+	pt->tls.hs_inflight--;
+
+	return job;
+}
+
+/*
+ * Returns 0 if the SSL_accept() step was passed to a worker, 1 if the caller
+ * should do it on the service thread as usual, or -1 if the connection should
+ * be closed
+ */
+
+int
+lws_tls_hs_offload(struct lws *wsi)
+{
+	struct lws_context_per_thread *pt = &wsi->a.context->pt[(int)wsi->tsi];
+	struct lws_context *cx = wsi->a.context;
+	struct lws_threadpool_task_args args;
+	struct lws_tls_hs_job *job;
+
+	/*
+	 * These make openssl call back into user code from inside the
+	 * SSL_accept(), which can't expect to be on another thread
+	 */
+
+	if (!cx->tls.hs_tp || wsi->a.vhost->tls.ssl_info_event_mask ||
+	    lws_check_opt(wsi->a.vhost->options,
+			  LWS_SERVER_OPTION_REQUIRE_VALID_OPENSSL_CLIENT_CERT))
+		return 1;
+
+	job = lws_zalloc(sizeof(*job), __func__);
+	if (!job)
+		return 1;
+
+	pthread_mutex_init(&job->lock, NULL);
+	pthread_cond_init(&job->cond, NULL);
+	job->ssl = wsi->tls.ssl;
+	job->us_queued = lws_now_usecs();
+
+	memset(&args, 0, sizeof(args));
+	args.wsi = wsi;
+	args.user = job;
+	args.task = lws_tls_hs_task;
+	args.cleanup = lws_tls_hs_task_cleanup;
+
+	job->task = lws_threadpool_enqueue(cx->tls.hs_tp, &args, "tlshs %s",
+					   lws_wsi_tag(wsi));
+	if (!job->task) {
+		/* the queue is full, the service thread does this one */
+#if defined(LWS_WITH_SYS_METRICS)
+		lws_metric_event(cx->mt_tls_hs_queue, METRES_NOGO,
+				 pt->tls.hs_inflight);
+#endif
+		lws_tls_hs_job_free(job);
+
+		return 1;
+	}
+
+	wsi->tls.hs_job = job;
+	pt->tls.hs_inflight++;
+
+#if defined(LWS_WITH_SYS_METRICS)
+	/* go means it went to the workers, the value is how many we have there */
+	lws_metric_event(cx->mt_tls_hs_queue, METRES_GO, pt->tls.hs_inflight);
+#endif
+
+	if (lws_change_pollfd(wsi, LWS_POLLIN | LWS_POLLOUT, 0)) {
+		lwsl_wsi_err(wsi, "change_pollfd failed");
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * We are called back to a connection with a job on the workers, if it's done,
+ * act on the SSL_accept() result.  MORE_SERVICE means it's still in progress.
+ */
+
+enum lws_ssl_capable_status
+lws_tls_hs_offload_reap(struct lws *wsi)
+{
+	struct lws_tls_hs_job *job = wsi->tls.hs_job;
+	enum lws_ssl_capable_status r;
+	char done;
+
+	pthread_mutex_lock(&job->lock);
+	done = job->done;
+	pthread_mutex_unlock(&job->lock);
+
+	/*
+	 * The writeable request was only to get us here... once we have the
+	 * result, go back to the POLLIN the connection had before we took it
+	 */
+	if (lws_change_pollfd(wsi, LWS_POLLOUT, done ? LWS_POLLIN : 0))
+		return LWS_SSL_CAPABLE_ERROR;
+
+	if (!done)
+		return LWS_SSL_CAPABLE_MORE_SERVICE;
+
+	job = lws_tls_hs_job_collect(wsi);
+
+	r = lws_tls_server_accept_result(wsi, job->n, job->m);
+
+#if defined(LWS_WITH_SYS_METRICS)
+	/* go means the step didn't fail, the value is the us it took us */
+	lws_metric_event(wsi->a.context->mt_tls_hs_lat,
+			 r == LWS_SSL_CAPABLE_ERROR ? METRES_NOGO : METRES_GO,
+			 (u_mt_t)(lws_now_usecs() - job->us_queued));
+#endif
+
+	lws_tls_hs_job_free(job);
+
+	return r;
+}
+
+/* the connection is closing, a worker must be done with the SSL first */
+
+void
+lws_tls_hs_offload_cancel(struct lws *wsi)
+{
+	if (!wsi->tls.hs_job)
+		return;
+
+	lws_tls_hs_job_free(lws_tls_hs_job_collect(wsi));
+}
+
+int
+lws_tls_hs_offload_init(struct lws_context *cx,
+			const struct lws_context_creation_info *info)
+{
+	struct lws_threadpool_create_args a;
+
+	if (!info->tls_handshake_threads)
+		return 0;
+
+#if OPENSSL_VERSION_NUMBER < 0x10100000L && LWS_MAX_SMP == 1
+	/* we only set up the openssl locking callbacks for SMP */
+	lwsl_cx_warn(cx, "tls handshake offload needs OpenSSL 1.1.0+ "
+			 "or LWS_MAX_SMP > 1");
+
+	return 0;
+#endif
+
+	memset(&a, 0, sizeof(a));
+	a.threads = (int)info->tls_handshake_threads;
+	a.max_queue_depth = info->tls_handshake_queue_max ?
+				(int)info->tls_handshake_queue_max :
+				a.threads * 64;
+
+	cx->tls.hs_tp = lws_threadpool_create(cx, &a, "tlshs");
+	if (!cx->tls.hs_tp) {
+		lwsl_cx_err(cx, "failed to create tls handshake threadpool");
+
+		return 1;
+	}
+
+	lwsl_cx_info(cx, "tls handshakes on %d threads, queue %d", a.threads,
+		     a.max_queue_depth);
+
+	return 0;
+}
+
+void
+lws_tls_hs_offload_destroy(struct lws_context *cx)
+{
+	if (!cx->tls.hs_tp)
+		return;
+
+	lws_threadpool_destroy(cx->tls.hs_tp);
+	cx->tls.hs_tp = NULL;
+}
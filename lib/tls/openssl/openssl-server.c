@@ -23,6 +23,7 @@
  */
 
 #include "private-lib-core.h"
+#include "private-lib-tls-openssl.h"
 
 /*
  * Care: many openssl apis return 1 for success.  These are translated to the
@@ -551,6 +552,7 @@ lws_tls_server_vhost_backend_init(const struct lws_context_creation_info *info,
 #endif
 	SSL_CTX_set_options(vhost->tls.ssl_ctx, SSL_OP_SINGLE_DH_USE);
 	SSL_CTX_set_options(vhost->tls.ssl_ctx, SSL_OP_CIPHER_SERVER_PREFERENCE);
+	lws_tls_openssl_ktls_ctx(vhost, vhost->tls.ssl_ctx);
 
 	if (info->ssl_cipher_list)
 		SSL_CTX_set_cipher_list(vhost->tls.ssl_ctx, info->ssl_cipher_list);
@@ -689,16 +691,49 @@ lws_tls_server_abort_connection(struct lws *wsi)
 	return 0;
 }
 
+/*
+ * The part of the accept that only involves the SSL, this may be called on a
+ * handshake offload thread.  The openssl error queue is per-thread, so we
+ * must also collect the error on the thread that did the SSL_accept().
+ */
+
+int
+lws_tls_server_accept_ssl(lws_tls_conn *ssl, int *m)
+{
+	int n;
+
+	ERR_clear_error();
+	n = SSL_accept(ssl);
+	if (n == 1)
+		return n;
+
+	*m = SSL_get_error(ssl, n);
+	lws_tls_err_describe_clear();
+
+	return n;
+}
+
 enum lws_ssl_capable_status
 lws_tls_server_accept(struct lws *wsi)
 {
-	struct lws_context_per_thread *pt = &wsi->a.context->pt[(int)wsi->tsi];
-	union lws_tls_cert_info_results ir;
-	int m, n;
+	int m = 0, n;
 
 	errno = 0;
-	ERR_clear_error();
-	n = SSL_accept(wsi->tls.ssl);
+	n = lws_tls_server_accept_ssl(wsi->tls.ssl, &m);
+
+	return lws_tls_server_accept_result(wsi, n, m);
+}
+
+/*
+ * Act on what SSL_accept() returned, and the SSL_get_error() for it, on the
+ * service thread
+ */
+
+enum lws_ssl_capable_status
+lws_tls_server_accept_result(struct lws *wsi, int n, int m)
+{
+	struct lws_context_per_thread *pt = &wsi->a.context->pt[(int)wsi->tsi];
+	union lws_tls_cert_info_results ir;
 
 	wsi->skip_fallback = 1;
 
@@ -712,6 +747,7 @@ lws_tls_server_accept(struct lws *wsi)
 			lwsl_info("%s: no client cert CN\n", __func__);
 
 		lws_openssl_describe_cipher(wsi);
+		lws_tls_openssl_ktls_check(wsi);
 
 		if (SSL_pending(wsi->tls.ssl) &&
 		    lws_dll2_is_detached(&wsi->tls.dll_pending_tls))
@@ -721,8 +757,7 @@ lws_tls_server_accept(struct lws *wsi)
 		return LWS_SSL_CAPABLE_DONE;
 	}
 
-	m = lws_ssl_get_error(wsi, n);
-	lws_tls_err_describe_clear();
+	lwsl_debug("%s: %p %d -> %d\n", __func__, wsi->tls.ssl, n, m);
 
 	if (m == SSL_ERROR_SYSCALL || m == SSL_ERROR_SSL)
 		return LWS_SSL_CAPABLE_ERROR;
@@ -26,9 +26,11 @@
 
 typedef struct lws_tls_session_cache_openssl {
 	lws_dll2_t			list;
+	lws_dll2_t			hash_list; /* vh->tls_sessions_hash */
 
 	SSL_SESSION			*session;
 	lws_sorted_usec_list_t		sul_ttl;
+	uint32_t			hash; /* of the tag */
 
 	/* name is overallocated here */
 } lws_tls_sco_t;
@@ -44,6 +46,7 @@ __lws_tls_session_destroy(lws_tls_sco_t *ts)
 	lws_sul_cancel(&ts->sul_ttl);
 	SSL_SESSION_free(ts->session);
 	lws_dll2_remove(&ts->list);		/* vh lock */
+	lws_dll2_remove(&ts->hash_list);
 
 	lws_free(ts);
 }
@@ -51,6 +54,23 @@ __lws_tls_session_destroy(lws_tls_sco_t *ts)
 static lws_tls_sco_t *
 __lws_tls_session_lookup_by_name(struct lws_vhost *vh, const char *name)
 {
+	uint32_t h = lws_tls_session_hash(name);
+	lws_dll2_owner_t *b = lws_tls_session_bucket(vh, h);
+
+	if (b) {
+		lws_start_foreach_dll(struct lws_dll2 *, p,
+				      lws_dll2_get_head(b)) {
+			lws_tls_sco_t *ts = lws_container_of(p, lws_tls_sco_t,
+							     hash_list);
+
+			if (ts->hash == h && !strcmp(name, (const char *)&ts[1]))
+				return ts;
+
+		} lws_end_foreach_dll(p);
+
+		return NULL;
+	}
+
 	lws_start_foreach_dll(struct lws_dll2 *, p,
 			      lws_dll2_get_head(&vh->tls_sessions)) {
 		lws_tls_sco_t *ts = lws_container_of(p, lws_tls_sco_t, list);
@@ -85,6 +105,11 @@ lws_tls_reuse_session(struct lws *wsi)
 		goto bail;
 	ts = __lws_tls_session_lookup_by_name(wsi->a.vhost, tag);
 
+#if defined(LWS_WITH_SYS_METRICS) && defined(LWS_WITH_CLIENT)
+	lws_metric_event(wsi->a.context->mt_tls_sess,
+			 ts ? METRES_GO : METRES_NOGO, 0);
+#endif
+
 	if (!ts) {
 		lwsl_tlssess("%s: no existing session for %s\n", __func__, tag);
 		goto bail;
@@ -148,6 +173,7 @@ lws_tls_session_vh_destroy(struct lws_vhost *vh)
 {
 	lws_dll2_foreach_safe(&vh->tls_sessions, NULL,
 			      lws_tls_session_destroy_dll);
+	lws_tls_session_hash_destroy(vh);
 }
 
 static void
@@ -167,8 +193,9 @@ lws_tls_session_expiry_cb(lws_sorted_usec_list_t *sul)
 static lws_tls_sco_t *
 lws_tls_session_add_entry(struct lws_vhost *vh, const char *tag)
 {
-	lws_tls_sco_t *ts;
 	size_t nl = strlen(tag);
+	lws_dll2_owner_t *b;
+	lws_tls_sco_t *ts;
 
 	if (vh->tls_sessions.count == (vh->tls_session_cache_max ?
 				      vh->tls_session_cache_max : 10)) {
@@ -196,7 +223,11 @@ lws_tls_session_add_entry(struct lws_vhost *vh, const char *tag)
 
 	memset(ts, 0, sizeof(*ts));
 	memcpy(&ts[1], tag, nl + 1);
+	ts->hash = lws_tls_session_hash(tag);
 
+	b = lws_tls_session_bucket(vh, ts->hash);
+	if (b)
+		lws_dll2_add_head(&ts->hash_list, b);
 	lws_dll2_add_tail(&ts->list, &vh->tls_sessions);
 
 	return ts;
@@ -416,8 +447,7 @@ lws_tls_session_dump_load(struct lws_vhost *vh, const char *host, uint16_t port,
 {
 	struct lws_tls_session_dump d;
 	lws_tls_sco_t *ts;
-	SSL_SESSION *sess = NULL; /* allow it to "bail" early */
-	void *v;
+	int ret;
 
 	if (vh->options & LWS_SERVER_OPTION_DISABLE_TLS_SESSION_CACHE)
 		return 1;
@@ -427,8 +457,9 @@ lws_tls_session_dump_load(struct lws_vhost *vh, const char *host, uint16_t port,
 
 	lws_context_lock(vh->context, __func__); /* -------------- cx { */
 	lws_vhost_lock(vh); /* -------------- vh { */
-
 	ts = __lws_tls_session_lookup_by_name(vh, d.tag);
+	lws_vhost_unlock(vh); /* } vh --------------  */
+	lws_context_unlock(vh->context); /* } cx --------------  */
 
 	if (ts) {
 		/*
@@ -437,38 +468,69 @@ lws_tls_session_dump_load(struct lws_vhost *vh, const char *host, uint16_t port,
 		 */
 		lwsl_notice("%s: session already exists for %s\n", __func__,
 				d.tag);
-		goto bail1;
+		return 1;
 	}
 
 	if (cb_load(vh->context, &d)) {
 		lwsl_warn("%s: load failed\n", __func__);
 
-		goto bail1;
+		return 1;
 	}
 
 	/* the callback has allocated the blob and set d.blob / d.blob_len */
 
-	v = d.blob;
-	/* this advances d.blob by the blob size ;-) */
-	sess = d2i_SSL_SESSION(NULL, (const uint8_t **)&d.blob,
-							(long)d.blob_len);
-	free(v); /* user code will have used malloc() */
+	ret = lws_tls_session_add_blob(vh, d.tag, d.blob, d.blob_len);
+	free(d.blob); /* user code will have used malloc() */
+	if (ret) {
+		lwsl_warn("%s: unable to restore session\n", __func__);
+		return 1;
+	}
+
+	lwsl_tlssess("%s: session loaded OK\n", __func__);
+
+	return 0;
+}
+
+/*
+ * Add a serialized session to the cache under tag, unless it has expired or
+ * we already have one for the tag, which is likely newer
+ */
+
+int
+lws_tls_session_add_blob(struct lws_vhost *vh, const char *tag,
+			 const uint8_t *blob, size_t len)
+{
+	const uint8_t *p = blob;
+	SSL_SESSION *sess;
+	lws_tls_sco_t *ts;
+	long left;
+
+	/* this advances p by the blob size ;-) */
+	sess = d2i_SSL_SESSION(NULL, &p, (long)len);
 	if (!sess) {
 		lwsl_warn("%s: d2i_SSL_SESSION failed\n", __func__);
-		goto bail;
+		return 1;
 	}
 
+	left = (long)SSL_SESSION_get_time(sess) +
+	       (long)SSL_SESSION_get_timeout(sess) - (long)time(NULL);
+	if (left <= 0)
+		goto bail1;
+
+	lws_context_lock(vh->context, __func__); /* -------------- cx { */
 	lws_vhost_lock(vh); /* -------------- vh { */
-	ts = lws_tls_session_add_entry(vh, d.tag);
-	lws_vhost_unlock(vh); /* } vh --------------  */
 
-	if (!ts) {
-		lwsl_warn("%s: unable to add cache entry\n", __func__);
+	if (__lws_tls_session_lookup_by_name(vh, tag))
+		goto bail;
+
+	ts = lws_tls_session_add_entry(vh, tag);
+	if (!ts)
 		goto bail;
-	}
 
 	ts->session = sess;
-	lwsl_tlssess("%s: session loaded OK\n", __func__);
+	lws_sul_schedule(vh->context, 0, &ts->sul_ttl,
+			 lws_tls_session_expiry_cb,
+			 (lws_usec_t)left * LWS_US_PER_SEC);
 
 	lws_vhost_unlock(vh); /* } vh --------------  */
 	lws_context_unlock(vh->context); /* } cx --------------  */
@@ -476,11 +538,69 @@ lws_tls_session_dump_load(struct lws_vhost *vh, const char *host, uint16_t port,
 	return 0;
 
 bail:
-	SSL_SESSION_free(sess);
+	lws_vhost_unlock(vh); /* } vh --------------  */
+	lws_context_unlock(vh->context); /* } cx --------------  */
 bail1:
+	SSL_SESSION_free(sess);
+
+	return 1;
+}
+
+/*
+ * Pass each cached session, serialized, to cb, in lru -> mru order
+ */
+
+int
+lws_tls_session_foreach(struct lws_vhost *vh, lws_tls_sess_cb_t cb, void *opq)
+{
+	struct lws_tls_session_dump d;
+	size_t alloc = 0;
+	uint8_t *buf = NULL, *p;
+	int ret = 0, bl;
+
+	d.opaque = opq;
+
+	lws_context_lock(vh->context, __func__); /* -------------- cx { */
+	lws_vhost_lock(vh); /* -------------- vh { */
+
+	lws_start_foreach_dll(struct lws_dll2 *, q,
+			      lws_dll2_get_head(&vh->tls_sessions)) {
+		lws_tls_sco_t *ts = lws_container_of(q, lws_tls_sco_t, list);
+
+		bl = i2d_SSL_SESSION(ts->session, NULL);
+		if (bl <= 0)
+			goto next;
+
+		if ((size_t)bl > alloc) {
+			lws_free(buf);
+			alloc = (size_t)bl;
+			buf = lws_malloc(alloc, __func__);
+			if (!buf) {
+				ret = 1;
+				break;
+			}
+		}
+
+		/* this advances p by the blob size ;-) */
+		p = buf;
+		i2d_SSL_SESSION(ts->session, &p);
+
+		lws_strncpy(d.tag, (const char *)&ts[1], sizeof(d.tag));
+		d.blob = buf;
+		d.blob_len = (size_t)bl;
+
+		if (cb(vh->context, &d)) {
+			ret = 1;
+			break;
+		}
+next:
+		;
+	} lws_end_foreach_dll(q);
 
 	lws_vhost_unlock(vh); /* } vh --------------  */
 	lws_context_unlock(vh->context); /* } cx --------------  */
 
-	return 1;
+	lws_free(buf);
+
+	return ret;
 }
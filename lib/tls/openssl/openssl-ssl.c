@@ -396,6 +396,41 @@ lws_ssl_capable_write(struct lws *wsi, unsigned char *buf, size_t len)
 	return LWS_SSL_CAPABLE_ERROR;
 }
 
+/*
+ * With LWS_SERVER_OPTION_TLS_KTLS, we ask OpenSSL to try to pass the record
+ * layer to the kernel when the handshake completes.  It quietly carries on in
+ * userspace if the kernel has no tls support or the cipher isn't one it can
+ * do, so afterwards we have to look at what we actually got.
+ */
+
+void
+lws_tls_openssl_ktls_ctx(struct lws_vhost *vh, SSL_CTX *ctx)
+{
+	if (!lws_check_opt(vh->options, LWS_SERVER_OPTION_TLS_KTLS))
+		return;
+
+#if defined(LWS_OPENSSL_KTLS)
+	SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+#else
+	lwsl_vhost_warn(vh, "kTLS not supported by this OpenSSL");
+#endif
+}
+
+void
+lws_tls_openssl_ktls_check(struct lws *wsi)
+{
+#if defined(LWS_OPENSSL_KTLS)
+	if (!lws_check_opt(wsi->a.vhost->options, LWS_SERVER_OPTION_TLS_KTLS))
+		return;
+
+	wsi->tls.ktls_tx = !!BIO_get_ktls_send(SSL_get_wbio(wsi->tls.ssl));
+	wsi->tls.ktls_rx = !!BIO_get_ktls_recv(SSL_get_rbio(wsi->tls.ssl));
+
+	lwsl_wsi_info(wsi, "kTLS tx %d, rx %d", wsi->tls.ktls_tx,
+		      wsi->tls.ktls_rx);
+#endif
+}
+
 void
 lws_ssl_info_callback(const SSL *ssl, int where, int ret)
 {
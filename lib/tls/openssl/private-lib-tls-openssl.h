@@ -27,6 +27,12 @@
 #if !defined(__LWS_PRIVATE_LIB_TLS_OPENSSL_H__)
 #define __LWS_PRIVATE_LIB_TLS_OPENSSL_H__
 
+/* OpenSSL 3+ can pass the record layer to the kernel after the handshake */
+#if defined(LWS_HAVE_SSL_sendfile) && defined(SSL_OP_ENABLE_KTLS) && \
+    !defined(OPENSSL_NO_KTLS)
+#define LWS_OPENSSL_KTLS
+#endif
+
 /*
  * one of these per different client context
  * cc_owner is in lws_context.lws_context_tls
@@ -54,6 +60,18 @@ lws_gencrypto_openssl_hash_to_NID(enum lws_genhash_types hash_type);
 const EVP_MD *
 lws_gencrypto_openssl_hash_to_EVP_MD(enum lws_genhash_types hash_type);
 
+void
+lws_tls_openssl_ktls_ctx(struct lws_vhost *vh, SSL_CTX *ctx);
+void
+lws_tls_openssl_ktls_check(struct lws *wsi);
+
+#if defined(LWS_WITH_SERVER)
+int
+lws_tls_server_accept_ssl(lws_tls_conn *ssl, int *m);
+enum lws_ssl_capable_status
+lws_tls_server_accept_result(struct lws *wsi, int n, int m);
+#endif
+
 #if !defined(LWS_HAVE_BN_bn2binpad)
 int BN_bn2binpad(const BIGNUM *a, unsigned char *to, int tolen);
 #endif
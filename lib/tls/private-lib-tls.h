@@ -204,6 +204,25 @@ lws_tls_reuse_session(struct lws *wsi);
 void
 lws_tls_session_cache(struct lws_vhost *vh, uint32_t ttl);
 
+uint32_t
+lws_tls_session_hash(const char *tag);
+lws_dll2_owner_t *
+lws_tls_session_bucket(struct lws_vhost *vh, uint32_t hash);
+void
+lws_tls_session_hash_destroy(struct lws_vhost *vh);
+int
+lws_tls_session_cache_serialize(struct lws_vhost *vh, struct lws_buflist **pbl);
+int
+lws_tls_session_cache_write(struct lws_vhost *vh, const char *filepath,
+			    struct lws_buflist **pbl);
+
+/* implemented by the tls library backend */
+int
+lws_tls_session_foreach(struct lws_vhost *vh, lws_tls_sess_cb_t cb, void *opq);
+int
+lws_tls_session_add_blob(struct lws_vhost *vh, const char *tag,
+			 const uint8_t *blob, size_t len);
+
 int
 lws_tls_session_name_from_wsi(struct lws *wsi, char *buf, size_t len);
 
@@ -34,14 +34,21 @@ struct lws_context_tls {
 	const char *alpn_default;
 	time_t last_cert_check_s;
 	struct lws_dll2_owner cc_owner;
+#if defined(LWS_WITH_TLS_HANDSHAKE_OFFLOAD)
+	struct lws_threadpool *hs_tp; /* server handshake workers */
+#endif
 	int count_client_contexts;
 };
 
 struct lws_pt_tls {
 	struct lws_dll2_owner dll_pending_tls_owner;
+#if defined(LWS_WITH_TLS_HANDSHAKE_OFFLOAD)
+	uint32_t hs_inflight; /* our handshake steps with the workers */
+#endif
 };
 
 struct lws_tls_ss_pieces;
+struct lws_tls_hs_job;
 
 struct alpn_ctx {
 	uint8_t data[23];
@@ -85,9 +92,14 @@ struct lws_lws_tls {
 	lws_tls_kid_chain_t	kid_chain;
 #endif
 	struct lws_dll2		dll_pending_tls;
+#if defined(LWS_WITH_TLS_HANDSHAKE_OFFLOAD)
+	struct lws_tls_hs_job	*hs_job; /* SSL_accept() is on a worker */
+#endif
 	char			err_helper[32];
 	unsigned int		use_ssl;
 	unsigned int		redirect_to_https:1;
+	unsigned int		ktls_tx:1; /* the kernel encrypts what we send */
+	unsigned int		ktls_rx:1; /* the kernel decrypts what we get */
 };
 
 
@@ -170,6 +182,20 @@ lws_tls_server_accept(struct lws *wsi);
 enum lws_ssl_capable_status
 lws_tls_server_abort_connection(struct lws *wsi);
 
+#if defined(LWS_WITH_TLS_HANDSHAKE_OFFLOAD)
+int
+lws_tls_hs_offload_init(struct lws_context *cx,
+			const struct lws_context_creation_info *info);
+void
+lws_tls_hs_offload_destroy(struct lws_context *cx);
+int
+lws_tls_hs_offload(struct lws *wsi);
+enum lws_ssl_capable_status
+lws_tls_hs_offload_reap(struct lws *wsi);
+void
+lws_tls_hs_offload_cancel(struct lws *wsi);
+#endif
+
 enum lws_ssl_capable_status
 __lws_tls_shutdown(struct lws *wsi);
 
@@ -24,6 +24,19 @@
 
 #include "private-lib-core.h"
 
+static void
+lws_tls_client_report_resume(struct lws *wsi)
+{
+#if defined(LWS_WITH_TLS_SESSIONS) && defined(LWS_WITH_SYS_METRICS)
+	/* if we had a cached session, did the server take it? */
+	if (!(wsi->a.vhost->options &
+	      LWS_SERVER_OPTION_DISABLE_TLS_SESSION_CACHE))
+		lws_metric_event(wsi->a.context->mt_tls_resume,
+				 lws_tls_session_is_reused(wsi) ?
+						METRES_GO : METRES_NOGO, 0);
+#endif
+}
+
 static int
 lws_ssl_client_connect1(struct lws *wsi, char *errbuf, size_t len)
 {
@@ -37,6 +50,7 @@ lws_ssl_client_connect1(struct lws *wsi, char *errbuf, size_t len)
 	case LWS_SSL_CAPABLE_DONE:
 		lws_tls_restrict_return_handshake(wsi);
 		lws_metrics_caliper_report(wsi->cal_conn, METRES_GO);
+		lws_tls_client_report_resume(wsi);
 #if defined(LWS_WITH_CONMON)
 	wsi->conmon.ciu_tls = (lws_conmon_interval_us_t)
 					(lws_now_usecs() - wsi->conmon_datum);
@@ -89,6 +103,7 @@ lws_ssl_client_connect2(struct lws *wsi, char *errbuf, size_t len)
 	}
 
 	lws_metrics_caliper_report(wsi->cal_conn, METRES_GO);
+	lws_tls_client_report_resume(wsi);
 #if defined(LWS_WITH_CONMON)
 	wsi->conmon.ciu_tls = (lws_conmon_interval_us_t)
 					(lws_now_usecs() - wsi->conmon_datum);
@@ -175,6 +190,16 @@ int lws_context_init_client_ssl(const struct lws_context_creation_info *info,
 			LWS_CALLBACK_OPENSSL_LOAD_EXTRA_CLIENT_VERIFY_CERTS,
 				     vhost->tls.ssl_client_ctx, NULL, 0);
 
+#if defined(LWS_WITH_TLS_SESSIONS)
+	if (info->tls_session_cache_filepath) {
+		/* restored now, saved again when the vhost is destroyed */
+		vhost->tls_session_cache_filepath =
+					info->tls_session_cache_filepath;
+		lws_tls_session_cache_load(vhost,
+					   info->tls_session_cache_filepath);
+	}
+#endif
+
 	return 0;
 }
 
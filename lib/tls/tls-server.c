@@ -34,7 +34,7 @@ lws_sul_tls_cb(lws_sorted_usec_list_t *sul)
 
 	lws_tls_check_all_cert_lifetimes(pt->context);
 
-	__lws_sul_insert_us(&pt->pt_sul_owner[LWSSULLI_MISS_IF_SUSPENDED],
+	__lws_sul_insert_us(pt, LWSSULLI_MISS_IF_SUSPENDED,
 			    &pt->sul_tls,
 			    (lws_usec_t)24 * 3600 * LWS_US_PER_SEC);
 }
@@ -116,7 +116,7 @@ lws_context_init_server_ssl(const struct lws_context_creation_info *info,
 	/* check certs once a day */
 
 	context->pt[0].sul_tls.cb = lws_sul_tls_cb;
-	__lws_sul_insert_us(&context->pt[0].pt_sul_owner[LWSSULLI_MISS_IF_SUSPENDED],
+	__lws_sul_insert_us(&context->pt[0], LWSSULLI_MISS_IF_SUSPENDED,
 			    &context->pt[0].sul_tls,
 			    (lws_usec_t)24 * 3600 * LWS_US_PER_SEC);
 
@@ -180,6 +180,14 @@ lws_server_socket_service_ssl(struct lws *wsi, lws_sockfd_type accept_fd, char f
 
 	case LRS_SSL_ACK_PENDING:
 
+#if defined(LWS_WITH_TLS_HANDSHAKE_OFFLOAD)
+		if (wsi->tls.hs_job) {
+			/* our last SSL_accept() step went to the workers */
+			n = lws_tls_hs_offload_reap(wsi);
+			goto accept_result;
+		}
+#endif
+
 		if (lws_change_pollfd(wsi, LWS_POLLOUT, 0)) {
 			lwsl_err("%s: lws_change_pollfd failed\n", __func__);
 			goto fail;
@@ -315,8 +323,20 @@ punt:
 
 		/* normal SSL connection processing path */
 
+#if defined(LWS_WITH_TLS_HANDSHAKE_OFFLOAD)
+		n = lws_tls_hs_offload(wsi);
+		if (n < 0)
+			goto fail;
+		if (!n)
+			/* a worker has it, we'll hear about it */
+			return 0;
+#endif
+
 		errno = 0;
 		n = lws_tls_server_accept(wsi);
+#if defined(LWS_WITH_TLS_HANDSHAKE_OFFLOAD)
+accept_result:
+#endif
 		lwsl_info("SSL_accept says %d\n", n);
 		switch (n) {
 		case LWS_SSL_CAPABLE_DONE:
@@ -62,3 +62,234 @@ lws_tls_session_tag_from_wsi(struct lws *wsi, char *buf, size_t len)
 }
 
 
+
+/*
+ * The vhost's cached sessions are also listed in buckets by the hash of their
+ * tag, so lookups don't have to strcmp() their way down the whole cache.  The
+ * bucket table is sized from the cache limit when the first session is added.
+ */
+
+uint32_t
+lws_tls_session_hash(const char *tag)
+{
+	uint32_t h = 0x811c9dc5; /* FNV-1a */
+
+	while (*tag) {
+		h ^= (uint8_t)*tag++;
+		h *= 0x01000193;
+	}
+
+	return h;
+}
+
+/* returns NULL if we have no table, then the caller must walk the list */
+
+lws_dll2_owner_t *
+lws_tls_session_bucket(struct lws_vhost *vh, uint32_t hash)
+{
+	unsigned int n = 16, max;
+
+	if (!vh->tls_sessions_hash) {
+		/* sessions already cached can't be added to a new table */
+		if (vh->tls_sessions.count)
+			return NULL;
+
+		max = vh->tls_session_cache_max ? vh->tls_session_cache_max : 10;
+		while (n < max && n < 65536)
+			n <<= 1;
+
+		vh->tls_sessions_hash = lws_zalloc(n *
+					sizeof(*vh->tls_sessions_hash),
+					"tls-sess-hash");
+		if (!vh->tls_sessions_hash)
+			return NULL;
+
+		vh->tls_sessions_hash_buckets = n;
+	}
+
+	return &vh->tls_sessions_hash[hash &
+				      (vh->tls_sessions_hash_buckets - 1)];
+}
+
+void
+lws_tls_session_hash_destroy(struct lws_vhost *vh)
+{
+	lws_free_set_NULL(vh->tls_sessions_hash);
+	vh->tls_sessions_hash_buckets = 0;
+}
+
+/*
+ * The cache file is the magic, then for each session, oldest first, a 2-byte
+ * tag length and 4-byte blob length, both big-endian, followed by the tag and
+ * the serialized session.  The session carries its own expiry time.
+ */
+
+static const char tls_sess_magic[] = "LWSTSC1\n";
+
+static int
+lws_tls_session_save_cb(struct lws_context *cx,
+			struct lws_tls_session_dump *d)
+{
+	struct lws_buflist **pbl = (struct lws_buflist **)d->opaque;
+	size_t tl = strlen(d->tag);
+	uint8_t hdr[6];
+
+	lws_ser_wu16be(hdr, (uint16_t)tl);
+	lws_ser_wu32be(hdr + 2, (uint32_t)d->blob_len);
+
+	if (lws_buflist_append_segment(pbl, hdr, sizeof(hdr)) < 0 ||
+	    lws_buflist_append_segment(pbl, (uint8_t *)d->tag, tl) < 0 ||
+	    lws_buflist_append_segment(pbl, d->blob, d->blob_len) < 0)
+		return 1;
+
+	return 0;
+}
+
+/*
+ * Only takes the cx + vh locks long enough to copy the cache into *pbl, so
+ * the caller can do the file i/o after dropping whatever locks it holds
+ */
+
+int
+lws_tls_session_cache_serialize(struct lws_vhost *vh, struct lws_buflist **pbl)
+{
+	*pbl = NULL;
+
+	if (vh->options & LWS_SERVER_OPTION_DISABLE_TLS_SESSION_CACHE)
+		return 1;
+
+	if (lws_buflist_append_segment(pbl, (const uint8_t *)tls_sess_magic,
+				       sizeof(tls_sess_magic) - 1) < 0 ||
+	    lws_tls_session_foreach(vh, lws_tls_session_save_cb, pbl)) {
+		lws_buflist_destroy_all_segments(pbl);
+
+		return 1;
+	}
+
+	return 0;
+}
+
+int
+lws_tls_session_cache_write(struct lws_vhost *vh, const char *filepath,
+			    struct lws_buflist **pbl)
+{
+	char temp[256];
+	size_t len;
+	uint8_t *p;
+	int fd, n = 0;
+
+	/* write it beside the real one, so we never leave a partial file */
+
+	lws_snprintf(temp, sizeof(temp), "%s.tmp", filepath);
+	fd = lws_open(temp, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0) {
+		lwsl_vhost_warn(vh, "unable to create %s", temp);
+		lws_buflist_destroy_all_segments(pbl);
+
+		return 1;
+	}
+
+	while (!n && (len = lws_buflist_next_segment_len(pbl, &p))) {
+		n = write(fd, p, len) != (ssize_t)len;
+		lws_buflist_use_segment(pbl, len);
+	}
+	lws_buflist_destroy_all_segments(pbl);
+	close(fd);
+
+	if (n || rename(temp, filepath)) {
+		lwsl_vhost_warn(vh, "failed to save sessions to %s", filepath);
+		unlink(temp);
+
+		return 1;
+	}
+
+	lwsl_vhost_info(vh, "saved sessions to %s", filepath);
+
+	return 0;
+}
+
+int
+lws_tls_session_cache_save(struct lws_vhost *vh, const char *filepath)
+{
+	struct lws_buflist *bl;
+
+	if (lws_tls_session_cache_serialize(vh, &bl))
+		return 1;
+
+	return lws_tls_session_cache_write(vh, filepath, &bl);
+}
+
+static int
+lws_tls_session_read(int fd, void *buf, size_t len)
+{
+	ssize_t n;
+
+	while (len) {
+		n = read(fd, buf, len);
+		if (n <= 0)
+			return 1;
+		buf = (uint8_t *)buf + n;
+		len -= (size_t)n;
+	}
+
+	return 0;
+}
+
+int
+lws_tls_session_cache_load(struct lws_vhost *vh, const char *filepath)
+{
+	char tag[LWS_SESSION_TAG_LEN], magic[sizeof(tls_sess_magic) - 1];
+	uint8_t hdr[6], *blob = NULL;
+	size_t tl, bl, alloc = 0;
+	int fd, count = 0;
+
+	if (vh->options & LWS_SERVER_OPTION_DISABLE_TLS_SESSION_CACHE)
+		return -1;
+
+	fd = lws_open(filepath, O_RDONLY);
+	if (fd < 0) {
+		lwsl_vhost_info(vh, "no session cache file %s", filepath);
+
+		return -1;
+	}
+
+	if (lws_tls_session_read(fd, magic, sizeof(magic)) ||
+	    memcmp(magic, tls_sess_magic, sizeof(magic))) {
+		lwsl_vhost_warn(vh, "%s is not a session cache file", filepath);
+		close(fd);
+
+		return -1;
+	}
+
+	while (!lws_tls_session_read(fd, hdr, sizeof(hdr))) {
+		tl = lws_ser_ru16be(hdr);
+		bl = lws_ser_ru32be(hdr + 2);
+
+		if (tl >= sizeof(tag) || !bl || bl > 65536)
+			break;
+
+		if (bl > alloc) {
+			lws_free(blob);
+			blob = lws_malloc(bl, __func__);
+			if (!blob)
+				break;
+			alloc = bl;
+		}
+
+		if (lws_tls_session_read(fd, tag, tl) ||
+		    lws_tls_session_read(fd, blob, bl))
+			break;
+		tag[tl] = '\0';
+
+		/* expired, or we already have a newer one, are skipped */
+		if (!lws_tls_session_add_blob(vh, tag, blob, bl))
+			count++;
+	}
+
+	lws_free(blob);
+	close(fd);
+
+	lwsl_vhost_info(vh, "restored %d sessions from %s", count, filepath);
+
+	return count;
+}
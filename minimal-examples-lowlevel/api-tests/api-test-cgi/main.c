@@ -0,0 +1,475 @@
+/*
+ * lws-api-test-cgi
+ *
+ * Written in 2010-2021 by Andy Green <andy@warmcat.com>
+ *
+ * This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * This api test runs a server with a cgi mount on a service thread, and
+ * fetches from it over loopback from the main thread with raw h1 and h2
+ * clients.
+ *
+ * The cgi script writes its headers and body with a single printf, so the
+ * body arrives in the same read as the end of the headers, and exits at once.
+ *
+ *  - over h1, with and without a content-length, the whole body must arrive
+ *    and the response must end
+ *
+ *  - over h2, several streams on one connection must all get the whole body
+ *    and END_STREAM, together, not one stream for each time the server looks
+ *    for finished cgis
+ */
+
+#include <libwebsockets.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+
+#define CGI_BODY	"hello from cgi\n"
+#define H2_STREAMS	4
+
+static const char cgi_script[] =
+	"#!/bin/sh\n"
+	"if [ \"$QUERY_STRING\" = \"cl=1\" ] ; then\n"
+	"\tprintf \"content-type: text/plain\\r\\ncontent-length: 15\\r\\n"
+		"\\r\\n" CGI_BODY "\"\n"
+	"else\n"
+	"\tprintf \"content-type: text/plain\\r\\n\\r\\n" CGI_BODY "\"\n"
+	"fi\n";
+
+static char script_path[] = "/tmp/lws-api-test-cgi-XXXXXX";
+
+static const struct lws_http_mount mount = {
+	/* .mount_next */		NULL,		/* linked-list "next" */
+	/* .mountpoint */		"/cgi",		/* mountpoint URL */
+	/* .origin */			script_path,	/* cgi script */
+	/* .def */			NULL,
+	/* .protocol */			NULL,
+	/* .cgienv */			NULL,
+	/* .extra_mimetypes */		NULL,
+	/* .interpret */		NULL,
+	/* .cgi_timeout */		20,
+	/* .cache_max_age */		0,
+	/* .auth_mask */		0,
+	/* .cache_reusable */		0,
+	/* .cache_revalidate */		0,
+	/* .cache_intermediaries */	0,
+	/* .origin_protocol */		LWSMPRO_CGI,
+	/* .mountpoint_len */		4,		/* char count */
+	/* .basic_auth_login_file */	NULL,
+};
+
+static struct lws_context *cx;
+static volatile char stop;
+static int fd = -1;
+
+static void *
+thread_service(void *d)
+{
+	while (!stop && lws_service(cx, 0) >= 0)
+		;
+
+	pthread_exit(NULL);
+
+	return NULL;
+}
+
+static int
+write_script(void)
+{
+	int sfd = mkstemp(script_path);
+
+	if (sfd < 0) {
+		lwsl_err("%s: can't create %s\n", __func__, script_path);
+		return 1;
+	}
+
+	if (write(sfd, cgi_script, sizeof(cgi_script) - 1) !=
+					(ssize_t)sizeof(cgi_script) - 1 ||
+	    fchmod(sfd, 0700)) {
+		lwsl_err("%s: can't write %s\n", __func__, script_path);
+		close(sfd);
+		unlink(script_path);
+
+		return 1;
+	}
+
+	close(sfd);
+
+	return 0;
+}
+
+static int
+cli_send(const void *buf, size_t len)
+{
+	return send(fd, buf, len, MSG_NOSIGNAL) != (ssize_t)len;
+}
+
+static int
+cli_connect(int port)
+{
+	struct timeval tv = { 10, 0 };
+	struct sockaddr_in sa;
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0)
+		return 1;
+
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sin_family = AF_INET;
+	sa.sin_port = htons((uint16_t)port);
+	sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if (connect(fd, (struct sockaddr *)&sa, sizeof(sa))) {
+		lwsl_err("%s: connect failed\n", __func__);
+		close(fd);
+		fd = -1;
+
+		return 1;
+	}
+
+	return 0;
+}
+
+static void
+cli_close(void)
+{
+	if (fd >= 0)
+		close(fd);
+	fd = -1;
+}
+
+/*
+ * Fetch path over h1 and check we get all of the body and the response ends,
+ * either at the end of the content-length, or with the terminating chunk
+ */
+
+static int
+test_h1(int port, const char *path, int cl)
+{
+	char buf[2048], *body = NULL;
+	size_t len = 0;
+	ssize_t n;
+
+	if (cli_connect(port))
+		goto bail;
+
+	n = lws_snprintf(buf, sizeof(buf), "GET %s HTTP/1.1\r\n"
+					   "Host: localhost\r\n\r\n", path);
+	if (cli_send(buf, (size_t)n))
+		goto bail;
+
+	while (1) {
+		n = recv(fd, buf + len, sizeof(buf) - 1 - len, 0);
+		if (n <= 0) {
+			lwsl_err("%s: %s: response didn't end\n", __func__,
+				 path);
+			goto bail;
+		}
+		len += (size_t)n;
+		buf[len] = '\0';
+
+		if (!body && (body = strstr(buf, "\r\n\r\n")))
+			body += 4;
+		if (!body)
+			continue;
+
+		if (cl) {
+			if (strlen(body) >= strlen(CGI_BODY))
+				break;
+			continue;
+		}
+
+		if (len >= 5 && !strcmp(buf + len - 5, "0\r\n\r\n"))
+			break;
+	}
+
+	if (strncmp(buf, "HTTP/1.1 200", 12) || !strstr(body, CGI_BODY) ||
+	    (cl && strcmp(body, CGI_BODY))) {
+		lwsl_err("%s: %s: bad response '%s'\n", __func__, path, buf);
+		goto bail;
+	}
+
+	cli_close();
+	lwsl_user("%s: %s: PASS\n", __func__, path);
+
+	return 0;
+
+bail:
+	cli_close();
+	lwsl_user("%s: %s: FAIL\n", __func__, path);
+
+	return 1;
+}
+
+#if defined(LWS_ROLE_H2)
+
+enum {
+	H2F_DATA		= 0,
+	H2F_HEADERS		= 1,
+	H2F_RST_STREAM		= 3,
+	H2F_SETTINGS		= 4,
+	H2F_PING		= 6,
+	H2F_GOAWAY		= 7,
+
+	H2FL_END_STREAM		= 1,
+	H2FL_ACK		= 1,
+	H2FL_END_HEADERS	= 4,
+};
+
+static int
+send_frame(uint8_t type, uint8_t flags, uint32_t sid, const void *pl,
+	   size_t len)
+{
+	uint8_t h[9];
+
+	h[0] = (uint8_t)(len >> 16);
+	h[1] = (uint8_t)(len >> 8);
+	h[2] = (uint8_t)len;
+	h[3] = type;
+	h[4] = flags;
+	lws_ser_wu32be(&h[5], sid);
+
+	return cli_send(h, sizeof(h)) || (len && cli_send(pl, len));
+}
+
+static int
+send_get(uint32_t sid, const char *path)
+{
+	uint8_t hb[128], *p = hb;
+	size_t pl = strlen(path);
+
+	*p++ = 0x82; /* :method: GET */
+	*p++ = 0x86; /* :scheme: http */
+	*p++ = 0x04; /* :path, literal without indexing */
+	*p++ = (uint8_t)pl;
+	memcpy(p, path, pl);
+	p += pl;
+	*p++ = 0x01; /* :authority, literal without indexing */
+	*p++ = 9;
+	memcpy(p, "localhost", 9);
+	p += 9;
+
+	return send_frame(H2F_HEADERS, H2FL_END_HEADERS | H2FL_END_STREAM, sid,
+			  hb, lws_ptr_diff_size_t(p, hb));
+}
+
+static int
+recv_all(void *buf, size_t len)
+{
+	ssize_t n;
+
+	while (len) {
+		n = recv(fd, buf, len, 0);
+		if (n <= 0)
+			return 1;
+		buf = (uint8_t *)buf + n;
+		len -= (size_t)n;
+	}
+
+	return 0;
+}
+
+/*
+ * Start H2_STREAMS cgis on one connection, the last one with a content-length,
+ * and check they all get their whole body and END_STREAM.  The server looks for
+ * finished cgis every 3s, if it only finished one each time, the last would
+ * take 3s x H2_STREAMS.
+ */
+
+static int
+test_h2(int port)
+{
+	static const char preface[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+	char data[H2_STREAMS][32];
+	size_t dlen[H2_STREAMS];
+	int n, ended = 0, idx;
+	uint8_t h[9], pl[1024];
+	lws_usec_t us;
+	uint32_t len, sid;
+
+	memset(dlen, 0, sizeof(dlen));
+
+	if (cli_connect(port) ||
+	    cli_send(preface, sizeof(preface) - 1) ||
+	    send_frame(H2F_SETTINGS, 0, 0, NULL, 0))
+		goto bail;
+
+	us = lws_now_usecs();
+
+	for (n = 0; n < H2_STREAMS; n++)
+		if (send_get((uint32_t)(1 + n * 2), n == H2_STREAMS - 1 ?
+							"/cgi?cl=1" : "/cgi"))
+			goto bail;
+
+	while (ended != (1 << H2_STREAMS) - 1) {
+		if (recv_all(h, sizeof(h))) {
+			lwsl_err("%s: streams ended 0x%x\n", __func__, ended);
+			goto bail;
+		}
+
+		len = (uint32_t)((h[0] << 16) | (h[1] << 8) | h[2]);
+		sid = lws_ser_ru32be(&h[5]) & 0x7fffffff;
+		if (len > sizeof(pl) || recv_all(pl, len)) {
+			lwsl_err("%s: bad frame len %u\n", __func__,
+				 (unsigned int)len);
+			goto bail;
+		}
+
+		switch (h[3]) {
+		case H2F_SETTINGS:
+			if (!(h[4] & H2FL_ACK) &&
+			    send_frame(H2F_SETTINGS, H2FL_ACK, 0, NULL, 0))
+				goto bail;
+			continue;
+
+		case H2F_PING:
+			if (!(h[4] & H2FL_ACK) &&
+			    send_frame(H2F_PING, H2FL_ACK, 0, pl, len))
+				goto bail;
+			continue;
+
+		case H2F_RST_STREAM:
+		case H2F_GOAWAY:
+			lwsl_err("%s: frame type %d on sid %u\n", __func__,
+				 h[3], (unsigned int)sid);
+			goto bail;
+
+		case H2F_DATA:
+		case H2F_HEADERS:
+			break;
+
+		default:
+			continue;
+		}
+
+		if (!(sid & 1) || sid > H2_STREAMS * 2) {
+			lwsl_err("%s: unexpected sid %u\n", __func__,
+				 (unsigned int)sid);
+			goto bail;
+		}
+		idx = (int)(sid - 1) / 2;
+
+		if (h[3] == H2F_DATA) {
+			if (dlen[idx] + len > sizeof(data[idx])) {
+				lwsl_err("%s: sid %u: too much DATA\n",
+					 __func__, (unsigned int)sid);
+				goto bail;
+			}
+			memcpy(data[idx] + dlen[idx], pl, len);
+			dlen[idx] += len;
+		}
+
+		if (h[4] & H2FL_END_STREAM)
+			ended |= 1 << idx;
+	}
+
+	us = lws_now_usecs() - us;
+
+	for (n = 0; n < H2_STREAMS; n++)
+		if (dlen[n] != strlen(CGI_BODY) ||
+		    memcmp(data[n], CGI_BODY, dlen[n])) {
+			lwsl_err("%s: sid %d: bad body\n", __func__, 1 + n * 2);
+			goto bail;
+		}
+
+	if (us > 7 * LWS_US_PER_SEC) {
+		lwsl_err("%s: streams took %dms to end\n", __func__,
+			 (int)(us / LWS_US_PER_MS));
+		goto bail;
+	}
+
+	cli_close();
+	lwsl_user("%s: PASS\n", __func__);
+
+	return 0;
+
+bail:
+	cli_close();
+	lwsl_user("%s: FAIL\n", __func__);
+
+	return 1;
+}
+
+#endif
+
+int main(int argc, const char **argv)
+{
+	int logs = LLL_USER | LLL_ERR | LLL_WARN, ret = 1, port;
+	struct lws_context_creation_info info;
+	struct lws_vhost *vh;
+	pthread_t pt;
+	const char *p;
+
+	if ((p = lws_cmdline_option(argc, argv, "-d")))
+		logs = atoi(p);
+
+	lws_set_log_level(logs, NULL);
+	lwsl_user("LWS API selftest: cgi\n");
+
+	if (write_script())
+		return 1;
+
+	memset(&info, 0, sizeof info);
+	info.options = LWS_SERVER_OPTION_EXPLICIT_VHOSTS;
+
+	cx = lws_create_context(&info);
+	if (!cx) {
+		lwsl_err("lws init failed\n");
+		goto bail1;
+	}
+
+	/* h1 vhost, and an h2 prior knowledge one, both on any free port */
+
+	info.port = 0;
+	info.mounts = &mount;
+	info.vhost_name = "h1";
+	vh = lws_create_vhost(cx, &info);
+	if (!vh) {
+		lwsl_err("vhost creation failed\n");
+		goto bail;
+	}
+	port = lws_get_vhost_listen_port(vh);
+
+#if defined(LWS_ROLE_H2)
+	info.vhost_name = "h2";
+	info.options = LWS_SERVER_OPTION_H2_PRIOR_KNOWLEDGE;
+	vh = lws_create_vhost(cx, &info);
+	if (!vh) {
+		lwsl_err("vhost creation failed\n");
+		goto bail;
+	}
+#endif
+
+	if (pthread_create(&pt, NULL, thread_service, NULL)) {
+		lwsl_err("thread creation failed\n");
+		goto bail;
+	}
+
+	ret = test_h1(port, "/cgi", 0);
+	ret |= test_h1(port, "/cgi?cl=1", 1);
+#if defined(LWS_ROLE_H2)
+	ret |= test_h2(lws_get_vhost_listen_port(vh));
+#endif
+
+	stop = 1;
+	lws_cancel_service(cx);
+	pthread_join(pt, NULL);
+
+bail:
+	lws_context_destroy(cx);
+bail1:
+	unlink(script_path);
+
+	lwsl_user("Completed: %s\n", ret ? "FAIL" : "PASS");
+
+	return ret;
+}
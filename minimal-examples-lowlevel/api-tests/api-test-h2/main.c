@@ -0,0 +1,1423 @@
+/*
+ * lws-api-test-h2
+ *
+ * Written in 2010-2021 by Andy Green <andy@warmcat.com>
+ *
+ * This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * This api test runs an h2 server (cleartext, prior knowledge) on a service
+ * thread, and talks to it from the main thread with a raw h2 client, so it can
+ * send exactly the frames it likes and see exactly what comes back.
+ *
+ *  - many short streams on one connection must not make the server grant us
+ *    a connection window beyond 2^31 - 1
+ *
+ *  - after we reduce SETTINGS_INITIAL_WINDOW_SIZE, the server's window for a
+ *    stream it already sent on goes negative, and WINDOW_UPDATEs for it must
+ *    still be accepted
+ *
+ *  - header blocks split across CONTINUATION frames anywhere, or in padded
+ *    HEADERS, must decode the same, and huffman strings with bad padding or
+ *    EOS in them must be rejected
+ *
+ *  - an lws h2 client, connected through a relay that can inject
+ *    SETTINGS_HEADER_TABLE_SIZE changes, must decode every header the server
+ *    encodes across many responses on one connection, while the server's
+ *    dynamic table fills, evicts, shrinks and grows again
+ */
+
+#include <libwebsockets.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <poll.h>
+
+#define BIG_LEN		(256 * 1024)
+#define STREAMS		10000
+#define BATCH		20
+#define HPACK_ROUNDS	24
+#define HPACK_RAW_ROUND	18
+
+enum {
+	H2F_DATA		= 0,
+	H2F_HEADERS		= 1,
+	H2F_RST_STREAM		= 3,
+	H2F_SETTINGS		= 4,
+	H2F_PING		= 6,
+	H2F_GOAWAY		= 7,
+	H2F_WINDOW_UPDATE	= 8,
+	H2F_CONTINUATION	= 9,
+
+	H2FL_END_STREAM		= 1,
+	H2FL_ACK		= 1,
+	H2FL_END_HEADERS	= 4,
+	H2FL_PADDED		= 8,
+	H2FL_PRIORITY		= 0x20,
+
+	H2SET_INITIAL_WINDOW	= 4,
+
+	H2ERR_COMPRESSION	= 9,
+};
+
+struct frame {
+	uint32_t		len;
+	uint32_t		sid;
+	uint8_t			type;
+	uint8_t			flags;
+	uint8_t			pl[16384];
+};
+
+struct pss {
+	size_t			len;
+	size_t			sent;
+	char			echo;
+	uint8_t			eb[LWS_PRE + 512];
+};
+
+static struct lws_context *cx;
+static uint8_t body[LWS_PRE + BIG_LEN];
+static volatile char stop;
+static int fd = -1, settings_acks;
+
+/* the headers "/echo..." sends back to us, as the server decoded them */
+
+static const enum lws_token_indexes echo_toks[] = {
+	WSI_TOKEN_HTTP_COLON_AUTHORITY,
+	WSI_TOKEN_HTTP_USER_AGENT,
+	WSI_TOKEN_HTTP_REFERER,
+	WSI_TOKEN_HTTP_CACHE_CONTROL,
+};
+
+/*
+ * The extra response headers for hpack round r.  Some repeat, so they are
+ * worth indexing, content-language is new each time and forces evictions, vary
+ * only fits in a table of 1024 or more, and set-cookie must never be indexed
+ */
+
+static const enum lws_token_indexes hpack_toks[] = {
+	WSI_TOKEN_HTTP_ACCEPT_RANGES,
+	WSI_TOKEN_HTTP_CACHE_CONTROL,
+	WSI_TOKEN_HTTP_CONTENT_LANGUAGE,
+	WSI_TOKEN_HTTP_VARY,
+	WSI_TOKEN_HTTP_SET_COOKIE,
+};
+
+static size_t
+hpack_hdr(int r, int n, char *buf, size_t len)
+{
+	size_t fill, m;
+
+	switch (n) {
+	case 0:
+		return (size_t)lws_snprintf(buf, len, "bytes");
+	case 1:
+		return (size_t)lws_snprintf(buf, len, "private, max-age=%d",
+					    r % 3);
+	case 2:
+		fill = 100;
+		break;
+	case 3:
+		fill = 600;
+		r /= 2;
+		break;
+	default:
+		return (size_t)lws_snprintf(buf, len, "id=%d; Path=/", r & 1);
+	}
+
+	m = (size_t)lws_snprintf(buf, len, "%c%d-", n == 2 ? 'l' : 'v', r);
+	while (m < fill && m < len - 1) {
+		buf[m] = (char)('a' + (m * 7 + (size_t)r) % 26);
+		m++;
+	}
+	buf[m] = '\0';
+
+	return m;
+}
+
+static int
+callback_http(struct lws *wsi, enum lws_callback_reasons reason, void *user,
+	      void *in, size_t len)
+{
+	struct pss *pss = (struct pss *)user;
+	uint8_t buf[LWS_PRE + 2048], *start = &buf[LWS_PRE], *p = start,
+		*end = &buf[sizeof(buf) - 1];
+	lws_fileofs_t allow;
+	char v[1024];
+	size_t chunk;
+	int n;
+
+	switch (reason) {
+	case LWS_CALLBACK_HTTP:
+		pss->len = !strcmp((const char *)in, "/big") ? BIG_LEN : 2;
+		pss->sent = 0;
+
+		pss->echo = !strncmp((const char *)in, "/echo", 5);
+		if (pss->echo) {
+			char *e = (char *)&pss->eb[LWS_PRE],
+			     *ee = (char *)&pss->eb[sizeof(pss->eb) - 1];
+
+			e += lws_snprintf(e, lws_ptr_diff_size_t(ee, e), "%s|",
+					  (const char *)in);
+			for (n = 0; n < (int)LWS_ARRAY_SIZE(echo_toks); n++) {
+				if (lws_hdr_copy(wsi, v, sizeof(v),
+						 echo_toks[n]) < 0)
+					v[0] = '\0';
+				e += lws_snprintf(e, lws_ptr_diff_size_t(ee, e),
+						  "%s|", v);
+			}
+			pss->len = lws_ptr_diff_size_t(e,
+						(char *)&pss->eb[LWS_PRE]);
+		}
+
+		if (!strncmp((const char *)in, "/hpack/", 7) &&
+		    atoi((const char *)in + 7) == HPACK_RAW_ROUND) {
+			/*
+			 * Start the block with an indexed :status 200, so the
+			 * encoder must send it as it is
+			 */
+			*p++ = 0x88;
+			if (lws_add_http_header_by_token(wsi,
+					WSI_TOKEN_HTTP_CONTENT_TYPE,
+					(uint8_t *)"text/plain", 10, &p, end) ||
+			    lws_add_http_header_content_length(wsi, pss->len,
+							       &p, end))
+				return 1;
+		} else
+			if (lws_add_http_common_headers(wsi, HTTP_STATUS_OK,
+					"text/plain", pss->len, &p, end))
+				return 1;
+
+		if (!strncmp((const char *)in, "/hpack/", 7))
+			for (n = 0; n < (int)LWS_ARRAY_SIZE(hpack_toks); n++) {
+				chunk = hpack_hdr(atoi((const char *)in + 7), n,
+						  v, sizeof(v));
+				if (lws_add_http_header_by_token(wsi,
+						hpack_toks[n], (uint8_t *)v,
+						(int)chunk, &p, end))
+					return 1;
+			}
+
+		if (lws_finalize_write_http_header(wsi, start, &p, end))
+			return 1;
+
+		lws_callback_on_writable(wsi);
+
+		return 0;
+
+	case LWS_CALLBACK_HTTP_WRITEABLE:
+		if (!pss->len)
+			/* the stream may be writeable before we saw the request */
+			return 0;
+
+		chunk = pss->len - pss->sent;
+		if (chunk > 4096)
+			chunk = 4096;
+
+		/* stick to the window the peer gave us */
+
+		allow = lws_get_peer_write_allowance(wsi);
+		if (allow <= 0)
+			/* his WINDOW_UPDATE will get us WRITEABLE again */
+			return 0;
+		if ((lws_fileofs_t)chunk > allow)
+			chunk = (size_t)allow;
+
+		if (lws_write(wsi, (pss->echo ? pss->eb : body) + LWS_PRE +
+				   pss->sent, chunk,
+			      pss->sent + chunk == pss->len ?
+					LWS_WRITE_HTTP_FINAL : LWS_WRITE_HTTP) !=
+								(int)chunk)
+			return 1;
+
+		pss->sent += chunk;
+		if (pss->sent != pss->len) {
+			lws_callback_on_writable(wsi);
+			return 0;
+		}
+
+		if (lws_http_transaction_completed(wsi))
+			return -1;
+
+		return 0;
+
+	default:
+		break;
+	}
+
+	return lws_callback_http_dummy(wsi, reason, user, in, len);
+}
+
+static const struct lws_protocols protocols[] = {
+	{ "http", callback_http, sizeof(struct pss), 0, 0, NULL, 0 },
+	LWS_PROTOCOL_LIST_TERM
+};
+
+static void *
+thread_service(void *d)
+{
+	while (!stop && lws_service(cx, 0) >= 0)
+		;
+
+	pthread_exit(NULL);
+
+	return NULL;
+}
+
+/*
+ * The raw h2 client
+ */
+
+static int
+cli_send(const void *buf, size_t len)
+{
+	return send(fd, buf, len, MSG_NOSIGNAL) != (ssize_t)len;
+}
+
+static int
+send_frame(uint8_t type, uint8_t flags, uint32_t sid, const void *pl,
+	   size_t len)
+{
+	uint8_t h[9];
+
+	h[0] = (uint8_t)(len >> 16);
+	h[1] = (uint8_t)(len >> 8);
+	h[2] = (uint8_t)len;
+	h[3] = type;
+	h[4] = flags;
+	lws_ser_wu32be(&h[5], sid);
+
+	return cli_send(h, sizeof(h)) || (len && cli_send(pl, len));
+}
+
+static int
+send_window_update(uint32_t sid, uint32_t credit)
+{
+	uint8_t pl[4];
+
+	lws_ser_wu32be(pl, credit);
+
+	return send_frame(H2F_WINDOW_UPDATE, 0, sid, pl, sizeof(pl));
+}
+
+static int
+send_get(uint32_t sid, const char *path)
+{
+	uint8_t hb[128], *p = hb;
+	size_t pl = strlen(path);
+
+	*p++ = 0x82; /* :method: GET */
+	*p++ = 0x86; /* :scheme: http */
+	*p++ = 0x04; /* :path, literal without indexing */
+	*p++ = (uint8_t)pl;
+	memcpy(p, path, pl);
+	p += pl;
+	*p++ = 0x01; /* :authority, literal without indexing */
+	*p++ = 9;
+	memcpy(p, "localhost", 9);
+	p += 9;
+
+	return send_frame(H2F_HEADERS, H2FL_END_HEADERS | H2FL_END_STREAM, sid,
+			  hb, lws_ptr_diff_size_t(p, hb));
+}
+
+static int
+cli_connect(int port)
+{
+	static const char preface[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+	struct timeval tv = { 5, 0 };
+	struct sockaddr_in sa;
+
+	settings_acks = 0;
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0)
+		return 1;
+
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sin_family = AF_INET;
+	sa.sin_port = htons((uint16_t)port);
+	sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if (connect(fd, (struct sockaddr *)&sa, sizeof(sa))) {
+		lwsl_err("%s: connect failed\n", __func__);
+		close(fd);
+		fd = -1;
+
+		return 1;
+	}
+
+	return cli_send(preface, sizeof(preface) - 1) ||
+	       send_frame(H2F_SETTINGS, 0, 0, NULL, 0);
+}
+
+static void
+cli_close(void)
+{
+	if (fd >= 0)
+		close(fd);
+	fd = -1;
+}
+
+static int
+recv_all(void *buf, size_t len)
+{
+	ssize_t n;
+
+	while (len) {
+		n = recv(fd, buf, len, 0);
+		if (n <= 0)
+			return 1;
+		buf = (uint8_t *)buf + n;
+		len -= (size_t)n;
+	}
+
+	return 0;
+}
+
+/*
+ * Read the next frame for the test, answering the server's SETTINGS and PING
+ */
+
+static int
+read_frame(struct frame *f)
+{
+	uint8_t h[9];
+
+	do {
+		if (recv_all(h, sizeof(h))) {
+			lwsl_notice("%s: no frame from server\n", __func__);
+			return 1;
+		}
+
+		f->len = (uint32_t)((h[0] << 16) | (h[1] << 8) | h[2]);
+		f->type = h[3];
+		f->flags = h[4];
+		f->sid = lws_ser_ru32be(&h[5]) & 0x7fffffff;
+
+		if (f->len > sizeof(f->pl) || recv_all(f->pl, f->len)) {
+			lwsl_err("%s: bad frame len %u\n", __func__,
+				 (unsigned int)f->len);
+			return 1;
+		}
+
+		switch (f->type) {
+		case H2F_SETTINGS:
+			if (f->flags & H2FL_ACK) {
+				settings_acks++;
+				break;
+			}
+			if (send_frame(H2F_SETTINGS, H2FL_ACK, 0, NULL, 0))
+				return 1;
+			continue;
+
+		case H2F_PING:
+			if (f->flags & H2FL_ACK)
+				continue;
+			if (send_frame(H2F_PING, H2FL_ACK, 0, f->pl, f->len))
+				return 1;
+			continue;
+
+		case H2F_GOAWAY:
+			lwsl_notice("%s: GOAWAY, err 0x%x\n", __func__,
+				    (unsigned int)(f->len >= 8 ?
+					    lws_ser_ru32be(&f->pl[4]) : 0));
+			break;
+
+		case H2F_RST_STREAM:
+			lwsl_notice("%s: RST_STREAM sid %u, err 0x%x\n",
+				    __func__, (unsigned int)f->sid,
+				    (unsigned int)(f->len >= 4 ?
+					    lws_ser_ru32be(f->pl) : 0));
+			break;
+		}
+
+		return 0;
+	} while (1);
+}
+
+/*
+ * Each new stream makes the server grant us more connection window, which only
+ * comes back down as we send DATA.  With enough short streams, that must not
+ * take the window past 2^31 - 1, since we would have to treat that as a
+ * connection error.
+ */
+
+static int
+test_many_streams(int port)
+{
+	int64_t window = 65535;
+	uint32_t sid = 1;
+	struct frame f;
+	int n, open;
+
+	if (cli_connect(port))
+		goto bail;
+
+	for (n = 0; n < STREAMS; n += BATCH) {
+		for (open = 0; open < BATCH; open++, sid += 2)
+			if (send_get(sid, "/"))
+				goto bail;
+
+		while (open) {
+			if (read_frame(&f))
+				goto bail;
+
+			switch (f.type) {
+			case H2F_HEADERS:
+			case H2F_DATA:
+				if (f.flags & H2FL_END_STREAM)
+					open--;
+				break;
+
+			case H2F_WINDOW_UPDATE:
+				if (f.sid)
+					break;
+				window += lws_ser_ru32be(f.pl) & 0x7fffffff;
+				if (window > 0x7fffffff) {
+					lwsl_err("%s: window 0x%llx after %d "
+						 "streams\n", __func__,
+						 (unsigned long long)window, n);
+					goto bail;
+				}
+				break;
+
+			case H2F_GOAWAY:
+			case H2F_RST_STREAM:
+				goto bail;
+			}
+		}
+	}
+
+	cli_close();
+	lwsl_user("%s: PASS\n", __func__);
+
+	return 0;
+
+bail:
+	cli_close();
+	lwsl_user("%s: FAIL\n", __func__);
+
+	return 1;
+}
+
+/*
+ * Let the server use some of its window for a stream, then reduce
+ * SETTINGS_INITIAL_WINDOW_SIZE to 0, so the server's window for the stream goes
+ * negative.  WINDOW_UPDATEs that leave it negative, and that bring it back, are
+ * well within the limit and the server must finish the stream.
+ */
+
+static int
+test_negative_window(int port)
+{
+	uint8_t set[6];
+	struct frame f;
+	size_t rx = 0;
+	int phase = 0;
+
+	if (cli_connect(port) || send_get(1, "/big"))
+		goto bail;
+
+	do {
+		if (read_frame(&f))
+			goto bail;
+
+		switch (f.type) {
+		case H2F_DATA:
+			rx += f.len;
+			if (f.flags & H2FL_END_STREAM) {
+				if (phase != 2)
+					/* it ignored our window */
+					goto bail;
+				phase = 3;
+			}
+			break;
+
+		case H2F_GOAWAY:
+		case H2F_RST_STREAM:
+			goto bail;
+		}
+
+		if (!phase && rx) {
+			/* we haven't given any credit back, take it away */
+			lws_ser_wu16be(set, H2SET_INITIAL_WINDOW);
+			lws_ser_wu32be(&set[2], 0);
+			if (send_frame(H2F_SETTINGS, 0, 0, set, sizeof(set)))
+				goto bail;
+			phase = 1;
+		}
+
+		if (phase == 1 && settings_acks == 2) {
+			/*
+			 * It has applied the new setting.  First give it a
+			 * little that leaves its window still negative, then
+			 * enough to finish
+			 */
+			if (send_window_update(0, BIG_LEN) ||
+			    send_window_update(1, 1) ||
+			    send_window_update(1, BIG_LEN))
+				goto bail;
+			phase = 2;
+		}
+	} while (phase != 3);
+
+	if (rx != BIG_LEN) {
+		lwsl_err("%s: rx %u\n", __func__, (unsigned int)rx);
+		goto bail;
+	}
+
+	cli_close();
+	lwsl_user("%s: PASS\n", __func__);
+
+	return 0;
+
+bail:
+	cli_close();
+	lwsl_user("%s: FAIL\n", __func__);
+
+	return 1;
+}
+
+/*
+ * A header block using huffman strings from rfc7541 appendix C, with ua as a
+ * huffman user-agent value, so we can also send broken ones
+ */
+
+static const uint8_t huff_www_example[] = {
+	0xf1, 0xe3, 0xc2, 0xe5, 0xf2, 0x3a, 0x6b, 0xa0, 0xab, 0x90, 0xf4, 0xff
+}, huff_date[] = {
+	0xd0, 0x7a, 0xbe, 0x94, 0x10, 0x54, 0xd4, 0x44, 0xa8, 0x20, 0x05, 0x95,
+	0x04, 0x0b, 0x81, 0x66, 0xe0, 0x82, 0xa6, 0x2d, 0x1b, 0xff
+}, huff_https_www_example[] = {
+	0x9d, 0x29, 0xad, 0x17, 0x18, 0x63, 0xc7, 0x8f, 0x0b, 0x97, 0xc8, 0xe9,
+	0xae, 0x82, 0xae, 0x43, 0xd3
+}, huff_no_cache[] = {
+	0xa8, 0xeb, 0x10, 0x64, 0x9c, 0xbf
+};
+
+static const char echo_expected[] = "/echo/a b|www.example.com|"
+	"Mon, 21 Oct 2013 20:13:21 GMT|https://www.example.com|no-cache|";
+
+static size_t
+echo_block(uint8_t *hb, const uint8_t *ua, size_t ual)
+{
+	uint8_t *p = hb;
+
+	*p++ = 0x82; /* :method: GET */
+	*p++ = 0x86; /* :scheme: http */
+	*p++ = 0x04; /* :path, literal without indexing, raw */
+	*p++ = 11;
+	memcpy(p, "/echo/a%20b", 11);
+	p += 11;
+	*p++ = 0x01; /* :authority, literal without indexing, huffman */
+	*p++ = 0x80 | sizeof(huff_www_example);
+	memcpy(p, huff_www_example, sizeof(huff_www_example));
+	p += sizeof(huff_www_example);
+	*p++ = 0x0f; /* user-agent (58) */
+	*p++ = 58 - 15;
+	*p++ = (uint8_t)(0x80 | ual);
+	memcpy(p, ua, ual);
+	p += ual;
+	*p++ = 0x0f; /* referer (51) */
+	*p++ = 51 - 15;
+	*p++ = 0x80 | sizeof(huff_https_www_example);
+	memcpy(p, huff_https_www_example, sizeof(huff_https_www_example));
+	p += sizeof(huff_https_www_example);
+	*p++ = 0x0f; /* cache-control (24) */
+	*p++ = 24 - 15;
+	*p++ = 0x80 | sizeof(huff_no_cache);
+	memcpy(p, huff_no_cache, sizeof(huff_no_cache));
+	p += sizeof(huff_no_cache);
+
+	return lws_ptr_diff_size_t(p, hb);
+}
+
+/*
+ * Send a header block as a HEADERS frame with the first "first" bytes,
+ * then CONTINUATION frames of up to "chunk" bytes.  pad is 0 for none, 1 for
+ * a padded HEADERS, 2 for padded with a priority part too.
+ */
+
+static int
+send_block(uint32_t sid, const uint8_t *hb, size_t len, size_t first,
+	   size_t chunk, int pad)
+{
+	uint8_t f[256], *p = f, fl = H2FL_END_STREAM;
+
+	if (first > len)
+		first = len;
+
+	if (pad) {
+		fl |= H2FL_PADDED;
+		*p++ = pad == 1 ? 7 : 3;
+	}
+	if (pad == 2) {
+		fl |= H2FL_PRIORITY;
+		memset(p, 0, 4); /* exclusive 0, depends on sid 0 */
+		p += 4;
+		*p++ = 15; /* weight */
+	}
+	memcpy(p, hb, first);
+	p += first;
+	if (pad) {
+		memset(p, 0, f[0]);
+		p += f[0];
+	}
+
+	if (first == len)
+		fl |= H2FL_END_HEADERS;
+	if (send_frame(H2F_HEADERS, fl, sid, f, lws_ptr_diff_size_t(p, f)))
+		return 1;
+
+	hb += first;
+	len -= first;
+	while (len) {
+		first = len < chunk ? len : chunk;
+		if (send_frame(H2F_CONTINUATION, first == len ?
+						H2FL_END_HEADERS : 0,
+			       sid, hb, first))
+			return 1;
+		hb += first;
+		len -= first;
+	}
+
+	return 0;
+}
+
+/* after read_frame() failed, did the server close the connection? */
+
+static int
+cli_closed(void)
+{
+	uint8_t c;
+	ssize_t n = recv(fd, &c, 1, MSG_DONTWAIT);
+
+	return !n || (n < 0 && errno == ECONNRESET);
+}
+
+/*
+ * Read until the stream finishes, and check what the server echoed.  Returns
+ * 0 if it matched, 1 if not, 2 if the server sent GOAWAY with err, or 3 if it
+ * closed the connection.
+ */
+
+static int
+echo_response(uint32_t sid, uint32_t *err)
+{
+	char rx[512];
+	struct frame f;
+	size_t len = 0;
+
+	do {
+		if (read_frame(&f))
+			return cli_closed() ? 3 : 1;
+
+		switch (f.type) {
+		case H2F_DATA:
+			if (f.sid != sid || len + f.len >= sizeof(rx))
+				return 1;
+			memcpy(rx + len, f.pl, f.len);
+			len += f.len;
+			break;
+
+		case H2F_GOAWAY:
+			*err = f.len >= 8 ? lws_ser_ru32be(&f.pl[4]) : 0;
+			return 2;
+
+		case H2F_RST_STREAM:
+			return 1;
+		}
+	} while (f.type != H2F_DATA || !(f.flags & H2FL_END_STREAM));
+
+	rx[len] = '\0';
+	if (strcmp(rx, echo_expected)) {
+		lwsl_err("%s: sid %u: got '%s'\n", __func__,
+			 (unsigned int)sid, rx);
+		return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * The server must decode the same headers however the block is split across
+ * HEADERS and CONTINUATION frames, and with padding, and must refuse huffman
+ * strings with more than 7 bits of padding, padding that isn't all 1s, or EOS
+ * in them
+ */
+
+static int
+test_headers(int port)
+{
+	static const uint8_t pad8[] = { /* www.example.com and 8 more 1s */
+		0xf1, 0xe3, 0xc2, 0xe5, 0xf2, 0x3a, 0x6b, 0xa0, 0xab, 0x90,
+		0xf4, 0xff, 0xff
+	}, pad0[] = { /* no-cache with 10000 as padding */
+		0xa8, 0xeb, 0x10, 0x64, 0x9c, 0xb0
+	}, eos[] = { /* 30 bits of EOS and 2 of padding */
+		0xff, 0xff, 0xff, 0xff
+	};
+	static const struct {
+		const uint8_t	*ua;
+		size_t		len;
+	} bad[] = {
+		{ pad8, sizeof(pad8) },
+		{ pad0, sizeof(pad0) },
+		{ eos, sizeof(eos) },
+	};
+	uint8_t hb[192], bhb[192];
+	uint32_t sid = 1, err;
+	size_t len, blen, n;
+	int pad, r;
+
+	len = echo_block(hb, huff_date, sizeof(huff_date));
+
+	if (cli_connect(port))
+		goto bail;
+
+	/* in one frame, then split at every offset */
+
+	for (n = 1; n <= len; n++, sid += 2)
+		if (send_block(sid, hb, len, n, len, 0) ||
+		    echo_response(sid, &err))
+			goto bail;
+
+	/* a byte per frame */
+
+	if (send_block(sid, hb, len, 1, 1, 0) || echo_response(sid, &err))
+		goto bail;
+	sid += 2;
+
+	/* padded, with and without priority, whole and split */
+
+	for (pad = 1; pad <= 2; pad++)
+		for (n = 0; n < 2; n++, sid += 2)
+			if (send_block(sid, hb, len, n ? 9 : len, 5, pad) ||
+			    echo_response(sid, &err))
+				goto bail;
+
+	cli_close();
+
+	/*
+	 * The server may not get its GOAWAY out before it drops the
+	 * connection, so either is a rejection... but only if the connection
+	 * was fine until the bad string
+	 */
+
+	for (n = 0; n < LWS_ARRAY_SIZE(bad); n++) {
+		blen = echo_block(bhb, bad[n].ua, bad[n].len);
+
+		if (cli_connect(port) || send_block(1, hb, len, len, len, 0) ||
+		    echo_response(1, &err) ||
+		    send_block(3, bhb, blen, blen, blen, 0))
+			goto bail;
+
+		r = echo_response(3, &err);
+		if (r < 2 || (r == 2 && err != H2ERR_COMPRESSION)) {
+			lwsl_err("%s: bad string %d not rejected\n", __func__,
+				 (int)n);
+			goto bail;
+		}
+
+		cli_close();
+	}
+
+	lwsl_user("%s: PASS\n", __func__);
+
+	return 0;
+
+bail:
+	cli_close();
+	lwsl_user("%s: FAIL\n", __func__);
+
+	return 1;
+}
+
+#if defined(LWS_WITH_CLIENT) && defined(LWS_WITH_TLS)
+
+/*
+ * For the hpack test, an lws h2 client talks to the server through a relay
+ * thread.  The relay passes frames unchanged, except that it can slip
+ * SETTINGS_HEADER_TABLE_SIZE changes of its own into the client's side, and
+ * drop the server's ACKs for them, so neither end's state machine is upset.
+ * It also notes the size of each response HEADERS block, and what table size
+ * updates and never-indexed fields are in it, so we can see what the server
+ * chose to do with its table.
+ */
+
+/* the table size changes we make before some rounds */
+
+static const struct {
+	int			round;
+	int			count;
+	uint32_t		size[2];
+} sched[] = {
+	{  6, 1, {  512,    0 } }, /* shrink */
+	{ 12, 2, {    0, 4096 } }, /* empty it, then grow */
+	{ 18, 2, {  256, 1024 } }, /* shrink and grow, before a raw block */
+};
+
+struct relay_dir {
+	int			from;
+	int			to;
+	size_t			skip; /* unframed bytes to pass, ie, preface */
+	size_t			len;
+	uint8_t			buf[65536];
+};
+
+static struct {
+	pthread_mutex_t		lock;
+	struct relay_dir	dir[2];
+	uint32_t		inject[2];
+	uint32_t		hdr_len[HPACK_ROUNDS];
+	uint32_t		update[HPACK_ROUNDS][2];
+	uint8_t			updates[HPACK_ROUNDS];
+	uint8_t			never[HPACK_ROUNDS];
+	uint8_t			fifo[32]; /* 1 = a SETTINGS we injected */
+	unsigned int		fifo_head;
+	unsigned int		fifo_tail;
+	int			inject_count;
+	int			lfd;
+} relay;
+
+static struct {
+	struct lws_context	*cx;
+	int			port;
+	int			round;
+	int			checked;
+	char			fail;
+	char			done;
+} hp;
+
+static int
+relay_send(int to, const void *buf, size_t len)
+{
+	return send(to, buf, len, MSG_NOSIGNAL) != (ssize_t)len;
+}
+
+static int
+relay_int(const uint8_t **p, const uint8_t *end, int bits, uint32_t *v)
+{
+	unsigned int m = 0;
+	uint8_t c;
+
+	if (*p >= end)
+		return 1;
+
+	*v = *((*p)++) & ((1u << bits) - 1);
+	if (*v != (1u << bits) - 1)
+		return 0;
+
+	do {
+		if (*p >= end || m > 21)
+			return 1;
+		c = *((*p)++);
+		*v += (uint32_t)(c & 0x7f) << m;
+		m += 7;
+	} while (c & 0x80);
+
+	return 0;
+}
+
+static int
+relay_str(const uint8_t **p, const uint8_t *end)
+{
+	uint32_t len;
+
+	if (relay_int(p, end, 7, &len) || lws_ptr_diff_size_t(end, *p) < len)
+		return 1;
+	*p += len;
+
+	return 0;
+}
+
+/*
+ * Walk the field representations in a response block, noting the table size
+ * updates and how many fields were never indexed
+ */
+
+static int
+relay_scan_block(int r, const uint8_t *p, const uint8_t *end)
+{
+	uint32_t v;
+	uint8_t c;
+
+	while (p < end) {
+		c = *p;
+
+		if (c & 0x80) { /* indexed */
+			if (relay_int(&p, end, 7, &v))
+				return 1;
+			continue;
+		}
+
+		if ((c & 0xe0) == 0x20) { /* table size update */
+			if (relay_int(&p, end, 5, &v))
+				return 1;
+			if (relay.updates[r] < 2)
+				relay.update[r][relay.updates[r]] = v;
+			relay.updates[r]++;
+			continue;
+		}
+
+		if ((c & 0xf0) == 0x10)
+			relay.never[r]++;
+
+		if (relay_int(&p, end, (c & 0x40) ? 6 : 4, &v) ||
+		    (!v && relay_str(&p, end)) || relay_str(&p, end))
+			return 1;
+	}
+
+	return 0;
+}
+
+static int
+relay_frame(int c2s, int to, const uint8_t *f, size_t len)
+{
+	uint32_t sid = lws_ser_ru32be(&f[5]) & 0x7fffffff;
+	uint8_t set[15];
+	int n, drop = 0;
+
+	pthread_mutex_lock(&relay.lock);
+
+	if (c2s) {
+		for (n = 0; n < relay.inject_count; n++) {
+			memset(set, 0, sizeof(set));
+			set[2] = 6;
+			set[3] = H2F_SETTINGS;
+			lws_ser_wu16be(&set[9], H2SET_HEADER_TABLE_SIZE);
+			lws_ser_wu32be(&set[11], relay.inject[n]);
+			if (relay_send(to, set, sizeof(set)))
+				goto bail;
+			relay.fifo[relay.fifo_head++ % sizeof(relay.fifo)] = 1;
+		}
+		relay.inject_count = 0;
+
+		if (f[3] == H2F_SETTINGS && !(f[4] & H2FL_ACK))
+			relay.fifo[relay.fifo_head++ % sizeof(relay.fifo)] = 0;
+	} else {
+		if (f[3] == H2F_SETTINGS && (f[4] & H2FL_ACK) &&
+		    relay.fifo_tail != relay.fifo_head)
+			drop = relay.fifo[relay.fifo_tail++ %
+							sizeof(relay.fifo)];
+
+		/*
+		 * The lws client starts at sid 3.  The server's blocks are
+		 * small, so they come in one HEADERS without padding.
+		 */
+		if (f[3] == H2F_HEADERS && sid >= 3 &&
+		    (sid - 3) / 2 < HPACK_ROUNDS) {
+			relay.hdr_len[(sid - 3) / 2] = (uint32_t)(len - 9);
+			if (relay_scan_block((int)(sid - 3) / 2, f + 9, f + len))
+				goto bail;
+		}
+	}
+
+	pthread_mutex_unlock(&relay.lock);
+
+	return !drop && relay_send(to, f, len);
+
+bail:
+	pthread_mutex_unlock(&relay.lock);
+
+	return 1;
+}
+
+static int
+relay_frames(int c2s, struct relay_dir *d)
+{
+	uint8_t *p = d->buf;
+	size_t left = d->len, fl;
+
+	if (d->skip) {
+		fl = left < d->skip ? left : d->skip;
+		if (relay_send(d->to, p, fl))
+			return 1;
+		d->skip -= fl;
+		p += fl;
+		left -= fl;
+	}
+
+	while (left >= 9) {
+		fl = 9 + (size_t)((p[0] << 16) | (p[1] << 8) | p[2]);
+		if (left < fl)
+			break;
+		if (relay_frame(c2s, d->to, p, fl))
+			return 1;
+		p += fl;
+		left -= fl;
+	}
+
+	memmove(d->buf, p, left);
+	d->len = left;
+
+	return 0;
+}
+
+static void *
+thread_relay(void *d)
+{
+	struct pollfd pfd[2];
+	struct sockaddr_in sa;
+	int c, s, n;
+	ssize_t r;
+
+	c = accept(relay.lfd, NULL, NULL);
+	if (c < 0)
+		goto bail;
+
+	s = socket(AF_INET, SOCK_STREAM, 0);
+	if (s < 0)
+		goto bail1;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sin_family = AF_INET;
+	sa.sin_port = htons((uint16_t)(intptr_t)d);
+	sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if (connect(s, (struct sockaddr *)&sa, sizeof(sa)))
+		goto bail2;
+
+	relay.dir[0].from = relay.dir[1].to = c;
+	relay.dir[0].to = relay.dir[1].from = s;
+	relay.dir[0].skip = 24; /* the client connection preface */
+
+	while (1) {
+		pfd[0].fd = c;
+		pfd[1].fd = s;
+		pfd[0].events = pfd[1].events = POLLIN;
+		pfd[0].revents = pfd[1].revents = 0;
+
+		if (poll(pfd, 2, 10000) <= 0)
+			break;
+
+		for (n = 0; n < 2; n++) {
+			struct relay_dir *rd = &relay.dir[n];
+
+			if (!pfd[n].revents)
+				continue;
+
+			r = recv(rd->from, rd->buf + rd->len,
+				 sizeof(rd->buf) - rd->len, 0);
+			if (r <= 0)
+				goto bail2;
+
+			rd->len += (size_t)r;
+			if (relay_frames(!n, rd))
+				goto bail2;
+		}
+	}
+
+bail2:
+	close(s);
+bail1:
+	close(c);
+bail:
+	pthread_exit(NULL);
+
+	return NULL;
+}
+
+/*
+ * Ask for the next round, on the same connection since the last round's stream
+ * is still around
+ */
+
+static int
+hpack_connect(void)
+{
+	struct lws_client_connect_info i;
+	char path[32];
+	size_t n;
+
+	for (n = 0; n < LWS_ARRAY_SIZE(sched); n++)
+		if (sched[n].round == hp.round) {
+			pthread_mutex_lock(&relay.lock);
+			memcpy(relay.inject, sched[n].size,
+			       sizeof(relay.inject));
+			relay.inject_count = sched[n].count;
+			pthread_mutex_unlock(&relay.lock);
+		}
+
+	lws_snprintf(path, sizeof(path), "/hpack/%d", hp.round);
+
+	memset(&i, 0, sizeof i);
+	i.context = hp.cx;
+	i.port = hp.port;
+	i.address = "127.0.0.1";
+	i.path = path;
+	i.host = i.address;
+	i.origin = i.address;
+	i.method = "GET";
+	i.protocol = "hpack";
+	i.alpn = "h2";
+	i.ssl_connection = LCCSCF_H2_PRIOR_KNOWLEDGE | LCCSCF_PIPELINE;
+
+	return !lws_client_connect_via_info(&i);
+}
+
+static int
+callback_hpack(struct lws *wsi, enum lws_callback_reasons reason, void *user,
+	       void *in, size_t len)
+{
+	char exp[1024], got[1024], rb[LWS_PRE + 256], *px = rb + LWS_PRE;
+	int n, lenx = (int)sizeof(rb) - LWS_PRE;
+
+	switch (reason) {
+	case LWS_CALLBACK_CLIENT_CONNECTION_ERROR:
+		lwsl_err("%s: round %d: %s\n", __func__, hp.round,
+			 in ? (const char *)in : "(null)");
+		hp.fail = hp.done = 1;
+		return 0;
+
+	case LWS_CALLBACK_ESTABLISHED_CLIENT_HTTP:
+		if (!lws_http_client_http_response(wsi))
+			/* we joined the h2 connection, no response yet */
+			return 0;
+		if (lws_http_client_http_response(wsi) != HTTP_STATUS_OK)
+			hp.fail = 1;
+
+		hp.checked++;
+		for (n = 0; n < (int)LWS_ARRAY_SIZE(hpack_toks); n++) {
+			hpack_hdr(hp.round, n, exp, sizeof(exp));
+			if (lws_hdr_copy(wsi, got, sizeof(got),
+					 hpack_toks[n]) < 0 ||
+			    strcmp(exp, got)) {
+				lwsl_err("%s: round %d, header %d: got '%s'\n",
+					 __func__, hp.round, n, got);
+				hp.fail = 1;
+			}
+		}
+		return 0;
+
+	case LWS_CALLBACK_RECEIVE_CLIENT_HTTP:
+		if (lws_http_client_read(wsi, &px, &lenx) < 0)
+			return -1;
+		return 0;
+
+	case LWS_CALLBACK_RECEIVE_CLIENT_HTTP_READ:
+	case LWS_CALLBACK_CLIENT_APPEND_HANDSHAKE_HEADER:
+	case LWS_CALLBACK_CLIENT_HTTP_WRITEABLE:
+	case LWS_CALLBACK_CLOSED_CLIENT_HTTP:
+		/*
+		 * the dummy callback would treat us as the client side of
+		 * its http proxy, which we are not
+		 */
+		return 0;
+
+	case LWS_CALLBACK_COMPLETED_CLIENT_HTTP:
+		if (hp.fail || ++hp.round == HPACK_ROUNDS) {
+			hp.done = 1;
+			return 0;
+		}
+		if (hpack_connect())
+			hp.fail = hp.done = 1;
+		return 0;
+
+	default:
+		break;
+	}
+
+	return lws_callback_http_dummy(wsi, reason, user, in, len);
+}
+
+static const struct lws_protocols protocols_hpack[] = {
+	{ "hpack", callback_hpack, 0, 0, 0, NULL, 0 },
+	LWS_PROTOCOL_LIST_TERM
+};
+
+/*
+ * The server's encoder keeps its own copy of our decoder's dynamic table, if
+ * they ever disagree, headers decode wrongly from then on.  Run many responses
+ * through one connection while the table evicts, shrinks, empties and grows,
+ * and check every header comes out as it went in.
+ *
+ * Set-cookie must always go out never indexed, and when the table shrinks and
+ * grows between blocks, the next block must announce the smallest size first,
+ * even when it's one the encoder otherwise sends as it is (round 18).
+ *
+ * Odd rounds repeat the big vary header from the round before, where the
+ * table is big enough that must cost much less the second time, and where it
+ * was shrunk to 512 it can't have been indexed.
+ */
+
+static int
+test_hpack(int port)
+{
+	struct lws_context_creation_info info;
+	struct sockaddr_in sa;
+	socklen_t sl = sizeof(sa);
+	lws_usec_t until;
+	pthread_t pt;
+	int r, n, small;
+
+	memset(&relay, 0, sizeof(relay));
+	pthread_mutex_init(&relay.lock, NULL);
+
+	relay.lfd = socket(AF_INET, SOCK_STREAM, 0);
+	if (relay.lfd < 0)
+		goto bail;
+
+	memset(&sa, 0, sizeof(sa));
+	sa.sin_family = AF_INET;
+	sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (bind(relay.lfd, (struct sockaddr *)&sa, sizeof(sa)) ||
+	    listen(relay.lfd, 1) ||
+	    getsockname(relay.lfd, (struct sockaddr *)&sa, &sl))
+		goto bail1;
+
+	memset(&hp, 0, sizeof(hp));
+	hp.port = ntohs(sa.sin_port);
+
+	memset(&info, 0, sizeof info);
+	info.port = CONTEXT_PORT_NO_LISTEN;
+	info.protocols = protocols_hpack;
+
+	hp.cx = lws_create_context(&info);
+	if (!hp.cx)
+		goto bail1;
+
+	if (pthread_create(&pt, NULL, thread_relay, (void *)(intptr_t)port)) {
+		lws_context_destroy(hp.cx);
+		goto bail1;
+	}
+
+	if (hpack_connect())
+		hp.fail = hp.done = 1;
+
+	until = lws_now_usecs() + 20 * LWS_US_PER_SEC;
+	while (!hp.done && lws_now_usecs() < until &&
+	       lws_service(hp.cx, 0) >= 0)
+		;
+
+	lws_context_destroy(hp.cx);
+	pthread_join(pt, NULL);
+	close(relay.lfd);
+	pthread_mutex_destroy(&relay.lock);
+
+	if (hp.fail || hp.round != HPACK_ROUNDS ||
+	    hp.checked != HPACK_ROUNDS) {
+		lwsl_err("%s: failed at round %d\n", __func__, hp.round);
+		goto bail;
+	}
+
+	for (r = 0; r < HPACK_ROUNDS; r++) {
+		const uint32_t *u = NULL;
+		int count = 0;
+
+		if (relay.never[r] != (r != HPACK_RAW_ROUND)) {
+			/*
+			 * only set-cookie must not be indexed, except in the
+			 * block we sent as it was, where nothing is
+			 */
+			lwsl_err("%s: round %d: %d never indexed\n", __func__,
+				 r, relay.never[r]);
+			goto bail;
+		}
+
+		for (n = 0; n < (int)LWS_ARRAY_SIZE(sched); n++)
+			if (sched[n].round == r) {
+				u = sched[n].size;
+				count = sched[n].count;
+			}
+
+		/* after a shrink and grow, the smallest must come first */
+
+		if (r && (relay.updates[r] != count ||
+			  (count && memcmp(relay.update[r], u,
+					   (size_t)count * sizeof(*u))))) {
+			lwsl_err("%s: round %d: %d table size updates\n",
+				 __func__, r, relay.updates[r]);
+			goto bail;
+		}
+	}
+
+	for (r = 1; r < HPACK_ROUNDS; r += 2) {
+		if (r - 1 == HPACK_RAW_ROUND)
+			/* no huffman in the raw block, they can't compare */
+			continue;
+
+		small = relay.hdr_len[r] + 300 < relay.hdr_len[r - 1];
+		if (small == (r >= 6 && r < 12)) {
+			lwsl_err("%s: round %d headers %u, round %d %u\n",
+				 __func__, r - 1,
+				 (unsigned int)relay.hdr_len[r - 1], r,
+				 (unsigned int)relay.hdr_len[r]);
+			goto bail;
+		}
+	}
+
+	lwsl_user("%s: PASS\n", __func__);
+
+	return 0;
+
+bail1:
+	close(relay.lfd);
+	pthread_mutex_destroy(&relay.lock);
+bail:
+	lwsl_user("%s: FAIL\n", __func__);
+
+	return 1;
+}
+
+#endif
+
+int main(int argc, const char **argv)
+{
+	int logs = LLL_USER | LLL_ERR | LLL_WARN, ret = 1, port;
+	struct lws_context_creation_info info;
+	pthread_t pt;
+	const char *p;
+
+	if ((p = lws_cmdline_option(argc, argv, "-d")))
+		logs = atoi(p);
+
+	lws_set_log_level(logs, NULL);
+	lwsl_user("LWS API selftest: h2\n");
+
+	memset(body, 'x', sizeof(body));
+
+	memset(&info, 0, sizeof info);
+	info.port = 0; /* any free port */
+	info.protocols = protocols;
+	info.options = LWS_SERVER_OPTION_H2_PRIOR_KNOWLEDGE;
+
+	cx = lws_create_context(&info);
+	if (!cx) {
+		lwsl_err("lws init failed\n");
+		return 1;
+	}
+
+	port = lws_get_vhost_listen_port(lws_get_vhost_by_name(cx, "default"));
+
+	if (pthread_create(&pt, NULL, thread_service, NULL)) {
+		lwsl_err("thread creation failed\n");
+		goto bail;
+	}
+
+	ret = test_many_streams(port);
+	ret |= test_negative_window(port);
+	ret |= test_headers(port);
+#if defined(LWS_WITH_CLIENT) && defined(LWS_WITH_TLS)
+	ret |= test_hpack(port);
+#endif
+
+	stop = 1;
+	lws_cancel_service(cx);
+	pthread_join(pt, NULL);
+
+bail:
+	lws_context_destroy(cx);
+
+	lwsl_user("Completed: %s\n", ret ? "FAIL" : "PASS");
+
+	return ret;
+}
@@ -153,6 +153,97 @@ cdone:
 	return ret;
 }
 
+static int
+test_just_l1_many(void)
+{
+	struct lws_cache_creation_info ci;
+	struct lws_cache_ttl_lru *l1;
+	lws_usec_t now = lws_now_usecs(), us;
+	int ret = 1, n, count = 5000;
+	char key[32], val[32];
+	size_t size;
+	char *po;
+
+	lwsl_user("%s\n", __func__);
+	tests++;
+
+	memset(&ci, 0, sizeof(ci));
+	ci.cx = cx;
+	ci.ops = &lws_cache_ops_heap;
+	ci.name = "L1_many";
+
+	l1 = lws_cache_create(&ci);
+	if (!l1)
+		goto cdone;
+
+	/* add many items, with expiries scattered over the next hour */
+
+	for (n = 0; n < count; n++) {
+		lws_snprintf(key, sizeof(key), "many.%d", n);
+		lws_snprintf(val, sizeof(val), "v%d", n);
+		if (lws_cache_write_through(l1, key, (const uint8_t *)val,
+				strlen(val) + 1, (n & 3) ? 0 : now +
+				(lws_usec_t)(60 + ((n * 7919) % 3600)) *
+							LWS_US_PER_SEC, NULL))
+			goto cdone;
+	}
+
+	/* replace some, invalidate some others */
+
+	for (n = 0; n < count; n += 5) {
+		lws_snprintf(key, sizeof(key), "many.%d", n);
+		lws_snprintf(val, sizeof(val), "r%d", n);
+		if (lws_cache_write_through(l1, key, (const uint8_t *)val,
+				strlen(val) + 1, now + LWS_US_PER_SEC * 30,
+				NULL))
+			goto cdone;
+	}
+
+	for (n = 3; n < count; n += 7) {
+		lws_snprintf(key, sizeof(key), "many.%d", n);
+		lws_cache_item_remove(l1, key);
+	}
+
+	/* check everything is as it should be */
+
+	us = lws_now_usecs();
+	for (n = 0; n < count; n++) {
+		int e;
+
+		lws_snprintf(key, sizeof(key), "many.%d", n);
+		e = lws_cache_item_get(l1, key, (const void **)&po, &size);
+		if (n % 7 == 3) {
+			if (!e) {
+				lwsl_err("%s: %s still exists\n", __func__,
+					 key);
+				goto cdone;
+			}
+			continue;
+		}
+		lws_snprintf(val, sizeof(val), "%c%d", n % 5 ? 'v' : 'r', n);
+		if (e || size != strlen(val) + 1 || strcmp(po, val)) {
+			lwsl_err("%s: %s wrong\n", __func__, key);
+			goto cdone;
+		}
+	}
+	us = lws_now_usecs() - us;
+
+	lwsl_user("%s: %d items, %dns per get\n", __func__, count,
+		  (int)((us * 1000) / count));
+
+	/* that's ok then */
+
+	ret = 0;
+
+cdone:
+	lws_cache_destroy(&l1);
+
+	if (ret)
+		lwsl_warn("%s: fail\n", __func__);
+
+	return ret;
+}
+
 #if defined(LWS_WITH_CACHE_NSCOOKIEJAR)
 
 static const char
@@ -495,6 +586,8 @@ int main(int argc, const char **argv)
 		fail++;
 	if (test_just_l1_limits())
 		fail++;
+	if (test_just_l1_many())
+		fail++;
 
 #if defined(LWS_WITH_CACHE_NSCOOKIEJAR)
 	if (test_nsc1())
@@ -0,0 +1,243 @@
+/*
+ * lws-api-test-lws_mount
+ *
+ * Written in 2010-2021 by Andy Green <andy@warmcat.com>
+ *
+ * This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * This api test confirms lws_vhost_find_mount() picks the same mount as the
+ * old linear scan of the mount list, for a vhost with a few mounts and one
+ * with enough that lws compiles them into a tree.  Then it benchmarks lookups
+ * on the big vhost against the linear scan.
+ */
+
+#include <libwebsockets.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#define MP_LEN 24
+
+static struct lws_http_mount *mounts;
+static char (*mps)[MP_LEN];
+static char (*paths)[MP_LEN + 16];
+static int count_paths;
+
+/*
+ * This is how lws found the mount before, longest mountpoint matching at a
+ * path segment boundary wins, the first one in the list on a tie
+ */
+
+static const struct lws_http_mount *
+scan(const struct lws_http_mount *hm, const char *uri, int uri_len)
+{
+	const struct lws_http_mount *hit = NULL;
+	int best = 0;
+
+	for (; hm; hm = hm->mount_next)
+		if (uri_len >= hm->mountpoint_len &&
+		    !strncmp(uri, hm->mountpoint, hm->mountpoint_len) &&
+		    (uri[hm->mountpoint_len] == '\0' ||
+		     uri[hm->mountpoint_len] == '/' ||
+		     hm->mountpoint_len == 1) &&
+		    hm->mountpoint_len > best) {
+			best = hm->mountpoint_len;
+			hit = hm;
+		}
+
+	return hit;
+}
+
+/*
+ * Mounts like an api gateway's... a catchall, per-tenant prefixes with
+ * nested api mounts, plugin endpoints, and a duplicated mountpoint
+ */
+
+static int
+make_mounts(int count)
+{
+	int n;
+
+	mounts = calloc((size_t)count, sizeof(*mounts));
+	mps = calloc((size_t)count, sizeof(*mps));
+	paths = calloc((size_t)count * 6 + 8, sizeof(*paths));
+	if (!mounts || !mps || !paths)
+		return 1;
+
+	for (n = 0; n < count; n++) {
+		if (!n)
+			lws_strncpy(mps[n], "/", sizeof(mps[n]));
+		else
+			if (n == count - 1)
+				lws_strncpy(mps[n], "/t0001", sizeof(mps[n]));
+			else
+				switch (n % 3) {
+				case 0:
+					lws_snprintf(mps[n], sizeof(mps[n]),
+						     "/t%04d", n / 3);
+					break;
+				case 1:
+					lws_snprintf(mps[n], sizeof(mps[n]),
+						     "/t%04d/api/v2", n / 3);
+					break;
+				default:
+					lws_snprintf(mps[n], sizeof(mps[n]),
+						     "/plugin/p%d", n);
+					break;
+				}
+
+		if (n)
+			mounts[n - 1].mount_next = &mounts[n];
+		mounts[n].mountpoint = mps[n];
+		mounts[n].mountpoint_len = (unsigned char)strlen(mps[n]);
+		mounts[n].origin = "/var/www";
+		mounts[n].origin_protocol = LWSMPRO_FILE;
+
+		lws_snprintf(paths[count_paths++], sizeof(paths[0]),
+			     "%s", mps[n]);
+		lws_snprintf(paths[count_paths++], sizeof(paths[0]),
+			     "%s/", mps[n]);
+		lws_snprintf(paths[count_paths++], sizeof(paths[0]),
+			     "%s/x/y.html", mps[n]);
+		lws_snprintf(paths[count_paths++], sizeof(paths[0]),
+			     "%sx", mps[n]);
+		lws_snprintf(paths[count_paths++], sizeof(paths[0]),
+			     "%s", mps[n]);
+		paths[count_paths - 1][strlen(mps[n]) - 1] = '\0';
+		lws_snprintf(paths[count_paths++], sizeof(paths[0]),
+			     "%s/api", mps[n]);
+	}
+
+	lws_strncpy(paths[count_paths++], "", sizeof(paths[0]));
+	lws_strncpy(paths[count_paths++], "/t", sizeof(paths[0]));
+	lws_strncpy(paths[count_paths++], "/plugin", sizeof(paths[0]));
+	lws_strncpy(paths[count_paths++], "/plugin/", sizeof(paths[0]));
+	lws_strncpy(paths[count_paths++], "nothing", sizeof(paths[0]));
+
+	return 0;
+}
+
+static int
+test_vhost(struct lws_vhost *vh, const struct lws_http_mount *list,
+	   const char *name)
+{
+	const struct lws_http_mount *a, *b;
+	int n, fails = 0;
+
+	for (n = 0; n < count_paths; n++) {
+		a = scan(list, paths[n], (int)strlen(paths[n]));
+		b = lws_vhost_find_mount(vh, paths[n], (int)strlen(paths[n]));
+		if (a != b) {
+			lwsl_err("%s: %s: '%s': expected %s, got %s\n",
+				 __func__, name, paths[n],
+				 a ? a->mountpoint : "none",
+				 b ? b->mountpoint : "none");
+			fails++;
+		}
+	}
+
+	return fails;
+}
+
+static void
+bench(struct lws_vhost *vh, int count, int lookups)
+{
+	lws_usec_t t[2], s;
+	const struct lws_http_mount *hit;
+	int n, m, found[2];
+
+	for (m = 0; m < 2; m++) {
+		found[m] = 0;
+		s = lws_now_usecs();
+		for (n = 0; n < lookups; n++) {
+			const char *p = paths[n % count_paths];
+			int len = (int)strlen(p);
+
+			hit = m ? lws_vhost_find_mount(vh, p, len) :
+				  scan(mounts, p, len);
+			if (hit)
+				found[m]++;
+		}
+		t[m] = lws_now_usecs() - s;
+	}
+
+	lwsl_user("bench: %d mounts: linear scan %dns, "
+		  "lws_vhost_find_mount %dns per lookup (%d / %d found)\n",
+		  count, (int)((t[0] * 1000) / lookups),
+		  (int)((t[1] * 1000) / lookups), found[0], found[1]);
+}
+
+int main(int argc, const char **argv)
+{
+	int logs = LLL_USER | LLL_ERR | LLL_WARN | LLL_NOTICE;
+	struct lws_context_creation_info info;
+	int ret = 0, count = 600, lookups = 200000;
+	struct lws_context *context;
+	struct lws_vhost *vh;
+	const char *p;
+
+	if ((p = lws_cmdline_option(argc, argv, "-d")))
+		logs = atoi(p);
+	if ((p = lws_cmdline_option(argc, argv, "-n")))
+		count = atoi(p);
+	if ((p = lws_cmdline_option(argc, argv, "-l")))
+		lookups = atoi(p);
+
+	lws_set_log_level(logs, NULL);
+	lwsl_user("LWS API selftest: lws_mount\n");
+
+	if (count < 8 || make_mounts(count)) {
+		lwsl_err("need at least 8 mounts\n");
+		return 1;
+	}
+
+	memset(&info, 0, sizeof info);
+	info.port = CONTEXT_PORT_NO_LISTEN;
+	info.options = LWS_SERVER_OPTION_EXPLICIT_VHOSTS;
+
+	context = lws_create_context(&info);
+	if (!context) {
+		lwsl_err("lws init failed\n");
+		return 1;
+	}
+
+	/* a vhost with only the first few mounts, it just scans them */
+
+	mounts[3].mount_next = NULL;
+	info.vhost_name = "few";
+	info.mounts = mounts;
+	vh = lws_create_vhost(context, &info);
+	if (!vh)
+		goto bail1;
+	ret |= test_vhost(vh, mounts, info.vhost_name);
+	mounts[3].mount_next = &mounts[4];
+
+	/* a vhost with all of them, it has a tree */
+
+	info.vhost_name = "many";
+	vh = lws_create_vhost(context, &info);
+	if (!vh)
+		goto bail1;
+	ret |= test_vhost(vh, mounts, info.vhost_name);
+
+	lwsl_user("%s: lookup test: %d\n", __func__, ret);
+
+	if (!ret && lookups > 0)
+		bench(vh, count, lookups);
+
+	goto bail;
+
+bail1:
+	lwsl_err("%s: vhost creation failed\n", __func__);
+	ret = 1;
+bail:
+	lws_context_destroy(context);
+	free(mounts);
+	free(mps);
+	free(paths);
+
+	lwsl_user("Completed: %s\n", ret ? "FAIL" : "PASS");
+
+	return ret;
+}
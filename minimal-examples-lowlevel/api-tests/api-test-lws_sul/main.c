@@ -0,0 +1,263 @@
+/*
+ * lws-api-test-lws_sul
+ *
+ * Written in 2010-2021 by Andy Green <andy@warmcat.com>
+ *
+ * This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * This api test confirms suls scheduled on a pt fire in order, not early, and
+ * not at all if cancelled, over delays that land on different levels of the
+ * timer wheel.  Then it benchmarks scheduling against a plain sorted list.
+ */
+
+#include <libwebsockets.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define COUNT_TSUL 512
+
+struct tsul {
+	lws_sorted_usec_list_t	sul;
+	lws_usec_t		due;
+	char			cancelled;
+	char			fired;
+};
+
+static struct lws_context *context;
+static struct tsul tsul[COUNT_TSUL];
+static lws_usec_t last_due;
+static int expected, fired, fail;
+
+static void
+tsul_cb(lws_sorted_usec_list_t *sul)
+{
+	struct tsul *t = lws_container_of(sul, struct tsul, sul);
+	lws_usec_t now = lws_now_usecs();
+
+	if (t->cancelled || t->fired) {
+		lwsl_err("%s: %d: fired when cancelled %d / fired %d\n",
+			 __func__, (int)(t - tsul), t->cancelled, t->fired);
+		fail = 1;
+	}
+
+	if (now < t->due) {
+		lwsl_err("%s: %d: fired %lldus early\n", __func__,
+			 (int)(t - tsul), (long long)(t->due - now));
+		fail = 1;
+	}
+
+	if (t->due < last_due) {
+		lwsl_err("%s: %d: fired out of order\n", __func__,
+			 (int)(t - tsul));
+		fail = 1;
+	}
+
+	last_due = t->due;
+	t->fired = 1;
+	if (++fired == expected)
+		/* the far ones are still scheduled, don't wait for them */
+		lws_cancel_service(context);
+}
+
+static void
+tsul_schedule(struct tsul *t, lws_usec_t us)
+{
+	lws_sul_schedule(context, 0, &t->sul, tsul_cb, us);
+	t->due = t->sul.us;
+}
+
+static int
+test_ordering(void)
+{
+	lws_usec_t start = lws_now_usecs();
+	int n, far = 0;
+
+	memset(tsul, 0, sizeof(tsul));
+
+	for (n = 0; n < COUNT_TSUL; n++) {
+		lws_usec_t us;
+
+		switch (n & 7) {
+		case 0:
+		case 1:
+		case 2: /* same or next level 0 tick */
+			us = (lws_usec_t)(rand() % 3000);
+			break;
+		case 3:
+		case 4: /* level 0 and 1 */
+			us = (lws_usec_t)(rand() % 400) * LWS_US_PER_MS;
+			break;
+		case 5: /* level 1 */
+			us = (lws_usec_t)(500 + rand() % 2000) * LWS_US_PER_MS;
+			break;
+		case 6: /* level 2, a few only */
+			if (n & 0x78) {
+				us = (lws_usec_t)(rand() % 100) * LWS_US_PER_MS;
+				break;
+			}
+			us = (lws_usec_t)(4300 + rand() % 300) * LWS_US_PER_MS;
+			break;
+		default: /* far future, to be cancelled before they fire */
+			us = (lws_usec_t)(1 + rand() % (86400 * 30)) *
+								LWS_US_PER_SEC;
+			tsul[n].cancelled = 1;
+			far++;
+			break;
+		}
+
+		tsul_schedule(&tsul[n], us);
+	}
+
+	/* cancel some that would have fired */
+
+	for (n = 9; n < COUNT_TSUL; n += 13)
+		if (!tsul[n].cancelled) {
+			lws_sul_cancel(&tsul[n].sul);
+			tsul[n].cancelled = 1;
+		}
+
+	/* reschedule some to be later, and some to be earlier */
+
+	for (n = 11; n < COUNT_TSUL; n += 17)
+		if (!tsul[n].cancelled)
+			tsul_schedule(&tsul[n], (lws_usec_t)(n & 1 ? 20 : 600) *
+							LWS_US_PER_MS);
+
+	for (n = 0; n < COUNT_TSUL; n++)
+		if (!tsul[n].cancelled)
+			expected++;
+
+	lwsl_notice("%s: %d to fire, %d cancelled, %d far\n", __func__,
+		    expected, COUNT_TSUL - expected, far);
+
+	while (fired < expected && !fail &&
+	       lws_now_usecs() - start < 10 * LWS_US_PER_SEC)
+		if (lws_service(context, 0) < 0)
+			break;
+
+	for (n = 0; n < COUNT_TSUL; n++) {
+		if (!tsul[n].cancelled && !tsul[n].fired) {
+			lwsl_err("%s: %d never fired\n", __func__, n);
+			fail = 1;
+		}
+		lws_sul_cancel(&tsul[n].sul);
+	}
+
+	return fail;
+}
+
+static void
+bench_cb(lws_sorted_usec_list_t *sul)
+{
+	lwsl_err("%s: benchmark sul fired\n", __func__);
+	fail = 1;
+}
+
+static int
+bench(int count)
+{
+	lws_usec_t t[2][3], s, now = lws_now_usecs();
+	lws_sorted_usec_list_t *suls;
+	lws_dll2_owner_t own;
+	int n, m;
+
+	suls = calloc((size_t)count, sizeof(*suls));
+	if (!suls)
+		return 1;
+
+	for (m = 0; m < 2; m++) {
+		memset(&own, 0, sizeof(own));
+		srand(1234);
+
+		/* insert at random times over the next minute */
+
+		s = lws_now_usecs();
+		for (n = 0; n < count; n++) {
+			lws_usec_t us = (lws_usec_t)(1 + (rand() % 60000)) *
+								LWS_US_PER_MS;
+			if (m) {
+				lws_sul_schedule(context, 0, &suls[n],
+						 bench_cb, us);
+				continue;
+			}
+			suls[n].cb = bench_cb;
+			suls[n].us = now + us;
+			__lws_sul_insert(&own, &suls[n]);
+		}
+		t[m][0] = lws_now_usecs() - s;
+
+		/* everyone rearms their timeout, like traffic on every wsi */
+
+		s = lws_now_usecs();
+		for (n = 0; n < count; n++) {
+			if (m) {
+				lws_sul_schedule(context, 0, &suls[n],
+						 bench_cb, 30 * LWS_US_PER_SEC);
+				continue;
+			}
+			suls[n].us = lws_now_usecs() + 30 * LWS_US_PER_SEC;
+			__lws_sul_insert(&own, &suls[n]);
+		}
+		t[m][1] = lws_now_usecs() - s;
+
+		s = lws_now_usecs();
+		for (n = 0; n < count; n++)
+			lws_sul_cancel(&suls[n]);
+		t[m][2] = lws_now_usecs() - s;
+
+		lwsl_user("bench: %d suls: %s: insert %dns, rearm %dns, "
+			  "cancel %dns per op\n", count,
+			  m ? "pt scheduler" : "sorted list",
+			  (int)((t[m][0] * 1000) / count),
+			  (int)((t[m][1] * 1000) / count),
+			  (int)((t[m][2] * 1000) / count));
+	}
+
+	free(suls);
+
+	return fail;
+}
+
+int main(int argc, const char **argv)
+{
+	int logs = LLL_USER | LLL_ERR | LLL_WARN | LLL_NOTICE;
+	struct lws_context_creation_info info;
+	int ret = 0, n, count = 20000;
+	const char *p;
+
+	if ((p = lws_cmdline_option(argc, argv, "-d")))
+		logs = atoi(p);
+	if ((p = lws_cmdline_option(argc, argv, "-n")))
+		count = atoi(p);
+
+	lws_set_log_level(logs, NULL);
+	lwsl_user("LWS API selftest: lws_sul\n");
+
+	memset(&info, 0, sizeof info);
+	info.port = CONTEXT_PORT_NO_LISTEN;
+
+	context = lws_create_context(&info);
+	if (!context) {
+		lwsl_err("lws init failed\n");
+		return 1;
+	}
+
+	n = test_ordering();
+	lwsl_user("%s: ordering test: %d\n", __func__, n);
+	ret |= n;
+	if (ret)
+		goto bail;
+
+	if (count > 0) {
+		n = bench(count);
+		ret |= n;
+	}
+
+bail:
+	lws_context_destroy(context);
+
+	lwsl_user("Completed: %s\n", ret ? "FAIL" : "PASS");
+
+	return ret;
+}
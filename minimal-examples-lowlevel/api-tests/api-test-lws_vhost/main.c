@@ -0,0 +1,165 @@
+/*
+ * lws-api-test-lws_vhost
+ *
+ * Written in 2010-2021 by Andy Green <andy@warmcat.com>
+ *
+ * This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * This api test creates a lot of vhosts in one context and confirms
+ * lws_get_vhost_by_name() finds each of them, including after some are
+ * destroyed, and that it doesn't match names that are only a prefix of the
+ * vhost name or vice versa.  Then it benchmarks lookups against a linear scan
+ * of the vhost names, which is how lws used to find them.
+ */
+
+#include <libwebsockets.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#define NAME_LEN 32
+
+static struct lws_vhost **vhs;
+static char (*names)[NAME_LEN];
+
+static int
+check(struct lws_context *cx, const char *name, struct lws_vhost *expected)
+{
+	struct lws_vhost *vh = lws_get_vhost_by_name(cx, name);
+
+	if (vh == expected)
+		return 0;
+
+	lwsl_err("%s: '%s': expected %p, got %p\n", __func__, name,
+		 expected, vh);
+
+	return 1;
+}
+
+static void
+bench(struct lws_context *cx, int count, int lookups)
+{
+	lws_usec_t t[2], s;
+	int n, m, k, found[2];
+
+	for (m = 0; m < 2; m++) {
+		found[m] = 0;
+		s = lws_now_usecs();
+		for (n = 0; n < lookups; n++) {
+			const char *p = names[(n * 7919) % count];
+
+			if (m) {
+				if (lws_get_vhost_by_name(cx, p))
+					found[m]++;
+				continue;
+			}
+
+			for (k = 0; k < count; k++)
+				if (vhs[k] && !strcmp(names[k], p)) {
+					found[m]++;
+					break;
+				}
+		}
+		t[m] = lws_now_usecs() - s;
+	}
+
+	lwsl_user("bench: %d vhosts: linear scan %dns, "
+		  "lws_get_vhost_by_name %dns per lookup (%d / %d found)\n",
+		  count, (int)((t[0] * 1000) / lookups),
+		  (int)((t[1] * 1000) / lookups), found[0], found[1]);
+}
+
+int main(int argc, const char **argv)
+{
+	int logs = LLL_USER | LLL_ERR | LLL_WARN;
+	struct lws_context_creation_info info;
+	int ret = 0, count = 3000, lookups = 20000, n;
+	struct lws_vhost *dup[2];
+	struct lws_context *cx;
+	const char *p;
+
+	if ((p = lws_cmdline_option(argc, argv, "-d")))
+		logs = atoi(p);
+	if ((p = lws_cmdline_option(argc, argv, "-n")))
+		count = atoi(p);
+	if ((p = lws_cmdline_option(argc, argv, "-l")))
+		lookups = atoi(p);
+
+	lws_set_log_level(logs, NULL);
+	lwsl_user("LWS API selftest: lws_vhost\n");
+
+	vhs = calloc((size_t)count + 1, sizeof(*vhs));
+	names = calloc((size_t)count + 1, sizeof(*names));
+	if (count < 1 || !vhs || !names) {
+		lwsl_err("OOM\n");
+		return 1;
+	}
+
+	memset(&info, 0, sizeof info);
+	info.port = CONTEXT_PORT_NO_LISTEN;
+	info.options = LWS_SERVER_OPTION_EXPLICIT_VHOSTS;
+
+	cx = lws_create_context(&info);
+	if (!cx) {
+		lwsl_err("lws init failed\n");
+		return 1;
+	}
+
+	for (n = 0; n < count; n++) {
+		lws_snprintf(names[n], sizeof(names[n]), "cust%d.example.com", n);
+		info.vhost_name = names[n];
+		vhs[n] = lws_create_vhost(cx, &info);
+		if (!vhs[n])
+			goto bail1;
+	}
+
+	/* two vhosts with the same name, the first one should be found */
+
+	info.vhost_name = "dup";
+	dup[0] = lws_create_vhost(cx, &info);
+	dup[1] = lws_create_vhost(cx, &info);
+	if (!dup[0] || !dup[1])
+		goto bail1;
+
+	for (n = 0; n < count; n++)
+		ret |= check(cx, names[n], vhs[n]);
+
+	ret |= check(cx, "dup", dup[0]);
+	ret |= check(cx, "cust1.example.co", NULL);
+	ret |= check(cx, "cust1.example.comm", NULL);
+	ret |= check(cx, "cust1", NULL);
+	ret |= check(cx, "", NULL);
+
+	/* destroy every third vhost and the first dup */
+
+	for (n = 0; n < count; n += 3) {
+		lws_vhost_destroy(vhs[n]);
+		vhs[n] = NULL;
+	}
+	lws_vhost_destroy(dup[0]);
+
+	for (n = 0; n < count; n++)
+		ret |= check(cx, names[n], vhs[n]);
+
+	ret |= check(cx, "dup", dup[1]);
+
+	lwsl_user("%s: lookup test: %d\n", __func__, ret);
+
+	if (!ret && lookups > 0)
+		bench(cx, count, lookups);
+
+	goto bail;
+
+bail1:
+	lwsl_err("%s: vhost creation failed\n", __func__);
+	ret = 1;
+bail:
+	lws_context_destroy(cx);
+	free(vhs);
+	free(names);
+
+	lwsl_user("Completed: %s\n", ret ? "FAIL" : "PASS");
+
+	return ret;
+}
@@ -0,0 +1,425 @@
+/*
+ * lws-minimal-bench common helpers
+ *
+ * Written in 2010-2021 by Andy Green <andy@warmcat.com>
+ *
+ * This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * This is #included by each of the benchmarks, it takes care of the common
+ * commandline options, running the server side in its own context and
+ * service thread, timing the measurement window, collecting latency samples
+ * and emitting the results as JSON on stdout.
+ *
+ * Commandline options common to all the benchmarks:
+ *
+ *   -c <n>            connections (or streams) generating load
+ *   -s <secs>         length of the measurement window
+ *   -z <bytes>        payload size per operation
+ *   -p <port>         server port (default: any free port when in-process)
+ *   --server          only run the server side, until killed
+ *   --client <addr>   only run the client side, against <addr>:<port>
+ *   --freelist <n>    set info.conn_freelist_max on both contexts
+ *   --access-log <f>  server writes an access log to file <f>
+ *   --json-log        ... in JSON format
+ *   --log-queue <n>   ... queued for a background writer, n bytes per thread
+ *   --hs-threads <n>  server passes tls handshakes to a pool of n threads
+ *   --h2-coalesce <n> server gathers h2 frames in an n byte buffer per POLLOUT
+ *   --h2-prio         server schedules h2 streams by RFC9218 priority
+ *
+ * By default, the server and the client both run in this process, in their
+ * own contexts on their own threads, talking over loopback.
+ */
+
+#include <libwebsockets.h>
+#include <string.h>
+#include <stdlib.h>
+#include <signal.h>
+#if defined(WIN32)
+#define HAVE_STRUCT_TIMESPEC
+#if defined(pid_t)
+#undef pid_t
+#endif
+#endif
+#include <pthread.h>
+
+/* we stop keeping latency samples after this many */
+#define BENCH_MAX_LAT_SAMPLES (1 << 22)
+
+struct bench {
+	lws_sorted_usec_list_t	sul_end;
+
+	struct lws_context	*cx_srv;
+	struct lws_context	*cx_cli;
+	pthread_t		pt_srv;
+
+	const char		**argv;
+	const char		*name;
+	const char		*client_addr;
+
+	uint32_t		*lat;
+	size_t			lat_count;
+	size_t			lat_alloc;
+
+	lws_usec_t		t_start;
+	lws_usec_t		t_end;
+
+	uint64_t		ops;
+	uint64_t		bytes;
+	uint64_t		errors;
+	uint64_t		alog_dropped;
+
+	int			argc;
+	int			conns;
+	int			secs;
+	int			size;
+	int			port;
+	int			established;
+	int			inflight; /* optionally tracked by the bench */
+
+	char			server_only;
+	char			measuring;
+	char			srv_thread;
+	volatile char		stop_srv;
+	volatile char		done;
+};
+
+static struct bench b;
+
+static void
+sigint_handler(int sig)
+{
+	b.done = 1;
+	b.stop_srv = 1;
+}
+
+static void
+bench_args(int argc, const char **argv, const char *name, int conns, int secs,
+	   int size)
+{
+	const char *p;
+
+	b.argc		= argc;
+	b.argv		= argv;
+	b.name		= name;
+	b.conns		= conns;
+	b.secs		= secs;
+	b.size		= size;
+
+	if ((p = lws_cmdline_option(argc, argv, "-c")))
+		b.conns = atoi(p);
+	if ((p = lws_cmdline_option(argc, argv, "-s")))
+		b.secs = atoi(p);
+	if ((p = lws_cmdline_option(argc, argv, "-z")))
+		b.size = atoi(p);
+	if ((p = lws_cmdline_option(argc, argv, "-p")))
+		b.port = atoi(p);
+	if (lws_cmdline_option(argc, argv, "--server"))
+		b.server_only = 1;
+	if ((p = lws_cmdline_option(argc, argv, "--client")))
+		b.client_addr = p;
+
+	if (b.conns < 1)
+		b.conns = 1;
+	if (b.secs < 1)
+		b.secs = 1;
+	if (b.size < 1)
+		b.size = 1;
+
+	if (b.client_addr && !b.port) {
+		lwsl_err("%s: --client needs -p <port>\n", __func__);
+		exit(1);
+	}
+
+	signal(SIGINT, sigint_handler);
+}
+
+/*
+ * Prepare a creation info for either of our contexts, the benchmarks only log
+ * warnings and errors by default so the logging doesn't affect the results
+ */
+
+static void
+bench_info_init(struct lws_context_creation_info *info)
+{
+	const char *p;
+
+	memset(info, 0, sizeof(*info));
+	lws_cmdline_option_handle_builtin(b.argc, b.argv, info);
+	if ((p = lws_cmdline_option(b.argc, b.argv, "--freelist")))
+		info->conn_freelist_max = (unsigned int)atoi(p);
+	if (!lws_cmdline_option(b.argc, b.argv, "-d"))
+		lws_set_log_level(LLL_USER | LLL_ERR | LLL_WARN, NULL);
+}
+
+static void *
+bench_thread_srv(void *d)
+{
+	while (!b.stop_srv)
+		if (lws_service(b.cx_srv, 0) < 0)
+			break;
+
+	return NULL;
+}
+
+/*
+ * Create the server context from info (unless we're only the client), and
+ * either service it here until interrupted if --server, or start a thread to
+ * service it so the client side can run in this one.
+ *
+ * Returns nonzero if we should just exit with that value.
+ */
+
+static int
+bench_server(struct lws_context_creation_info *info)
+{
+#if defined(LWS_WITH_ACCESS_LOG) || \
+    defined(LWS_WITH_TLS_HANDSHAKE_OFFLOAD) || defined(LWS_ROLE_H2)
+	const char *p;
+#endif
+
+	if (b.client_addr)
+		return 0;
+
+#if defined(LWS_WITH_ACCESS_LOG)
+	info->log_filepath = lws_cmdline_option(b.argc, b.argv, "--access-log");
+	if (lws_cmdline_option(b.argc, b.argv, "--json-log"))
+		info->access_log_format = LWS_ACCESS_LOG_FMT_JSON;
+	if ((p = lws_cmdline_option(b.argc, b.argv, "--log-queue")))
+		info->access_log_queue_size = (unsigned int)atoi(p);
+#endif
+#if defined(LWS_WITH_TLS_HANDSHAKE_OFFLOAD)
+	if ((p = lws_cmdline_option(b.argc, b.argv, "--hs-threads")))
+		info->tls_handshake_threads = (unsigned int)atoi(p);
+#endif
+#if defined(LWS_ROLE_H2)
+	if ((p = lws_cmdline_option(b.argc, b.argv, "--h2-coalesce")))
+		info->h2_tx_coalesce_size = (unsigned int)atoi(p);
+	if (lws_cmdline_option(b.argc, b.argv, "--h2-prio"))
+		info->options |= LWS_SERVER_OPTION_H2_PRIORITIES;
+#endif
+
+	if (!b.server_only && !b.port)
+		info->port = 0; /* let the kernel choose a free port */
+	else
+		info->port = b.port ? b.port : 7681;
+
+	b.cx_srv = lws_create_context(info);
+	if (!b.cx_srv) {
+		lwsl_err("%s: server context creation failed\n", __func__);
+		return 1;
+	}
+
+	b.port = lws_get_vhost_listen_port(
+			lws_get_vhost_by_name(b.cx_srv, "default"));
+
+	if (b.server_only) {
+		lwsl_user("%s: serving on port %d\n", b.name, b.port);
+		while (!b.stop_srv)
+			if (lws_service(b.cx_srv, 0) < 0)
+				break;
+		lws_context_destroy(b.cx_srv);
+
+		return 2;
+	}
+
+	if (pthread_create(&b.pt_srv, NULL, bench_thread_srv, NULL)) {
+		lwsl_err("%s: server thread creation failed\n", __func__);
+		lws_context_destroy(b.cx_srv);
+
+		return 1;
+	}
+
+	b.srv_thread = 1;
+
+	return 0;
+}
+
+static const char *
+bench_addr(void)
+{
+	return b.client_addr ? b.client_addr : "127.0.0.1";
+}
+
+static void
+bench_end_cb(lws_sorted_usec_list_t *sul)
+{
+	b.t_end = lws_now_usecs();
+	b.measuring = 0;
+	b.done = 1;
+	lws_cancel_service(b.cx_cli);
+}
+
+/*
+ * Each client connection calls this when it is ready to start generating
+ * load, the measurement window starts when all of them are up
+ */
+
+static void
+bench_established(void)
+{
+	if (++b.established != b.conns)
+		return;
+
+	lwsl_user("%s: %d connections up, measuring for %ds\n", b.name,
+		  b.conns, b.secs);
+
+	b.t_start = lws_now_usecs();
+	b.measuring = 1;
+	lws_sul_schedule(b.cx_cli, 0, &b.sul_end, bench_end_cb,
+			 (lws_usec_t)b.secs * LWS_US_PER_SEC);
+}
+
+static void
+bench_op(size_t bytes, lws_usec_t latency)
+{
+	if (!b.measuring)
+		return;
+
+	b.ops++;
+	b.bytes += bytes;
+
+	if (latency < 0)
+		return;
+
+	if (b.lat_count == b.lat_alloc) {
+		size_t na = b.lat_alloc ? b.lat_alloc * 2 : 65536;
+		void *p;
+
+		if (na > BENCH_MAX_LAT_SAMPLES)
+			return;
+
+		p = realloc(b.lat, na * sizeof(*b.lat));
+		if (!p)
+			return;
+
+		b.lat = p;
+		b.lat_alloc = na;
+	}
+
+	b.lat[b.lat_count++] = (uint32_t)latency;
+}
+
+static void
+bench_error(const char *why)
+{
+	lwsl_warn("%s: %s\n", b.name, why);
+	b.errors++;
+}
+
+static int
+bench_lat_cmp(const void *a1, const void *a2)
+{
+	uint32_t x = *(const uint32_t *)a1, y = *(const uint32_t *)a2;
+
+	return x < y ? -1 : x > y;
+}
+
+static uint32_t
+bench_lat_pct(int tenths)
+{
+	if (!b.lat_count)
+		return 0;
+
+	return b.lat[((b.lat_count - 1) * (size_t)tenths) / 1000];
+}
+
+/*
+ * Create the client context from info, if it fails we still need to clean up
+ * the server side via bench_run()
+ */
+
+static int
+bench_client(struct lws_context_creation_info *info)
+{
+	info->port = CONTEXT_PORT_NO_LISTEN;
+
+	b.cx_cli = lws_create_context(info);
+	if (!b.cx_cli) {
+		lwsl_err("%s: client context creation failed\n", __func__);
+		b.errors++;
+		b.done = 1;
+
+		return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Service the client context until the measurement window ends, then stop
+ * the server thread, clean up and print the results on stdout
+ */
+
+static int
+bench_run(void)
+{
+	double secs;
+
+	if (!b.cx_cli)
+		goto bail;
+
+	while (!b.done)
+		if (lws_service(b.cx_cli, 0) < 0)
+			break;
+
+	if (!b.t_end)
+		b.t_end = lws_now_usecs();
+	b.measuring = 0;
+
+	/* let anything the bench knows is still in flight finish, briefly */
+
+	while (b.inflight > 0 && lws_now_usecs() - b.t_end < LWS_US_PER_SEC)
+		if (lws_service(b.cx_cli, 0) < 0)
+			break;
+
+	lws_context_destroy(b.cx_cli);
+
+bail:
+	if (b.srv_thread) {
+		b.stop_srv = 1;
+		lws_cancel_service(b.cx_srv);
+		pthread_join(b.pt_srv, NULL);
+	}
+	if (b.cx_srv) {
+#if defined(LWS_WITH_ACCESS_LOG)
+		b.alog_dropped = lws_access_log_dropped(b.cx_srv);
+#endif
+		lws_context_destroy(b.cx_srv);
+	}
+
+	if (!b.t_start)
+		b.t_start = b.t_end;
+	secs = (double)(b.t_end - b.t_start) / (double)LWS_US_PER_SEC;
+
+	if (b.lat_count)
+		qsort(b.lat, b.lat_count, sizeof(*b.lat), bench_lat_cmp);
+
+	printf("{\"bench\":\"%s\",\"lws\":\"%s\",\"connections\":%d,"
+	       "\"size\":%d,\"secs\":%.3f,\"ops\":%llu,\"ops_per_sec\":%.1f,"
+	       "\"bytes\":%llu,\"mbytes_per_sec\":%.2f,\"errors\":%llu",
+	       b.name, lws_get_library_version(), b.conns, b.size, secs,
+	       (unsigned long long)b.ops,
+	       secs > 0 ? (double)b.ops / secs : 0.0,
+	       (unsigned long long)b.bytes,
+	       secs > 0 ? (double)b.bytes / (secs * 1000000.0) : 0.0,
+	       (unsigned long long)b.errors);
+
+	if (b.lat_count)
+		printf(",\"latency_us\":{\"samples\":%llu,\"p50\":%u,"
+		       "\"p90\":%u,\"p99\":%u,\"p99_9\":%u,\"max\":%u}",
+		       (unsigned long long)b.lat_count, bench_lat_pct(500),
+		       bench_lat_pct(900), bench_lat_pct(990),
+		       bench_lat_pct(999), b.lat[b.lat_count - 1]);
+
+	if (b.alog_dropped)
+		printf(",\"access_log_dropped\":%llu",
+		       (unsigned long long)b.alog_dropped);
+
+	printf("}\n");
+	fflush(stdout);
+
+	free(b.lat);
+
+	return !b.t_end || b.errors || !b.ops;
+}
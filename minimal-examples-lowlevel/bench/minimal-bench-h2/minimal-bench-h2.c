@@ -0,0 +1,245 @@
+/*
+ * lws-minimal-bench-h2
+ *
+ * Written in 2010-2021 by Andy Green <andy@warmcat.com>
+ *
+ * This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * This measures http/2 multiplexed requests per second.  One h2 over tls
+ * connection is made to a server that replies to everything with -z bytes of
+ * dynamic content, and -c streams are kept in flight on it, each completed
+ * stream being replaced by a new one.  The first stream is made on its own,
+ * the others are started once it has established the h2 connection.
+ *
+ * The server uses the test certificate in this directory, so it should be run
+ * from here, or point --client at another server, with --path to choose the
+ * url path.
+ */
+
+#include "../bench-common.c"
+
+struct pss_srv {
+	size_t		sent;
+};
+
+static struct lws_client_connect_info i;
+static lws_usec_t *lane_sent;
+static uint8_t *payload;
+static char lanes_started;
+
+static int
+callback_srv(struct lws *wsi, enum lws_callback_reasons reason,
+	     void *user, void *in, size_t len)
+{
+	struct pss_srv *pss = (struct pss_srv *)user;
+	uint8_t buf[LWS_PRE + 256], *start = &buf[LWS_PRE], *p = start,
+		*end = &buf[sizeof(buf) - 1];
+	lws_fileofs_t allow;
+	size_t chunk;
+
+	switch (reason) {
+	case LWS_CALLBACK_HTTP:
+		if (lws_add_http_common_headers(wsi, HTTP_STATUS_OK,
+				"text/plain", (lws_filepos_t)b.size, &p, end))
+			return 1;
+		if (lws_finalize_write_http_header(wsi, start, &p, end))
+			return 1;
+
+		pss->sent = 0;
+		lws_callback_on_writable(wsi);
+
+		return 0;
+
+	case LWS_CALLBACK_HTTP_WRITEABLE:
+		if (pss->sent == (size_t)b.size)
+			break;
+
+		/* keep to a size that fits in one h2 DATA frame */
+		chunk = (size_t)b.size - pss->sent;
+		if (chunk > 4096)
+			chunk = 4096;
+
+		/* and to the window the peer gave us, -1 means no limit */
+		allow = lws_get_peer_write_allowance(wsi);
+		if (!allow || allow < -1)
+			/* his WINDOW_UPDATE will get us WRITEABLE again */
+			break;
+		if (allow > 0 && (lws_fileofs_t)chunk > allow)
+			chunk = (size_t)allow;
+
+		if (lws_write(wsi, payload + LWS_PRE + pss->sent, chunk,
+			      pss->sent + chunk == (size_t)b.size ?
+					LWS_WRITE_HTTP_FINAL : LWS_WRITE_HTTP) !=
+								(int)chunk)
+			return 1;
+
+		pss->sent += chunk;
+		if (pss->sent != (size_t)b.size) {
+			lws_callback_on_writable(wsi);
+			break;
+		}
+
+		if (lws_http_transaction_completed(wsi))
+			return -1;
+
+		return 0;
+
+	default:
+		break;
+	}
+
+	return lws_callback_http_dummy(wsi, reason, user, in, len);
+}
+
+static void
+stream_start(int lane)
+{
+	i.opaque_user_data = (void *)(intptr_t)lane;
+	lane_sent[lane] = lws_now_usecs();
+	b.inflight++;
+
+	if (!lws_client_connect_via_info(&i)) {
+		b.inflight--;
+		bench_error("client connect failed");
+		b.done = 1;
+	}
+}
+
+static int
+callback_cli(struct lws *wsi, enum lws_callback_reasons reason,
+	     void *user, void *in, size_t len)
+{
+	int lane = (int)(intptr_t)lws_get_opaque_user_data(wsi), n;
+
+	switch (reason) {
+	case LWS_CALLBACK_CLIENT_CONNECTION_ERROR:
+		b.inflight--;
+		if (b.done) /* eg, pending ones when we're stopping */
+			break;
+		bench_error(in ? (const char *)in : "connection error");
+		b.done = 1;
+		break;
+
+	case LWS_CALLBACK_ESTABLISHED_CLIENT_HTTP:
+		if (!lanes_started) {
+			/*
+			 * Now the h2 connection is up, start the other streams
+			 * so they are all queued on it
+			 */
+			lanes_started = 1;
+			for (n = 1; n < b.conns && !b.done; n++)
+				stream_start(n);
+		}
+		if (!b.measuring && b.established < b.conns)
+			bench_established();
+		break;
+
+	case LWS_CALLBACK_RECEIVE_CLIENT_HTTP_READ:
+		return 0;
+
+	case LWS_CALLBACK_RECEIVE_CLIENT_HTTP:
+		{
+			char buffer[1024 + LWS_PRE];
+			char *px = buffer + LWS_PRE;
+			int lenx = sizeof(buffer) - LWS_PRE;
+
+			if (lws_http_client_read(wsi, &px, &lenx) < 0)
+				return -1;
+		}
+		return 0;
+
+	case LWS_CALLBACK_COMPLETED_CLIENT_HTTP:
+		b.inflight--;
+		if (lws_http_client_http_response(wsi) != HTTP_STATUS_OK) {
+			bench_error("bad response status");
+			b.done = 1;
+			break;
+		}
+		bench_op((size_t)b.size, lws_now_usecs() - lane_sent[lane]);
+		if (!b.done)
+			/* replace it with a new stream */
+			stream_start(lane);
+		break;
+
+	default:
+		break;
+	}
+
+	return lws_callback_http_dummy(wsi, reason, user, in, len);
+}
+
+static const struct lws_protocols protocols_srv[] = {
+	{ "http", callback_srv, sizeof(struct pss_srv), 0, 0, NULL, 0 },
+	LWS_PROTOCOL_LIST_TERM
+};
+
+static const struct lws_protocols protocols_cli[] = {
+	{ "http", callback_cli, 0, 0, 0, NULL, 0 },
+	LWS_PROTOCOL_LIST_TERM
+};
+
+int main(int argc, const char **argv)
+{
+	struct lws_context_creation_info info;
+	int n;
+
+	bench_args(argc, argv, "h2-multiplexed", 32, 5, 128);
+	bench_info_init(&info);
+
+	lwsl_user("LWS bench: h2 multiplexed\n");
+
+	payload = malloc(LWS_PRE + (size_t)b.size);
+	lane_sent = malloc((size_t)b.conns * sizeof(*lane_sent));
+	if (!payload || !lane_sent)
+		goto oom;
+	memset(payload, 'x', LWS_PRE + (size_t)b.size);
+
+	info.protocols = protocols_srv;
+	info.options = LWS_SERVER_OPTION_DO_SSL_GLOBAL_INIT;
+	info.ssl_cert_filepath = "localhost-100y.cert";
+	info.ssl_private_key_filepath = "localhost-100y.key";
+	n = bench_server(&info);
+	if (n) {
+		free(payload);
+		free(lane_sent);
+		return n == 2 ? 0 : 1;
+	}
+
+	bench_info_init(&info);
+	info.protocols = protocols_cli;
+	info.options = LWS_SERVER_OPTION_DO_SSL_GLOBAL_INIT;
+	info.fd_limit_per_thread = 1u + 1u + 1u;
+
+	if (!bench_client(&info)) {
+		i.context = b.cx_cli;
+		i.port = b.port;
+		i.address = bench_addr();
+		i.path = lws_cmdline_option(argc, argv, "--path");
+		if (!i.path)
+			i.path = "/";
+		i.host = i.address;
+		i.origin = i.address;
+		i.method = "GET";
+		i.alpn = "h2";
+		i.protocol = protocols_cli[0].name;
+		i.ssl_connection = LCCSCF_USE_SSL | LCCSCF_PIPELINE |
+				   LCCSCF_ALLOW_SELFSIGNED |
+				   LCCSCF_SKIP_SERVER_CERT_HOSTNAME_CHECK;
+
+		stream_start(0);
+	}
+
+	n = bench_run();
+
+	free(payload);
+	free(lane_sent);
+
+	return n;
+
+oom:
+	free(payload);
+	free(lane_sent);
+
+	return 1;
+}
@@ -0,0 +1,278 @@
+/*
+ * lws-minimal-bench-http
+ *
+ * Written in 2010-2021 by Andy Green <andy@warmcat.com>
+ *
+ * This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * This measures http/1.1 keep-alive requests per second.  -c connections
+ * each make GET requests one after the other on the same connection, against
+ * a server that replies to everything with -z bytes of dynamic content.
+ *
+ * With --close, each request is made on a new connection and the server
+ * closes it after the response, to measure connection setup and teardown.
+ *
+ * The load is generated from raw client sockets, so the client side costs
+ * little and can also be pointed at other servers using --client, with
+ * --path to choose the url path.  Replies must have a content-length.
+ */
+
+#include "../bench-common.c"
+
+struct pss_srv {
+	size_t		sent;
+};
+
+struct pss_cli {
+	lws_usec_t	sent;
+	size_t		body_left;
+	size_t		content_length;
+	char		line[32];
+	uint8_t		line_len;
+	uint8_t		crlfs;	/* count of consecutive \r\n seen */
+	char		in_body;
+	char		in_flight;
+};
+
+static struct lws_client_connect_info i;
+static uint8_t *payload;
+static char req[LWS_PRE + 256];
+static int req_len;
+static char close_mode;
+
+static int
+callback_srv(struct lws *wsi, enum lws_callback_reasons reason,
+	     void *user, void *in, size_t len)
+{
+	struct pss_srv *pss = (struct pss_srv *)user;
+	uint8_t buf[LWS_PRE + 256], *start = &buf[LWS_PRE], *p = start,
+		*end = &buf[sizeof(buf) - 1];
+	size_t chunk;
+
+	switch (reason) {
+	case LWS_CALLBACK_HTTP:
+		if (lws_add_http_common_headers(wsi, HTTP_STATUS_OK,
+				"text/plain", (lws_filepos_t)b.size, &p, end))
+			return 1;
+		if (lws_finalize_write_http_header(wsi, start, &p, end))
+			return 1;
+
+		pss->sent = 0;
+		lws_callback_on_writable(wsi);
+
+		return 0;
+
+	case LWS_CALLBACK_HTTP_WRITEABLE:
+		if (pss->sent == (size_t)b.size)
+			break;
+
+		chunk = (size_t)b.size - pss->sent;
+		if (chunk > 4096)
+			chunk = 4096;
+
+		if (lws_write(wsi, payload + LWS_PRE + pss->sent, chunk,
+			      pss->sent + chunk == (size_t)b.size ?
+					LWS_WRITE_HTTP_FINAL : LWS_WRITE_HTTP) !=
+								(int)chunk)
+			return 1;
+
+		pss->sent += chunk;
+		if (pss->sent != (size_t)b.size) {
+			lws_callback_on_writable(wsi);
+			break;
+		}
+
+		if (lws_http_transaction_completed(wsi))
+			return -1;
+
+		return 0;
+
+	default:
+		break;
+	}
+
+	return lws_callback_http_dummy(wsi, reason, user, in, len);
+}
+
+/*
+ * Parse just enough of the response headers to find the content-length and
+ * where the body starts, and count off the body
+ */
+
+static void
+cli_parse(struct lws *wsi, struct pss_cli *pss, const uint8_t *in, size_t len)
+{
+	size_t n;
+
+	while (len) {
+		if (pss->in_body) {
+			n = len < pss->body_left ? len : pss->body_left;
+			pss->body_left -= n;
+			in += n;
+			len -= n;
+		} else {
+			switch (*in) {
+			case '\r':
+				break;
+			case '\n':
+				pss->line[pss->line_len] = '\0';
+				if (!strncasecmp(pss->line, "content-length:", 15))
+					pss->content_length = (size_t)atoll(
+								&pss->line[15]);
+				pss->line_len = 0;
+				if (++pss->crlfs == 2) {
+					/* end of headers */
+					pss->crlfs = 0;
+					pss->body_left = pss->content_length;
+					pss->in_body = 1;
+				}
+				break;
+			default:
+				pss->crlfs = 0;
+				if (pss->line_len < sizeof(pss->line) - 1)
+					pss->line[pss->line_len++] = (char)*in;
+				break;
+			}
+			in++;
+			len--;
+		}
+
+		if (pss->in_body && !pss->body_left) {
+			/* the response is complete, go again */
+			bench_op(pss->content_length,
+				 lws_now_usecs() - pss->sent);
+			pss->in_body = 0;
+			pss->in_flight = 0;
+			pss->content_length = 0;
+			if (!close_mode)
+				lws_callback_on_writable(wsi);
+		}
+	}
+}
+
+static int
+callback_cli(struct lws *wsi, enum lws_callback_reasons reason,
+	     void *user, void *in, size_t len)
+{
+	struct pss_cli *pss = (struct pss_cli *)user;
+
+	switch (reason) {
+	case LWS_CALLBACK_CLIENT_CONNECTION_ERROR:
+		if (b.done) /* eg, pending ones when we're stopping */
+			break;
+		bench_error(in ? (const char *)in : "connection error");
+		b.done = 1;
+		break;
+
+	case LWS_CALLBACK_RAW_CONNECTED:
+		bench_established();
+		lws_callback_on_writable(wsi);
+		break;
+
+	case LWS_CALLBACK_RAW_WRITEABLE:
+		if (b.done || pss->in_flight)
+			break;
+
+		pss->sent = lws_now_usecs();
+		pss->in_flight = 1;
+		if (lws_write(wsi, (uint8_t *)req + LWS_PRE, (size_t)req_len,
+			      LWS_WRITE_RAW) < req_len)
+			return -1;
+		break;
+
+	case LWS_CALLBACK_RAW_RX:
+		cli_parse(wsi, pss, (const uint8_t *)in, len);
+		break;
+
+	case LWS_CALLBACK_RAW_CLOSE:
+		if (close_mode && !pss->in_flight && !b.done) {
+			/* the server closed it after the response, go again */
+			if (!lws_client_connect_via_info(&i)) {
+				bench_error("client connect failed");
+				b.done = 1;
+			}
+			break;
+		}
+		if (!b.done) {
+			bench_error("connection closed early");
+			b.done = 1;
+		}
+		break;
+
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+static const struct lws_protocols protocols_srv[] = {
+	{ "http", callback_srv, sizeof(struct pss_srv), 0, 0, NULL, 0 },
+	LWS_PROTOCOL_LIST_TERM
+};
+
+static const struct lws_protocols protocols_cli[] = {
+	{ "lws-bench-http", callback_cli, sizeof(struct pss_cli), 0, 0, NULL, 0 },
+	LWS_PROTOCOL_LIST_TERM
+};
+
+int main(int argc, const char **argv)
+{
+	struct lws_context_creation_info info;
+	const char *path = "/";
+	int n;
+
+	close_mode = !!lws_cmdline_option(argc, argv, "--close");
+	bench_args(argc, argv, close_mode ? "http1-close" : "http1-keepalive",
+		   16, 5, 128);
+	bench_info_init(&info);
+
+	lwsl_user("LWS bench: http/1.1 %s\n",
+		  close_mode ? "connection per request" : "keep-alive");
+
+	payload = malloc(LWS_PRE + (size_t)b.size);
+	if (!payload)
+		return 1;
+	memset(payload, 'x', LWS_PRE + (size_t)b.size);
+
+	info.protocols = protocols_srv;
+	n = bench_server(&info);
+	if (n) {
+		free(payload);
+		return n == 2 ? 0 : 1;
+	}
+
+	if (lws_cmdline_option(argc, argv, "--path"))
+		path = lws_cmdline_option(argc, argv, "--path");
+
+	req_len = lws_snprintf(req + LWS_PRE, sizeof(req) - LWS_PRE,
+			       "GET %s HTTP/1.1\x0d\x0aHost: %s\x0d\x0a"
+			       "User-Agent: lws-bench\x0d\x0a%s\x0d\x0a",
+			       path, bench_addr(), close_mode ?
+					"Connection: close\x0d\x0a" : "");
+
+	bench_info_init(&info);
+	info.protocols = protocols_cli;
+	info.fd_limit_per_thread = 1u + 1u + (unsigned int)b.conns;
+
+	if (!bench_client(&info)) {
+		memset(&i, 0, sizeof i);
+		i.method = "RAW";
+		i.context = b.cx_cli;
+		i.port = b.port;
+		i.address = bench_addr();
+		i.local_protocol_name = "lws-bench-http";
+
+		for (n = 0; n < b.conns; n++)
+			if (!lws_client_connect_via_info(&i)) {
+				bench_error("client connect failed");
+				b.done = 1;
+			}
+	}
+
+	n = bench_run();
+	free(payload);
+
+	return n;
+}
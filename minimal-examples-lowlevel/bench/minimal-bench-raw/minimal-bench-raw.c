@@ -0,0 +1,126 @@
+/*
+ * lws-minimal-bench-raw
+ *
+ * Written in 2010-2021 by Andy Green <andy@warmcat.com>
+ *
+ * This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * This measures raw socket throughput.  -c raw client connections each write
+ * -z byte chunks as fast as they become writeable, to a raw vhost that just
+ * discards what it receives.
+ */
+
+#include "../bench-common.c"
+
+static uint8_t *payload;
+
+static int
+callback_srv(struct lws *wsi, enum lws_callback_reasons reason,
+	     void *user, void *in, size_t len)
+{
+	/* we just let lws read it and throw it away */
+
+	return 0;
+}
+
+static int
+callback_cli(struct lws *wsi, enum lws_callback_reasons reason,
+	     void *user, void *in, size_t len)
+{
+	switch (reason) {
+	case LWS_CALLBACK_CLIENT_CONNECTION_ERROR:
+		if (b.done) /* eg, pending ones when we're stopping */
+			break;
+		bench_error(in ? (const char *)in : "connection error");
+		b.done = 1;
+		break;
+
+	case LWS_CALLBACK_RAW_CONNECTED:
+		bench_established();
+		lws_callback_on_writable(wsi);
+		break;
+
+	case LWS_CALLBACK_RAW_WRITEABLE:
+		if (b.done)
+			break;
+
+		if (lws_write(wsi, payload + LWS_PRE, (size_t)b.size,
+			      LWS_WRITE_RAW) < b.size)
+			return -1;
+
+		bench_op((size_t)b.size, -1);
+		lws_callback_on_writable(wsi);
+		break;
+
+	case LWS_CALLBACK_RAW_CLOSE:
+		if (!b.done) {
+			bench_error("connection closed early");
+			b.done = 1;
+		}
+		break;
+
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+static const struct lws_protocols protocols_srv[] = {
+	{ "lws-bench-raw", callback_srv, 0, 0, 0, NULL, 0 },
+	LWS_PROTOCOL_LIST_TERM
+};
+
+static const struct lws_protocols protocols_cli[] = {
+	{ "lws-bench-raw", callback_cli, 0, 0, 0, NULL, 0 },
+	LWS_PROTOCOL_LIST_TERM
+};
+
+int main(int argc, const char **argv)
+{
+	struct lws_context_creation_info info;
+	struct lws_client_connect_info i;
+	int n;
+
+	bench_args(argc, argv, "raw", 4, 5, 65536);
+	bench_info_init(&info);
+
+	lwsl_user("LWS bench: raw socket throughput\n");
+
+	info.protocols = protocols_srv;
+	info.options = LWS_SERVER_OPTION_ONLY_RAW; /* vhost accepts RAW */
+	info.pt_serv_buf_size = 64 * 1024;
+	n = bench_server(&info);
+	if (n)
+		return n == 2 ? 0 : 1;
+
+	payload = malloc(LWS_PRE + (size_t)b.size);
+	if (!payload)
+		return 1;
+	memset(payload, 0x55, LWS_PRE + (size_t)b.size);
+
+	bench_info_init(&info);
+	info.protocols = protocols_cli;
+	info.fd_limit_per_thread = 1u + 1u + (unsigned int)b.conns;
+
+	if (!bench_client(&info)) {
+		memset(&i, 0, sizeof i);
+		i.method = "RAW";
+		i.context = b.cx_cli;
+		i.port = b.port;
+		i.address = bench_addr();
+		i.local_protocol_name = "lws-bench-raw";
+
+		for (n = 0; n < b.conns; n++)
+			if (!lws_client_connect_via_info(&i)) {
+				bench_error("client connect failed");
+				b.done = 1;
+			}
+	}
+
+	n = bench_run();
+	free(payload);
+
+	return n;
+}
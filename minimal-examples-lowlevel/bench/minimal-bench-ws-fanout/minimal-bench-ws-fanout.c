@@ -0,0 +1,292 @@
+/*
+ * lws-minimal-bench-ws-fanout
+ *
+ * Written in 2010-2021 by Andy Green <andy@warmcat.com>
+ *
+ * This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * This measures the rate the server can send the same ws message to many
+ * connections.  -c client connections subscribe, the first of them acks each
+ * message it receives, and the server keeps a window of messages in flight
+ * ahead of the last ack, each one sent to every subscriber.
+ *
+ * By default the server uses lws_ws_bcast_queue_vhost_protocol(), so each
+ * message is framed once and shared by all the connections.  With -l it
+ * instead uses the traditional pattern of keeping a ring of the recent
+ * messages, asking for WRITEABLE on every connection, and copying the
+ * message into a buffer with LWS_PRE for lws_write() on each connection.
+ */
+
+#include "../bench-common.c"
+
+/* messages the server keeps in flight ahead of the ack */
+#define FANOUT_WINDOW		4
+/* messages one connection may have waiting before it misses some */
+#define FANOUT_MAX_PENDING	1024
+
+struct pss_srv {
+	uint64_t	next; /* legacy: next seq to send this connection */
+};
+
+struct pss_cli {
+	uint64_t	expect;
+	uint64_t	seq;
+	size_t		rx;
+	lws_usec_t	ts;
+	int		idx;
+};
+
+struct fanout_ts {
+	lws_usec_t	ts;
+};
+
+/* server side, only touched from the server service thread */
+
+static struct fanout_ts ring[FANOUT_MAX_PENDING];
+static uint8_t *srv_msg, *srv_tx;
+static uint64_t pub_seq, acked;
+static char legacy;
+
+/* client side */
+
+static struct lws *cli_ack;
+static uint64_t lost;
+static int cli_count;
+
+static void
+publish(struct lws *wsi)
+{
+	struct lws_vhost *vh = lws_get_vhost(wsi);
+	const struct lws_protocols *prot = lws_get_protocol(wsi);
+	struct lws_ws_bcast *bc;
+	lws_usec_t now;
+
+	while (pub_seq < acked + FANOUT_WINDOW) {
+		pub_seq++;
+		now = lws_now_usecs();
+
+		if (legacy) {
+			ring[pub_seq % FANOUT_MAX_PENDING].ts = now;
+			lws_callback_on_writable_all_protocol_vhost(vh, prot);
+			continue;
+		}
+
+		lws_ser_wu64be(srv_msg, pub_seq);
+		lws_ser_wu64be(srv_msg + 8, (uint64_t)now);
+
+		bc = lws_ws_bcast_create(srv_msg, (size_t)b.size, 1);
+		if (!bc)
+			return;
+		lws_ws_bcast_queue_vhost_protocol(vh, prot, bc,
+						  FANOUT_MAX_PENDING, 0);
+		lws_ws_bcast_unref(bc);
+	}
+}
+
+static int
+callback_srv(struct lws *wsi, enum lws_callback_reasons reason,
+	     void *user, void *in, size_t len)
+{
+	struct pss_srv *pss = (struct pss_srv *)user;
+
+	switch (reason) {
+	case LWS_CALLBACK_ESTABLISHED:
+		pss->next = pub_seq + 1;
+		break;
+
+	case LWS_CALLBACK_RECEIVE:
+		/* the acking client tells us the last seq it saw */
+		if (len != 8)
+			return -1;
+
+		acked = lws_ser_ru64be(in);
+		publish(wsi);
+		break;
+
+	case LWS_CALLBACK_SERVER_WRITEABLE:
+		if (!legacy || pss->next > pub_seq)
+			break;
+
+		/* too far behind, skip what we no longer have */
+		if (pub_seq - pss->next >= FANOUT_MAX_PENDING)
+			pss->next = pub_seq - FANOUT_MAX_PENDING + 1;
+
+		memcpy(srv_tx + LWS_PRE, srv_msg, (size_t)b.size);
+		lws_ser_wu64be(srv_tx + LWS_PRE, pss->next);
+		lws_ser_wu64be(srv_tx + LWS_PRE + 8, (uint64_t)
+				ring[pss->next % FANOUT_MAX_PENDING].ts);
+
+		if (lws_write(wsi, srv_tx + LWS_PRE, (size_t)b.size,
+			      LWS_WRITE_BINARY) < b.size)
+			return -1;
+
+		if (++pss->next <= pub_seq)
+			lws_callback_on_writable(wsi);
+		break;
+
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+static int
+callback_cli(struct lws *wsi, enum lws_callback_reasons reason,
+	     void *user, void *in, size_t len)
+{
+	struct pss_cli *pss = (struct pss_cli *)user;
+	uint8_t ack[LWS_PRE + 8];
+	lws_usec_t now;
+
+	switch (reason) {
+	case LWS_CALLBACK_CLIENT_CONNECTION_ERROR:
+		if (b.done) /* eg, pending ones when we're stopping */
+			break;
+		bench_error(in ? (const char *)in : "connection error");
+		b.done = 1;
+		break;
+
+	case LWS_CALLBACK_CLIENT_ESTABLISHED:
+		pss->idx = cli_count++;
+		if (!pss->idx)
+			cli_ack = wsi;
+		bench_established();
+		if (b.measuring)
+			/* everyone is up, start the server publishing */
+			lws_callback_on_writable(cli_ack);
+		break;
+
+	case LWS_CALLBACK_CLIENT_WRITEABLE:
+		if (b.done || pss->idx)
+			break;
+
+		lws_ser_wu64be(ack + LWS_PRE, pss->seq);
+		if (lws_write(wsi, ack + LWS_PRE, 8, LWS_WRITE_BINARY) < 8)
+			return -1;
+		break;
+
+	case LWS_CALLBACK_CLIENT_RECEIVE:
+		if (lws_is_first_fragment(wsi)) {
+			if (len < 16) {
+				bench_error("short message");
+				return -1;
+			}
+			pss->seq = lws_ser_ru64be(in);
+			pss->ts = (lws_usec_t)lws_ser_ru64be((uint8_t *)in + 8);
+			pss->rx = 0;
+		}
+		pss->rx += len;
+		if (!lws_is_final_fragment(wsi))
+			break;
+
+		now = lws_now_usecs();
+		if (pss->rx != (size_t)b.size) {
+			bench_error("message length mismatch");
+			return -1;
+		}
+
+		if (pss->expect && pss->seq > pss->expect)
+			lost += pss->seq - pss->expect;
+		pss->expect = pss->seq + 1;
+
+		bench_op(pss->rx, now - pss->ts);
+
+		if (!pss->idx)
+			lws_callback_on_writable(wsi);
+		break;
+
+	case LWS_CALLBACK_CLIENT_CLOSED:
+		if (!b.done) {
+			bench_error("connection closed early");
+			b.done = 1;
+		}
+		break;
+
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+static const struct lws_protocols protocols_srv[] = {
+	{ "http", lws_callback_http_dummy, 0, 0, 0, NULL, 0 },
+	{ "lws-bench-fanout", callback_srv, sizeof(struct pss_srv), 0, 0,
+								NULL, 0 },
+	LWS_PROTOCOL_LIST_TERM
+};
+
+static const struct lws_protocols protocols_cli[] = {
+	{ "lws-bench-fanout", callback_cli, sizeof(struct pss_cli), 0, 0,
+								NULL, 0 },
+	LWS_PROTOCOL_LIST_TERM
+};
+
+int main(int argc, const char **argv)
+{
+	struct lws_context_creation_info info;
+	struct lws_client_connect_info i;
+	int n;
+
+	legacy = !!lws_cmdline_option(argc, argv, "-l");
+	bench_args(argc, argv, legacy ? "ws-fanout-legacy" : "ws-fanout",
+		   100, 5, 128);
+	if (b.size < 16)
+		b.size = 16; /* room for the seq and timestamp */
+	bench_info_init(&info);
+
+	lwsl_user("LWS bench: ws fanout%s\n", legacy ? " (legacy)" : "");
+
+	srv_msg = malloc((size_t)b.size);
+	srv_tx = malloc(LWS_PRE + (size_t)b.size);
+	if (!srv_msg || !srv_tx) {
+		n = 1;
+		goto bail;
+	}
+	for (n = 0; n < b.size; n++)
+		srv_msg[n] = (uint8_t)n;
+
+	info.protocols = protocols_srv;
+	info.pt_serv_buf_size = 32 * 1024;
+	n = bench_server(&info);
+	if (n) {
+		n = n == 2 ? 0 : 1;
+		goto bail;
+	}
+
+	bench_info_init(&info);
+	info.protocols = protocols_cli;
+	info.fd_limit_per_thread = 1u + 1u + (unsigned int)b.conns;
+	info.pt_serv_buf_size = 32 * 1024;
+
+	if (!bench_client(&info)) {
+		memset(&i, 0, sizeof i);
+		i.context = b.cx_cli;
+		i.port = b.port;
+		i.address = bench_addr();
+		i.path = "/";
+		i.host = i.address;
+		i.origin = i.address;
+		i.protocol = "lws-bench-fanout";
+
+		for (n = 0; n < b.conns; n++)
+			if (!lws_client_connect_via_info(&i)) {
+				bench_error("client connect failed");
+				b.done = 1;
+			}
+	}
+
+	n = bench_run();
+
+	if (lost)
+		lwsl_warn("%llu messages were missed by lagging clients\n",
+			  (unsigned long long)lost);
+
+bail:
+	free(srv_msg);
+	free(srv_tx);
+
+	return n;
+}
@@ -0,0 +1,219 @@
+/*
+ * lws-minimal-bench-ws
+ *
+ * Written in 2010-2021 by Andy Green <andy@warmcat.com>
+ *
+ * This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * This measures ws echo throughput and round-trip latency.  -c client
+ * connections each send a binary message of -z bytes, wait for the server to
+ * echo it back in full, and then send the next one.  The server echoes what
+ * it has received as it arrives, holding off rx until it has been sent back.
+ */
+
+#include "../bench-common.c"
+
+struct pss_srv {
+	uint8_t		*buf;
+	size_t		len;
+	size_t		alloc;
+	char		first;
+	char		final;
+	char		binary;
+};
+
+struct pss_cli {
+	lws_usec_t	sent;
+	size_t		rx;
+	char		in_flight;
+};
+
+static uint8_t *payload;
+
+static int
+callback_srv(struct lws *wsi, enum lws_callback_reasons reason,
+	     void *user, void *in, size_t len)
+{
+	struct pss_srv *pss = (struct pss_srv *)user;
+	int m;
+
+	switch (reason) {
+	case LWS_CALLBACK_RECEIVE:
+		/*
+		 * We may get more rx from what lws already read before the
+		 * flow control takes effect, so append to anything pending
+		 */
+		if (LWS_PRE + pss->len + len > pss->alloc) {
+			void *p = realloc(pss->buf, LWS_PRE + pss->len + len);
+
+			if (!p)
+				return -1;
+			pss->buf = p;
+			pss->alloc = LWS_PRE + pss->len + len;
+		}
+
+		if (!pss->len) {
+			pss->first	= (char)lws_is_first_fragment(wsi);
+			pss->binary	= (char)lws_frame_is_binary(wsi);
+		}
+		memcpy(pss->buf + LWS_PRE + pss->len, in, len);
+		pss->len	+= len;
+		pss->final	= (char)lws_is_final_fragment(wsi);
+
+		/* don't take any more until this has been echoed */
+		lws_rx_flow_control(wsi, 0);
+		lws_callback_on_writable(wsi);
+		break;
+
+	case LWS_CALLBACK_SERVER_WRITEABLE:
+		if (!pss->len)
+			break;
+
+		m = lws_write(wsi, pss->buf + LWS_PRE, pss->len,
+			      (enum lws_write_protocol)lws_write_ws_flags(
+				pss->binary ? LWS_WRITE_BINARY : LWS_WRITE_TEXT,
+				pss->first, pss->final));
+		if (m < (int)pss->len)
+			return -1;
+
+		pss->len = 0;
+		lws_rx_flow_control(wsi, 1);
+		break;
+
+	case LWS_CALLBACK_CLOSED:
+		free(pss->buf);
+		pss->buf = NULL;
+		break;
+
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+static int
+callback_cli(struct lws *wsi, enum lws_callback_reasons reason,
+	     void *user, void *in, size_t len)
+{
+	struct pss_cli *pss = (struct pss_cli *)user;
+	lws_usec_t now;
+
+	switch (reason) {
+	case LWS_CALLBACK_CLIENT_CONNECTION_ERROR:
+		if (b.done) /* eg, pending ones when we're stopping */
+			break;
+		bench_error(in ? (const char *)in : "connection error");
+		b.done = 1;
+		break;
+
+	case LWS_CALLBACK_CLIENT_ESTABLISHED:
+		bench_established();
+		lws_callback_on_writable(wsi);
+		break;
+
+	case LWS_CALLBACK_CLIENT_WRITEABLE:
+		/* we can get extra writeable callbacks, only one in flight */
+		if (b.done || pss->in_flight)
+			break;
+
+		pss->sent = lws_now_usecs();
+		pss->rx = 0;
+		pss->in_flight = 1;
+		if (lws_write(wsi, payload + LWS_PRE, (size_t)b.size,
+			      LWS_WRITE_BINARY) < b.size)
+			return -1;
+		break;
+
+	case LWS_CALLBACK_CLIENT_RECEIVE:
+		pss->rx += len;
+		if (!lws_is_final_fragment(wsi))
+			break;
+
+		now = lws_now_usecs();
+		if (pss->rx != (size_t)b.size) {
+			bench_error("echo length mismatch");
+			return -1;
+		}
+
+		bench_op(pss->rx, now - pss->sent);
+		pss->in_flight = 0;
+		lws_callback_on_writable(wsi);
+		break;
+
+	case LWS_CALLBACK_CLIENT_CLOSED:
+		if (!b.done) {
+			bench_error("connection closed early");
+			b.done = 1;
+		}
+		break;
+
+	default:
+		break;
+	}
+
+	return 0;
+}
+
+static const struct lws_protocols protocols_srv[] = {
+	{ "http", lws_callback_http_dummy, 0, 0, 0, NULL, 0 },
+	{ "lws-bench-ws", callback_srv, sizeof(struct pss_srv), 0, 0, NULL, 0 },
+	LWS_PROTOCOL_LIST_TERM
+};
+
+static const struct lws_protocols protocols_cli[] = {
+	{ "lws-bench-ws", callback_cli, sizeof(struct pss_cli), 0, 0, NULL, 0 },
+	LWS_PROTOCOL_LIST_TERM
+};
+
+int main(int argc, const char **argv)
+{
+	struct lws_context_creation_info info;
+	struct lws_client_connect_info i;
+	int n;
+
+	bench_args(argc, argv, "ws-echo", 16, 5, 128);
+	bench_info_init(&info);
+
+	lwsl_user("LWS bench: ws echo\n");
+
+	info.protocols = protocols_srv;
+	info.pt_serv_buf_size = 32 * 1024;
+	n = bench_server(&info);
+	if (n)
+		return n == 2 ? 0 : 1;
+
+	payload = malloc(LWS_PRE + (size_t)b.size);
+	if (!payload)
+		return 1;
+	for (n = 0; n < b.size; n++)
+		payload[LWS_PRE + n] = (uint8_t)n;
+
+	bench_info_init(&info);
+	info.protocols = protocols_cli;
+	info.fd_limit_per_thread = 1u + 1u + (unsigned int)b.conns;
+	info.pt_serv_buf_size = 32 * 1024;
+
+	if (!bench_client(&info)) {
+		memset(&i, 0, sizeof i);
+		i.context = b.cx_cli;
+		i.port = b.port;
+		i.address = bench_addr();
+		i.path = "/";
+		i.host = i.address;
+		i.origin = i.address;
+		i.protocol = "lws-bench-ws";
+
+		for (n = 0; n < b.conns; n++)
+			if (!lws_client_connect_via_info(&i)) {
+				bench_error("client connect failed");
+				b.done = 1;
+			}
+	}
+
+	n = bench_run();
+	free(payload);
+
+	return n;
+}
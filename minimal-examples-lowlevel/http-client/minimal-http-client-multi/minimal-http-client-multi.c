@@ -27,6 +27,10 @@
  * HTTP/1.1: always possible... serializes requests
  * HTTP/2:   always possible... all requests sent as individual streams in parallel
  *
+ * Alternatively, with --idle-pool <n> the vhost is told to let connections
+ * without LCCSCF_PIPELINE reuse idle h1 connections or join h2 ones to the
+ * same server, keeping up to n idle, so staggered connections share one.
+ *
  * Note: stats are kept on tls session reuse and checked depending on mode
  *
  *  - default: no reuse expected (connections made too quickly at once)
@@ -551,7 +555,7 @@ int main(int argc, const char **argv)
 
 	lwsl_user("LWS minimal http client [-s (staggered)] [-p (pipeline)]\n");
 	lwsl_user("   [--h1 (http/1 only)] [-l (localhost)] [-d <logs>]\n");
-	lwsl_user("   [-n (numbered)] [--post]\n");
+	lwsl_user("   [-n (numbered)] [--post] [--idle-pool <n>]\n");
 
 	info.port = CONTEXT_PORT_NO_LISTEN; /* we do not run any server */
 	info.protocols = protocols;
@@ -586,6 +590,9 @@ int main(int argc, const char **argv)
 	if ((p = lws_cmdline_option(argc, argv, "--limit")))
 		info.simultaneous_ssl_restriction = atoi(p);
 
+	if ((p = lws_cmdline_option(argc, argv, "--idle-pool")))
+		info.client_idle_max_per_origin = (unsigned int)atoi(p);
+
 	if ((p = lws_cmdline_option(argc, argv, "--ssl-handshake-serialize")))
 		/* We only consider simultaneous_ssl_restriction > 1 use cases.
 		 * If ssl isn't limited or only 1 is allowed, we don't care.
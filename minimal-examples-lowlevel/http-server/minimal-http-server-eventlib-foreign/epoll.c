@@ -0,0 +1,111 @@
+/*
+ * lws-minimal-http-server-eventlib-foreign
+ *
+ * Written in 2010-2026 by Andy Green <andy@warmcat.com>
+ *
+ * This file is made available under the Creative Commons CC0 1.0
+ * Universal Public Domain Dedication.
+ *
+ * The epoll specific code
+ *
+ * The "foreign loop" here is just a bare epoll fd owned by the application.
+ * Lws nests its own per-thread epoll set inside it, and marks that with
+ * data.ptr set to the foreign_loops[] entry we gave it at context creation.
+ */
+
+#include <libwebsockets.h>
+
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "private.h"
+
+static int epfd = -1, tfd = -1, sfd = -1, running;
+
+static void
+foreign_event_loop_init_and_run_epoll(void)
+{
+	struct itimerspec its;
+	struct epoll_event ev;
+	sigset_t mask;
+
+	/* we create and start our "foreign loop" */
+
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+
+	tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	memset(&its, 0, sizeof(its));
+	its.it_value.tv_sec = 1;
+	its.it_interval.tv_sec = 1;
+	timerfd_settime(tfd, 0, &its, NULL);
+
+	memset(&ev, 0, sizeof(ev));
+	ev.events = EPOLLIN;
+	ev.data.ptr = &tfd;
+	epoll_ctl(epfd, EPOLL_CTL_ADD, tfd, &ev);
+
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGINT);
+	sigprocmask(SIG_BLOCK, &mask, NULL);
+	sfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+
+	ev.data.ptr = &sfd;
+	epoll_ctl(epfd, EPOLL_CTL_ADD, sfd, &ev);
+
+	running = 1;
+	while (running) {
+		struct epoll_event evs[8];
+		int n, m;
+
+		n = epoll_wait(epfd, evs, LWS_ARRAY_SIZE(evs), -1);
+		for (m = 0; m < n; m++) {
+			uint64_t ticks;
+
+			if (evs[m].data.ptr == &tfd) {
+				if (read(tfd, &ticks, sizeof(ticks)) > 0)
+					foreign_timer_service(&epfd);
+				continue;
+			}
+
+			if (evs[m].data.ptr == &sfd) {
+				struct signalfd_siginfo si;
+
+				if (read(sfd, &si, sizeof(si)) == sizeof(si))
+					signal_cb((int)si.ssi_signo);
+				continue;
+			}
+
+			/* it's the lws nested set becoming ready */
+
+			if (evs[m].data.ptr == &epfd && context)
+				lws_service_tsi(context, 0, 0);
+		}
+	}
+}
+
+static void
+foreign_event_loop_stop_epoll(void)
+{
+	running = 0;
+}
+
+static void
+foreign_event_loop_cleanup_epoll(void)
+{
+	/* cleanup the foreign loop assets */
+
+	close(sfd);
+	close(tfd);
+	close(epfd);
+}
+
+const struct ops ops_epoll = {
+	foreign_event_loop_init_and_run_epoll,
+	foreign_event_loop_stop_epoll,
+	foreign_event_loop_cleanup_epoll
+};
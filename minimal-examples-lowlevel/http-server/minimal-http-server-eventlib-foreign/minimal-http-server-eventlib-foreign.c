@@ -305,10 +305,25 @@ int main(int argc, const char **argv)
 						ops = &ops_uloop;
 						lwsl_notice("%s: using uloop loop\n", __func__);
 					} else
+#endif
+#if defined(LWS_WITH_EPOLL)
+					if (lws_cmdline_option(argc, argv, "--epoll")) {
+						info.options |= LWS_SERVER_OPTION_EPOLL;
+						ops = &ops_epoll;
+						lwsl_notice("%s: using epoll loop\n", __func__);
+					} else
+#endif
+#if defined(LWS_WITH_IO_URING)
+					if (lws_cmdline_option(argc, argv, "--io_uring")) {
+						/* the foreign loop is still a bare epoll fd */
+						info.options |= LWS_SERVER_OPTION_IO_URING;
+						ops = &ops_epoll;
+						lwsl_notice("%s: using io_uring in epoll loop\n", __func__);
+					} else
 #endif
 				{
 				lwsl_err("This app only makes sense when used\n");
-				lwsl_err(" with a foreign loop, --uv, --event, --glib, --ev or --sd\n");
+				lwsl_err(" with a foreign loop, --uv, --event, --glib, --ev, --sd, --uloop, --epoll or --io_uring\n");
 
 				return 1;
 				}
@@ -135,6 +135,9 @@ int main(int argc, const char **argv)
 	if (lws_cmdline_option(argc, argv, "-h"))
 		info.options |= LWS_SERVER_OPTION_VHOST_UPG_STRICT_HOST_CHECK;
 
+	if (lws_cmdline_option(argc, argv, "--ktls"))
+		info.options |= LWS_SERVER_OPTION_TLS_KTLS;
+
 	context = lws_create_context(&info);
 	if (!context) {
 		lwsl_err("lws init failed\n");